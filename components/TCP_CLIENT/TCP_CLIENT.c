@@ -1,9 +1,9 @@
 #include "include/TCP_CLIENT.h"
+#include "tcp_client_socket.h"
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
-#include "freertos/stream_buffer.h"
 #include "esp_mac.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -13,8 +13,6 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
-#include "../../../include/comms.h"
-
 /* The event group allows multiple bits for each event, but we only care about two events:
  * - we are connected to the AP with an IP
  * - we failed to connect after the maximum amount of retries */
@@ -35,11 +33,10 @@
 // STA PROPIO
 #define EXAMPLE_ESP_WIFI_SSID       "HoverRobotV2"
 #define EXAMPLE_ESP_WIFI_PASS       "12345678"
-#define HOST_IP_ADDR                "192.168.4.2"
+// HOST_IP_ADDR y PORT en tcp_client_socket.h
 #define EXAMPLE_ESP_WIFI_CHANNEL    1
 #define EXAMPLE_MAX_STA_CONN        2
 
-#define PORT                        8080
 #define CONFIG_EXAMPLE_IPV4 1
 // #define CONFIG_EXAMPLE_IPV6 1
 
@@ -47,11 +44,6 @@
 #define EXAMPLE_ESP_MAXIMUM_RETRY  30
 
 
-#define STREAM_BUFFER_SIZE              100
-#define STREAM_BUFFER_LENGTH_TRIGGER    3
-StreamBufferHandle_t xStreamBufferReceiver;
-StreamBufferHandle_t xStreamBufferSender;
-
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
 
@@ -59,94 +51,6 @@ static int s_retry_num = 0;
 
 static const char *TAG = "TCP CLIENT";
 
-uint8_t serverClientConnected = false;
-
-int sock = 0;   // TODO: sacar de aca
-
-static void tcpClientReceiver(void *pvParameters)
-{
-    char rx_buffer[128];
-    xStreamBufferReset(xStreamBufferReceiver);
-
-    while (serverClientConnected) {
-
-        int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-   
-        if (len > 0) {
-            xStreamBufferSend(xStreamBufferReceiver,rx_buffer,len,1);               // TODO: rompio en pruebas, stacktrace: 0x40376c32:0x3fcbe630 0x4037d395:0x3fcbe650 0x40384ad5:0x3fcbe670 0x40380161:0x3fcbe790 0x4038020d:0x3fcbe7b0 0x40380499:0x3fcbe7e0 0x42004c96:0x3fcbe820 0x403805dd:0x3fcbe8d0
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(25));
-    }
-    ESP_LOGE(TAG,"TCP CLIENT SOCKET vTASKDELETE");
-    vTaskDelete(NULL);
-}
-
-static void tcpClientSocket(void *pvParameters) {
-    char host_ip[] = HOST_IP_ADDR;
-    int addr_family = 0;
-    int ip_protocol = 0;
-
-    char received_data[100];
-
-    while (1) {
-        struct sockaddr_in dest_addr;
-        dest_addr.sin_addr.s_addr = inet_addr(host_ip);
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(PORT);
-        addr_family = AF_INET;                          // ipv4
-        ip_protocol = IPPROTO_TCP;//IPPROTO_IP;
-        sock =  socket(addr_family, SOCK_STREAM, ip_protocol);
-        
-        if (sock < 0) {
-            ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-            shutdown(sock, 0);
-            close(sock);
-            vTaskDelay(pdMS_TO_TICKS(500));
-        } else {
-            ESP_LOGI(TAG, "Socket created, connecting to %s:%d", host_ip, PORT);
-
-            int errConnect = connect(sock, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr_in6));
-            if (errConnect != 0) {
-                ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
-                close(sock);
-                // spp_wr_task_shut_down();
-                vTaskDelay(pdMS_TO_TICKS(500));
-            } else {
-                ESP_LOGI(TAG, "Successfully connected");
-                serverClientConnected = true;
-                spp_wr_task_start_up();         // TODO: refactorizar este mecanismo HORRIBLE
-                xTaskCreatePinnedToCore(tcpClientReceiver, "tcp_client receiver", 4096, NULL,configMAX_PRIORITIES - 2, NULL,0);
-
-                xStreamBufferReset(xStreamBufferSender);
-                
-                while (serverClientConnected) {
-                    BaseType_t bytesStreamReceived = xStreamBufferReceive(xStreamBufferSender, received_data, sizeof(received_data), 0);
-
-                    if (bytesStreamReceived > 1) {
-                        int errSend = lwip_send(sock, received_data, bytesStreamReceived, 0);
-                        if (errSend < 0) {
-                            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                            break;
-                        } 
-                    }
-
-                    vTaskDelay(pdMS_TO_TICKS(25));
-                }
-
-                serverClientConnected = false;
-                if (sock != -1) {
-                    ESP_LOGE(TAG, "Shutting down socket and restarting...");
-                    shutdown(sock, 0);
-                    close(sock);
-                }
-            }
-        }
-    }
-    ESP_LOGE(TAG,"TCP CLIENT SOCKET vTASKDELETE");
-    vTaskDelete(NULL);
-}
-
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                     int32_t event_id, void* event_data)
 {
@@ -156,13 +60,13 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                  MAC2STR(event->mac), event->aid);
 
         ESP_LOGI(TAG,"iniciando tcp_client_task");
-        xTaskCreatePinnedToCore(tcpClientSocket, "tcp_client", 4096, NULL,configMAX_PRIORITIES - 1, NULL,0);
+        tcpClientSocketStart();
     } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
         wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
         ESP_LOGI(TAG, "station "MACSTR" leave, AID=%d",
                  MAC2STR(event->mac), event->aid);
 
-        serverClientConnected = false;
+        tcpClientSocketStop();
     }
 }
 
@@ -248,7 +152,7 @@ static void wifiAndIpEvent(void* arg, esp_event_base_t event_base,
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 
         ESP_LOGI(TAG,"iniciando tcp_client_task");
-        xTaskCreatePinnedToCore(tcpClientSocket, "tcp_client", 4096, NULL,configMAX_PRIORITIES - 1, NULL,0);// COMMS_HANDLER_CORE); // TODO: agregar core configurable
+        tcpClientSocketStart();
     }
 }
 
@@ -333,10 +237,5 @@ void initTcpClient(char *serverIp) {
     // ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
     // wifi_init_sta();
 
-    xStreamBufferSender = xStreamBufferCreate(STREAM_BUFFER_SIZE, STREAM_BUFFER_LENGTH_TRIGGER);
-    xStreamBufferReceiver = xStreamBufferCreate(STREAM_BUFFER_SIZE, STREAM_BUFFER_LENGTH_TRIGGER);
-}
-
-uint8_t isTcpClientConnected(void) {
-    return serverClientConnected; 
+    tcpClientSocketInit();
 }
\ No newline at end of file
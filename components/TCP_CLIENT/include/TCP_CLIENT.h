@@ -2,8 +2,15 @@
 #define TCP_CLIENT_H
 
 #include <stdio.h>
+#include <stdbool.h>
 
 void initTcpClient(char *serverIp);
 uint8_t isTcpClientConnected(void);
 
+/*
+ * Envia un datagrama UDP a la app (misma IP, puerto UDP_PORT), sin bloquear y sin pasar por el
+ * stream buffer. Solo con la app conectada por TCP, false si no se envio
+ */
+bool tcpClientSendDatagram(const void *data, size_t len);
+
 #endif
\ No newline at end of file
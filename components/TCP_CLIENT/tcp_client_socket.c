@@ -0,0 +1,266 @@
+/*
+ * Conexion TCP con la app, separada del WiFi para poder compilarla en el host.
+ * Ninguna tarea duerme un tiempo fijo: el receptor espera en select() a que el socket tenga datos
+ * y el emisor espera a que commsManager encole un frame del pool de transmision, asi un comando
+ * no espera un ciclo de polling en cada sentido. Las esperas tienen un timeout de
+ * TCP_CLIENT_WAIT_MS solo para enterarse de que se perdio la conexion.
+ *
+ * Las dos tareas se crean una sola vez y sobreviven a las desconexiones: el emisor (tcpClientSocket)
+ * conecta y le pasa cada socket nuevo al receptor por receiverSocketQueue, y el receptor avisa por
+ * receiverDoneQueue cuando lo suelta para que el emisor lo cierre.
+ */
+#include "tcp_client_socket.h"
+#include "include/TCP_CLIENT.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/stream_buffer.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "../../../include/comms.h"
+#include "../../../include/tx_frame_pool.h"
+
+#define TCP_CLIENT_RX_CHUNK         128
+
+StreamBufferHandle_t xStreamBufferReceiver;
+
+static const char *TAG = "TCP CLIENT";
+
+static volatile uint8_t serverClientConnected = false;
+static TaskHandle_t socketTaskHandle;
+static QueueHandle_t receiverSocketQueue;
+static QueueHandle_t receiverDoneQueue;
+static int udpSock = -1;                                // se crea una vez, no depende de la conexion TCP
+static struct sockaddr_in udpDestAddr;
+
+static void receiveFromSocket(int sock, uint8_t *rxBuffer, size_t rxBufferSize) {
+    while (serverClientConnected) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(sock, &readSet);
+        struct timeval timeout = {
+            .tv_sec = 0,
+            .tv_usec = TCP_CLIENT_WAIT_MS * 1000,
+        };
+
+        int ready = select(sock + 1, &readSet, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Error in select: errno %d", errno);
+            return;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        int len = recv(sock, rxBuffer, rxBufferSize, 0);
+        if (len == 0) {
+            ESP_LOGI(TAG, "Connection closed by the app");
+            return;
+        }
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+            return;
+        }
+
+        if (xStreamBufferSend(xStreamBufferReceiver, rxBuffer, len, pdMS_TO_TICKS(TCP_CLIENT_WAIT_MS)) != (size_t)len) {
+            ESP_LOGW(TAG, "Overflow stream buffer receiver, %d bytes", len);       // el entramado descarta lo incompleto
+        }
+    }
+}
+
+static void tcpClientReceiver(void *pvParameters) {
+    uint8_t rxBuffer[TCP_CLIENT_RX_CHUNK];
+    int sock;
+
+    while (true) {
+        xQueueReceive(receiverSocketQueue, &sock, portMAX_DELAY);
+        receiveFromSocket(sock, rxBuffer, sizeof(rxBuffer));
+        serverClientConnected = false;
+        xQueueSend(receiverDoneQueue, &sock, portMAX_DELAY);        // recien ahora el socket se puede cerrar
+    }
+}
+
+static int sendAll(int sock, const uint8_t *data, size_t len) {
+    while (len) {
+        int sent = send(sock, data, len, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+/*
+ * connect() no bloqueante con timeout: si la app todavia no tiene IP lwIP reintenta el SYN por
+ * varios segundos, y mientras tanto no se ve que la estacion se volvio a asociar
+ */
+static int connectWithTimeout(int sock, const struct sockaddr_in *destAddr) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    int err = connect(sock, (const struct sockaddr *)destAddr, sizeof(*destAddr));
+    if (err != 0 && errno == EINPROGRESS) {
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        FD_SET(sock, &writeSet);
+        struct timeval timeout = {
+            .tv_sec = TCP_CLIENT_CONNECT_TIMEOUT_MS / 1000,
+            .tv_usec = (TCP_CLIENT_CONNECT_TIMEOUT_MS % 1000) * 1000,
+        };
+        err = -1;
+        if (select(sock + 1, NULL, &writeSet, NULL, &timeout) == 1) {
+            int sockError = 0;
+            socklen_t optLen = sizeof(sockError);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &sockError, &optLen);
+            errno = sockError;
+            err = sockError ? -1 : 0;
+        }
+        else {
+            errno = ETIMEDOUT;
+        }
+    }
+
+    fcntl(sock, F_SETFL, flags);
+    return err;
+}
+
+static int tcpClientConnect(void) {
+    struct sockaddr_in dest_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PORT),
+    };
+    dest_addr.sin_addr.s_addr = inet_addr(HOST_IP_ADDR);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Socket created, connecting to %s:%d", HOST_IP_ADDR, PORT);
+    if (connectWithTimeout(sock, &dest_addr) != 0) {
+        ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
+        close(sock);
+        return -1;
+    }
+
+    // Los paquetes son chicos y van de a uno, con Nagle cada respuesta esperaria el ACK del anterior
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return sock;
+}
+
+static void tcpClientSocket(void *pvParameters) {
+    uint32_t retryMs = TCP_CLIENT_RETRY_MIN_MS;
+    TickType_t fastRetryStart = xTaskGetTickCount();
+
+    while (1) {
+        int sock = tcpClientConnect();
+        if (sock < 0) {
+            // Recien asociada una estacion la app aparece en cualquier momento: se reintenta rapido por
+            // TCP_CLIENT_FAST_RETRY_MS y despues con backoff hasta TCP_CLIENT_RETRY_MS.
+            // tcpClientSocketStart corta la espera y vuelve a empezar
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(retryMs))) {
+                retryMs = TCP_CLIENT_RETRY_MIN_MS;
+                fastRetryStart = xTaskGetTickCount();
+            }
+            else if (xTaskGetTickCount() - fastRetryStart >= pdMS_TO_TICKS(TCP_CLIENT_FAST_RETRY_MS) &&
+                     (retryMs *= 2) > TCP_CLIENT_RETRY_MS) {
+                retryMs = TCP_CLIENT_RETRY_MS;
+            }
+            continue;
+        }
+        retryMs = TCP_CLIENT_RETRY_MIN_MS;
+        fastRetryStart = xTaskGetTickCount();
+
+        ESP_LOGI(TAG, "Successfully connected");
+        // Lo que quedo de la conexion anterior no sirve; si communicationHandler esta bloqueado en el
+        // receptor el reset no se hace, pero el entramado descarta los bytes viejos igual
+        txFramePoolFlush();
+        xStreamBufferReset(xStreamBufferReceiver);
+        commsConnectionOpened();
+        serverClientConnected = true;
+        xQueueSend(receiverSocketQueue, &sock, portMAX_DELAY);
+
+        // Cada frame sale desde el pool tal como lo armo el productor y vuelve al pool enviado
+        while (serverClientConnected) {
+            tx_frame_t *frame = txFrameReceive(pdMS_TO_TICKS(TCP_CLIENT_WAIT_MS));
+            if (frame == NULL) {
+                continue;
+            }
+            bool sent = sendAll(sock, frame->data, frame->len) == 0;
+            txFrameRelease(frame, sent);
+            if (!sent) {
+                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+                break;
+            }
+        }
+
+        ESP_LOGE(TAG, "Shutting down socket and restarting...");
+        serverClientConnected = false;
+        shutdown(sock, SHUT_RDWR);                              // despierta al receptor si esta en select
+        xQueueReceive(receiverDoneQueue, &sock, portMAX_DELAY);
+        close(sock);
+    }
+}
+
+void tcpClientSocketInit(void) {
+    txFramePoolInit();
+    receiverSocketQueue = xQueueCreate(1, sizeof(int));
+    receiverDoneQueue = xQueueCreate(1, sizeof(int));
+    xStreamBufferReceiver = xStreamBufferCreate(STREAM_BUFFER_SIZE, STREAM_BUFFER_LENGTH_TRIGGER);
+
+    udpDestAddr = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_port = htons(UDP_PORT),
+    };
+    udpDestAddr.sin_addr.s_addr = inet_addr(HOST_IP_ADDR);
+    udpSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udpSock < 0) {
+        ESP_LOGE(TAG, "Unable to create UDP socket: errno %d", errno);
+    }
+}
+
+void tcpClientSocketStart(void) {
+    // Las tareas reintentan la conexion para siempre; si la estacion se vuelve a asociar no se lanzan
+    // otras, solo se corta la espera entre intentos
+    if (socketTaskHandle == NULL) {
+        xTaskCreatePinnedToCore(tcpClientReceiver, "tcp_client receiver", 4096, NULL,
+                                configMAX_PRIORITIES - 2, NULL, 0);
+        xTaskCreatePinnedToCore(tcpClientSocket, "tcp_client", 4096, NULL, configMAX_PRIORITIES - 1,
+                                &socketTaskHandle, 0);      // TODO: agregar core configurable
+        return;
+    }
+    xTaskNotifyGive(socketTaskHandle);
+}
+
+void tcpClientSocketStop(void) {
+    serverClientConnected = false;
+}
+
+uint8_t isTcpClientConnected(void) {
+    return serverClientConnected;
+}
+
+bool tcpClientSendDatagram(const void *data, size_t len) {
+    if (!serverClientConnected || udpSock < 0) {
+        return false;
+    }
+    return sendto(udpSock, data, len, MSG_DONTWAIT, (struct sockaddr *)&udpDestAddr, sizeof(udpDestAddr)) == (int)len;
+}
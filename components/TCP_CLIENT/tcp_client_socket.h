@@ -0,0 +1,42 @@
+#ifndef TCP_CLIENT_SOCKET_H
+#define TCP_CLIENT_SOCKET_H
+
+#include <stdint.h>
+
+// Se pueden redefinir al compilar, el benchmark host se conecta a 127.0.0.1
+#ifndef HOST_IP_ADDR
+#define HOST_IP_ADDR                "192.168.4.2"       // IP que toma la app en el AP propio
+#endif
+#ifndef PORT
+#define PORT                        8080
+#endif
+#ifndef UDP_PORT
+#define UDP_PORT                    (PORT + 1)          // telemetria por datagramas, misma IP que la app
+#endif
+
+#define STREAM_BUFFER_SIZE              256             // recepcion, dos lecturas del socket
+#define STREAM_BUFFER_LENGTH_TRIGGER    3
+
+#define TCP_CLIENT_WAIT_MS          100                 // espera maxima de cada tarea, solo para enterarse de una desconexion
+#define TCP_CLIENT_RETRY_MIN_MS     25                  // espera entre intentos al asociarse una estacion o perder la conexion
+#define TCP_CLIENT_FAST_RETRY_MS    2000                // despues de este tiempo sin conectar la espera se duplica en cada fallo
+#define TCP_CLIENT_RETRY_MS         500                 // espera maxima entre intentos de conexion
+#define TCP_CLIENT_CONNECT_TIMEOUT_MS 1000              // la app tiene la IP del AP, responde o rechaza enseguida
+
+/*
+ * Crea el stream buffer de recepcion hacia communicationHandler y el pool de transmision de commsManager
+ */
+void tcpClientSocketInit(void);
+
+/*
+ * Lanza las tareas que se conectan a la app la primera vez que hay red; despues solo reintenta
+ * la conexion sin esperar el backoff
+ */
+void tcpClientSocketStart(void);
+
+/*
+ * Fuerza la desconexion, las tareas del socket lo ven en menos de TCP_CLIENT_WAIT_MS
+ */
+void tcpClientSocketStop(void);
+
+#endif
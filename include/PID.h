@@ -19,19 +19,28 @@
 
 typedef struct {
 	pid_floats_t pids[CANT_PIDS];
-	float sampleTimeInMs;
+	float sampleTimeInMs[CANT_PIDS];					//periodo real con el que se llama a cada PID
 } pid_init_t;
 
+/*
+ * Estado de todos los PID en estructura de arreglos (un arreglo por campo, indexado por PID_ANGLE..PID_YAW)
+ * para que pidCalculateBatch recorra cada campo en memoria contigua y el compilador pueda vectorizarlo.
+ */
 typedef struct {
-	uint8_t enablePID;
-	float lastInput;
-	float iTerm;
-	float kp;											//parametro P
-	float ki;											//parametro I
-	float kd;											//parametro D
-	float setPoint;										//setPoint del PID, normalizado: [-1.00;1.00]
-	float sampleTimeInSec;
-} pid_control_t;
+	float lastInput[CANT_PIDS];
+	float iTerm[CANT_PIDS];
+	float kp[CANT_PIDS];								//parametro P
+	float ki[CANT_PIDS];								//parametros I y D tal cual, para recalcular si cambia sampleTimeInSec
+	float kd[CANT_PIDS];
+	float kiSampleTime[CANT_PIDS];						//parametro I * sampleTimeInSec
+	float kdDivSampleTime[CANT_PIDS];					//parametro D / sampleTimeInSec
+	float setPoint[CANT_PIDS];							//setPoint del PID, normalizado: [-1.00;1.00]
+	float sampleTimeInSec[CANT_PIDS];
+	uint32_t enablePID[CANT_PIDS];						//mismo ancho que los float para que el lazo vectorizado lo lea como mascara
+} pid_bank_t;
+
+#define PID_MASK(numPid)	(1U << (numPid))
+#define PID_MASK_ALL		(PID_MASK(CANT_PIDS) - 1)
 
 esp_err_t pidInit(pid_init_t initConfig);
 
@@ -47,6 +56,15 @@ bool pidGetEnable(uint8_t numPid);
  */
 float pidCalculate(uint8_t numPid,float input);
 
+/*
+ * Calcula en una sola pasada los PID seleccionados en mask (PID_MASK(n)) que esten habilitados.
+ * Equivale a llamar pidCalculate por cada uno: los no seleccionados o deshabilitados no modifican
+ * su estado y devuelven 0 en outputs.
+ * @param inputs entradas en rango [-100;100], indexadas por numPid
+ * @param outputs resultados normalizados [-1.00;1.00], indexados por numPid
+ */
+void pidCalculateBatch(uint32_t mask, const float *restrict inputs, float *restrict outputs);
+
 /*
  * Funcion para asignar un nuevo setPoint
  */
@@ -57,11 +75,21 @@ void pidSetSetPoint(uint8_t numPid,float value);
  */
 float pidGetSetPoint(uint8_t numPid);
 
+/*
+ * Funcion para obtener el termino integral acumulado, normalizado [-1.00;1.00]
+ */
+float pidGetITerm(uint8_t numPid);
+
 /*
  * 	Funcion para cargar los parametros al filtro PID
  */
 void pidSetConstants(uint8_t numPid,float KP, float KI, float KD);
 
+/*
+ * 	Funcion para cambiar el periodo real con el que se llama al PID, sin limpiar sus terminos
+ */
+esp_err_t pidSetSampleTime(uint8_t numPid, float sampleTimeInMs);
+
 /*
  * 	Funcion para limpiar los terminos acumulativos del PID
  */
@@ -0,0 +1,41 @@
+#ifndef __PID_FIXED_H__
+#define __PID_FIXED_H__
+
+#include "stdint.h"
+
+/*
+ * Motor PID en punto fijo, misma semantica que pidCalculate (normalizacion /100, recorte a [-1;1]
+ * del termino I, D y salida, derivada sobre la medicion).
+ * Señales y constantes en Q16.16, el acumulador integral en Q2.30 para no perder resolucion
+ * con ki * sampleTime chicos. La entrada anterior se guarda en Q8.24: la derivada la multiplica
+ * por kd / sampleTime y con periodos cortos el redondeo de Q16 ya se ve en la salida.
+ */
+
+typedef int32_t q16_t;
+typedef int32_t q24_t;
+typedef int32_t q30_t;
+
+#define Q16_ONE         ((q16_t)1 << 16)
+#define Q30_ONE         ((q30_t)1 << 30)
+
+typedef struct {
+    q24_t lastInput;                // normalizada, Q8.24
+    q30_t iTerm;
+    q16_t kp;
+    q16_t kiSampleTime;             // ki * sampleTimeInSec, precalculado para no multiplicar en cada ciclo
+    q16_t kdDivSampleTime;          // kd / sampleTimeInSec, precalculado para no dividir en cada ciclo
+    q16_t setPoint;                 // normalizado [-1.00;1.00]
+} pid_fixed_t;
+
+void pidFixedSetConstants(pid_fixed_t *pid, float kp, float ki, float kd, float sampleTimeInSec);
+void pidFixedSetSampleTime(pid_fixed_t *pid, float ki, float kd, float sampleTimeInSec);    // no limpia los terminos
+void pidFixedSetSetPoint(pid_fixed_t *pid, float normalizedSetPoint);
+void pidFixedClearTerms(pid_fixed_t *pid);
+
+/*
+ * @param input entra en rango [-100;100]
+ * @return resultado del PID normalizado [-1.00;1.00]
+ */
+float pidFixedCalculate(pid_fixed_t *pid, float input);
+
+#endif
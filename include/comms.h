@@ -4,15 +4,39 @@
 #include "stdio.h"
 #include "main.h"
 #include "utils.h"
+#include "loop_timing.h"
+#include "flight_recorder.h"
+#include "telemetry_stream.h"
+#include "robot_snapshot.h"
+#include "tx_frame_pool.h"
+#include "comms_frame.h"
+#include "mpu6050_wrapper.h"
 
-#define TIMEOUT_COMMS           100                      // Timeout maximo sin recibir communicacion de la app, en ms * 10, ej: 15 = 150ms
+#define COMMS_CONTROL_TIMEOUT_US 1000000                 // sin control de la app durante este tiempo el joystick vuelve a cero (failsafe)
 
+// ATENCION: los paquetes que envia la app llegan entramados (sincronismo, largo y CRC, ver comms_frame.h),
+// la app tiene que entramarlos igual
 #define HEADER_PACKAGE_STATUS           0xAB01          // key a enviar que indica que el paquete enviado a la app es un status
 #define HEADER_PACKAGE_CONTROL          0xAB02          // key que indica que el paquete recibido de la app es de control
 #define HEADER_PACKAGE_SETTINGS         0xAB03          // key que indica que el paquete recibido de la app es de configuracion
 #define HEADER_PACKAGE_COMMAND          0xAB04          // key que indica que el paquete a enviar es un comando
 
 #define HEADER_PACKAGE_LOCAL_CONFIG     0xAB05          // key que indica que el paquete a enviar es una setting local
+#define HEADER_PACKAGE_LOOP_TIMING      0xAB06          // key que indica que el paquete enviado a la app son los tiempos de cada lazo
+#define HEADER_PACKAGE_FLIGHT_RECORDER  0xAB07          // key que indica que el paquete enviado a la app es un tramo de la caja negra
+#define HEADER_PACKAGE_STATUS_UDP       0xAB08          // key del datagrama UDP que lleva un status numerado (con TELEMETRY_UDP)
+#define HEADER_PACKAGE_TELEMETRY_BATCH  0xAB09          // key del frame de telemetria por suscripcion, ver telemetry_stream.h
+#define HEADER_PACKAGE_TELEMETRY_SUBSCRIBE 0xAB0A       // key que indica que el paquete recibido de la app es una suscripcion de telemetria
+#define HEADER_PACKAGE_TX_STATS         0xAB0B          // key que indica que el paquete enviado a la app son los contadores de transmision
+#define HEADER_PACKAGE_LINK_STATUS      0xAB0C          // key que indica que el paquete enviado a la app es la antiguedad de lo ultimo recibido
+#define HEADER_PACKAGE_IMU_STATUS       0xAB0D          // key que indica que el paquete enviado a la app es el arranque del IMU
+
+#define PERIOD_LOOP_TIMING_MS           1000            // cada cuanto se envian los tiempos de los lazos
+#define PERIOD_LINK_STATUS_MS           100             // cada cuanto se envia la antiguedad de lo recibido
+#define PERIOD_IMU_STATUS_MS            500             // cada cuanto se envia el arranque del IMU
+#define COMMS_AGE_NEVER                 0xFFFF          // antiguedad de un stream del que todavia no llego nada
+#define FLIGHT_RECORDER_CHUNK_RECORDS   2               // registros por paquete
+#define TELEMETRY_BATCH_FRAMES_PER_CYCLE 4              // frames de telemetria por ciclo de commsManager como maximo
 
 enum CommandsToRobot {
     COMMAND_CALIBRATE_IMU,
@@ -23,7 +47,16 @@ enum CommandsToRobot {
     COMMAND_MOVE_FORWARD,
     COMMAND_MOVE_BACKWARD,
     COMMAND_MOVE_ABS_YAW,
-    COMMAND_MOVE_REL_YAW
+    COMMAND_MOVE_REL_YAW,
+    COMMAND_DUMP_FLIGHT_RECORDER                        // congela la caja negra (si no lo estaba) y la envia
+};
+
+// Streams de la app con su antiguedad, en el orden de robot_link_status_t
+enum {
+    COMMS_STREAM_CONTROL,
+    COMMS_STREAM_SETTINGS,
+    COMMS_STREAM_COMMAND,
+    COMMS_STREAM_COUNT
 };
 
 // ATENCION: este enum esta emparejado con una enum class en la app, se deben modificar a la vez
@@ -40,6 +73,9 @@ enum {
     STATUS_ROBOT_ERROR_BATTERY,
 };
 
+// Los structs de paquetes de aca documentan el formato en el cable para la app. Se codifican y
+// decodifican con comms_codec.h, que verifica que cada esquema coincida con su struct
+
 /**
  * @brief Estructura de datos de configuracion recibida de la app
  */
@@ -74,6 +110,16 @@ enum {
     int16_t  axisY;
 } control_app_raw_t;
 
+/**
+ * @brief Suscripcion a la telemetria recibida de la app, fieldMask con bits TELEMETRY_FIELD_*
+ */
+typedef struct {
+    uint16_t headerPackage;
+    uint8_t  decimation;                                // 1 = una muestra por tick de control
+    uint8_t  samplesPerFrame;
+    uint32_t fieldMask;                                 // 0 = cortar la suscripcion
+} telemetry_subscribe_app_raw_t;
+
 /**
  * @brief Estructura de datos de comandos recibida de la app
  */
@@ -107,6 +153,16 @@ typedef struct {
     uint16_t statusCode;
 } robot_dynamic_data_t;
 
+/**
+ * @brief Datagrama UDP de status. La secuencia sube de a 1 por datagrama y da la vuelta en 65535,
+ * la app la usa para contar perdidos, desordenados y duplicados, y descarta los que llegan tarde
+ */
+typedef struct {
+    uint16_t headerPackage;                             // HEADER_PACKAGE_STATUS_UDP
+    uint16_t sequence;
+    robot_dynamic_data_t status;
+} robot_udp_status_t;
+
 /**
  * @brief Estructura de datos enviada a la app, contiene settings locales
  */
@@ -125,8 +181,163 @@ typedef struct {
     int16_t  distanceInMts;
 } command_move_position_t;
 
-void spp_wr_task_start_up(void);
-void spp_wr_task_shut_down(void);
-void sendDynamicData(robot_dynamic_data_t status);
-void sendLocalConfig(robot_local_configs_t localConfig);
+/**
+ * @brief Tiempos de un lazo en us, saturados a 65535
+ */
+typedef struct {
+    uint16_t periodMinUs;
+    uint16_t periodMaxUs;
+    uint16_t periodMeanUs;
+    uint16_t periodP99Us;
+    uint16_t execMinUs;
+    uint16_t execMaxUs;
+    uint16_t execMeanUs;
+    uint16_t execP99Us;
+} loop_timing_raw_t;
+
+/**
+ * @brief Tiempos de todos los lazos, en el orden de LOOP_TIMING_CONTROL_TICK..LOOP_TIMING_MPU
+ */
+typedef struct {
+    uint16_t headerPackage;
+    uint16_t samplesPerLoop;                            // ciclos de la ventana, LOOP_TIMING_SAMPLES una vez llena
+    loop_timing_raw_t loops[LOOP_TIMING_COUNT];
+} robot_loop_timing_t;
+
+/**
+ * @brief Tramo de la caja negra, los registros van del mas viejo (firstRecord = 0) al mas nuevo
+ */
+typedef struct {
+    uint16_t headerPackage;
+    uint16_t totalRecords;
+    uint16_t firstRecord;
+    uint8_t  triggerReason;                             // FLIGHT_RECORDER_TRIGGER_*
+    uint8_t  triggerStatus;
+    uint32_t triggerCycle;
+    flight_record_t records[FLIGHT_RECORDER_CHUNK_RECORDS];   // los que sobran despues de totalRecords van en 0
+} robot_flight_recorder_chunk_t;
+
+/**
+ * @brief Contadores de una clase de trafico saliente desde el arranque, ver tx_frame_pool.h
+ */
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;
+    uint32_t allocFailures;                             // paquetes no generados por falta de frames libres
+    uint32_t drops;                                     // paquetes encolados que no salieron (desconexion o error de envio)
+    uint32_t overwritten;                               // reemplazados por uno mas nuevo antes de salir, solo telemetria
+} tx_class_stats_raw_t;
+
+/**
+ * @brief Contadores de transmision, classes en el orden TX_CLASS_RELIABLE, TX_CLASS_TELEMETRY
+ */
+typedef struct {
+    uint16_t headerPackage;
+    uint16_t classCount;
+    tx_class_stats_raw_t classes[TX_CLASS_COUNT];
+} robot_tx_stats_t;
+
+/**
+ * @brief Recepcion desde el arranque, en communicationHandler
+ */
+typedef struct {
+    comms_frame_stats_t frames;                         // entramado: frames validos, CRC, largo, bytes salteados
+    uint32_t unknownPackets;                            // frame valido con un headerPackage desconocido
+    uint32_t badLength;                                 // headerPackage conocido con un largo que no le corresponde
+    uint32_t queued;                                    // paquetes pasados a las colas de commsManager
+    uint32_t queueDrops;                                // de los anteriores, descartados con la cola llena o control reemplazado por uno mas nuevo
+} comms_rx_stats_t;
+
+/**
+ * @brief Antiguedad de lo ultimo recibido de cada stream y estado del failsafe de control
+ */
+typedef struct {
+    uint8_t  failsafeActive;                            // joystick en cero por falta de control, hasta el proximo
+    uint16_t ageMs[COMMS_STREAM_COUNT];                 // saturada en COMMS_AGE_NEVER - 1, COMMS_AGE_NEVER si no llego ninguno
+    uint16_t failsafeCount;                             // veces que vencio COMMS_CONTROL_TIMEOUT_US desde el arranque
+    uint32_t packets[COMMS_STREAM_COUNT];
+} comms_link_status_t;
+
+/**
+ * @brief Formato en el cable de comms_link_status_t
+ */
+typedef struct {
+    uint16_t headerPackage;
+    uint8_t  failsafeActive;
+    uint8_t  streamCount;                               // COMMS_STREAM_COUNT
+    uint16_t ageMs[COMMS_STREAM_COUNT];                 // control, settings, comandos
+    uint16_t failsafeCount;
+    uint32_t packets[COMMS_STREAM_COUNT];
+} robot_link_status_t;
+
+/**
+ * @brief Formato en el cable de imu_status_t (mpu6050_wrapper.h)
+ */
+typedef struct {
+    uint16_t headerPackage;
+    uint16_t warmupSamples;
+    uint32_t firstSampleMs;                             // arranque -> primera muestra al control, 0 mientras se asienta
+    uint8_t  warmupState;                               // IMU_WARMUP_RUNNING, SETTLED o TIMEOUT (imu_warmup.h)
+    uint8_t  offsetsSource;                             // IMU_OFFSETS_FACTORY, STORED o CALIBRATED
+    uint8_t  gyroCorrections;
+    uint8_t  gyroStd;                                   // grados/s * 100, saturado en 2.55
+    uint16_t pitchStd;                                  // grados * 1000
+    int16_t  pitchDrift;                                // grados * 1000
+    int16_t  gyroBias[3];                               // grados/s * 100
+    int16_t  gyroOffsets[3];                            // registros XG_OFFS_USR
+    uint8_t  calibrationState;                          // IMU_CALIBRATION_* (imu_calibration.h)
+    uint8_t  calibrationProgress;                       // %
+    uint8_t  calibrationRound;
+    uint8_t  calibrationError;                          // IMU_CALIBRATION_ERROR_*
+    uint16_t accelResidual;                             // g * 10000
+    uint16_t gyroResidual;                              // grados/s * 100
+} robot_imu_status_t;
+
+/*
+ * Crea communicationHandler una sola vez, despues de initTcpClient (que crea el stream buffer de recepcion)
+ */
+void commsInit(void);
+
+/*
+ * Llamada por TCP_CLIENT en cada conexion nueva, antes de recibir nada de la app
+ */
+void commsConnectionOpened(void);
+
+/*
+ * Copia los contadores de recepcion, desde cualquier tarea (pueden estar desfasados en un paquete)
+ */
+void commsGetRxStats(comms_rx_stats_t *stats);
+
+/*
+ * Antiguedad de lo ultimo recibido de cada stream, calculada al llamarla, desde cualquier tarea
+ */
+void commsGetLinkStatus(comms_link_status_t *status);
+
+/*
+ * Arma el status directo en un frame de transmision a partir del snapshot. Reemplaza al status que
+ * todavia no salio; si no hay frames libres no se envia y queda contado en el pool
+ */
+void sendDynamicData(const robot_snapshot_t *snapshot);
+
+/*
+ * Envia la configuracion local por la cola confiable, sin bloquear.
+ * @return false si no hay frames libres, reintentar en el proximo ciclo
+ */
+bool sendLocalConfig(robot_local_configs_t localConfig);
+void sendLoopTiming(void);
+void sendTxStats(void);
+void sendLinkStatus(void);
+void sendImuStatus(const imu_status_t *status);
+
+/*
+ * Envia los frames de telemetria por suscripcion que esten listos, sin bloquear. Si no hay frames
+ * libres las muestras esperan al proximo ciclo
+ */
+void sendTelemetryBatch(void);
+
+/*
+ * Envia el tramo que empieza en firstRecord, sin bloquear.
+ * @return false si no hay frames de transmision libres, reintentar en el proximo ciclo
+ */
+bool sendFlightRecorderChunk(uint32_t firstRecord);
 #endif
\ No newline at end of file
@@ -0,0 +1,248 @@
+#ifndef __COMMS_CODEC_H__
+#define __COMMS_CODEC_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+#include "comms.h"
+
+/*
+ * Codificacion de los paquetes de la app, generada a partir de un esquema por paquete.
+ *
+ * En el cable cada paquete es headerPackage (uint16) seguido de los campos del esquema en orden,
+ * empaquetados (sin relleno) y en little-endian, sin importar el layout ni el endianness del
+ * struct en memoria. Los structs de comms.h siguen documentando el formato para la app; un
+ * _Static_assert en comms_codec.c verifica que el tamaño de cada uno coincida con su esquema.
+ *
+ * Cada campo es X(tipo, nombre, wire, arg):
+ *  - INT:          entero copiado, truncado al tipo del cable
+ *  - SCALED:       float en memoria, en el cable round(valor * arg) saturado al tipo (8 o 16 bits).
+ *                  Solo aritmetica float, se decodifica multiplicando por 1 / arg
+ *  - INT_ARRAY:    arg enteros
+ *  - STRUCT:       un struct con el esquema COMMS_SCHEMA_<wire>
+ *  - STRUCT_ARRAY: arg structs con el esquema COMMS_SCHEMA_<wire>
+ *  - CONST:        el valor arg, sin campo en memoria (nombre _); el decodificador lo verifica
+ * wire es U8, I8, U16, I16, U32 o I32.
+ *
+ * Por cada paquete de COMMS_PACKETS se genera:
+ *   COMMS_PACKET_SIZE_<Nombre>   bytes en el cable, con el header
+ *   size_t commsEncode<Nombre>(uint8_t *out, size_t outSize, const tipo *in)
+ *       @return bytes escritos, 0 si no entra en outSize
+ *   bool commsDecode<Nombre>(const uint8_t *in, size_t len, tipo *out)
+ *       @return false si el header, el largo o un CONST no coinciden; out puede quedar a medio llenar
+ * El headerPackage de los structs que lo tienen no se lee ni se escribe, lo maneja el codec.
+ */
+
+#define COMMS_WIRE_U8       1
+#define COMMS_WIRE_I8       1
+#define COMMS_WIRE_U16      2
+#define COMMS_WIRE_I16      2
+#define COMMS_WIRE_U32      4
+#define COMMS_WIRE_I32      4
+
+#define COMMS_SCALE         PRECISION_DECIMALS_COMMS
+
+/* ---------- esquemas ---------- */
+
+#define COMMS_SCHEMA_Settings(X) \
+    X(INT,    indexPid,     U16, 0) \
+    X(SCALED, kp,           U16, COMMS_SCALE) \
+    X(SCALED, ki,           U16, COMMS_SCALE) \
+    X(SCALED, kd,           U16, COMMS_SCALE) \
+    X(SCALED, centerAngle,  I16, COMMS_SCALE) \
+    X(SCALED, safetyLimits, U16, COMMS_SCALE)
+
+#define COMMS_SCHEMA_Control(X) \
+    X(INT, axisX, I16, 0) \
+    X(INT, axisY, I16, 0)
+
+#define COMMS_SCHEMA_Command(X) \
+    X(INT, command, U16, 0) \
+    X(INT, value,   I16, 0)
+
+#define COMMS_SCHEMA_TelemetrySubscribe(X) \
+    X(INT, decimation,      U8,  0) \
+    X(INT, samplesPerFrame, U8,  0) \
+    X(INT, fieldMask,       U32, 0)
+
+#define COMMS_SCHEMA_Status(X) \
+    X(INT, batVoltage,       U16, 0) \
+    X(INT, imuTemp,          U16, 0) \
+    X(INT, mcbTemp,          U16, 0) \
+    X(INT, mainboardTemp,    U16, 0) \
+    X(INT, speedR,           I16, 0) \
+    X(INT, speedL,           I16, 0) \
+    X(INT, pitch,            I16, 0) \
+    X(INT, roll,             I16, 0) \
+    X(INT, yaw,              I16, 0) \
+    X(INT, posInMeters,      I16, 0) \
+    X(INT, outputYawControl, I16, 0) \
+    X(INT, setPointAngle,    I16, 0) \
+    X(INT, setPointPos,      I16, 0) \
+    X(INT, setPointYaw,      I16, 0) \
+    X(INT, setPointSpeed,    I16, 0) \
+    X(INT, centerAngle,      U16, 0) \
+    X(INT, statusCode,       U16, 0)
+
+#define COMMS_SCHEMA_StatusUdp(X) \
+    X(INT,    sequence, U16,    0) \
+    X(CONST,  _,        U16,    HEADER_PACKAGE_STATUS) \
+    X(STRUCT, status,   Status, 0)
+
+#define COMMS_SCHEMA_PidGains(X) \
+    X(SCALED, kp, U16, COMMS_SCALE) \
+    X(SCALED, ki, U16, COMMS_SCALE) \
+    X(SCALED, kd, U16, COMMS_SCALE)
+
+#define COMMS_SCHEMA_LocalConfig(X) \
+    X(SCALED,       centerAngle,  I16,      COMMS_SCALE) \
+    X(SCALED,       safetyLimits, U16,      COMMS_SCALE) \
+    X(STRUCT_ARRAY, pids,         PidGains, CANT_PIDS)
+
+#define COMMS_SCHEMA_LoopTimingEntry(X) \
+    X(INT, periodMinUs,  U16, 0) \
+    X(INT, periodMaxUs,  U16, 0) \
+    X(INT, periodMeanUs, U16, 0) \
+    X(INT, periodP99Us,  U16, 0) \
+    X(INT, execMinUs,    U16, 0) \
+    X(INT, execMaxUs,    U16, 0) \
+    X(INT, execMeanUs,   U16, 0) \
+    X(INT, execP99Us,    U16, 0)
+
+#define COMMS_SCHEMA_LoopTiming(X) \
+    X(INT,          samplesPerLoop, U16,             0) \
+    X(STRUCT_ARRAY, loops,          LoopTimingEntry, LOOP_TIMING_COUNT)
+
+#define COMMS_SCHEMA_TxClassStats(X) \
+    X(INT, submitted,     U32, 0) \
+    X(INT, sent,          U32, 0) \
+    X(INT, allocFailures, U32, 0) \
+    X(INT, drops,         U32, 0) \
+    X(INT, overwritten,   U32, 0)
+
+#define COMMS_SCHEMA_TxStats(X) \
+    X(CONST,        _,       U16,          TX_CLASS_COUNT) \
+    X(STRUCT_ARRAY, classes, TxClassStats, TX_CLASS_COUNT)
+
+#define COMMS_SCHEMA_LinkStatus(X) \
+    X(INT,       failsafeActive, U8,  0) \
+    X(CONST,     _,              U8,  COMMS_STREAM_COUNT) \
+    X(INT_ARRAY, ageMs,          U16, COMMS_STREAM_COUNT) \
+    X(INT,       failsafeCount,  U16, 0) \
+    X(INT_ARRAY, packets,        U32, COMMS_STREAM_COUNT)
+
+#define COMMS_SCHEMA_ImuStatus(X) \
+    X(INT,       warmupSamples,   U16, 0) \
+    X(INT,       firstSampleMs,   U32, 0) \
+    X(INT,       warmupState,     U8,  0) \
+    X(INT,       offsetsSource,   U8,  0) \
+    X(INT,       gyroCorrections, U8,  0) \
+    X(SCALED,    gyroStd,         U8,  COMMS_SCALE) \
+    X(SCALED,    pitchStd,        U16, 1000.0f) \
+    X(SCALED,    pitchDrift,      I16, 1000.0f) \
+    X(SCALED,    gyroBiasX,       I16, COMMS_SCALE) \
+    X(SCALED,    gyroBiasY,       I16, COMMS_SCALE) \
+    X(SCALED,    gyroBiasZ,       I16, COMMS_SCALE) \
+    X(INT_ARRAY, gyroOffsets,     I16, 3) \
+    X(INT,       calibrationState,    U8,  0) \
+    X(INT,       calibrationProgress, U8,  0) \
+    X(INT,       calibrationRound,    U8,  0) \
+    X(INT,       calibrationError,    U8,  0) \
+    X(SCALED,    accelResidual,       U16, 10000.0f) \
+    X(SCALED,    gyroResidual,        U16, COMMS_SCALE)
+
+#define COMMS_SCHEMA_FlightRecord(X) \
+    X(INT,       cycle,        U32, 0) \
+    X(INT,       pitch,        I16, 0) \
+    X(INT,       roll,         I16, 0) \
+    X(INT,       yaw,          I16, 0) \
+    X(INT_ARRAY, pidOutput,    I16, CANT_PIDS) \
+    X(INT_ARRAY, pidITerm,     I16, CANT_PIDS) \
+    X(INT_ARRAY, setPoint,     I16, CANT_PIDS) \
+    X(INT,       motorL,       I16, 0) \
+    X(INT,       motorR,       I16, 0) \
+    X(INT,       statusCode,   U8,  0) \
+    X(INT,       motorsEnable, U8,  0)
+
+#define COMMS_SCHEMA_FlightRecorder(X) \
+    X(INT,          totalRecords,  U16,          0) \
+    X(INT,          firstRecord,   U16,          0) \
+    X(INT,          triggerReason, U8,           0) \
+    X(INT,          triggerStatus, U8,           0) \
+    X(INT,          triggerCycle,  U32,          0) \
+    X(STRUCT_ARRAY, records,       FlightRecord, FLIGHT_RECORDER_CHUNK_RECORDS)
+
+/*
+ * S(nombre, tipo en memoria) de todos los esquemas, los anidados antes de quien los usa
+ */
+#define COMMS_SCHEMAS(S) \
+    S(Settings,           pid_settings_comms_t) \
+    S(Control,            control_app_raw_t) \
+    S(Command,            command_app_raw_t) \
+    S(TelemetrySubscribe, telemetry_subscribe_app_raw_t) \
+    S(Status,             robot_dynamic_data_t) \
+    S(StatusUdp,          robot_udp_status_t) \
+    S(PidGains,           pid_floats_t) \
+    S(LocalConfig,        robot_local_configs_t) \
+    S(LoopTimingEntry,    loop_timing_raw_t) \
+    S(LoopTiming,         robot_loop_timing_t) \
+    S(TxClassStats,       tx_class_stats_t) \
+    S(TxStats,            tx_frame_pool_stats_t) \
+    S(LinkStatus,         comms_link_status_t) \
+    S(ImuStatus,          imu_status_t) \
+    S(FlightRecord,       flight_record_t) \
+    S(FlightRecorder,     robot_flight_recorder_chunk_t)
+
+/*
+ * P(nombre, headerPackage, tipo en memoria, struct de comms.h con el mismo formato)
+ */
+#define COMMS_PACKETS(P) \
+    P(Settings,           HEADER_PACKAGE_SETTINGS,            pid_settings_comms_t,          pid_settings_app_raw_t) \
+    P(Control,            HEADER_PACKAGE_CONTROL,             control_app_raw_t,             control_app_raw_t) \
+    P(Command,            HEADER_PACKAGE_COMMAND,             command_app_raw_t,             command_app_raw_t) \
+    P(TelemetrySubscribe, HEADER_PACKAGE_TELEMETRY_SUBSCRIBE, telemetry_subscribe_app_raw_t, telemetry_subscribe_app_raw_t) \
+    P(Status,             HEADER_PACKAGE_STATUS,              robot_dynamic_data_t,          robot_dynamic_data_t) \
+    P(StatusUdp,          HEADER_PACKAGE_STATUS_UDP,          robot_udp_status_t,            robot_udp_status_t) \
+    P(LocalConfig,        HEADER_PACKAGE_LOCAL_CONFIG,        robot_local_configs_t,         robot_local_configs_comms_t) \
+    P(LoopTiming,         HEADER_PACKAGE_LOOP_TIMING,         robot_loop_timing_t,           robot_loop_timing_t) \
+    P(TxStats,            HEADER_PACKAGE_TX_STATS,            tx_frame_pool_stats_t,         robot_tx_stats_t) \
+    P(LinkStatus,         HEADER_PACKAGE_LINK_STATUS,         comms_link_status_t,           robot_link_status_t) \
+    P(ImuStatus,          HEADER_PACKAGE_IMU_STATUS,          imu_status_t,                  robot_imu_status_t) \
+    P(FlightRecorder,     HEADER_PACKAGE_FLIGHT_RECORDER,     robot_flight_recorder_chunk_t, robot_flight_recorder_chunk_t)
+
+/* ---------- tamaños ---------- */
+
+#define COMMS_SIZE_INT(wire, arg)           COMMS_WIRE_##wire
+#define COMMS_SIZE_SCALED(wire, arg)        COMMS_WIRE_##wire
+#define COMMS_SIZE_INT_ARRAY(wire, arg)     ((arg) * COMMS_WIRE_##wire)
+#define COMMS_SIZE_STRUCT(wire, arg)        COMMS_SCHEMA_SIZE_##wire
+#define COMMS_SIZE_STRUCT_ARRAY(wire, arg)  ((arg) * COMMS_SCHEMA_SIZE_##wire)
+#define COMMS_SIZE_CONST(wire, arg)         COMMS_WIRE_##wire
+#define COMMS_FIELD_SIZE(kind, name, wire, arg) + COMMS_SIZE_##kind(wire, arg)
+
+#define COMMS_SCHEMA_SIZE_ENUM(name, type)  COMMS_SCHEMA_SIZE_##name = 0 COMMS_SCHEMA_##name(COMMS_FIELD_SIZE),
+#define COMMS_PACKET_SIZE_ENUM(name, header, type, layout) \
+    COMMS_PACKET_SIZE_##name = COMMS_WIRE_U16 + COMMS_SCHEMA_SIZE_##name,
+
+enum {
+    COMMS_SCHEMAS(COMMS_SCHEMA_SIZE_ENUM)
+    COMMS_PACKETS(COMMS_PACKET_SIZE_ENUM)
+};
+
+/* ---------- funciones ---------- */
+
+#define COMMS_PACKET_DECLARE(name, header, type, layout) \
+    size_t commsEncode##name(uint8_t *out, size_t outSize, const type *in); \
+    bool commsDecode##name(const uint8_t *in, size_t len, type *out);
+
+COMMS_PACKETS(COMMS_PACKET_DECLARE)
+
+/*
+ * Lectura de un uint16 little-endian, para despachar por headerPackage antes de decodificar
+ */
+static inline uint16_t commsGetU16(const uint8_t *in) {
+    return in[0] | (in[1] << 8);
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __COMMS_FRAME_H__
+#define __COMMS_FRAME_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+/*
+ * Entramado de los paquetes sobre el stream TCP:
+ *
+ *   | 0xA5 | 0x5A | largo (uint16 LE) | payload (largo bytes) | CRC16 (uint16 LE) |
+ *
+ * El payload es el paquete de siempre (empieza con headerPackage). El CRC es CRC-16/CCITT-FALSE
+ * (poly 0x1021, init 0xFFFF) sobre el largo y el payload. El parser es incremental: acepta el
+ * stream cortado en cualquier punto o con varios paquetes juntos, y ante basura o un CRC invalido
+ * se resincroniza buscando el proximo 0xA5 0x5A.
+ */
+
+#define COMMS_FRAME_SYNC_0          0xA5
+#define COMMS_FRAME_SYNC_1          0x5A
+#define COMMS_FRAME_HEADER_SIZE     4                   // sync + largo
+#define COMMS_FRAME_OVERHEAD        (COMMS_FRAME_HEADER_SIZE + 2)
+#define COMMS_FRAME_MAX_PAYLOAD     128
+#define COMMS_FRAME_BUFFER_SIZE     256                 // al menos un frame maximo mas lo que entrega una lectura
+
+#if (COMMS_FRAME_BUFFER_SIZE < COMMS_FRAME_MAX_PAYLOAD + COMMS_FRAME_OVERHEAD)
+#error COMMS_FRAME_BUFFER_SIZE chico para COMMS_FRAME_MAX_PAYLOAD
+#endif
+
+/**
+ * @brief Frame extraido, payload apunta al buffer del parser (sin copia)
+ */
+typedef struct {
+    const uint8_t *payload;
+    uint16_t len;
+} comms_frame_t;
+
+typedef struct {
+    uint32_t frames;                                    // frames validos entregados
+    uint32_t crcErrors;
+    uint32_t lengthErrors;                              // largo mayor a COMMS_FRAME_MAX_PAYLOAD
+    uint32_t discardedBytes;                            // bytes salteados buscando sincronismo
+} comms_frame_stats_t;
+
+typedef struct {
+    uint8_t  buffer[COMMS_FRAME_BUFFER_SIZE];
+    uint16_t start;                                     // primer byte sin procesar
+    uint16_t end;                                       // fin de los bytes recibidos
+    comms_frame_stats_t stats;
+} comms_frame_parser_t;
+
+void commsFrameParserInit(comms_frame_parser_t *parser);
+
+/*
+ * Lugar libre para recibir bytes directo en el buffer del parser (ej: xStreamBufferReceive).
+ * Puede mover al principio el resto de un frame incompleto, los frames entregados antes dejan de ser validos.
+ */
+uint8_t *commsFrameParserWritePtr(comms_frame_parser_t *parser, size_t *space);
+
+/*
+ * Confirma len bytes escritos en el lugar devuelto por commsFrameParserWritePtr
+ */
+void commsFrameParserCommit(comms_frame_parser_t *parser, size_t len);
+
+/*
+ * Copia bytes al parser, para cuando no se puede recibir en el lugar
+ * @return bytes aceptados, menos que len si el buffer se lleno (procesar los frames y reintentar)
+ */
+size_t commsFrameParserFeed(comms_frame_parser_t *parser, const uint8_t *data, size_t len);
+
+/*
+ * Extrae el proximo frame completo y valido.
+ * @return false si no hay mas frames completos en lo recibido hasta ahora
+ */
+bool commsFrameParserNext(comms_frame_parser_t *parser, comms_frame_t *frame);
+
+/*
+ * Arma un frame con el payload dado
+ * @return bytes escritos en out, 0 si no entra o el payload es mas largo que COMMS_FRAME_MAX_PAYLOAD
+ */
+size_t commsFrameEncode(uint8_t *out, size_t outSize, const void *payload, uint16_t len);
+
+uint16_t commsFrameCrc16(uint16_t crc, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "esp_err.h"
+#include "main.h"
+#include "mpu6050_wrapper.h"
+
+typedef struct {
+    uint8_t attMode;
+    float   setPointPosCms;
+    float   setPointSpeed;
+    float   setPointYaw;
+    uint8_t contSafetyMaxSpeed;
+} attitude_control_stat_t;
+
+#define CONTROL_STAGES_COUNT    4                       // yaw, pos, speed, angle
+#define CONTROL_INPUT_QUEUE_LENGTH  8                   // entradas por tick de sobra: commsManager publica cada 25 ms
+
+/*
+ * Entradas de otras tareas al control. No tocan statusRobot ni los setPoints directamente: van por
+ * controlPostInput y la tarea del tick las aplica antes de la cascada.
+ */
+enum {
+    CONTROL_INPUT_JOYSTICK,                             // dirControl
+    CONTROL_INPUT_PID_SETTINGS,                         // ganancias de un PID, con PID_ANGLE tambien centerAngle
+    CONTROL_INPUT_MOVE_POS,                             // value: cms a sumar al setPoint de posicion
+    CONTROL_INPUT_MOVE_ABS_YAW,                         // value: grados
+    CONTROL_INPUT_MOVE_REL_YAW,                         // value: grados desde el setPoint de yaw actual
+    CONTROL_INPUT_MOTORS_MEAS,                          // mediciones de la placa de motores o los steppers
+    CONTROL_INPUT_SAVE_LOCAL_CONFIG                     // sin datos: marca en el snapshot la config a grabar, con las entradas anteriores ya aplicadas
+};
+
+typedef struct {
+    uint8_t      numPid;
+    pid_floats_t gains;                                 // setPoint no se usa
+    float        centerAngle;
+} control_pid_input_t;
+
+typedef struct {
+    uint16_t batVoltage;
+    uint16_t tempMcb;
+    int16_t  speedMeasR;
+    int16_t  speedMeasL;
+    float    posInMetersR;
+    float    posInMetersL;
+} control_motors_input_t;
+
+typedef struct {
+    uint8_t type;                                       // CONTROL_INPUT_*
+    union {
+        direction_control_t    dirControl;
+        control_pid_input_t    pid;
+        control_motors_input_t motors;
+        float                  value;
+    };
+} control_input_t;
+
+/**
+ * @brief Estadisticas de cada etapa de la cascada de control
+ */
+typedef struct {
+    const char *name;
+    uint8_t  decimation;
+    uint32_t runs;                      // ciclos en que se calculo su PID
+    uint32_t lastLatencyUs;             // desde que leyo su entrada hasta que la salida quedo en speedMotors
+    uint32_t maxLatencyUs;
+} control_stage_stats_t;
+
+extern status_robot_t statusRobot;                      // Estructura que contiene todos los parametros de status a enviar a la app
+extern output_motors_t speedMotors;
+extern output_motors_t attitudeControlMotor;
+extern attitude_control_stat_t attitudeControlStat;
+
+float pos2mts(int32_t steps);
+float cutAngle(float angleInput);
+
+/*
+ * Carga las constantes por defecto de cada hardware sobre la config local
+ */
+void controlLoadDefaultConfig(robot_local_configs_t *localConfig);
+
+/*
+ * Ganancias en las unidades de la app y la flash (ki y kd referidos a PID_GAINS_REF_PERIOD_MS) <-> las que usan
+ * los PID (ki por segundo, kd en segundos). Se convierte solo al cruzar comms o storage, asi lo que viaja y lo
+ * guardado no cambia de significado.
+ */
+pid_floats_t controlPidGainsFromLegacy(uint8_t numPid, pid_floats_t gains);
+pid_floats_t controlPidGainsToLegacy(uint8_t numPid, pid_floats_t gains);
+void controlLocalConfigFromLegacy(robot_local_configs_t *localConfig);
+robot_local_configs_t controlLocalConfigToLegacy(robot_local_configs_t localConfig);
+
+/*
+ * Periodo real con el que se calcula cada PID: el del tick (CONTROL_TICK_PERIOD_US hasta que se mida otro)
+ * por la decimacion de su etapa
+ */
+float controlGetPidPeriodMs(uint8_t numPid);
+
+/*
+ * Periodo medido entre ciclos de la cascada. Recalcula el sampleTime de cada PID sin limpiar sus terminos,
+ * desde la tarea del tick o antes de arrancarla
+ */
+void controlSetTickPeriodUs(uint32_t periodUs);
+
+void setStatusRobot(uint8_t newStatus);
+
+/*
+ * Crea la cola de entradas, antes de arrancar las tareas que publican
+ */
+esp_err_t controlInputInit(void);
+
+/*
+ * Publica una entrada para el proximo tick, desde cualquier tarea. No bloquea.
+ * @return false si la cola estaba llena y se descarto
+ */
+bool controlPostInput(const control_input_t *input);
+
+/*
+ * Entradas descartadas por cola llena desde el arranque
+ */
+uint32_t controlGetInputDrops(void);
+
+/*
+ * Aplica las entradas pendientes, en la tarea del tick antes de la cascada. Sin controlInputInit no hace nada
+ */
+void controlApplyInputs(void);
+
+/*
+ * Un ciclo de la cascada, llamada en cada tick de control con la ultima muestra del IMU.
+ * Corre los lazos externos que tocan en este tick (yaw, posicion o velocidad), con su salida
+ * el lazo de angulo, la mezcla de motores y las protecciones.
+ */
+void controlCascadeUpdate(vector_queue_t *newAngles);
+
+/*
+ * El tick se quedo sin muestras del IMU: desactiva el lazo de angulo y pasa a STATUS_ROBOT_ERROR_IMU.
+ * Con muestras de nuevo y el robot derecho se vuelve a estabilizar como despues de cualquier error.
+ */
+void controlImuLost(void);
+
+/*
+ * Publica el snapshot con statusRobot y la salida a motores, una vez por tick despues de las entradas y la
+ * cascada, haya corrido o no: commsManager ve las entradas aplicadas tambien sin muestras del IMU
+ */
+void controlPublishSnapshot(void);
+
+void controlGetStageStats(control_stage_stats_t stats[CONTROL_STAGES_COUNT]);
+
+#endif
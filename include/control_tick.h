@@ -0,0 +1,56 @@
+#ifndef __CONTROL_TICK_H__
+#define __CONTROL_TICK_H__
+
+#include "stdint.h"
+#include "esp_err.h"
+#include "main.h"
+
+enum {
+    CONTROL_TICK_SOURCE_TIMER,          // esp_timer periodico, toma la ultima muestra disponible del IMU
+    CONTROL_TICK_SOURCE_IMU             // cada muestra nueva del IMU dispara el ciclo, el DMP marca el periodo
+};
+
+/*
+ * Salida directa al driver de motores, llamada desde la tarea del tick en el mismo ciclo que la cascada
+ */
+typedef void (*control_tick_output_t)(const output_motors_t *output);
+
+typedef struct {
+    uint32_t periodUs;                  // periodo del timer, o periodo nominal del IMU con CONTROL_TICK_SOURCE_IMU
+    uint8_t  priorityTask;
+    uint8_t  core;
+    uint8_t  source;
+    control_tick_output_t motorOutput;  // NULL: se publica en motorControlQueueHandler
+} control_tick_config_t;
+
+/**
+ * @brief Contadores del tick de control, el jitter es la diferencia entre el intervalo medido y periodUs
+ */
+typedef struct {
+    uint32_t ticks;
+    uint32_t missedTicks;               // ticks que llegaron mientras el anterior seguia ejecutando
+    uint32_t staleSamples;              // ticks sin muestra nueva del IMU: no corre la cascada, se mantiene la salida
+    uint32_t imuLost;                   // veces que faltaron muestras CONTROL_TICK_IMU_LOST_PERIODS seguidos
+    uint32_t offPeriodSamples;          // por muestra: intervalo que no es un multiplo del periodo, el DMP a otra tasa
+    uint32_t periodMeasuredUs;          // media entre muestras usadas por la cascada, el dt de los PID
+    uint32_t periodUpdates;             // veces que se recalcularon los PID con un periodo medido distinto
+    uint32_t inputDrops;                // entradas de otras tareas descartadas con la cola llena (controlPostInput)
+    int32_t  jitterMinUs;
+    int32_t  jitterMaxUs;
+    float    jitterMeanAbsUs;
+    uint32_t execMaxUs;                 // peor duracion de muestreo + cascada de control + salida a motores
+    uint32_t latencyLastUs;             // desde la marca de tiempo de la muestra del IMU hasta el comando aplicado
+    uint32_t latencyMaxUs;
+    float    latencyMeanUs;
+} control_tick_stats_t;
+
+/*
+ * Arranca la tarea que en cada tick, en este orden: toma la ultima muestra del IMU, aplica las entradas de
+ * otras tareas, corre la cascada de control (controlCascadeUpdate), publica el snapshot y envia la salida a motores. El tick lo da un esp_timer periodico o,
+ * con CONTROL_TICK_SOURCE_IMU, la llegada de cada muestra.
+ */
+esp_err_t controlTickInit(control_tick_config_t *config);
+
+void controlTickGetStats(control_tick_stats_t *stats);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __FLIGHT_RECORDER_H__
+#define __FLIGHT_RECORDER_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "main.h"
+
+/*
+ * Caja negra: buffer circular de tamaño fijo con un registro por ciclo de control. Ante un error
+ * sigue grabando FLIGHT_RECORDER_POST_TRIGGER ciclos mas y se congela hasta que se descarga, asi
+ * queda la historia antes y despues de la falla. Un pedido de descarga congela en el ciclo siguiente.
+ */
+
+// Con PSRAM (S3 con CONFIG_SPIRAM_ALLOW_BSS_EXT_MEM) el buffer va a la externa y entra mucha mas historia
+#if defined(CONFIG_SPIRAM_ALLOW_BSS_EXT_MEM)
+#define FLIGHT_RECORDER_RECORDS         16384           // ~164 s a 100 Hz, 640 KB
+#else
+#define FLIGHT_RECORDER_RECORDS         512             // ~5 s a 100 Hz, 20 KB de RAM interna
+#endif
+#define FLIGHT_RECORDER_POST_TRIGGER    (FLIGHT_RECORDER_RECORDS / 4)
+
+#define FLIGHT_RECORDER_SCALE_ANGLE     100.0f          // grados -> centesimas
+#define FLIGHT_RECORDER_SCALE_PID       10000.0f        // salidas normalizadas [-1;1] -> [-10000;10000]
+
+enum {
+    FLIGHT_RECORDER_TRIGGER_NONE,
+    FLIGHT_RECORDER_TRIGGER_ERROR_STATUS,               // setStatusRobot a un estado de error
+    FLIGHT_RECORDER_TRIGGER_SAFETY_LIMIT,               // desarme por angulo fuera de safetyLimits
+    FLIGHT_RECORDER_TRIGGER_REQUEST,                    // pedido de descarga desde la app
+};
+
+/**
+ * @brief Un ciclo de control, en enteros escalados como los paquetes de comms
+ */
+typedef struct {
+    uint32_t cycle;
+    int16_t  pitch;                                     // x FLIGHT_RECORDER_SCALE_ANGLE
+    int16_t  roll;
+    int16_t  yaw;
+    int16_t  pidOutput[CANT_PIDS];                      // x FLIGHT_RECORDER_SCALE_PID, 0 si no se calculo en el ciclo
+    int16_t  pidITerm[CANT_PIDS];                       // x FLIGHT_RECORDER_SCALE_PID
+    int16_t  setPoint[CANT_PIDS];                       // setPoint del PID [-100;100] x 100
+    int16_t  motorL;
+    int16_t  motorR;
+    uint8_t  statusCode;
+    uint8_t  motorsEnable;
+} flight_record_t;
+
+typedef struct {
+    uint32_t records;                                   // registros validos, hasta FLIGHT_RECORDER_RECORDS
+    uint32_t capacity;
+    uint8_t  frozen;
+    uint8_t  triggerReason;
+    uint8_t  triggerStatus;                             // statusCode al momento del disparo
+    uint32_t triggerCycle;
+} flight_recorder_info_t;
+
+/*
+ * Agrega un registro, solo desde la tarea del tick de control. No hace nada si esta congelado.
+ */
+void flightRecorderWrite(const flight_record_t *record);
+
+/*
+ * Dispara el congelamiento desde cualquier tarea. Solo cuenta el primer disparo hasta flightRecorderRearm.
+ */
+void flightRecorderTrigger(uint8_t reason, uint8_t statusCode);
+
+bool flightRecorderIsFrozen(void);
+
+void flightRecorderGetInfo(flight_recorder_info_t *info);
+
+/*
+ * Copia hasta maxRecords registros desde `first` (0 = el mas viejo). Solo con el buffer congelado.
+ * @return registros copiados
+ */
+uint16_t flightRecorderRead(uint32_t first, flight_record_t *records, uint16_t maxRecords);
+
+/*
+ * Descarta la captura y vuelve a grabar
+ */
+void flightRecorderRearm(void);
+
+#endif
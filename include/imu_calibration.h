@@ -0,0 +1,104 @@
+#ifndef __IMU_CALIBRATION_H__
+#define __IMU_CALIBRATION_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "main.h"
+
+/*
+ * Calibracion de los offsets del MPU6050 muestra a muestra, para correr dentro del lazo de lectura
+ * sin bloquearlo (CalibrateAccel/CalibrateGyro de I2Cdev frenan la tarea varios segundos).
+ *
+ * Por ronda descarta IMU_CALIBRATION_SETTLE_MS (los offsets recien escritos pasan por el DLPF) y
+ * acumula IMU_CALIBRATION_ROUND_MS de acelerometro y giroscopo crudos. Al cerrarla, si algun desvio
+ * pasa su maximo el robot se movio y se repite la ronda; si no, el error medio contra el reposo
+ * (0, 0, +1 g con el MPU horizontal y Z hacia arriba, como CalibrateAccel; giroscopo en 0) da los
+ * offsets nuevos. Se aplican y la ronda siguiente verifica: termina cuando el error queda dentro de
+ * la tolerancia. Los pasos de los registros no son exactos, por eso puede hacer falta mas de una ronda.
+ * Si falla vuelve a los offsets de antes y espera una ronda mas para que se asiente el filtro.
+ */
+
+#define IMU_CALIBRATION_ROUND_MS            2000
+#define IMU_CALIBRATION_SETTLE_MS           100
+#define IMU_CALIBRATION_MAX_ROUNDS          6           // con pasos del registro un 20% cortos hacen falta 4
+#define IMU_CALIBRATION_MAX_MOTION          3           // rondas descartadas por movimiento antes de abandonar
+#define IMU_CALIBRATION_ACCEL_TOLERANCE_G   0.004f      // ~0.25 grados de inclinacion
+#define IMU_CALIBRATION_GYRO_TOLERANCE_DPS  0.05f
+#define IMU_CALIBRATION_ACCEL_STD_MAX_G     0.02f
+#define IMU_CALIBRATION_GYRO_STD_MAX_DPS    0.5f
+
+// Escala de los registros de offset, sin importar el rango configurado
+#define IMU_CALIBRATION_ACCEL_OFFSET_LSB_PER_G  2048.0f     // XA_OFFS en +-16 g, el bit 0 no se toca
+#define IMU_CALIBRATION_GYRO_OFFSET_LSB_PER_DPS 32.8f       // XG_OFFS_USR en +-1000 grados/s
+
+enum {
+    IMU_CALIBRATION_IDLE,
+    IMU_CALIBRATION_MEASURING,
+    IMU_CALIBRATION_RESTORING,                  // fallo: se volvio a los offsets de antes, esperando que se asiente
+    IMU_CALIBRATION_DONE,
+    IMU_CALIBRATION_FAILED
+};
+
+enum {
+    IMU_CALIBRATION_ERROR_NONE,
+    IMU_CALIBRATION_ERROR_MOTION,               // IMU_CALIBRATION_MAX_MOTION rondas con movimiento
+    IMU_CALIBRATION_ERROR_NOT_CONVERGED,        // IMU_CALIBRATION_MAX_ROUNDS sin entrar en la tolerancia
+    IMU_CALIBRATION_ERROR_BUS,                  // no se pudieron escribir los offsets
+    IMU_CALIBRATION_ERROR_ARMED                 // pedida con los motores habilitados, no se empezo
+};
+
+#define IMU_CALIBRATION_AXES    6               // acelerometro X, Y, Z y giroscopo X, Y, Z
+
+typedef struct {
+    uint8_t  state;
+    uint8_t  error;                             // IMU_CALIBRATION_ERROR_*
+    uint8_t  round;                             // ronda en curso, desde 1
+    uint8_t  motionRounds;                      // rondas descartadas por movimiento
+    uint8_t  progress;                          // %, estimado sobre dos rondas (medir y verificar)
+    uint16_t roundSamples;
+    uint16_t settleSamples;
+    uint16_t count;                             // muestras acumuladas en la ronda
+    uint16_t settle;                            // muestras que faltan descartar
+    float    accelLsbPerG;
+    float    gyroLsbPerDps;
+    // ronda en curso, relativa a su primera muestra para no perder precision en float
+    int16_t  ref[IMU_CALIBRATION_AXES];
+    float    sum[IMU_CALIBRATION_AXES];
+    float    sumSq[IMU_CALIBRATION_AXES];
+    // ultima ronda cerrada
+    float    accelResidualG;                    // mayor error medio de los tres ejes
+    float    gyroResidualDps;
+    imu_offsets_t offsets;                      // los de los registros, o a escribir si imuCalibrationUpdate devuelve true
+    imu_offsets_t previous;                     // los de antes de empezar
+} imu_calibration_t;
+
+/*
+ * @param current offsets que tienen los registros
+ * @param sampleHz muestras por segundo con que se llama a imuCalibrationUpdate
+ * @param accelLsbPerG, gyroLsbPerDps escalas de las lecturas crudas con la configuracion actual
+ */
+void imuCalibrationStart(imu_calibration_t *calibration, const imu_offsets_t *current, uint16_t sampleHz,
+                         float accelLsbPerG, float gyroLsbPerDps);
+
+/*
+ * Una muestra cruda (getMotion6). Solo trabaja en MEASURING y RESTORING, en el resto no hace nada.
+ * @return true si hay que escribir offsets ya (los tres ejes de cada sensor juntos), antes de la proxima muestra
+ */
+bool imuCalibrationUpdate(imu_calibration_t *calibration, const int16_t accel[3], const int16_t gyro[3]);
+
+/*
+ * Sale con error como una ronda fallida (por ejemplo si no se pudieron escribir los offsets): vuelve a los de
+ * antes y espera una ronda en RESTORING. Si lo que fallo era justamente volver, termina en FAILED.
+ * @return true si hay que escribir los offsets de antes
+ */
+bool imuCalibrationAbort(imu_calibration_t *calibration, uint8_t error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
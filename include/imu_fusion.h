@@ -0,0 +1,83 @@
+#ifndef __IMU_FUSION_H__
+#define __IMU_FUSION_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stdint.h"
+
+/*
+ * Fusion de 6 ejes (acelerometro + giroscopo) en el MCU, alternativa al DMP del MPU6050.
+ * Los angulos siguen la convencion de dmpGetYawPitchRoll (misma conversion cuaternion -> YPR), asi el
+ * control no cambia al elegir el motor. Las velocidades angulares salen en el mismo signo que los
+ * angulos: d(pitch)/dt = ratePitch sin importar la orientacion del giroscopo.
+ */
+
+// Motores, se elige con IMU_FUSION_ENGINE en main.h
+#define IMU_FUSION_DMP              0               // cuaternion del DMP leido de la FIFO
+#define IMU_FUSION_COMPLEMENTARY    1               // rota la gravedad estimada con el giroscopo y la corrige con el acelerometro
+#define IMU_FUSION_MADGWICK         2               // cuaternion, correccion por descenso de gradiente (beta)
+#define IMU_FUSION_MAHONY           3               // cuaternion, correccion PI del error de gravedad (kp, ki)
+
+// Escalas con que se configura el MPU6050 para la fusion (MPU6050_ACCEL_FS_2, MPU6050_GYRO_FS_500)
+#define IMU_FUSION_ACCEL_LSB_PER_G      16384.0f
+#define IMU_FUSION_GYRO_LSB_PER_DPS     65.5f
+#define IMU_FUSION_DMP_GYRO_LSB_PER_DPS 16.4f       // dmpInitialize deja el giroscopo en MPU6050_GYRO_FS_2000
+
+#define IMU_FUSION_COMPLEMENTARY_TAU_S  1.0f        // constante de tiempo de la correccion con el acelerometro
+#define IMU_FUSION_MADGWICK_BETA        0.033f
+#define IMU_FUSION_MAHONY_KP            0.2f
+#define IMU_FUSION_MAHONY_KI            0.05f
+#define IMU_FUSION_ACCEL_GATE_G         0.25f       // con |a| fuera de 1g +/- este margen no se corrige con el acelerometro
+
+typedef struct {
+    float yaw;                                      // grados
+    float pitch;
+    float roll;
+    float rateYaw;                                  // grados/s
+    float ratePitch;
+    float rateRoll;
+} imu_fusion_output_t;
+
+typedef struct {
+    uint8_t engine;
+    uint8_t initialized;                            // la primera muestra fija la inclinacion con el acelerometro
+    float q[4];                                     // w, x, y, z (Madgwick y Mahony)
+    float integralError[3];                         // termino integral de Mahony, sesgo del giroscopo en rad/s
+    float gravity[3];                               // gravedad estimada en los ejes del sensor (complementario)
+    float yaw;                                      // rad (complementario)
+    float rates[3];                                 // ultima velocidad en rad/s, en el signo de los angulos
+    float gain;                                     // beta de Madgwick, kp de Mahony, tau del complementario
+    float gainIntegral;                             // ki de Mahony
+} imu_fusion_t;
+
+/*
+ * Estado inicial con las ganancias por defecto del motor
+ */
+void imuFusionInit(imu_fusion_t *fusion, uint8_t engine);
+
+/*
+ * @param accel aceleracion en g, en los ejes del sensor
+ * @param gyro velocidad angular en rad/s, en los ejes del sensor
+ * @param dt segundos desde la muestra anterior
+ */
+void imuFusionUpdate(imu_fusion_t *fusion, const float accel[3], const float gyro[3], float dt);
+
+/*
+ * Igual que imuFusionUpdate con las cuentas crudas de getMotion6
+ */
+void imuFusionUpdateRaw(imu_fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3], float dt);
+
+void imuFusionGetOutput(const imu_fusion_t *fusion, imu_fusion_output_t *out);
+
+/*
+ * Conversion de dmpGetGravity + dmpGetYawPitchRoll, en radianes [yaw, pitch, roll]
+ */
+void imuFusionQuaternionToYpr(const float q[4], float ypr[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __IMU_WARMUP_H__
+#define __IMU_WARMUP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stdint.h"
+
+/*
+ * Detector de arranque del IMU: decide cuando la estimacion se asento y se pueden empezar a entregar
+ * muestras, en lugar de descartar una cantidad fija.
+ *
+ * Trabaja por ventanas de IMU_WARMUP_WINDOW_MS. En cada una calcula media y desvio del pitch y media
+ * y desvio del giroscopo por eje. La ventana esta quieta si los dos desvios quedan bajo sus maximos;
+ * quieta, la media del giroscopo es el sesgo. Se da por asentado con dos ventanas quietas seguidas
+ * cuyo pitch medio no cambio mas de IMU_WARMUP_PITCH_DRIFT_MAX_DEG (la estimacion dejo de converger)
+ * y con el sesgo de cada eje bajo IMU_WARMUP_GYRO_BIAS_MAX_DPS. Si esta quieto pero el sesgo es
+ * grande avisa una vez por ventana para que se corrijan los offsets, hasta IMU_WARMUP_MAX_CORRECTIONS.
+ * Sin asentarse en maxSamples (el robot se mueve) se entrega igual, como antes.
+ */
+
+#define IMU_WARMUP_WINDOW_MS                250
+#define IMU_WARMUP_PITCH_STD_MAX_DEG        0.1f
+#define IMU_WARMUP_PITCH_DRIFT_MAX_DEG      0.02f       // entre ventanas: con una convergencia de ~1 s quedan <0.1 grados
+#define IMU_WARMUP_GYRO_STD_MAX_DPS         0.5f
+#define IMU_WARMUP_GYRO_BIAS_MAX_DPS        0.2f
+#define IMU_WARMUP_MAX_CORRECTIONS          3
+
+enum {
+    IMU_WARMUP_RUNNING,
+    IMU_WARMUP_SETTLED,                         // asentado, se entregan muestras
+    IMU_WARMUP_TIMEOUT,                         // vencio maxSamples sin asentarse, se entregan igual
+    IMU_WARMUP_CORRECT                          // solo como retorno de imuWarmupUpdate: quieto con sesgo en gyroBias
+};
+
+typedef struct {
+    uint8_t  state;                             // IMU_WARMUP_RUNNING, SETTLED o TIMEOUT
+    uint8_t  corrections;                       // veces que se devolvio IMU_WARMUP_CORRECT
+    uint8_t  hasPrevious;                       // hay una ventana quieta anterior para medir la deriva
+    uint16_t windowSamples;
+    uint16_t maxSamples;
+    uint32_t samples;                           // desde el arranque
+    // ventana en curso, relativa a su primera muestra para no perder precision en float
+    uint16_t windowCount;
+    float    pitchRef;
+    float    pitchSum;
+    float    pitchSumSq;
+    float    gyroSum[3];
+    float    gyroSumSq[3];
+    // ultima ventana cerrada
+    float    pitchMean;
+    float    pitchStd;                          // grados
+    float    pitchDrift;                        // grados, contra la ventana quieta anterior
+    float    gyroStd;                           // grados/s, el mayor de los tres ejes
+    float    gyroBias[3];                       // grados/s, media del giroscopo
+} imu_warmup_t;
+
+/*
+ * @param sampleHz muestras por segundo con que se llama a imuWarmupUpdate
+ * @param maxSamples muestras hasta entregar sin asentarse
+ */
+void imuWarmupInit(imu_warmup_t *warmup, uint16_t sampleHz, uint16_t maxSamples);
+
+/*
+ * Una muestra: pitch en grados y giroscopo en grados/s. Con IMU_WARMUP_CORRECT el sesgo queda en
+ * gyroBias: se corrigen los offsets y el detector descarta las ventanas anteriores.
+ * @return state, o IMU_WARMUP_CORRECT
+ */
+uint8_t imuWarmupUpdate(imu_warmup_t *warmup, float pitch, const float gyroDps[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __LOOP_TIMING_H__
+#define __LOOP_TIMING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stdint.h"
+
+#define LOOP_TIMING_SAMPLES     64              // ciclos guardados por lazo, potencia de 2
+
+// ATENCION: el orden define la posicion de cada lazo en el paquete HEADER_PACKAGE_LOOP_TIMING
+enum {
+    LOOP_TIMING_CONTROL_TICK,                   // controlTickHandler (reemplaza a imuControlHandler)
+    LOOP_TIMING_ATTITUDE,                       // lazos externos de la cascada (reemplaza a attitudeControl)
+    LOOP_TIMING_COMMS,                          // commsManager
+    LOOP_TIMING_MPU,                            // mpu6050Handler, un ciclo por paquete DMP leido
+    LOOP_TIMING_COUNT
+};
+
+/**
+ * @brief Periodo (entre inicios) y tiempo de ejecucion (inicio a fin) de los ultimos LOOP_TIMING_SAMPLES ciclos
+ */
+typedef struct {
+    uint16_t samples;
+    uint32_t periodMinUs;
+    uint32_t periodMaxUs;
+    uint32_t periodMeanUs;
+    uint32_t periodP99Us;
+    uint32_t execMinUs;
+    uint32_t execMaxUs;
+    uint32_t execMeanUs;
+    uint32_t execP99Us;
+} loop_timing_stats_t;
+
+/*
+ * Marcan inicio y fin de un ciclo con el contador de ciclos de la CPU. Cada lazo debe ser escrito
+ * por una sola tarea fijada a un core. Un inicio sin fin (ej: polling sin dato) se descarta.
+ */
+void loopTimingStart(uint8_t loop);
+void loopTimingEnd(uint8_t loop);
+
+/*
+ * Calcula min/max/media/p99 sobre la ventana actual. Se puede llamar desde otra tarea:
+ * un ciclo escrito durante la copia puede quedar mezclado, aceptable para estadistica.
+ */
+void loopTimingGetStats(uint8_t loop, loop_timing_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
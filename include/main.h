@@ -4,10 +4,37 @@
 
 // PARA DETECTAR EL ESP32S3: CONFIG_IDF_TARGET_ESP32S3
 
+// Se puede forzar desde el build (ej: -DHARDWARE_PROTOTYPE en el simulador host)
+#if !defined(HARDWARE_PROTOTYPE) && !defined(HARDWARE_S3)
 // #define HARDWARE_PROTOTYPE
 #define HARDWARE_S3
+#endif
 
-#define PERIOD_IMU_MS           100
+#define CONTROL_TICK_PERIOD_US  10000                               // Tick del lazo de angulo (esp_timer), no mas rapido que la FIFO del DMP
+#define PERIOD_IMU_MS           (CONTROL_TICK_PERIOD_US / 1000)
+#define PERIOD_ATTITUDE_MS      50                                  // Lazos externos: posicion, velocidad y yaw
+#define ATTITUDE_DECIMATION     (PERIOD_ATTITUDE_MS / PERIOD_IMU_MS)    // Ticks de control por ciclo de los lazos externos
+#if (PERIOD_ATTITUDE_MS % PERIOD_IMU_MS)
+#error PERIOD_ATTITUDE_MS debe ser multiplo de PERIOD_IMU_MS
+#endif
+// Tick de control disparado por cada muestra del IMU: la salida a motores sale en el mismo ciclo que la muestra.
+// mpu6050Handler fija la FIFO del DMP a CONTROL_TICK_PERIOD_US (MPU_DMP_RATE_DIVIDER). Comentado: esp_timer periodico, independiente del DMP.
+#define CONTROL_TICK_FROM_IMU
+// Fusion del IMU (ver imu_fusion.h): IMU_FUSION_DMP usa el cuaternion del DMP; IMU_FUSION_COMPLEMENTARY,
+// IMU_FUSION_MADGWICK o IMU_FUSION_MAHONY leen getMotion6 a IMU_FUSION_RATE_HZ y fusionan en el MCU.
+// Con fusion en el MCU la cola recibe una muestra cada CONTROL_TICK_PERIOD_US, con las velocidades del giroscopo
+#define IMU_FUSION_ENGINE       IMU_FUSION_DMP
+#define IMU_FUSION_RATE_HZ      1000                                // 1 kHz / (1 + divisor): 1000, 500, 250, 200...
+// Loguea cada paquete del DMP junto con getMotion6 (CSV para fusion_bench --dmp), solo con IMU_FUSION_DMP
+// #define IMU_FUSION_RECORD_DMP
+// Con IMU_FUSION_DMP la FIFO se vacia en rafagas y se entrega solo el paquete mas nuevo. Con este define se
+// entregan todos los leidos, con su marca de tiempo, para filtrar en el tick (cola de MPU_FIFO_BURST_PACKETS)
+// #define MPU_FIFO_FORWARD_ALL
+// Lecturas del lazo del MPU por el driver i2c_master con callback de fin (ESP-IDF >= 5.2, ver mpu_i2c.h): la tarea
+// duerme en un semaforo mientras sale cada transaccion. Necesita CONFIG_I2C_SKIP_LEGACY_CONFLICT_CHECK, I2Cdev
+// configura el MPU con el driver legacy. Comentado o con un IDF anterior: driver legacy
+// #define MPU_I2C_ASYNC
+#define PID_GAINS_REF_PERIOD_MS 100                                 // Periodo que asumian las ganancias por defecto al ajustarlas
 #define MPU_HANDLER_PRIORITY    5//configMAX_PRIORITIES - 1
 #define IMU_HANDLER_PRIORITY    configMAX_PRIORITIES - 2
 
@@ -16,7 +43,14 @@
 
 #define COMM_HANDLER_PRIORITY   configMAX_PRIORITIES - 4
 
-#define PRECISION_DECIMALS_COMMS    100.00              // Precision al convertir la data cruda a float, en este caso 100 = 0.01
+#define PRECISION_DECIMALS_COMMS    100.0f              // Precision al convertir la data cruda a float, en este caso 100 = 0.01 (float: el ESP32 no tiene FPU de doble precision)
+
+// Status a la app por datagramas UDP numerados en lugar del socket TCP, asi una retransmision no frena
+// al joystick ni a los status siguientes. Config, comandos y el resto de los paquetes siguen por TCP
+// #define TELEMETRY_UDP
+
+// Motor de calculo de los PID: float (por defecto) o punto fijo Q16.16, ver PID_fixed.h
+// #define PID_FIXED_POINT
 
 #define CANT_PIDS	4
 
@@ -109,6 +143,14 @@ typedef struct {
     pid_floats_t pids[CANT_PIDS];
 } robot_local_configs_t;
 
+/**
+ * @brief Offsets del MPU6050 tal como van en los registros (XA_OFFS, XG_OFFS_USR), guardados en la NVS
+ */
+typedef struct {
+    int16_t accel[3];
+    int16_t gyro[3];
+} imu_offsets_t;
+
 /**
  * @brief Esta estructura de datos generica del robot
  */
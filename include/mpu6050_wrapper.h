@@ -6,6 +6,32 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "driver/gpio.h"
+#include "main.h"
+#include "imu_fusion.h"
+#include "mpu_fifo.h"
+#include "imu_warmup.h"
+#include "imu_calibration.h"
+
+// Paquetes del DMP entregados por lectura de la FIFO y largo de la cola hacia el tick de control
+#if defined(MPU_FIFO_FORWARD_ALL) && IMU_FUSION_ENGINE == IMU_FUSION_DMP
+#define MPU_FIFO_FORWARD_PACKETS    MPU_FIFO_BURST_PACKETS
+#else
+#define MPU_FIFO_FORWARD_PACKETS    1
+#endif
+#define MPU6050_QUEUE_LENGTH        MPU_FIFO_FORWARD_PACKETS
+
+enum {
+    MPU6050_READ_POLLING,           // consulta continua del INT_STATUS y FIFO por I2C
+    MPU6050_READ_INTERRUPT          // la tarea duerme hasta el flanco del pin INT del MPU
+};
+
+enum {
+    IMU_OFFSETS_FACTORY,            // los que deja dmpInitialize, no habia offsets en la NVS
+    IMU_OFFSETS_STORED,             // restaurados de la NVS, los del ultimo arranque que se asento
+    IMU_OFFSETS_CALIBRATED          // de una calibracion (COMMAND_CALIBRATE_IMU) en este arranque
+};
 
 typedef struct {
     gpio_num_t sclGpio;
@@ -13,8 +39,57 @@ typedef struct {
     gpio_num_t intGpio;
     uint8_t priorityTask;
     uint8_t core;
+    uint8_t readMode;
 } mpu6050_init_t;
 
+/**
+ * @brief Contadores de lectura del MPU, para medir la carga de bus y cpu por muestra
+ */
+typedef struct {
+    uint8_t  readMode;                  // modo efectivo, puede caer a polling si el pin INT no es valido
+    uint8_t  i2cAsync;                  // lecturas por i2c_master con callback (MPU_I2C_ASYNC)
+    uint32_t samples;                   // paquetes DMP o muestras de getMotion6 leidos
+    uint32_t busTransactions;           // transacciones I2C del lazo (mpu_i2c)
+    uint32_t i2cErrors;                 // NACK o timeout, el lazo sigue en la muestra siguiente
+    uint64_t i2cTransferUs;             // tiempo dentro de transacciones I2C, la tarea duerme
+    uint64_t cpuTimeUs;                 // tiempo que la tarea estuvo activa (sin esperar el flanco), incluye el bus
+    uint64_t runTimeUs;                 // cpu real de la tarea (run time stats de FreeRTOS), 0 si no estan habilitadas
+    uint32_t fifoResets;
+    uint32_t fifoOverflows;             // FIFO llena al leerla, se pierden los paquetes pendientes
+    uint32_t intTimeouts;               // esperas de interrupcion vencidas
+    uint64_t busBytes;                  // bytes de datos movidos por I2C (sin direcciones ni registros)
+    uint32_t skippedPackets;            // paquetes leidos de la FIFO pero no entregados, habia uno mas nuevo
+    uint32_t queueDrops;                // con MPU_FIFO_FORWARD_ALL: muestras que no entraron en la cola
+    float    busTransactionsPerSample;
+    float    cpuTimeUsPerSample;
+    float    runTimeUsPerSample;
+    float    busBytesPerSample;
+} mpu6050_stats_t;
+
+/**
+ * @brief Arranque y calibracion del IMU, ver imu_warmup.h e imu_calibration.h. Se envia a la app en HEADER_PACKAGE_IMU_STATUS
+ */
+typedef struct {
+    uint16_t warmupSamples;         // muestras descartadas antes de la primera
+    uint32_t firstSampleMs;         // desde el arranque hasta la primera muestra en la cola, 0 si todavia no
+    uint8_t  warmupState;           // IMU_WARMUP_RUNNING, SETTLED o TIMEOUT
+    uint8_t  offsetsSource;         // IMU_OFFSETS_*
+    uint8_t  gyroCorrections;       // correcciones de los offsets del giroscopo durante el arranque
+    float    gyroStd;               // grados/s, ultima ventana del detector (el mayor de los ejes)
+    float    pitchStd;              // grados
+    float    pitchDrift;            // grados, contra la ventana quieta anterior
+    float    gyroBiasX;             // grados/s, media del giroscopo
+    float    gyroBiasY;
+    float    gyroBiasZ;
+    int16_t  gyroOffsets[3];        // XG_OFFS_USR actuales
+    uint8_t  calibrationState;      // IMU_CALIBRATION_*, IDLE si no se pidio en este arranque
+    uint8_t  calibrationProgress;   // %
+    uint8_t  calibrationRound;
+    uint8_t  calibrationError;      // IMU_CALIBRATION_ERROR_*
+    float    accelResidual;         // g, mayor error medio de la ultima ronda
+    float    gyroResidual;          // grados/s
+} imu_status_t;
+
 typedef struct {
     float w;
     float x;
@@ -33,6 +108,11 @@ typedef struct {
     float pitch;
     float roll;
     float temp;
+    float rateYaw;                  // grados/s en el signo de los angulos, solo con fusion en el MCU (0 con el DMP)
+    float ratePitch;
+    float rateRoll;
+    int64_t timestampUs;            // esp_timer_get_time() del flanco INT (o de la lectura en polling)
+    uint8_t calibrating;            // calibracion en curso, los offsets cambian: no se estabiliza con esta muestra
 } vector_queue_t;
 
 enum {
@@ -43,7 +123,27 @@ enum {
 
 void mpu6050_initialize(mpu6050_init_t *config);
 // int mpu6050_testConnection();
-void mpu6050_recalibrate();
+/*
+ * Pide una calibracion en segundo plano (ver imu_calibration.h): la corre la tarea del MPU muestra a
+ * muestra, sin dejar de entregar, y al terminar bien deja los offsets para guardar. Con el robot
+ * estabilizando se rechaza y queda IMU_CALIBRATION_ERROR_ARMED en el estado.
+ * @param disarmed motores deshabilitados
+ * @return true si se acepto (no habia otra en curso)
+ */
+bool mpu6050_recalibrate(bool disarmed);
+void mpu6050_getStats(mpu6050_stats_t *stats);
+
+/*
+ * Copia el estado del arranque y de la calibracion, desde cualquier tarea
+ */
+void mpu6050_getImuStatus(imu_status_t *status);
+
+/*
+ * Offsets a guardar en la NVS, pendientes desde que el arranque se asento o termino una calibracion. Los graba quien la llama
+ * (commsManager) para no frenar la lectura del MPU con la flash.
+ * @return true una sola vez por cada juego de offsets nuevo
+ */
+bool mpu6050_takeOffsetsToSave(imu_offsets_t *offsets);
 // int mpu6050_dmpInitialize();
 // void mpu6050_calibrateAccel(int loops);
 // void mpu6050_calibrateGyro(int loops);
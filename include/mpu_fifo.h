@@ -0,0 +1,59 @@
+#ifndef __MPU_FIFO_H__
+#define __MPU_FIFO_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/*
+ * Lectura de la FIFO del DMP en rafagas: todos los paquetes completos salen en la menor cantidad de
+ * transacciones I2C posible. El acceso al bus queda detras de mpu_fifo_bus_t para compilar en el host.
+ */
+
+#define MPU_FIFO_SIZE               1024
+#define MPU_DMP_PACKET_SIZE         42              // MPU6050_6Axis_MotionApps20
+#define MPU_FIFO_BURST_PACKETS      (255 / MPU_DMP_PACKET_SIZE)     // getFIFOBytes recibe el largo en un uint8_t: 6 paquetes
+#define MPU_FIFO_BURST_BYTES        (MPU_FIFO_BURST_PACKETS * MPU_DMP_PACKET_SIZE)
+
+typedef struct {
+    bool (*read)(void *ctx, uint8_t *data, uint8_t len);       // getFIFOBytes, false si la transaccion fallo
+    void *ctx;
+} mpu_fifo_bus_t;
+
+typedef struct {
+    uint16_t packets;                               // paquetes completos leidos
+    uint8_t  decoded;                               // cuaterniones devueltos, los mas nuevos
+    uint8_t  bursts;                                // transacciones de lectura
+    uint8_t  overflow;                              // FIFO llena: los bytes ya no estan alineados, hay que resetearla
+    uint8_t  error;                                 // fallo una lectura: se corta ahi y tambien hay que resetearla
+} mpu_fifo_drain_t;
+
+/*
+ * Lee todos los paquetes completos que indica fifoCount, de a MPU_FIFO_BURST_PACKETS por transaccion.
+ * Decodifica el cuaternion de los maxPackets mas nuevos en quaternions, del mas viejo al mas nuevo, y
+ * si gyros no es NULL tambien el giroscopo; los anteriores se leen y se descartan (la FIFO no se puede
+ * saltear). Lo incompleto queda en la FIFO.
+ * Con fifoCount en MPU_FIFO_SIZE no lee nada y marca overflow. Si una lectura falla devuelve lo decodificado
+ * hasta ahi y marca error: no se sabe cuantos bytes salieron de la FIFO.
+ */
+mpu_fifo_drain_t mpuFifoDrain(const mpu_fifo_bus_t *bus, uint16_t fifoCount, float (*quaternions)[4], int16_t (*gyros)[3],
+                              uint8_t maxPackets);
+
+/*
+ * Cuaternion [w, x, y, z] de un paquete DMP, igual que dmpGetQuaternion
+ */
+void mpuFifoDecodeQuaternion(const uint8_t *packet, float q[4]);
+
+/*
+ * Giroscopo crudo de un paquete DMP, igual que dmpGetGyro: escala del DMP, IMU_FUSION_DMP_GYRO_LSB_PER_DPS
+ */
+void mpuFifoDecodeGyro(const uint8_t *packet, int16_t gyro[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef __MPU_I2C_H__
+#define __MPU_I2C_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "esp_err.h"
+#include "esp_idf_version.h"
+#include "driver/gpio.h"
+#include "main.h"
+
+/*
+ * Transporte I2C de las lecturas del lazo del MPU6050 (FIFO, INT_STATUS, getMotion6, temperatura).
+ * La configuracion (dmpInitialize, offsets, calibracion) sigue por I2Cdev sobre el driver legacy.
+ *
+ * Con MPU_I2C_ASYNC (main.h) y ESP-IDF >= 5.2, mpuI2cBeginAsync pasa el bus al driver i2c_master: cada
+ * transaccion se encola y la tarea duerme en un semaforo hasta el callback de fin. Sin eso, o con un
+ * IDF anterior, las lecturas van por el driver legacy con una sola transaccion (write + repeated start
+ * + read) en lugar de las dos de I2Cdev (seleccion de registro con stop y lectura).
+ */
+
+#if defined(MPU_I2C_ASYNC) && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define MPU_I2C_ASYNC_ENABLED   1
+#else
+#define MPU_I2C_ASYNC_ENABLED   0
+#endif
+
+#define MPU_I2C_ADDRESS         0x68            // MPU6050_DEFAULT_ADDRESS, AD0 en bajo
+#define MPU_I2C_CLOCK_HZ        400000
+#define MPU_I2C_TIMEOUT_MS      10              // una rafaga de 252 bytes a 400 kHz tarda ~6 ms
+
+// Registros del MPU6050 que usa el lazo
+#define MPU_REG_XA_OFFS_H       0x06            // offsets del acelerometro X, Y, Z: 3 palabras big-endian
+#define MPU_REG_XG_OFFS_USRH    0x13            // offsets del giroscopo X, Y, Z
+#define MPU_REG_ACCEL_XOUT_H    0x3B
+#define MPU_REG_TEMP_OUT_H      0x41
+#define MPU_REG_INT_STATUS      0x3A
+#define MPU_REG_USER_CTRL       0x6A
+#define MPU_REG_FIFO_COUNTH     0x72
+#define MPU_REG_FIFO_R_W        0x74
+
+#define MPU_INT_STATUS_DATA_RDY     0x01
+#define MPU_INT_STATUS_DMP          0x02
+#define MPU_INT_STATUS_FIFO_OFLOW   0x10
+#define MPU_USER_CTRL_FIFO_RESET    0x04
+
+#define MPU_GYRO_OFFSET_LSB_PER_DPS 32.8f       // los offsets del giroscopo van en la escala de 1000 grados/s
+#define MPU_I2C_MAX_WORDS           3
+
+typedef struct {
+    gpio_num_t sdaGpio;
+    gpio_num_t sclGpio;
+    uint32_t clockHz;
+    uint8_t address;
+} mpu_i2c_config_t;
+
+/**
+ * @brief Contadores del transporte, solo de las lecturas del lazo (no de la configuracion por I2Cdev)
+ */
+typedef struct {
+    uint32_t transactions;
+    uint64_t bytes;                     // bytes de datos, sin direccion ni registro
+    uint32_t errors;                    // NACK o timeout
+    uint64_t transferUs;                // desde que se pide la transaccion hasta que termina (la tarea duerme)
+    uint8_t  async;                     // 1 si las transacciones van por i2c_master con callback
+} mpu_i2c_stats_t;
+
+/*
+ * Instala el driver legacy en I2C_NUM_0, lo usa I2Cdev para configurar el MPU
+ */
+esp_err_t mpuI2cInit(const mpu_i2c_config_t *config);
+
+/*
+ * Con MPU_I2C_ASYNC_ENABLED libera el driver legacy y crea el bus i2c_master con callback de fin.
+ * Se llama una vez terminada la configuracion: despues de esto I2Cdev ya no puede usar el bus.
+ * Sin MPU_I2C_ASYNC_ENABLED no hace nada.
+ */
+esp_err_t mpuI2cBeginAsync(void);
+
+esp_err_t mpuI2cRead(uint8_t reg, uint8_t *data, size_t len);
+esp_err_t mpuI2cWrite(uint8_t reg, uint8_t value);
+
+/*
+ * count palabras de 16 bits big-endian desde reg, en una sola transaccion (hasta MPU_I2C_MAX_WORDS):
+ * los tres ejes de un offset cambian juntos
+ */
+esp_err_t mpuI2cReadWords(uint8_t reg, int16_t *values, uint8_t count);
+esp_err_t mpuI2cWriteWords(uint8_t reg, const int16_t *values, uint8_t count);
+
+/*
+ * Lectura, modificacion y escritura de los bits de mask, como I2Cdev::writeBits
+ */
+esp_err_t mpuI2cUpdateBits(uint8_t reg, uint8_t mask, uint8_t value);
+
+esp_err_t mpuI2cReadIntStatus(uint8_t *status);
+esp_err_t mpuI2cReadFifoCount(uint16_t *count);
+esp_err_t mpuI2cResetFifo(void);
+
+/*
+ * getFIFOBytes para mpu_fifo_bus_t, ctx sin uso
+ */
+bool mpuI2cReadFifo(void *ctx, uint8_t *data, uint8_t len);
+
+/*
+ * getMotion6: cuentas crudas del acelerometro y del giroscopo en una sola transaccion. La temperatura
+ * viene en los mismos 14 bytes, celsius puede ser NULL
+ */
+esp_err_t mpuI2cReadMotion6(int16_t accel[3], int16_t gyro[3], float *celsius);
+
+/*
+ * getTemperature convertida a grados
+ */
+esp_err_t mpuI2cReadTemperature(float *celsius);
+
+void mpuI2cGetStats(mpu_i2c_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __ROBOT_SNAPSHOT_H__
+#define __ROBOT_SNAPSHOT_H__
+
+#include "stdint.h"
+#include "main.h"
+
+/**
+ * @brief Estado consistente del robot, publicado una vez por tick de control (cycle cuenta los ciclos de la cascada)
+ */
+typedef struct {
+    uint32_t                cycle;
+    status_robot_t          status;
+    output_motors_t         speedMotors;
+    output_motors_t         attitudeControlMotor;
+    uint32_t                localConfigSaves;   // CONTROL_INPUT_SAVE_LOCAL_CONFIG aplicados: al cambiar se graba status.localConfig
+} robot_snapshot_t;
+
+typedef struct {
+    uint32_t publishes;
+    uint32_t reads;
+    uint32_t readRetries;               // lecturas repetidas por coincidir con una escritura
+} robot_snapshot_stats_t;
+
+/*
+ * Publica un nuevo snapshot. Un unico escritor (la tarea del tick de control), nunca bloquea.
+ */
+void robotSnapshotPublish(const robot_snapshot_t *snapshot);
+
+/*
+ * Copia el ultimo snapshot publicado, sin locks, desde cualquier tarea o core.
+ * Nunca devuelve un snapshot mezclado entre dos ciclos.
+ */
+void robotSnapshotRead(robot_snapshot_t *snapshot);
+
+void robotSnapshotGetStats(robot_snapshot_stats_t *stats);
+
+#endif
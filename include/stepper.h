@@ -2,6 +2,7 @@
 #define __STEPPER_H__
 
 #include "stdint.h"
+#include "main.h"
 
 #define LOW_LIMIT_PCNT -100 // -0x7FFF
 #define HIGH_LIMIT_PCNT 100 // 0x7FFF
@@ -13,6 +14,7 @@ typedef struct {
     uint8_t gpio_mot_r_dir;
     uint8_t gpio_mot_enable;
     uint8_t gpio_mot_microstepper;
+    uint8_t queueOutput;                // crea la tarea que aplica motorControlQueueHandler; false: escribe solo quien llame a motorsSetOutput
 } stepper_config_t;
 
 typedef struct {
@@ -23,6 +25,12 @@ typedef struct {
 } motors_measurements_t;
 
 void motorsInit(stepper_config_t config);
+
+/*
+ * Aplica una salida de motores, se puede llamar directo desde el tick de control. Un unico escritor: con
+ * queueOutput es la tarea de la cola, sin ella quien la llame (el tick)
+ */
+void motorsSetOutput(const output_motors_t *output);
 void setMicroSteps(uint8_t fullStep);
 motors_measurements_t getMeasMotors();
 
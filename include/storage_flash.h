@@ -2,10 +2,17 @@
 #define __STORAGE_FLASH_H__
 
 #include "stdio.h"
+#include "stdbool.h"
 #include "main.h"
 
 void storageInit(void);
 void storageLocalConfig(robot_local_configs_t params);
 robot_local_configs_t getFromStorageLocalConfig(void);
+void storageImuOffsets(imu_offsets_t offsets);
+
+/*
+ * @return false si no hay offsets guardados (primer arranque o NVS borrada)
+ */
+bool getFromStorageImuOffsets(imu_offsets_t *offsets);
 
 #endif
\ No newline at end of file
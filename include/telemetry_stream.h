@@ -0,0 +1,78 @@
+#ifndef __TELEMETRY_STREAM_H__
+#define __TELEMETRY_STREAM_H__
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "flight_recorder.h"
+
+/*
+ * Telemetria por suscripcion: la app elige los campos y cada cuantos ticks de control los quiere.
+ * El tick de control solo copia el registro del ciclo a un buffer circular; el armado de los frames
+ * (varias muestras por frame, con marca de tiempo y en deltas) lo hace la tarea de comunicaciones.
+ *
+ * Frame, little endian:
+ *   u16 headerPackage (HEADER_PACKAGE_TELEMETRY_BATCH), u16 largo total del frame, u32 fieldMask,
+ *   u32 timestampUs de la primera muestra, u32 cycle de la primera muestra, u8 cantidad de muestras
+ *   por muestra: varint con los us desde la anterior (no va en la primera), y por cada campo del
+ *   mask en orden de bit un varint zigzag con la diferencia contra la muestra anterior (la primera
+ *   va contra 0). Cada frame se decodifica solo, sin depender de los anteriores.
+ */
+
+#define TELEMETRY_STREAM_RING           64              // muestras pendientes, ~640 ms a 100 Hz
+#define TELEMETRY_STREAM_MAX_LATENCY_US 100000          // un frame incompleto sale igual despues de este tiempo
+#define TELEMETRY_STREAM_HEADER_SIZE    17
+#define TELEMETRY_STREAM_FRAME_MAX      128             // un frame de transmision, ver tx_frame_pool.h
+
+/* Campos int16 de flight_record_t, el indice es el bit en fieldMask */
+enum {
+    TELEMETRY_FIELD_PITCH,
+    TELEMETRY_FIELD_ROLL,
+    TELEMETRY_FIELD_YAW,
+    TELEMETRY_FIELD_PID_OUTPUT_ANGLE,
+    TELEMETRY_FIELD_PID_OUTPUT_POS,
+    TELEMETRY_FIELD_PID_OUTPUT_SPEED,
+    TELEMETRY_FIELD_PID_OUTPUT_YAW,
+    TELEMETRY_FIELD_PID_ITERM_ANGLE,
+    TELEMETRY_FIELD_PID_ITERM_POS,
+    TELEMETRY_FIELD_PID_ITERM_SPEED,
+    TELEMETRY_FIELD_PID_ITERM_YAW,
+    TELEMETRY_FIELD_SETPOINT_ANGLE,
+    TELEMETRY_FIELD_SETPOINT_POS,
+    TELEMETRY_FIELD_SETPOINT_SPEED,
+    TELEMETRY_FIELD_SETPOINT_YAW,
+    TELEMETRY_FIELD_MOTOR_L,
+    TELEMETRY_FIELD_MOTOR_R,
+    TELEMETRY_FIELDS_COUNT
+};
+
+typedef struct {
+    uint32_t samples;                                   // muestras guardadas para enviar
+    uint32_t overflows;                                 // muestras descartadas con el buffer lleno
+    uint32_t frames;
+    uint32_t bytes;
+} telemetry_stream_stats_t;
+
+/*
+ * Cambia la suscripcion, desde cualquier tarea. fieldMask 0 la corta y descarta lo pendiente.
+ * decimation 1 = una muestra por tick de control; samplesPerFrame se limita a lo que entra en un frame.
+ */
+void telemetryStreamSubscribe(uint32_t fieldMask, uint8_t decimation, uint8_t samplesPerFrame);
+
+bool telemetryStreamIsActive(void);
+
+/*
+ * Guarda el registro del ciclo si toca por la decimacion, solo desde la tarea del tick de control
+ */
+void telemetryStreamWrite(const flight_record_t *record, int64_t timestampUs);
+
+/*
+ * Arma un frame con las muestras pendientes, solo desde la tarea de comunicaciones. Espera a juntar
+ * samplesPerFrame salvo que la mas vieja supere TELEMETRY_STREAM_MAX_LATENCY_US.
+ * @return bytes del frame en out, 0 si todavia no hay que enviar
+ */
+size_t telemetryStreamBuildFrame(uint8_t *out, size_t outSize, int64_t nowUs);
+
+void telemetryStreamGetStats(telemetry_stream_stats_t *stats);
+
+#endif
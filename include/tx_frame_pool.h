@@ -0,0 +1,106 @@
+#ifndef __TX_FRAME_POOL_H__
+#define __TX_FRAME_POOL_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Frames de transmision preasignados. El productor (commsManager) pide un frame, arma el paquete
+ * directamente adentro y lo encola por puntero; la tarea del socket lo envia desde el mismo frame
+ * y lo devuelve al pool. No hay copias intermedias ni un buffer comun que se resetee entero:
+ * si no hay frames libres el paquete no se arma y se cuenta.
+ *
+ * Dos clases de trafico:
+ *  - TX_CLASS_RELIABLE (configuracion, caja negra): cola FIFO que sale primero, con
+ *    TX_FRAME_POOL_RESERVED frames que la telemetria no puede usar. Nunca se descartan por
+ *    congestion; si no consiguen frame el productor reintenta en el proximo ciclo.
+ *  - TX_CLASS_TELEMETRY: los paquetes que son una foto del estado (status, tiempos, contadores) van a
+ *    un slot por tipo y el nuevo reemplaza al que todavia no salio, en lugar de hacer cola detras.
+ *    Los frames de telemetria por suscripcion van en FIFO (cada uno trae muestras distintas).
+ */
+
+#define TX_FRAME_POOL_FRAMES    11                      // alcanza para los TX_LATEST_COUNT slots, la reserva y la telemetria
+#define TX_FRAME_POOL_RESERVED  2                       // de los anteriores, solo para TX_CLASS_RELIABLE
+#define TX_FRAME_SIZE           128                     // el paquete mas grande es un frame de telemetria
+
+enum {
+    TX_CLASS_RELIABLE,
+    TX_CLASS_TELEMETRY,
+    TX_CLASS_COUNT
+};
+
+// Slots de TX_CLASS_TELEMETRY donde el ultimo valor reemplaza al pendiente
+enum {
+    TX_LATEST_STATUS,
+    TX_LATEST_LOOP_TIMING,
+    TX_LATEST_TX_STATS,
+    TX_LATEST_LINK_STATUS,
+    TX_LATEST_IMU_STATUS,
+    TX_LATEST_COUNT
+};
+
+typedef struct {
+    uint16_t len;
+    uint8_t  txClass;
+    uint8_t  fromReserve;                               // vuelve a la reserva de TX_CLASS_RELIABLE al liberarse
+    union {
+        uint8_t  data[TX_FRAME_SIZE];
+        uint32_t align;                                 // para armar los paquetes casteando data
+    };
+} tx_frame_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;
+    uint32_t allocFailures;                             // paquetes que no se armaron por falta de frames
+    uint32_t drops;                                     // frames encolados que no llegaron al socket
+    uint32_t overwritten;                               // reemplazados en su slot por uno mas nuevo antes de salir
+} tx_class_stats_t;
+
+typedef struct {
+    tx_class_stats_t classes[TX_CLASS_COUNT];
+} tx_frame_pool_stats_t;
+
+void txFramePoolInit(void);
+
+/*
+ * Productor, no bloquea. TX_CLASS_RELIABLE usa primero la reserva y despues los compartidos.
+ * @return frame libre, NULL si no hay para la clase
+ */
+tx_frame_t *txFrameAlloc(uint8_t txClass);
+
+/*
+ * Encola el frame al final de la cola de su clase, con len bytes validos en data
+ */
+void txFrameSubmit(tx_frame_t *frame, uint16_t len);
+
+/*
+ * Deja el frame de TX_CLASS_TELEMETRY en el slot, liberando el que estaba esperando ahi
+ */
+void txFrameSubmitLatest(tx_frame_t *frame, uint16_t len, uint8_t slot);
+
+/*
+ * Devuelve un frame pedido que al final no se uso, no cuenta como descartado
+ */
+void txFrameFree(tx_frame_t *frame);
+
+/*
+ * Consumidor (tarea del socket): el proximo frame a enviar, primero los confiables, despues los
+ * slots y al final la telemetria por suscripcion. NULL si vence la espera
+ */
+tx_frame_t *txFrameReceive(TickType_t ticksToWait);
+
+/*
+ * Devuelve al pool un frame recibido o pedido, contandolo como enviado o descartado
+ */
+void txFrameRelease(tx_frame_t *frame, bool sent);
+
+/*
+ * Descarta los frames pendientes de todas las clases, al abrir una conexion nueva
+ */
+void txFramePoolFlush(void);
+
+void txFramePoolGetStats(tx_frame_pool_stats_t *stats);
+
+#endif
@@ -2,19 +2,29 @@
 
 #include "stdio.h"
 
-pid_control_t pidControl[CANT_PIDS];
+#ifdef PID_FIXED_POINT
+    #include "PID_fixed.h"
+#endif
+
+static pid_bank_t pidBank;
+
+#ifdef PID_FIXED_POINT
+static pid_fixed_t pidFixed[CANT_PIDS];
+#endif
 
 float normalize(float value);
 
 esp_err_t pidInit(pid_init_t initConfig) {
 
-    if (initConfig.sampleTimeInMs > MAX_PERIOD_PID || initConfig.sampleTimeInMs < MIN_PERIOD_PID) {
-        return ESP_FAIL;
+    for(uint8_t i=0;i<CANT_PIDS;i++) { 
+        if (initConfig.sampleTimeInMs[i] > MAX_PERIOD_PID || initConfig.sampleTimeInMs[i] < MIN_PERIOD_PID) {
+            return ESP_FAIL;
+        }
     }
 
     for(uint8_t i=0;i<CANT_PIDS;i++) { 
-        pidControl[i].sampleTimeInSec = initConfig.sampleTimeInMs / 1000.00;
-        pidControl[i].enablePID = false;
+        pidBank.sampleTimeInSec[i] = initConfig.sampleTimeInMs[i] / 1000.0f;
+        pidBank.enablePID[i] = false;
         pidSetConstants(i,initConfig.pids[i].kp, initConfig.pids[i].ki, initConfig.pids[i].kd);
         pidSetSetPoint(i,initConfig.pids[i].setPoint);
     }
@@ -22,88 +32,163 @@ esp_err_t pidInit(pid_init_t initConfig) {
 }
 
 void pidSetEnable(uint8_t numPid) {
-    // pidControl[numPid].iTerm = 0.00;
-    // pidControl[numPid].lastInput = 0.00;
-    pidControl[numPid].enablePID = true;
+    // pidBank.iTerm[numPid] = 0.00;
+    // pidBank.lastInput[numPid] = 0.00;
+    pidBank.enablePID[numPid] = true;
 }
 
 void pidSetDisable(uint8_t numPid) {
-    pidControl[numPid].enablePID = false;
-    // pidControl[numPid].iTerm = 0.00;
-    // pidControl[numPid].lastInput = 0.00;
+    pidBank.enablePID[numPid] = false;
+    // pidBank.iTerm[numPid] = 0.00;
+    // pidBank.lastInput[numPid] = 0.00;
 }
 
 bool pidGetEnable(uint8_t numPid) {
-    return pidControl[numPid].enablePID;
+    return pidBank.enablePID[numPid];
 }
 
 float normalize(float value) {
-    return (value / 100.00);
+    return (value * 0.01f);       // multiplicar por la inversa evita una division por ciclo
 }
 
 float cutNormalizeLimits(float normalizeInput) {
-    if (normalizeInput > 1.00) {  // recorto el termino integral maximo
-        return 1.00;
-    } else if (normalizeInput < -1.00) {  // recorto el termino intgral minimo
-        return -1.00;
+    if (normalizeInput > 1.0f) {  // recorto el termino integral maximo
+        return 1.0f;
+    } else if (normalizeInput < -1.0f) {  // recorto el termino intgral minimo
+        return -1.0f;
     }
     return normalizeInput;
 }
 
+/* Misma operacion que cutNormalizeLimits pero sin saltos, para que el lazo de pidCalculateBatch vectorice */
+static inline float cutNormalizeLimitsBranchless(float value) {
+    value = value < 1.0f ? value : 1.0f;
+    return value > -1.0f ? value : -1.0f;
+}
+
 /*
  * Esta funcion debe ser llamada cada un periodo fijo definido en pidControl1.sampleTime
  * @param input entra en rango [-100;100]
  * @return resultado del PID normalizado [-1.00;1.00]
  */
 float pidCalculate(uint8_t numPid,float input) {
-        if (!pidControl[numPid].enablePID) {
+        if (!pidBank.enablePID[numPid]) {
             return 0;
         }
-        
+
+        #ifdef PID_FIXED_POINT
+            return pidFixedCalculate(&pidFixed[numPid], input);
+        #else
         float normalizeInput = normalize(input);
-        float error = pidControl[numPid].setPoint - normalizeInput;  													  // Error: diferencia entre el valor seteado y el de entrada
+        float error = pidBank.setPoint[numPid] - normalizeInput;  													  // Error: diferencia entre el valor seteado y el de entrada
         
-        pidControl[numPid].iTerm += pidControl[numPid].sampleTimeInSec * pidControl[numPid].ki * error;                                // calculo I: acumulo error multiplicado por ki contemplando el tiempo transcurrido desd el anterior
-        float dTerm = ((normalizeInput - pidControl[numPid].lastInput) * pidControl[numPid].kd) / pidControl[numPid].sampleTimeInSec;  // Calculo D: resto la entrada anterior a la actual
+        pidBank.iTerm[numPid] += pidBank.kiSampleTime[numPid] * error;                                        // calculo I: acumulo error multiplicado por ki contemplando el tiempo transcurrido desd el anterior
+        float dTerm = (normalizeInput - pidBank.lastInput[numPid]) * pidBank.kdDivSampleTime[numPid];         // Calculo D: resto la entrada anterior a la actual
 
-        pidControl[numPid].iTerm = cutNormalizeLimits(pidControl[numPid].iTerm);
+        pidBank.iTerm[numPid] = cutNormalizeLimits(pidBank.iTerm[numPid]);
         dTerm = cutNormalizeLimits(dTerm);
 
         /*Suma de errores*/
-        float output = (pidControl[numPid].kp * error) + pidControl[numPid].iTerm - dTerm;  													// opero con los 3 parametros para obtener salida, el D se resta para evitar la kick derivate
+        float output = (pidBank.kp[numPid] * error) + pidBank.iTerm[numPid] - dTerm;  													// opero con los 3 parametros para obtener salida, el D se resta para evitar la kick derivate
 
         // printf(">pidIn:%f\n>normPid:%f\n",input,normalizeInput);
 
-        pidControl[numPid].lastInput = normalizeInput;
+        pidBank.lastInput[numPid] = normalizeInput;
         return cutNormalizeLimits(output);
+        #endif
+}
+
+/*
+ * Calcula en una sola pasada los PID seleccionados en mask que esten habilitados.
+ * Se calculan todos y se descarta el resultado de los inactivos en lugar de saltearlos,
+ * asi el cuerpo del lazo no tiene saltos y recorre cada campo de pidBank en forma contigua.
+ */
+void pidCalculateBatch(uint32_t mask, const float *restrict inputs, float *restrict outputs) {
+    #ifdef PID_FIXED_POINT
+        for (uint8_t i = 0; i < CANT_PIDS; i++) {
+            outputs[i] = ((mask & PID_MASK(i)) && pidBank.enablePID[i]) ? pidFixedCalculate(&pidFixed[i], inputs[i]) : 0.0f;
+        }
+    #else
+    _Static_assert(CANT_PIDS == 4, "actualizar pidBits con CANT_PIDS");
+    static const uint32_t pidBits[CANT_PIDS] = {PID_MASK(0), PID_MASK(1), PID_MASK(2), PID_MASK(3)};     // tabla en lugar de 1 << i, SSE no tiene desplazamiento variable por lane
+
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        uint32_t active = ((mask & pidBits[i]) != 0) & (pidBank.enablePID[i] != 0);
+        float normalizeInput = normalize(inputs[i]);
+        float error = pidBank.setPoint[i] - normalizeInput;
+
+        float iTerm = cutNormalizeLimitsBranchless(pidBank.iTerm[i] + pidBank.kiSampleTime[i] * error);
+        float dTerm = cutNormalizeLimitsBranchless((normalizeInput - pidBank.lastInput[i]) * pidBank.kdDivSampleTime[i]);
+        float output = cutNormalizeLimitsBranchless((pidBank.kp[i] * error) + iTerm - dTerm);
+
+        pidBank.iTerm[i] = active ? iTerm : pidBank.iTerm[i];
+        pidBank.lastInput[i] = active ? normalizeInput : pidBank.lastInput[i];
+        outputs[i] = active ? output : 0.0f;
+    }
+    #endif
 }
 
 /*
  * Funcion para asignar un nuevo setPoint
  */
 void pidSetSetPoint(uint8_t numPid,float value) {
-    pidControl[numPid].setPoint = normalize(value);
+    pidBank.setPoint[numPid] = normalize(value);
+    #ifdef PID_FIXED_POINT
+        pidFixedSetSetPoint(&pidFixed[numPid], pidBank.setPoint[numPid]);
+    #endif
 }
 
 /*
  * Funcion para obtener el setPoint actual
  */
 float pidGetSetPoint(uint8_t numPid) {
-    return pidControl[numPid].setPoint * 100.00;
+    return pidBank.setPoint[numPid] * 100.0f;
+}
+
+/*
+ * Funcion para obtener el termino integral acumulado, normalizado [-1.00;1.00]
+ */
+float pidGetITerm(uint8_t numPid) {
+    #ifdef PID_FIXED_POINT
+        return (float)pidFixed[numPid].iTerm / Q30_ONE;
+    #else
+    return pidBank.iTerm[numPid];
+    #endif
 }
 
 /*
  * 	Funcion para cargar los parametros al filtro PID
  */
 void pidSetConstants(uint8_t numPid,float KP, float KI, float KD) {
-    pidControl[numPid].kp = KP;
-    pidControl[numPid].ki = KI;
-    pidControl[numPid].kd = KD;
-    pidControl[numPid].iTerm = 0.00;
-    pidControl[numPid].lastInput = 0.00;
+    pidBank.kp[numPid] = KP;
+    pidBank.ki[numPid] = KI;
+    pidBank.kd[numPid] = KD;
+    pidBank.kiSampleTime[numPid] = KI * pidBank.sampleTimeInSec[numPid];       // precalculados para no dividir en cada ciclo
+    pidBank.kdDivSampleTime[numPid] = KD / pidBank.sampleTimeInSec[numPid];
+    pidBank.iTerm[numPid] = 0.00;
+    pidBank.lastInput[numPid] = 0.00;
+    #ifdef PID_FIXED_POINT
+        pidFixedSetConstants(&pidFixed[numPid], KP, KI, KD, pidBank.sampleTimeInSec[numPid]);
+    #endif
+}
+
+esp_err_t pidSetSampleTime(uint8_t numPid, float sampleTimeInMs) {
+    if (sampleTimeInMs > MAX_PERIOD_PID || sampleTimeInMs < MIN_PERIOD_PID) {
+        return ESP_FAIL;
+    }
+    pidBank.sampleTimeInSec[numPid] = sampleTimeInMs / 1000.0f;
+    pidBank.kiSampleTime[numPid] = pidBank.ki[numPid] * pidBank.sampleTimeInSec[numPid];
+    pidBank.kdDivSampleTime[numPid] = pidBank.kd[numPid] / pidBank.sampleTimeInSec[numPid];
+    #ifdef PID_FIXED_POINT
+        pidFixedSetSampleTime(&pidFixed[numPid], pidBank.ki[numPid], pidBank.kd[numPid], pidBank.sampleTimeInSec[numPid]);
+    #endif
+    return ESP_OK;
 }
 
 void pidClearTerms(uint8_t numPid) {
-    pidControl[numPid].iTerm = 0.00;
-    pidControl[numPid].lastInput = 0.00;
+    pidBank.iTerm[numPid] = 0.00;
+    pidBank.lastInput[numPid] = 0.00;
+    #ifdef PID_FIXED_POINT
+        pidFixedClearTerms(&pidFixed[numPid]);
+    #endif
 }
@@ -0,0 +1,95 @@
+#include "PID_fixed.h"
+
+#define Q24_FROM_NORMALIZE      (16777216.0f / 100.0f)      // entrada [-100;100] a Q8.24 normalizado
+#define Q16_TO_FLOAT            (1.0f / 65536.0f)
+
+/* Redondeo al mas cercano sin pasar por lroundf (llamada a libm en el ESP32) */
+static q16_t roundToQ16(float scaled) {
+    return (q16_t)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+static int32_t saturateToInt32(float scaled) {
+    if (scaled >= 2147483647.0f) {
+        return INT32_MAX;
+    }
+    else if (scaled <= -2147483648.0f) {
+        return INT32_MIN;
+    }
+    return roundToQ16(scaled);
+}
+
+static q16_t floatToQ16(float value) {
+    return saturateToInt32(value * 65536.0f);
+}
+
+static q16_t mulQ16(q16_t a, q16_t b) {
+    int64_t product = ((int64_t)a * b) >> 16;
+    if (product > INT32_MAX) {
+        return INT32_MAX;
+    }
+    else if (product < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (q16_t)product;
+}
+
+static q16_t cutNormalizeLimitsQ16(q16_t value) {
+    if (value > Q16_ONE) {
+        return Q16_ONE;
+    }
+    else if (value < -Q16_ONE) {
+        return -Q16_ONE;
+    }
+    return value;
+}
+
+void pidFixedSetConstants(pid_fixed_t *pid, float kp, float ki, float kd, float sampleTimeInSec) {
+    pid->kp = floatToQ16(kp);
+    pidFixedSetSampleTime(pid, ki, kd, sampleTimeInSec);
+    pidFixedClearTerms(pid);
+}
+
+void pidFixedSetSampleTime(pid_fixed_t *pid, float ki, float kd, float sampleTimeInSec) {
+    pid->kiSampleTime = floatToQ16(ki * sampleTimeInSec);
+    pid->kdDivSampleTime = floatToQ16(kd / sampleTimeInSec);
+}
+
+void pidFixedSetSetPoint(pid_fixed_t *pid, float normalizedSetPoint) {
+    pid->setPoint = floatToQ16(normalizedSetPoint);
+}
+
+void pidFixedClearTerms(pid_fixed_t *pid) {
+    pid->iTerm = 0;
+    pid->lastInput = 0;
+}
+
+float pidFixedCalculate(pid_fixed_t *pid, float input) {
+    q24_t normalizeInput24 = saturateToInt32(input * Q24_FROM_NORMALIZE);
+    q16_t normalizeInput = (normalizeInput24 + (1 << 7)) >> 8;
+    q16_t error = pid->setPoint - normalizeInput;
+
+    // Q16 * Q16 = Q32, >> 2 para acumular en Q30
+    int64_t iTerm = (int64_t)pid->iTerm + (((int64_t)pid->kiSampleTime * error) >> 2);
+    if (iTerm > Q30_ONE) {
+        iTerm = Q30_ONE;
+    }
+    else if (iTerm < -Q30_ONE) {
+        iTerm = -Q30_ONE;
+    }
+    pid->iTerm = (q30_t)iTerm;
+
+    // Q24 * Q16 >> 24 = Q16, saturado antes de recortar a [-1;1]
+    int64_t dTerm64 = ((int64_t)normalizeInput24 - pid->lastInput) * pid->kdDivSampleTime >> 24;
+    q16_t dTerm = cutNormalizeLimitsQ16(dTerm64 > INT32_MAX ? INT32_MAX : dTerm64 < INT32_MIN ? INT32_MIN : (q16_t)dTerm64);
+
+    int64_t output = (int64_t)mulQ16(pid->kp, error) + (pid->iTerm >> 14) - dTerm;
+    if (output > Q16_ONE) {
+        output = Q16_ONE;
+    }
+    else if (output < -Q16_ONE) {
+        output = -Q16_ONE;
+    }
+
+    pid->lastInput = normalizeInput24;
+    return (float)output * Q16_TO_FLOAT;
+}
@@ -3,123 +3,399 @@
 #include "freertos/queue.h"
 #include "freertos/stream_buffer.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "comms.h"
+#include "comms_frame.h"
+#include "comms_codec.h"
 #include "storage_flash.h"
+#include "tx_frame_pool.h"
 #include <string.h>
 
+#include "../components/TCP_CLIENT/include/TCP_CLIENT.h"
+
 extern StreamBufferHandle_t xStreamBufferReceiver;
-extern StreamBufferHandle_t xStreamBufferSender;
+
+_Static_assert(TELEMETRY_STREAM_FRAME_MAX <= TX_FRAME_SIZE, "el frame de telemetria no entra en un frame de transmision");
 
 // queues de recepcion externa
 extern QueueHandle_t newPidParamsQueueHandler;
 extern QueueHandle_t receiveControlQueueHandler;
 extern QueueHandle_t newCommandQueueHandler;
 
-TaskHandle_t commsHandle;
+static TaskHandle_t commsHandle;
+static comms_frame_parser_t parser;
+static comms_rx_stats_t rxStats;                        // solo los escribe communicationHandler
+
+/*
+ * Frescura de cada stream de la app, con el esp_timer_get_time del ultimo paquete valido. La escribe
+ * communicationHandler y el failsafe (desde la tarea de esp_timer), la lee commsManager: los int64
+ * no se leen de una vez en el ESP32, por eso la seccion critica
+ */
+typedef struct {
+    int64_t  lastUs;
+    uint32_t packets;
+} comms_freshness_t;
+
+static comms_freshness_t freshness[COMMS_STREAM_COUNT];
+static uint8_t failsafeActive = true;                   // sin app todavia el joystick arranca en cero
+static uint16_t failsafeCount;
+static portMUX_TYPE freshnessMux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t controlDeadman;
+static control_app_raw_t lastControl;                  // con freshnessMux, para reponerlo si el deadman lo piso
 
 static void communicationHandler(void * param);
 
-void spp_wr_task_start_up(void){
-    xTaskCreatePinnedToCore(communicationHandler, "communicationHandler", 4096, NULL, 10, &commsHandle,COMMS_HANDLER_CORE);
+/*
+ * Vencio COMMS_CONTROL_TIMEOUT_US sin control: un solo joystick en cero, que reemplaza a lo que
+ * hubiera en la cola. Corre en la tarea de esp_timer, no depende de la carga de communicationHandler.
+ * Puede correr a la vez que receiveControl: el vencimiento se decide con freshnessMux y, si entro un
+ * control mientras se publicaba el cero, se vuelve a publicar ese control.
+ */
+static void controlDeadmanExpired(void *arg) {
+    control_app_raw_t stop = {.headerPackage = HEADER_PACKAGE_CONTROL};
+    int64_t nowUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&freshnessMux);
+    uint32_t packets = freshness[COMMS_STREAM_CONTROL].packets;
+    bool expired = !failsafeActive && nowUs - freshness[COMMS_STREAM_CONTROL].lastUs >= COMMS_CONTROL_TIMEOUT_US;
+    if (expired) {
+        failsafeActive = true;
+        failsafeCount++;
+    }
+    portEXIT_CRITICAL(&freshnessMux);
+    if (!expired) {                                     // llego un control despues de que se disparo el timer
+        return;
+    }
+
+    xQueueOverwrite(receiveControlQueueHandler, &stop);
+
+    portENTER_CRITICAL(&freshnessMux);
+    bool refreshed = freshness[COMMS_STREAM_CONTROL].packets != packets;
+    control_app_raw_t control = lastControl;
+    portEXIT_CRITICAL(&freshnessMux);
+    if (refreshed) {
+        xQueueOverwrite(receiveControlQueueHandler, &control);
+        return;
+    }
+    ESP_LOGW("COMMS", "Sin control de la app por %d ms, joystick en cero", COMMS_CONTROL_TIMEOUT_US / 1000);
 }
 
-void spp_wr_task_shut_down(void) {
-    vTaskDelete(commsHandle);
+void commsInit(void) {
+    // Una sola tarea puede quedar bloqueada leyendo el stream buffer, vive mientras viva el robot
+    if (commsHandle == NULL) {
+        const esp_timer_create_args_t deadmanArgs = {
+            .callback = controlDeadmanExpired,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "controlDeadman",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&deadmanArgs, &controlDeadman));
+        xTaskCreatePinnedToCore(communicationHandler, "communicationHandler", 4096, NULL, 10, &commsHandle,COMMS_HANDLER_CORE);
+    }
 }
 
-uint32_t getUint32( uint32_t index, char* payload){
-    return (((uint32_t)payload[index+3]) << 24) + (((uint32_t)payload[index+2]) << 16) + (((uint32_t)payload[index+1]) << 8) + payload[index];
+void commsConnectionOpened(void) {
+    // TCP_CLIENT la llama en cada conexion, antes de recibir nada: la app nueva se vuelve a suscribir
+    telemetryStreamSubscribe(0, 1, 1);
 }
 
-uint32_t getUint16( uint16_t index, char* payload){
-    return (((uint32_t)payload[index+1]) << 8) + payload[index];
+static void queuePacket(QueueHandle_t queue, const void *item) {
+    rxStats.queued++;
+    if (!xQueueSend(queue, item, 0)) {
+        rxStats.queueDrops++;
+    }
 }
 
-void communicationHandler(void * param) {
-    char received_data[100];
-    uint16_t contTimeout = 0;
-    pid_settings_app_raw_t      newPidSettingsRaw;
+static void markFresh(uint8_t stream) {
+    int64_t nowUs = esp_timer_get_time();
+    portENTER_CRITICAL(&freshnessMux);
+    freshness[stream].lastUs = nowUs;
+    freshness[stream].packets++;
+    portEXIT_CRITICAL(&freshnessMux);
+}
+
+/*
+ * El ultimo control reemplaza al que commsManager todavia no leyo (la cola es de 1) y rearma el
+ * failsafe: vence COMMS_CONTROL_TIMEOUT_US despues de este paquete, con la resolucion de esp_timer.
+ * El timer se detiene y el control se marca fresco antes de publicarlo, asi un vencimiento en curso
+ * no lo pisa con el cero (ver controlDeadmanExpired)
+ */
+static void receiveControl(const control_app_raw_t *control) {
+    rxStats.queued++;
+    if (uxQueueMessagesWaiting(receiveControlQueueHandler)) {
+        rxStats.queueDrops++;
+    }
+
+    esp_timer_stop(controlDeadman);                     // ESP_ERR_INVALID_STATE si ya habia vencido
+    int64_t nowUs = esp_timer_get_time();
+    portENTER_CRITICAL(&freshnessMux);
+    freshness[COMMS_STREAM_CONTROL].lastUs = nowUs;
+    freshness[COMMS_STREAM_CONTROL].packets++;
+    lastControl = *control;
+    failsafeActive = false;
+    portEXIT_CRITICAL(&freshnessMux);
+
+    xQueueOverwrite(receiveControlQueueHandler, control);
+    esp_timer_start_once(controlDeadman, COMMS_CONTROL_TIMEOUT_US);
+}
+
+/*
+ * Despacha un paquete ya validado por el entramado, el payload empieza con headerPackage
+ */
+static void dispatchPacket(const uint8_t *payload, uint16_t len) {
     pid_settings_comms_t        pidSettingsComms;
-    control_app_raw_t           newControlVal;
-    command_app_raw_t           newCommand;
-    
-    while(true) {
-        BaseType_t bytes_received = xStreamBufferReceive(xStreamBufferReceiver, received_data, sizeof(received_data), 0);//25);
-
-        if (bytes_received > 1) {
-            uint16_t headerPackage = getUint16(0,received_data);
-            switch(headerPackage) {
-                case HEADER_PACKAGE_SETTINGS: 
-                    if (bytes_received == sizeof(newPidSettingsRaw)) {
-                        memcpy(&newPidSettingsRaw,received_data,bytes_received);
- 
-                        pidSettingsComms.indexPid = newPidSettingsRaw.indexPid;            // TODO: actualizar nuevos pid_floats_t
-                        pidSettingsComms.safetyLimits = newPidSettingsRaw.safetyLimits / PRECISION_DECIMALS_COMMS;
-                        pidSettingsComms.centerAngle = newPidSettingsRaw.centerAngle / PRECISION_DECIMALS_COMMS;
-                        pidSettingsComms.kp = newPidSettingsRaw.kp / PRECISION_DECIMALS_COMMS;
-                        pidSettingsComms.ki = newPidSettingsRaw.ki / PRECISION_DECIMALS_COMMS;
-                        pidSettingsComms.kd = newPidSettingsRaw.kd / PRECISION_DECIMALS_COMMS;
-                        xQueueSend(newPidParamsQueueHandler,(void*)&pidSettingsComms,0);
-                    }
-                break;
-
-                case HEADER_PACKAGE_CONTROL:
-                    // if (bytes_received == sizeof(newControlVal)) {  
-                    memcpy(&newControlVal,received_data,sizeof(newControlVal));//bytes_received);
-                    contTimeout = 0;
-                    // printf("NewControl recibido!\n");
-                    xQueueSend(receiveControlQueueHandler,(void*)&newControlVal,0);
-
-                break;
-
-                case HEADER_PACKAGE_COMMAND:
-                    if (bytes_received == sizeof(newCommand)) { 
-                        memcpy(&newCommand,received_data,bytes_received); 
-                        xQueueSend(newCommandQueueHandler,(void*)&newCommand,0); 
-                    }
-                break;
-                default:
-                    printf("\n\nComando no reconocido: %x\n\n",headerPackage); 
-                break;
+    control_app_raw_t           newControlVal = {.headerPackage = HEADER_PACKAGE_CONTROL};
+    command_app_raw_t           newCommand = {.headerPackage = HEADER_PACKAGE_COMMAND};
+    telemetry_subscribe_app_raw_t newSubscription;
+
+    if (len < sizeof(uint16_t)) {
+        rxStats.badLength++;
+        return;
+    }
+    // Los decodificadores leen byte a byte, el payload puede no estar alineado
+    uint16_t headerPackage = commsGetU16(payload);
+    switch(headerPackage) {
+        case HEADER_PACKAGE_SETTINGS:
+            if (commsDecodeSettings(payload, len, &pidSettingsComms)) {
+                queuePacket(newPidParamsQueueHandler,&pidSettingsComms);        // TODO: actualizar nuevos pid_floats_t
+                markFresh(COMMS_STREAM_SETTINGS);
             }
-        }
-        vTaskDelay(pdMS_TO_TICKS(10));  
-        contTimeout++;
-        if (contTimeout > TIMEOUT_COMMS) {
-            newControlVal.axisX = 0;
-            newControlVal.axisY = 0;
-            xQueueSend(receiveControlQueueHandler,(void*)&newControlVal,0);
+            else {
+                rxStats.badLength++;
+            }
+        break;
+
+        case HEADER_PACKAGE_CONTROL:
+            if (commsDecodeControl(payload, len, &newControlVal)) {
+                receiveControl(&newControlVal);
+            }
+            else {
+                rxStats.badLength++;
+            }
+        break;
+
+        case HEADER_PACKAGE_COMMAND:
+            if (commsDecodeCommand(payload, len, &newCommand)) {
+                queuePacket(newCommandQueueHandler,&newCommand);
+                markFresh(COMMS_STREAM_COMMAND);
+            }
+            else {
+                rxStats.badLength++;
+            }
+        break;
+
+        case HEADER_PACKAGE_TELEMETRY_SUBSCRIBE:
+            if (commsDecodeTelemetrySubscribe(payload, len, &newSubscription)) {
+                telemetryStreamSubscribe(newSubscription.fieldMask, newSubscription.decimation, newSubscription.samplesPerFrame);
+            }
+            else {
+                rxStats.badLength++;
+            }
+        break;
+        default:
+            rxStats.unknownPackets++;
+            printf("\n\nComando no reconocido: %x\n\n",headerPackage);
+        break;
+    }
+}
+
+void communicationHandler(void * param) {
+    commsFrameParserInit(&parser);
+
+    while(true) {
+        // Recibo directo en el buffer del parser, los frames se despachan desde ahi sin copiarlos.
+        // Se despierta apenas TCP_CLIENT escribe; el failsafe lo maneja controlDeadman, sin timeout aca
+        size_t space;
+        uint8_t *dest = commsFrameParserWritePtr(&parser, &space);
+        size_t bytes_received = xStreamBufferReceive(xStreamBufferReceiver, dest, space, portMAX_DELAY);
+        commsFrameParserCommit(&parser, bytes_received);
+
+        comms_frame_t frame;
+        while (commsFrameParserNext(&parser, &frame)) {
+            dispatchPacket(frame.payload, frame.len);
         }
     }
     vTaskDelete(NULL);
 }
 
-void sendDynamicData(robot_dynamic_data_t dynamicData) {
+void commsGetRxStats(comms_rx_stats_t *stats) {
+    *stats = rxStats;
+    stats->frames = parser.stats;
+}
+
+void commsGetLinkStatus(comms_link_status_t *status) {
+    comms_freshness_t streams[COMMS_STREAM_COUNT];
+    int64_t nowUs = esp_timer_get_time();
 
-    dynamicData.headerPackage = HEADER_PACKAGE_STATUS;
+    portENTER_CRITICAL(&freshnessMux);
+    memcpy(streams, freshness, sizeof(streams));
+    status->failsafeActive = failsafeActive;
+    status->failsafeCount = failsafeCount;
+    portEXIT_CRITICAL(&freshnessMux);
 
-    if (xStreamBufferSend(xStreamBufferSender, &dynamicData, sizeof(dynamicData), 1) != sizeof(dynamicData)) {
-        /* TODO: Manejar el caso en el que el buffer está lleno y no se pueden enviar datos */
-        ESP_LOGI("COMMS", "Overflow stream buffer dynamic data, is full?: %d, resetting...",xStreamBufferIsFull(xStreamBufferSender));
-        xStreamBufferReset(xStreamBufferSender);
+    for (uint8_t i = 0; i < COMMS_STREAM_COUNT; i++) {
+        int64_t ageMs = (nowUs - streams[i].lastUs) / 1000;
+        status->packets[i] = streams[i].packets;
+        status->ageMs[i] = !streams[i].packets ? COMMS_AGE_NEVER : ageMs < COMMS_AGE_NEVER ? ageMs : COMMS_AGE_NEVER - 1;
     }
 }
 
-void sendLocalConfig(robot_local_configs_t localConfig) {
-    robot_local_configs_comms_t localConfigRaw;
+void sendDynamicData(const robot_snapshot_t *snapshot) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_TELEMETRY);
+    if (frame == NULL) {
+        return;                                         // ya contado en el pool, el proximo status lo reemplaza
+    }
 
-    localConfigRaw.headerPackage = HEADER_PACKAGE_LOCAL_CONFIG;
-    localConfigRaw.centerAngle = localConfig.centerAngle * PRECISION_DECIMALS_COMMS;
-    localConfigRaw.safetyLimits = localConfig.safetyLimits * PRECISION_DECIMALS_COMMS;
+    const status_robot_t *status = &snapshot->status;
+    robot_dynamic_data_t dynamicData = {
+        .batVoltage = status->batVoltage,
+        .imuTemp = status->tempImu * PRECISION_DECIMALS_COMMS,
+        .mcbTemp = status->tempMcb * PRECISION_DECIMALS_COMMS,                  // Ya esta multiplicada por 1000 desde la mcb
+        .mainboardTemp = status->tempMainboard,
+        .speedR = status->speedR,
+        .speedL = status->speedL,
+        .pitch =  status->actualPitch * PRECISION_DECIMALS_COMMS,
+        .roll = status->actualRoll * PRECISION_DECIMALS_COMMS,
+        .yaw = status->actualYaw * PRECISION_DECIMALS_COMMS,
+        .posInMeters = ((status->posInMetersL + status->posInMetersR) / 2) * PRECISION_DECIMALS_COMMS,
+        .outputYawControl = status->outputYawControl * PRECISION_DECIMALS_COMMS,
+        .setPointAngle = status->localConfig.pids[PID_ANGLE].setPoint * PRECISION_DECIMALS_COMMS,
+        .setPointPos = status->localConfig.pids[PID_POS].setPoint,                      // No lo multiplico, para mandarlo en mts
+        .setPointYaw = status->localConfig.pids[PID_YAW].setPoint * PRECISION_DECIMALS_COMMS,
+        .setPointSpeed = status->localConfig.pids[PID_SPEED].setPoint * PRECISION_DECIMALS_COMMS,
+        .centerAngle = status->localConfig.centerAngle * PRECISION_DECIMALS_COMMS,
+        .statusCode = status->statusCode
+    };
 
-    for(uint8_t i=0;i<CANT_PIDS;i++) {
-        localConfigRaw.pid[i] = convertPidFloatsToRaw(localConfig.pids[i]);
+#ifdef TELEMETRY_UDP
+    static uint16_t sequence;
+    robot_udp_status_t datagram = {
+        .sequence = sequence++,                         // tambien si no sale, la app lo ve como perdido
+        .status = dynamicData,
+    };
+    size_t len = commsEncodeStatusUdp(frame->data, sizeof(frame->data), &datagram);
+    if (!tcpClientSendDatagram(frame->data, len)) {
+        ESP_LOGD("COMMS", "Status UDP %u no enviado", datagram.sequence);
+        txFrameRelease(frame, false);
+        return;
     }
+    txFrameRelease(frame, true);
+#else
+    // Se codifica directo en el frame que va a leer el socket
+    txFrameSubmitLatest(frame, commsEncodeStatus(frame->data, sizeof(frame->data), &dynamicData), TX_LATEST_STATUS);
+#endif
+}
 
-    ESP_LOGI("SendLocalConfig","center: %d, safety: %d",localConfigRaw.centerAngle,localConfigRaw.safetyLimits);
+bool sendLocalConfig(robot_local_configs_t localConfig) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_RELIABLE);
+    if (frame == NULL) {
+        return false;
+    }
+    ESP_LOGI("SendLocalConfig","center: %.2f, safety: %.2f",localConfig.centerAngle,localConfig.safetyLimits);
+    txFrameSubmit(frame, commsEncodeLocalConfig(frame->data, sizeof(frame->data), &localConfig));
+    return true;
+}
 
-    if (xStreamBufferSend(xStreamBufferSender, &localConfigRaw, sizeof(localConfigRaw), 1) != sizeof(localConfigRaw)) {
-        /* TODO: Manejar el caso en el que el buffer está lleno y no se pueden enviar datos */
-         ESP_LOGI("COMMS", "BUFFER DE TRANSMISION OVERFLOW");
+static uint16_t saturateUs(uint32_t valueUs) {
+    return valueUs > UINT16_MAX ? UINT16_MAX : valueUs;
+}
+
+void sendLoopTiming(void) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_TELEMETRY);
+    if (frame == NULL) {
+        return;
     }
-}
\ No newline at end of file
+    robot_loop_timing_t loopTiming = {0};
+
+    for (uint8_t i = 0; i < LOOP_TIMING_COUNT; i++) {
+        loop_timing_stats_t stats;
+        loopTimingGetStats(i, &stats);
+        if (stats.samples > loopTiming.samplesPerLoop) {
+            loopTiming.samplesPerLoop = stats.samples;
+        }
+        loopTiming.loops[i] = (loop_timing_raw_t){
+            .periodMinUs = saturateUs(stats.periodMinUs),
+            .periodMaxUs = saturateUs(stats.periodMaxUs),
+            .periodMeanUs = saturateUs(stats.periodMeanUs),
+            .periodP99Us = saturateUs(stats.periodP99Us),
+            .execMinUs = saturateUs(stats.execMinUs),
+            .execMaxUs = saturateUs(stats.execMaxUs),
+            .execMeanUs = saturateUs(stats.execMeanUs),
+            .execP99Us = saturateUs(stats.execP99Us),
+        };
+    }
+
+    txFrameSubmitLatest(frame, commsEncodeLoopTiming(frame->data, sizeof(frame->data), &loopTiming), TX_LATEST_LOOP_TIMING);
+}
+
+void sendTxStats(void) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_TELEMETRY);
+    if (frame == NULL) {
+        return;
+    }
+    tx_frame_pool_stats_t stats;
+    txFramePoolGetStats(&stats);
+    txFrameSubmitLatest(frame, commsEncodeTxStats(frame->data, sizeof(frame->data), &stats), TX_LATEST_TX_STATS);
+}
+
+void sendLinkStatus(void) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_TELEMETRY);
+    if (frame == NULL) {
+        return;
+    }
+    comms_link_status_t status;
+    commsGetLinkStatus(&status);
+    txFrameSubmitLatest(frame, commsEncodeLinkStatus(frame->data, sizeof(frame->data), &status), TX_LATEST_LINK_STATUS);
+}
+
+void sendImuStatus(const imu_status_t *status) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_TELEMETRY);
+    if (frame == NULL) {
+        return;
+    }
+    txFrameSubmitLatest(frame, commsEncodeImuStatus(frame->data, sizeof(frame->data), status), TX_LATEST_IMU_STATUS);
+}
+
+void sendTelemetryBatch(void) {
+    for (uint8_t i = 0; i < TELEMETRY_BATCH_FRAMES_PER_CYCLE; i++) {
+        if (!telemetryStreamIsActive()) {
+            telemetryStreamBuildFrame(NULL, 0, 0);      // sin suscripcion solo descarta lo pendiente, no pide frame
+            return;
+        }
+        tx_frame_t *frame = txFrameAlloc(TX_CLASS_TELEMETRY);
+        if (frame == NULL) {
+            return;                                     // las muestras esperan en el buffer circular
+        }
+        size_t len = telemetryStreamBuildFrame(frame->data, sizeof(frame->data), esp_timer_get_time());
+        if (!len) {
+            txFrameFree(frame);
+            return;
+        }
+#ifdef TELEMETRY_UDP
+        txFrameRelease(frame, tcpClientSendDatagram(frame->data, len));        // cada frame se decodifica solo, perder uno no rompe los siguientes
+#else
+        txFrameSubmit(frame, len);
+#endif
+    }
+}
+
+bool sendFlightRecorderChunk(uint32_t firstRecord) {
+    tx_frame_t *frame = txFrameAlloc(TX_CLASS_RELIABLE);
+    if (frame == NULL) {
+        return false;
+    }
+
+    flight_recorder_info_t info;
+    flightRecorderGetInfo(&info);
+
+    robot_flight_recorder_chunk_t chunk = {
+        .totalRecords = info.records,
+        .firstRecord = firstRecord,
+        .triggerReason = info.triggerReason,
+        .triggerStatus = info.triggerStatus,
+        .triggerCycle = info.triggerCycle,
+    };
+    flightRecorderRead(firstRecord, chunk.records, FLIGHT_RECORDER_CHUNK_RECORDS);
+
+    txFrameSubmit(frame, commsEncodeFlightRecorder(frame->data, sizeof(frame->data), &chunk));
+    return true;
+}
@@ -0,0 +1,166 @@
+#include "comms_codec.h"
+#include "comms_frame.h"
+#include "tx_frame_pool.h"
+
+/*
+ * Las funciones de cada esquema se generan con las macros de abajo a partir de comms_codec.h.
+ * Encode devuelve el puntero despues del ultimo byte escrito; decode el puntero despues del ultimo
+ * byte leido, NULL si un CONST no coincide.
+ */
+
+/* ---------- primitivas little-endian ---------- */
+
+static inline uint8_t *commsPutU8(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    return p + 1;
+}
+
+static inline uint8_t *commsPutU16(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static inline uint8_t *commsPutU32(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+#define commsPutI8      commsPutU8
+#define commsPutI16     commsPutU16
+#define commsPutI32     commsPutU32
+
+static inline uint8_t commsGetU8(const uint8_t *p) {
+    return p[0];
+}
+
+static inline int8_t commsGetI8(const uint8_t *p) {
+    return (int8_t)p[0];
+}
+
+static inline int16_t commsGetI16(const uint8_t *p) {
+    return (int16_t)commsGetU16(p);
+}
+
+static inline uint32_t commsGetU32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline int32_t commsGetI32(const uint8_t *p) {
+    return (int32_t)commsGetU32(p);
+}
+
+#define COMMS_MIN_U8    0.0f
+#define COMMS_MAX_U8    255.0f
+#define COMMS_MIN_I8    -128.0f
+#define COMMS_MAX_I8    127.0f
+#define COMMS_MIN_U16   0.0f
+#define COMMS_MAX_U16   65535.0f
+#define COMMS_MIN_I16   -32768.0f
+#define COMMS_MAX_I16   32767.0f
+
+/*
+ * round(value * scale) saturado a [min;max]. Saturar antes de convertir es obligatorio: un float
+ * fuera del rango del entero es comportamiento indefinido en C
+ */
+static inline int32_t commsScale(float value, float scale, float min, float max) {
+    float scaled = value * scale;
+    scaled += scaled >= 0 ? 0.5f : -0.5f;
+    if (scaled <= min) {
+        return min;
+    }
+    if (scaled >= max) {
+        return max;
+    }
+    return (int32_t)scaled;
+}
+
+/* ---------- generacion ---------- */
+
+#define COMMS_IS_FLOAT(x)   _Generic((x), float: 1, default: 0)
+#define COMMS_COUNT(array)  (sizeof(array) / sizeof((array)[0]))
+
+#define COMMS_ENCODE_INT(name, wire, arg) \
+    _Static_assert(!COMMS_IS_FLOAT(in->name), #name ": INT con un float en memoria, usar SCALED"); \
+    p = commsPut##wire(p, in->name);
+#define COMMS_ENCODE_SCALED(name, wire, arg) \
+    _Static_assert(COMMS_IS_FLOAT(in->name), #name ": SCALED necesita un float en memoria"); \
+    _Static_assert(COMMS_WIRE_##wire <= 2, #name ": SCALED solo a 8 o 16 bits"); \
+    p = commsPut##wire(p, commsScale(in->name, (float)(arg), COMMS_MIN_##wire, COMMS_MAX_##wire));
+#define COMMS_ENCODE_INT_ARRAY(name, wire, arg) \
+    _Static_assert(COMMS_COUNT(in->name) == (arg), #name ": el largo no coincide con el esquema"); \
+    for (uint16_t i = 0; i < (arg); i++) { \
+        p = commsPut##wire(p, in->name[i]); \
+    }
+#define COMMS_ENCODE_STRUCT(name, wire, arg) \
+    p = commsEncodeSchema##wire(p, &in->name);
+#define COMMS_ENCODE_STRUCT_ARRAY(name, wire, arg) \
+    _Static_assert(COMMS_COUNT(in->name) == (arg), #name ": el largo no coincide con el esquema"); \
+    for (uint16_t i = 0; i < (arg); i++) { \
+        p = commsEncodeSchema##wire(p, &in->name[i]); \
+    }
+#define COMMS_ENCODE_CONST(name, wire, arg) \
+    p = commsPut##wire(p, (arg));
+#define COMMS_ENCODE_FIELD(kind, name, wire, arg) COMMS_ENCODE_##kind(name, wire, arg)
+
+#define COMMS_DECODE_INT(name, wire, arg) \
+    out->name = commsGet##wire(p); \
+    p += COMMS_WIRE_##wire;
+#define COMMS_DECODE_SCALED(name, wire, arg) \
+    out->name = commsGet##wire(p) * (1.0f / (float)(arg)); \
+    p += COMMS_WIRE_##wire;
+#define COMMS_DECODE_INT_ARRAY(name, wire, arg) \
+    for (uint16_t i = 0; i < (arg); i++) { \
+        out->name[i] = commsGet##wire(p); \
+        p += COMMS_WIRE_##wire; \
+    }
+#define COMMS_DECODE_STRUCT(name, wire, arg) \
+    if ((p = commsDecodeSchema##wire(p, &out->name)) == NULL) { \
+        return NULL; \
+    }
+#define COMMS_DECODE_STRUCT_ARRAY(name, wire, arg) \
+    for (uint16_t i = 0; i < (arg); i++) { \
+        if ((p = commsDecodeSchema##wire(p, &out->name[i])) == NULL) { \
+            return NULL; \
+        } \
+    }
+#define COMMS_DECODE_CONST(name, wire, arg) \
+    if (commsGet##wire(p) != (arg)) { \
+        return NULL; \
+    } \
+    p += COMMS_WIRE_##wire;
+#define COMMS_DECODE_FIELD(kind, name, wire, arg) COMMS_DECODE_##kind(name, wire, arg)
+
+#define COMMS_SCHEMA_DEFINE(name, type) \
+    static uint8_t *commsEncodeSchema##name(uint8_t *p, const type *in) { \
+        COMMS_SCHEMA_##name(COMMS_ENCODE_FIELD) \
+        return p; \
+    } \
+    static const uint8_t *commsDecodeSchema##name(const uint8_t *p, type *out) { \
+        COMMS_SCHEMA_##name(COMMS_DECODE_FIELD) \
+        return p; \
+    }
+
+#define COMMS_PACKET_DEFINE(name, header, type, layout) \
+    _Static_assert(COMMS_PACKET_SIZE_##name == sizeof(layout), #layout " no coincide con el esquema " #name); \
+    _Static_assert(COMMS_PACKET_SIZE_##name <= TX_FRAME_SIZE, #name " no entra en un frame de transmision"); \
+    _Static_assert(COMMS_PACKET_SIZE_##name <= COMMS_FRAME_MAX_PAYLOAD, #name " no entra en un frame de recepcion"); \
+    size_t commsEncode##name(uint8_t *out, size_t outSize, const type *in) { \
+        if (outSize < COMMS_PACKET_SIZE_##name) { \
+            return 0; \
+        } \
+        commsEncodeSchema##name(commsPutU16(out, header), in); \
+        return COMMS_PACKET_SIZE_##name; \
+    } \
+    bool commsDecode##name(const uint8_t *in, size_t len, type *out) { \
+        if (len != COMMS_PACKET_SIZE_##name || commsGetU16(in) != header) { \
+            return false; \
+        } \
+        return commsDecodeSchema##name(in + COMMS_WIRE_U16, out) != NULL; \
+    }
+
+COMMS_SCHEMAS(COMMS_SCHEMA_DEFINE)
+COMMS_PACKETS(COMMS_PACKET_DEFINE)
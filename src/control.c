@@ -0,0 +1,667 @@
+#include "stdlib.h"
+#include "stdio.h"
+#include "stdbool.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "control.h"
+#include "comms.h"
+#include "PID.h"
+#include "robot_snapshot.h"
+#include "loop_timing.h"
+#include "flight_recorder.h"
+#include "telemetry_stream.h"
+
+#define MAX_VELOCITY            1000.00
+#define MAX_CYCLES_LIMIT_SPEED  10
+#define MAX_VELOCITY_SPEED_CONTROL  500.00         // Velocidad maxima permitida OJO: NO PUEDE SER > 999 (para prevenir la proteccion de LIMIT_SPEED)
+
+#define MIN_PITCH_ARMED     1.00
+#define MIN_ROLL_ARMED      5.00
+
+#if defined(HARDWARE_S3)
+    #define MAX_ANGLE_JOYSTICK          4.0
+    #define MAX_ANGLE_CONTROL       10.0
+    #define MAX_ROTATION_RATE_CONTROL   25.0
+#else
+    #define MAX_ANGLE_JOYSTICK          8.0
+    #define MAX_ANGLE_CONTROL       15.0
+    #define MAX_ROTATION_RATE_CONTROL   100
+#endif
+
+status_robot_t statusRobot;
+output_motors_t speedMotors;
+output_motors_t attitudeControlMotor;
+
+attitude_control_stat_t attitudeControlStat = {
+    .attMode = ATT_MODE_ATTI,
+    .setPointPosCms = 0.00,
+    .setPointSpeed = 0.00,
+    .setPointYaw = 0.00,
+};
+
+static float safetyLimitProm[5];
+static uint8_t safetyLimitPromIndex = 0;
+
+static float desiredAngleControl = 0.00;
+static uint8_t isYawControlEnabled = false;
+
+static uint32_t controlCycle = 0;                   // ticks de control, base de la decimacion de cada etapa
+
+static uint32_t controlTickPeriodUs = CONTROL_TICK_PERIOD_US;     // medido por el tick, ver controlSetTickPeriodUs
+
+static QueueHandle_t controlInputQueue;
+static uint32_t controlInputDrops;
+static uint32_t localConfigSaves;                   // CONTROL_INPUT_SAVE_LOCAL_CONFIG aplicados, viaja en el snapshot
+
+typedef struct {
+    const char *name;
+    uint8_t numPid;
+    uint8_t level;                                  // las etapas de un nivel alimentan a las del siguiente en el mismo ciclo
+    uint8_t decimation;                             // corre cada `decimation` ticks de control
+    bool (*prepare)(float *input);
+    void (*apply)(float output);
+} control_stage_t;
+
+float pos2mts(int32_t steps) {
+    return (steps/STEPS_PER_REV) * DIST_PER_REV;
+}
+
+/*
+  * Calculo de distancia angular para el yaw, donde hay una discontinuidad entre -180 y 180, ya que en realidad ese salto no es tal.
+*/
+float angularDistance(float setPoint,float actualValue) {
+
+    float error = setPoint - actualValue;
+
+    if(error > 180.00) {
+        error -= 360.00;
+    }
+    else if(error < -180.00) {
+        error += 360.00;
+    }
+    return error + setPoint;
+}
+
+float cutAngle(float angleInput) {
+    if (angleInput > 180.00) {
+        angleInput -= 360;
+    }
+    else if (angleInput < -180.00) {
+        angleInput += 360;
+    }
+    return angleInput;
+}
+
+int16_t cutSpeedRange(int16_t speed) {
+    if (speed > 1000) {
+        return 1000;
+    }
+    else if (speed < -1000) {
+        return -1000;
+    }
+    else {
+        return speed;
+    }
+}
+
+int16_t backlashAttenuator(int16_t speed) {
+    const uint16_t backlash = 15;
+    if(speed > 0 && speed < backlash) {
+        speed = backlash;
+    }
+    else if (speed < 0 && speed > -backlash) {
+        speed = -backlash;
+    }
+    return speed;
+}
+
+void controlLoadDefaultConfig(robot_local_configs_t *localConfig) {
+    #ifdef HARDWARE_S3
+        localConfig->pids[PID_ANGLE].kp = 0.57;
+        localConfig->pids[PID_ANGLE].ki = 0.13;
+        localConfig->pids[PID_ANGLE].kd = 1.16;
+
+        localConfig->pids[PID_POS].kp = 0.84;
+        localConfig->pids[PID_POS].ki = 0.11;
+        localConfig->pids[PID_POS].kd = 1.27;
+
+        localConfig->pids[PID_YAW].kp = 2.00;
+        localConfig->pids[PID_YAW].ki = 0.3;
+        localConfig->pids[PID_YAW].kd = 0.00;
+
+        localConfig->pids[PID_SPEED].kp = 2.80;
+        localConfig->pids[PID_SPEED].ki = 0.41;
+        localConfig->pids[PID_SPEED].kd = 0.04;
+
+        localConfig->centerAngle = 0;
+        localConfig->safetyLimits = 60;//45;
+    #endif
+
+    #ifdef HARDWARE_PROTOTYPE
+        localConfig->pids[PID_ANGLE].kp = 1.48;
+        localConfig->pids[PID_ANGLE].ki = 0.52;
+        localConfig->pids[PID_ANGLE].kd = 0.21;
+
+        //TODO: ajustar parametros
+        localConfig->pids[PID_POS].kp = 2.0;
+        localConfig->pids[PID_POS].ki = 0.1;
+        localConfig->pids[PID_POS].kd = 2.73;
+
+        localConfig->pids[PID_YAW].kp = 2.00;
+        localConfig->pids[PID_YAW].ki = 0.3;
+        localConfig->pids[PID_YAW].kd = 0.00;
+
+        localConfig->pids[PID_SPEED].kp = 2.80;
+        localConfig->pids[PID_SPEED].ki = 0.41;
+        localConfig->pids[PID_SPEED].kd = 0.04;
+
+        localConfig->centerAngle = 4.9;
+        localConfig->safetyLimits = 45; // 35;
+    #endif
+
+    // Las de arriba estan en las unidades de la app y la flash
+    controlLocalConfigFromLegacy(localConfig);
+
+    localConfig->pids[PID_ANGLE].setPoint = localConfig->centerAngle;
+}
+
+/*
+ * Las ganancias de la app y la flash se ajustaron con pidInit recibiendo siempre PID_GAINS_REF_PERIOD_MS, sin
+ * importar la tasa real de cada lazo. Ahora cada PID recibe su periodo, asi que se convierten con el nominal
+ * para mantener la misma respuesta: ki * dt y kd / dt por muestra quedan iguales.
+ */
+static float controlGetPidNominalPeriodMs(uint8_t numPid);
+
+pid_floats_t controlPidGainsFromLegacy(uint8_t numPid, pid_floats_t gains) {
+    float periodMs = controlGetPidNominalPeriodMs(numPid);
+    gains.ki *= PID_GAINS_REF_PERIOD_MS / periodMs;
+    gains.kd *= periodMs / PID_GAINS_REF_PERIOD_MS;
+    return gains;
+}
+
+pid_floats_t controlPidGainsToLegacy(uint8_t numPid, pid_floats_t gains) {
+    float periodMs = controlGetPidNominalPeriodMs(numPid);
+    gains.ki *= periodMs / PID_GAINS_REF_PERIOD_MS;
+    gains.kd *= PID_GAINS_REF_PERIOD_MS / periodMs;
+    return gains;
+}
+
+void controlLocalConfigFromLegacy(robot_local_configs_t *localConfig) {
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        localConfig->pids[i] = controlPidGainsFromLegacy(i, localConfig->pids[i]);
+    }
+}
+
+robot_local_configs_t controlLocalConfigToLegacy(robot_local_configs_t localConfig) {
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        localConfig.pids[i] = controlPidGainsToLegacy(i, localConfig.pids[i]);
+    }
+    return localConfig;
+}
+
+void setStatusRobot(uint8_t newStatus) {
+    const char *TAG = "StatusRobot";
+
+    switch(newStatus) {
+        case STATUS_ROBOT_STABILIZED:
+            pidClearTerms(PID_ANGLE);
+            statusRobot.speedL = 0;
+            statusRobot.speedR = 0;
+            speedMotors.motorL = 0;
+            speedMotors.motorR = 0;
+
+            attitudeControlStat.attMode = ATT_MODE_ATTI;
+            attitudeControlMotor.motorL = 0;
+            attitudeControlMotor.motorR = 0;
+            speedMotors.enable = true;
+            ESP_LOGI(TAG,"ROBOT STABILIZED");
+        break;
+
+        case STATUS_ROBOT_ARMED:
+            speedMotors.enable = false;
+            speedMotors.motorL = 0;
+            speedMotors.motorR = 0;
+            statusRobot.localConfig.pids[PID_ANGLE].setPoint = statusRobot.localConfig.centerAngle;         // Reseteo el setPoint de PID_ANGLE
+            pidSetSetPoint(PID_ANGLE,statusRobot.localConfig.pids[PID_ANGLE].setPoint);
+
+            attitudeControlStat.attMode = ATT_MODE_ATTI;
+
+            ESP_LOGI(TAG,"DISABLED -> ROBOT ARMED, safetyLimits: %f",statusRobot.localConfig.safetyLimits);
+        break;
+
+        case STATUS_ROBOT_ERROR:
+        case STATUS_ROBOT_ERROR_BATTERY:
+        case STATUS_ROBOT_ERROR_HALLS:
+        case STATUS_ROBOT_ERROR_IMU:
+        case STATUS_ROBOT_ERROR_LIMIT_SPEED:
+        case STATUS_ROBOT_ERROR_MCB:
+            speedMotors.enable = false;
+            speedMotors.motorL = 0;
+            speedMotors.motorR = 0;
+            attitudeControlStat.contSafetyMaxSpeed = 0;
+            flightRecorderTrigger(FLIGHT_RECORDER_TRIGGER_ERROR_STATUS, newStatus);
+            ESP_LOGI(TAG,"ROBOT ERROR: %d",newStatus);
+        break;
+
+        default:
+            ESP_LOGE(TAG,"Unknown state");
+        break;
+    }
+
+    statusRobot.statusCode = newStatus;
+}
+
+esp_err_t controlInputInit(void) {
+    controlInputQueue = xQueueCreate(CONTROL_INPUT_QUEUE_LENGTH, sizeof(control_input_t));
+    return controlInputQueue ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool controlPostInput(const control_input_t *input) {
+    if (controlInputQueue && xQueueSend(controlInputQueue, input, 0)) {
+        return true;
+    }
+    controlInputDrops++;
+    ESP_LOGW("controlInput", "Cola de entradas llena, descartada tipo %d (%" PRIu32 " en total)", input->type, controlInputDrops);
+    return false;
+}
+
+uint32_t controlGetInputDrops(void) {
+    return controlInputDrops;
+}
+
+static void controlApplyInput(const control_input_t *input) {
+    const char *TAG = "controlInput";
+
+    switch (input->type) {
+        case CONTROL_INPUT_JOYSTICK:
+            statusRobot.dirControl = input->dirControl;
+        break;
+
+        case CONTROL_INPUT_PID_SETTINGS: {
+            const control_pid_input_t *pid = &input->pid;
+            pidSetConstants(pid->numPid, pid->gains.kp, pid->gains.ki, pid->gains.kd);
+            if (pid->numPid == PID_ANGLE) {
+                pidSetSetPoint(PID_ANGLE, pid->centerAngle);
+                statusRobot.localConfig.pids[PID_ANGLE].setPoint = pid->centerAngle;
+                statusRobot.localConfig.centerAngle = pid->centerAngle; //TODO: ELIMINAR CENTER ANGLE
+            }
+            statusRobot.localConfig.pids[pid->numPid].kp = pid->gains.kp;
+            statusRobot.localConfig.pids[pid->numPid].ki = pid->gains.ki;
+            statusRobot.localConfig.pids[pid->numPid].kd = pid->gains.kd;
+            ESP_LOGI(TAG, "Nuevos parametros %d: P: %f, I: %f, D: %f, center: %f", pid->numPid, pid->gains.kp,
+                pid->gains.ki, pid->gains.kd, pid->centerAngle);
+        }
+        break;
+
+        case CONTROL_INPUT_MOVE_POS:
+            attitudeControlStat.setPointPosCms += input->value;
+            statusRobot.localConfig.pids[PID_POS].setPoint = attitudeControlStat.setPointPosCms;
+            pidSetSetPoint(PID_POS, attitudeControlStat.setPointPosCms);
+        break;
+
+        case CONTROL_INPUT_MOVE_REL_YAW:
+        case CONTROL_INPUT_MOVE_ABS_YAW: {
+            float yawAngle = input->value;
+            if (input->type == CONTROL_INPUT_MOVE_REL_YAW) {
+                yawAngle = cutAngle(input->value + attitudeControlStat.setPointYaw);
+                ESP_LOGI(TAG, "Move relative angle: actual: %f,\t relative: %f, \t result: %f", statusRobot.actualYaw,
+                    input->value, yawAngle);
+            }
+            attitudeControlStat.setPointYaw = yawAngle;
+            statusRobot.localConfig.pids[PID_YAW].setPoint = attitudeControlStat.setPointYaw;
+            pidSetSetPoint(PID_YAW, attitudeControlStat.setPointYaw / 1.8);
+        }
+        break;
+
+        case CONTROL_INPUT_MOTORS_MEAS:
+            statusRobot.batVoltage = input->motors.batVoltage;
+            statusRobot.tempMcb = input->motors.tempMcb;
+            statusRobot.speedMeasR = input->motors.speedMeasR;
+            statusRobot.speedMeasL = input->motors.speedMeasL;
+            statusRobot.posInMetersR = input->motors.posInMetersR;
+            statusRobot.posInMetersL = input->motors.posInMetersL;
+        break;
+
+        case CONTROL_INPUT_SAVE_LOCAL_CONFIG:
+            localConfigSaves++;                         // la flash la escribe commsManager, no frena el tick
+        break;
+    }
+}
+
+void controlApplyInputs(void) {
+    control_input_t input;
+    if (!controlInputQueue) {
+        return;
+    }
+    while (xQueueReceive(controlInputQueue, &input, 0)) {
+        controlApplyInput(&input);
+    }
+}
+
+/*
+ * Etapas de la cascada. prepare carga la entrada del PID y devuelve false si ese ciclo no se calcula
+ * (modo inactivo o cambio de modo), apply recibe la salida del PID. Corren en la tarea del tick de control.
+ */
+static bool yawControlPrepare(float *input) {
+    if (statusRobot.statusCode != STATUS_ROBOT_STABILIZED) {
+        isYawControlEnabled = false;
+        return false;
+    }
+
+    if (statusRobot.dirControl.joyAxisX) {
+        isYawControlEnabled = false;
+        pidSetDisable(PID_YAW);
+        // Yaw manual control
+        attitudeControlMotor.motorR = (statusRobot.dirControl.joyAxisX / 100.00) * MAX_ROTATION_RATE_CONTROL;
+        attitudeControlMotor.motorL = attitudeControlMotor.motorR * -1;
+        return false;
+    }
+
+    if (!isYawControlEnabled) {
+        attitudeControlStat.setPointYaw = statusRobot.actualYaw;
+        statusRobot.localConfig.pids[PID_YAW].setPoint = attitudeControlStat.setPointYaw;
+        pidSetSetPoint(PID_YAW, attitudeControlStat.setPointYaw / 1.8);
+        pidSetEnable(PID_YAW);
+        isYawControlEnabled = true;
+        ESP_LOGI("AttitudeControl","Enable YAW_CONTROL, sp: %f",attitudeControlStat.setPointYaw);
+    }
+
+    float angularDist = angularDistance(attitudeControlStat.setPointYaw,statusRobot.actualYaw);
+    *input = angularDist / 1.8;
+    return true;
+}
+
+static void yawControlApply(float output) {
+    statusRobot.outputYawControl = output * -1;
+    attitudeControlMotor.motorR = statusRobot.outputYawControl * MAX_ROTATION_RATE_CONTROL;
+    attitudeControlMotor.motorL = attitudeControlMotor.motorR * -1;
+}
+
+static bool posControlPrepare(float *input) {
+    if (statusRobot.statusCode != STATUS_ROBOT_STABILIZED || statusRobot.dirControl.joyAxisY) {
+        return false;
+    }
+
+    statusRobot.actualDistInCms = ((statusRobot.posInMetersL + statusRobot.posInMetersR) / 2) * 100.00;
+
+    if (attitudeControlStat.attMode != ATT_MODE_POS_CONTROL) {
+        pidSetDisable(PID_SPEED);
+        statusRobot.localConfig.pids[PID_SPEED].setPoint = 0.00;
+
+        attitudeControlStat.setPointPosCms = statusRobot.actualDistInCms;
+        statusRobot.localConfig.pids[PID_POS].setPoint = attitudeControlStat.setPointPosCms;
+        pidSetSetPoint(PID_POS,attitudeControlStat.setPointPosCms);
+        pidSetEnable(PID_POS);
+        // desiredAngleControl = 0;
+        pidClearTerms(PID_POS);
+        attitudeControlStat.attMode = ATT_MODE_POS_CONTROL;
+        ESP_LOGI("AttitudeControl","Enable POS_CONTROL");
+        return false;
+    }
+
+    *input = statusRobot.actualDistInCms;
+    return true;
+}
+
+static void posControlApply(float output) {
+    desiredAngleControl = output * MAX_ANGLE_CONTROL;
+}
+
+static bool speedControlPrepare(float *input) {
+    if (statusRobot.statusCode != STATUS_ROBOT_STABILIZED || !statusRobot.dirControl.joyAxisY) {
+        return false;
+    }
+
+    if (attitudeControlStat.attMode != ATT_MODE_VEL_CONTROL) {
+        pidSetDisable(PID_POS);
+        statusRobot.localConfig.pids[PID_POS].setPoint = 0.00;
+
+        attitudeControlStat.setPointSpeed = 0;
+        statusRobot.localConfig.pids[PID_SPEED].setPoint = attitudeControlStat.setPointSpeed;
+        pidSetSetPoint(PID_SPEED,attitudeControlStat.setPointSpeed);
+        pidSetEnable(PID_SPEED);
+        // desiredAngleControl = 0;
+        pidClearTerms(PID_SPEED);
+        attitudeControlStat.attMode = ATT_MODE_VEL_CONTROL;            // TODO: deberia switchear aca a modo control de velocidad
+        ESP_LOGI("AttitudeControl","Enable SPEED_CONTROL");
+        return false;
+    }
+
+    attitudeControlStat.setPointSpeed = (statusRobot.dirControl.joyAxisY * -MAX_VELOCITY_SPEED_CONTROL)  / 1000.00;
+    statusRobot.localConfig.pids[PID_SPEED].setPoint = attitudeControlStat.setPointSpeed;
+    pidSetSetPoint(PID_SPEED,attitudeControlStat.setPointSpeed);
+
+    *input = statusRobot.speedL / 10.00;   // TODO: rermplazar speedL por velocidad medidad
+    return true;
+}
+
+static void speedControlApply(float output) {
+    desiredAngleControl = output * MAX_ANGLE_CONTROL * -1;
+}
+
+static bool angleControlPrepare(float *input) {
+    // La salida de los lazos externos de este mismo ciclo alimenta al PID de angulo
+    statusRobot.localConfig.pids[PID_ANGLE].setPoint = desiredAngleControl + statusRobot.localConfig.centerAngle; // TODO: probar NO contemplar el center angle en position control
+    pidSetSetPoint(PID_ANGLE,statusRobot.localConfig.pids[PID_ANGLE].setPoint);
+
+    *input = statusRobot.actualPitch;
+    return true;
+}
+
+static void angleControlApply(float output) {
+    int16_t outputPidMotors = (uint16_t)(output * MAX_VELOCITY);
+
+    speedMotors.motorL = cutSpeedRange(outputPidMotors + attitudeControlMotor.motorL);
+    speedMotors.motorR = cutSpeedRange(outputPidMotors + attitudeControlMotor.motorR);
+
+    #ifdef HARDWARE_S3
+        speedMotors.motorL = backlashAttenuator(speedMotors.motorL);
+        speedMotors.motorR = backlashAttenuator(speedMotors.motorR);
+    #endif
+}
+
+/*
+ * Cascada declarativa: cada lazo corre cada `decimation` ticks de control. Las etapas de un mismo nivel
+ * son independientes y se calculan juntas con pidCalculateBatch; un nivel alimenta al siguiente en el
+ * mismo ciclo (pos/speed -> setPoint de angulo, yaw -> attitudeControlMotor -> mezcla de motores).
+ */
+static const control_stage_t controlStages[CONTROL_STAGES_COUNT] = {
+    {"yaw",   PID_YAW,   0, ATTITUDE_DECIMATION, yawControlPrepare,   yawControlApply},
+    {"pos",   PID_POS,   0, ATTITUDE_DECIMATION, posControlPrepare,   posControlApply},
+    {"speed", PID_SPEED, 0, ATTITUDE_DECIMATION, speedControlPrepare, speedControlApply},
+    {"angle", PID_ANGLE, 1, 1,                   angleControlPrepare, angleControlApply},
+};
+
+static control_stage_stats_t stageStats[CONTROL_STAGES_COUNT];
+
+static float controlGetPidNominalPeriodMs(uint8_t numPid) {
+    for (uint8_t i = 0; i < CONTROL_STAGES_COUNT; i++) {
+        if (controlStages[i].numPid == numPid) {
+            return PERIOD_IMU_MS * controlStages[i].decimation;
+        }
+    }
+    return PERIOD_IMU_MS;
+}
+
+float controlGetPidPeriodMs(uint8_t numPid) {
+    float tickPeriodMs = controlTickPeriodUs / 1000.0f;
+    for (uint8_t i = 0; i < CONTROL_STAGES_COUNT; i++) {
+        if (controlStages[i].numPid == numPid) {
+            return tickPeriodMs * controlStages[i].decimation;
+        }
+    }
+    return tickPeriodMs;
+}
+
+void controlSetTickPeriodUs(uint32_t periodUs) {
+    controlTickPeriodUs = periodUs;
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        if (pidSetSampleTime(i, controlGetPidPeriodMs(i)) != ESP_OK) {
+            ESP_LOGE("controlTick", "Periodo fuera de rango para el PID %d: %" PRIu32 " us", i, periodUs);
+        }
+    }
+}
+
+/*
+ * @param cycleOutputs salida de cada PID calculado en este ciclo, 0 para los que no tocaban
+ */
+static void controlCascadeRun(float cycleOutputs[CANT_PIDS]) {
+    int64_t stageStartUs[CONTROL_STAGES_COUNT];
+    uint8_t ranStage[CONTROL_STAGES_COUNT] = {0};
+    uint8_t stage = 0;
+
+    while (stage < CONTROL_STAGES_COUNT) {
+        uint8_t level = controlStages[stage].level;
+        uint8_t levelStart = stage;
+        bool attitudeCycle = (level == 0) && !(controlCycle % ATTITUDE_DECIMATION);
+
+        if (attitudeCycle) {
+            loopTimingStart(LOOP_TIMING_ATTITUDE);
+        }
+        uint32_t pidMask = 0;
+        float pidInputs[CANT_PIDS] = {0};
+        float pidOutputs[CANT_PIDS];
+
+        for (; stage < CONTROL_STAGES_COUNT && controlStages[stage].level == level; stage++) {
+            const control_stage_t *entry = &controlStages[stage];
+            if (controlCycle % entry->decimation) {
+                continue;
+            }
+            stageStartUs[stage] = esp_timer_get_time();
+            if (entry->prepare(&pidInputs[entry->numPid])) {
+                pidMask |= PID_MASK(entry->numPid);
+                ranStage[stage] = true;
+            }
+        }
+
+        if (pidMask) {
+            pidCalculateBatch(pidMask, pidInputs, pidOutputs);
+
+            for (uint8_t i = levelStart; i < stage; i++) {
+                if (ranStage[i]) {
+                    controlStages[i].apply(pidOutputs[controlStages[i].numPid]);
+                    cycleOutputs[controlStages[i].numPid] = pidOutputs[controlStages[i].numPid];
+                }
+            }
+        }
+
+        if (attitudeCycle) {
+            loopTimingEnd(LOOP_TIMING_ATTITUDE);
+        }
+    }
+
+    // Latencia de cada etapa: desde que leyo su entrada hasta que la salida quedo en speedMotors
+    int64_t endUs = esp_timer_get_time();
+    for (uint8_t i = 0; i < CONTROL_STAGES_COUNT; i++) {
+        if (ranStage[i]) {
+            uint32_t latencyUs = (uint32_t)(endUs - stageStartUs[i]);
+            stageStats[i].runs++;
+            stageStats[i].lastLatencyUs = latencyUs;
+            if (latencyUs > stageStats[i].maxLatencyUs) {
+                stageStats[i].maxLatencyUs = latencyUs;
+            }
+        }
+    }
+}
+
+void controlCascadeUpdate(vector_queue_t *newAngles) {
+
+    statusRobot.actualRoll = newAngles->roll;
+    statusRobot.actualPitch = newAngles->pitch;
+    statusRobot.actualYaw = newAngles->yaw;
+    statusRobot.tempImu = (uint16_t)newAngles->temp;
+
+    float pidOutputs[CANT_PIDS] = {0};
+    controlCascadeRun(pidOutputs);
+
+    safetyLimitProm[safetyLimitPromIndex++] = newAngles->pitch;
+    if (safetyLimitPromIndex > 2) {
+        safetyLimitPromIndex = 0;
+    }
+    float angleSafetyLimit = (safetyLimitProm[0] + safetyLimitProm[1] + safetyLimitProm[2]) / 3;
+
+    if (pidGetEnable(PID_ANGLE)) {
+        if ((angleSafetyLimit < (statusRobot.localConfig.centerAngle-statusRobot.localConfig.safetyLimits)) ||
+            (angleSafetyLimit > (statusRobot.localConfig.centerAngle+statusRobot.localConfig.safetyLimits))) {
+            pidSetDisable(PID_ANGLE);
+            flightRecorderTrigger(FLIGHT_RECORDER_TRIGGER_SAFETY_LIMIT, statusRobot.statusCode);
+            setStatusRobot(STATUS_ROBOT_ARMED);
+        }
+    }
+    else if (!newAngles->calibrating) {        // con la calibracion del IMU en curso los motores no se habilitan
+        if ((newAngles->pitch > (statusRobot.localConfig.centerAngle - MIN_PITCH_ARMED)) &&
+            (newAngles->pitch < (statusRobot.localConfig.centerAngle + MIN_PITCH_ARMED)) &&
+            (newAngles->roll > (statusRobot.localConfig.centerAngle - MIN_ROLL_ARMED)) &&
+            (newAngles->roll < (statusRobot.localConfig.centerAngle + MIN_ROLL_ARMED))) {
+
+            statusRobot.localConfig.pids[PID_ANGLE].setPoint = statusRobot.localConfig.centerAngle;         // Reseteo el setPoint de PID_ANGLE
+            pidSetSetPoint(PID_ANGLE,statusRobot.localConfig.pids[PID_ANGLE].setPoint);
+            setStatusRobot(STATUS_ROBOT_STABILIZED);
+            pidSetEnable(PID_ANGLE);
+        }
+    }
+
+    if (abs(speedMotors.motorR) == 1000 || abs(speedMotors.motorL) == 1000) {
+        attitudeControlStat.contSafetyMaxSpeed++;
+        if (attitudeControlStat.contSafetyMaxSpeed > MAX_CYCLES_LIMIT_SPEED ) {
+            pidSetDisable(PID_ANGLE);
+            setStatusRobot(STATUS_ROBOT_ERROR_LIMIT_SPEED);
+        }
+    }
+    else {
+        attitudeControlStat.contSafetyMaxSpeed = 0;
+    }
+
+    statusRobot.speedL = speedMotors.motorL;
+    statusRobot.speedR = speedMotors.motorR;
+    controlCycle++;
+
+    flight_record_t record = {
+        .cycle = controlCycle,
+        .pitch = newAngles->pitch * FLIGHT_RECORDER_SCALE_ANGLE,
+        .roll = newAngles->roll * FLIGHT_RECORDER_SCALE_ANGLE,
+        .yaw = newAngles->yaw * FLIGHT_RECORDER_SCALE_ANGLE,
+        .motorL = speedMotors.motorL,
+        .motorR = speedMotors.motorR,
+        .statusCode = statusRobot.statusCode,
+        .motorsEnable = speedMotors.enable,
+    };
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        record.pidOutput[i] = pidOutputs[i] * FLIGHT_RECORDER_SCALE_PID;
+        record.pidITerm[i] = pidGetITerm(i) * FLIGHT_RECORDER_SCALE_PID;
+        record.setPoint[i] = pidGetSetPoint(i) * PRECISION_DECIMALS_COMMS;
+    }
+    flightRecorderWrite(&record);
+    telemetryStreamWrite(&record, newAngles->timestampUs);
+}
+
+void controlImuLost(void) {
+    if (statusRobot.statusCode == STATUS_ROBOT_ERROR_IMU) {
+        return;
+    }
+    pidSetDisable(PID_ANGLE);
+    setStatusRobot(STATUS_ROBOT_ERROR_IMU);
+}
+
+void controlPublishSnapshot(void) {
+    robot_snapshot_t snapshot = {
+        .cycle = controlCycle,
+        .status = statusRobot,
+        .speedMotors = speedMotors,
+        .attitudeControlMotor = attitudeControlMotor,
+        .localConfigSaves = localConfigSaves,
+    };
+    robotSnapshotPublish(&snapshot);
+}
+
+void controlGetStageStats(control_stage_stats_t stats[CONTROL_STAGES_COUNT]) {
+    for (uint8_t i = 0; i < CONTROL_STAGES_COUNT; i++) {
+        stats[i] = stageStats[i];
+        stats[i].name = controlStages[i].name;
+        stats[i].decimation = controlStages[i].decimation;
+    }
+}
@@ -0,0 +1,279 @@
+#include "stdbool.h"
+#include "stdlib.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <inttypes.h>
+
+#include "control_tick.h"
+#include "control.h"
+#include "loop_timing.h"
+#include "main.h"
+
+#define CONTROL_TICK_STATS_LOG_TICKS    1000
+#define CONTROL_TICK_IMU_TIMEOUT_PERIODS 4      // sin muestras en este tiempo el tick corre igual, para la salida a motores
+#define CONTROL_TICK_IMU_LOST_PERIODS   10      // periodos seguidos sin muestra nueva hasta dar el IMU por perdido
+#define CONTROL_TICK_OFF_PERIOD_DIV     4       // fuera de periodo si se aparta mas de periodUs / 4
+#define CONTROL_TICK_OFF_PERIOD_MAX     20      // muestras seguidas fuera de periodo hasta dejar de usar el IMU
+#define CONTROL_TICK_PERIOD_WINDOW      200     // ciclos de la cascada por medicion del periodo
+#define CONTROL_TICK_PERIOD_TOLERANCE   50      // 1/1000 de diferencia con el periodo en uso antes de recalcular los PID
+
+static const char *TAG = "controlTick";
+
+extern QueueHandle_t mpu6050QueueHandler;
+extern QueueHandle_t motorControlQueueHandler;
+
+static control_tick_config_t tickConfig;
+static TaskHandle_t tickTaskHandle;
+static esp_timer_handle_t tickTimer;
+
+static control_tick_stats_t tickStats;
+static uint64_t jitterAbsSumUs;
+static uint64_t latencySumUs;
+static uint32_t latencyCount;
+static uint64_t periodSumUs;
+static uint32_t periodCount;
+
+/*
+ * Corre en la tarea de esp_timer: solo despierta a la tarea de control, el trabajo se hace en su prioridad
+ */
+static void controlTickTimerCallback(void *arg) {
+    xTaskNotifyGive(tickTaskHandle);
+}
+
+static void controlTickUpdateJitter(int32_t jitterUs) {
+    if (jitterUs < tickStats.jitterMinUs) {
+        tickStats.jitterMinUs = jitterUs;
+    }
+    if (jitterUs > tickStats.jitterMaxUs) {
+        tickStats.jitterMaxUs = jitterUs;
+    }
+    jitterAbsSumUs += abs(jitterUs);
+}
+
+static void controlTickUpdateLatency(int64_t sampleUs) {
+    uint32_t latencyUs = (uint32_t)(esp_timer_get_time() - sampleUs);
+    tickStats.latencyLastUs = latencyUs;
+    if (latencyUs > tickStats.latencyMaxUs) {
+        tickStats.latencyMaxUs = latencyUs;
+    }
+    latencySumUs += latencyUs;
+    latencyCount++;
+}
+
+/*
+ * Acumula el intervalo entre muestras usadas por la cascada, que es el dt real de los PID: el del DMP si
+ * marca el tick, el del timer si el IMU entrega mas rapido. Cada CONTROL_TICK_PERIOD_WINDOW ciclos, si la
+ * media se aparto del periodo en uso, recalcula los PID con la medida.
+ */
+static void controlTickUpdatePeriod(int64_t intervalUs) {
+    periodSumUs += intervalUs;
+    if (++periodCount < CONTROL_TICK_PERIOD_WINDOW) {
+        return;
+    }
+    uint32_t meanUs = (uint32_t)(periodSumUs / periodCount);
+    periodSumUs = 0;
+    periodCount = 0;
+
+    if (meanUs < tickConfig.periodUs / 2 || meanUs > tickConfig.periodUs * 2) {
+        ESP_LOGW(TAG, "Periodo medido %" PRIu32 " us, nominal %" PRIu32 " us: no se aplica", meanUs, tickConfig.periodUs);
+        return;
+    }
+    if ((uint64_t)abs((int32_t)(meanUs - tickStats.periodMeasuredUs)) * 1000 > (uint64_t)tickStats.periodMeasuredUs * CONTROL_TICK_PERIOD_TOLERANCE) {
+        ESP_LOGI(TAG, "Periodo medido %" PRIu32 " us (en uso %" PRIu32 " us), se recalculan los PID", meanUs, tickStats.periodMeasuredUs);
+        tickStats.periodMeasuredUs = meanUs;
+        tickStats.periodUpdates++;
+        controlSetTickPeriodUs(meanUs);
+    }
+}
+
+/*
+ * Muestra nueva que no llego a periodUs de la anterior: el IMU entrega mas rapido, o mas lento (por muestra la
+ * tarea estuvo esperando mas de un periodo o hubo timeouts, con el timer mas de un tick seguido sin muestra).
+ * Un ciclo que se alargo no cuenta: las muestras pisadas mientras tanto llegaron a tiempo.
+ */
+static bool controlTickOffPeriod(int64_t intervalUs, int64_t idleUs, uint32_t stalePeriods) {
+    int64_t toleranceUs = tickConfig.periodUs / CONTROL_TICK_OFF_PERIOD_DIV;
+    if (intervalUs < (int64_t)tickConfig.periodUs - toleranceUs) {
+        return true;
+    }
+    if (tickConfig.source == CONTROL_TICK_SOURCE_IMU) {
+        return stalePeriods || idleUs > (int64_t)tickConfig.periodUs + toleranceUs;
+    }
+    return stalePeriods > 1;
+}
+
+/*
+ * Espera el proximo tick. Devuelve los periodos transcurridos desde el anterior (mas de 1 si se perdieron ticks)
+ * y si hay muestra nueva del IMU en lastSample.
+ */
+static uint32_t controlTickWait(vector_queue_t *lastSample, bool *newSample) {
+    if (tickConfig.source == CONTROL_TICK_SOURCE_IMU) {
+        static bool afterTimeout;
+        int64_t lastSampleUs = lastSample->timestampUs;
+        uint32_t timeoutMs = (tickConfig.periodUs * CONTROL_TICK_IMU_TIMEOUT_PERIODS + 999) / 1000;
+        *newSample = xQueueReceive(mpu6050QueueHandler, lastSample, pdMS_TO_TICKS(timeoutMs));
+        if (!*newSample) {
+            afterTimeout = true;
+            return CONTROL_TICK_IMU_TIMEOUT_PERIODS;
+        }
+        if (!lastSampleUs || afterTimeout) {            // el hueco del IMU no son ticks perdidos
+            afterTimeout = false;
+            return 1;
+        }
+        // muestras pisadas en la cola mientras corria el ciclo anterior
+        uint32_t periods = (uint32_t)((lastSample->timestampUs - lastSampleUs + tickConfig.periodUs / 2) / tickConfig.periodUs);
+        return periods ? periods : 1;
+    }
+
+    uint32_t pendingTicks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    *newSample = xQueueReceive(mpu6050QueueHandler, lastSample, 0);
+    return pendingTicks;
+}
+
+static void controlTickHandler(void *pvParameters) {
+    vector_queue_t lastSample = {0};
+    bool hasSample = false;
+    uint32_t stalePeriods = 0;
+    int64_t lastWakeUs = 0;
+    int64_t lastEndUs = 0;
+    int64_t lastCascadeSampleUs = 0;
+    uint32_t offPeriodRun = 0;
+
+    while (true) {
+        // 1. Muestreo: la ultima muestra que dejo la tarea del MPU
+        bool newSample;
+        uint32_t pendingTicks = controlTickWait(&lastSample, &newSample);
+        int64_t wakeUs = esp_timer_get_time();
+        loopTimingStart(LOOP_TIMING_CONTROL_TICK);
+
+        // Por muestra, un timeout no es un tick: ni perdidos ni jitter, y el siguiente arranca de nuevo
+        bool imuTimeout = tickConfig.source == CONTROL_TICK_SOURCE_IMU && !newSample;
+        if (pendingTicks > 1 && !imuTimeout) {
+            tickStats.missedTicks += pendingTicks - 1;
+        }
+        if (lastWakeUs && !imuTimeout) {
+            controlTickUpdateJitter((int32_t)(wakeUs - lastWakeUs - (int64_t)tickConfig.periodUs * pendingTicks));
+        }
+        lastWakeUs = imuTimeout ? 0 : wakeUs;
+
+        bool offPeriod = false;
+        if (newSample) {
+            if (lastCascadeSampleUs) {
+                int64_t intervalUs = lastSample.timestampUs - lastCascadeSampleUs;
+                offPeriod = controlTickOffPeriod(intervalUs, lastEndUs ? wakeUs - lastEndUs : 0, stalePeriods);
+                if (offPeriod && !tickStats.offPeriodSamples++) {
+                    ESP_LOGW(TAG, "Muestra del IMU a %" PRId64 " us de la anterior, periodo nominal %" PRIu32 " us", intervalUs, tickConfig.periodUs);
+                }
+                if (intervalUs > 0) {
+                    controlTickUpdatePeriod(intervalUs);
+                }
+            }
+            lastCascadeSampleUs = lastSample.timestampUs;
+            hasSample = true;
+            stalePeriods = 0;
+            offPeriodRun = offPeriod ? offPeriodRun + 1 : 0;
+        }
+        else if (hasSample) {
+            tickStats.staleSamples++;
+            stalePeriods += pendingTicks;
+        }
+
+        // 2. Cascada de control (lazos externos decimados y lazo de angulo), solo con muestra nueva: repetir
+        //    la anterior integraria el mismo error otra vez. Antes, las entradas de comms: solo esta tarea
+        //    escribe statusRobot y los setPoints
+        controlApplyInputs();
+        if (offPeriodRun >= CONTROL_TICK_OFF_PERIOD_MAX) {
+            // El IMU no entrega a periodUs (el DMP a otra tasa): ni el dt de los PID ni el tick sirven
+            if (newSample && offPeriodRun == CONTROL_TICK_OFF_PERIOD_MAX) {
+                tickStats.imuLost++;
+                ESP_LOGE(TAG, "%d muestras seguidas del IMU fuera de periodo, se deja de controlar", CONTROL_TICK_OFF_PERIOD_MAX);
+            }
+            controlImuLost();
+        }
+        else if (newSample) {
+            controlCascadeUpdate(&lastSample);
+        }
+        else if (stalePeriods >= CONTROL_TICK_IMU_LOST_PERIODS) {
+            lastCascadeSampleUs = 0;                    // el hueco no es el periodo de los PID
+            if (stalePeriods - pendingTicks < CONTROL_TICK_IMU_LOST_PERIODS) {
+                tickStats.imuLost++;
+                ESP_LOGW(TAG, "Sin muestras del IMU hace %" PRIu32 " periodos", stalePeriods);
+            }
+            controlImuLost();
+        }
+        controlPublishSnapshot();
+
+        // 3. Salida a motores, la ultima calculada si no hubo muestra nueva: directa al driver si lo hay, en el mismo ciclo
+        if (tickConfig.motorOutput) {
+            tickConfig.motorOutput(&speedMotors);
+        }
+        else {
+            xQueueOverwrite(motorControlQueueHandler, &speedMotors);
+        }
+        if (newSample && lastSample.timestampUs) {
+            controlTickUpdateLatency(lastSample.timestampUs);
+        }
+        loopTimingEnd(LOOP_TIMING_CONTROL_TICK);
+
+        lastEndUs = esp_timer_get_time();
+        uint32_t execUs = (uint32_t)(lastEndUs - wakeUs);
+        if (execUs > tickStats.execMaxUs) {
+            tickStats.execMaxUs = execUs;
+        }
+        tickStats.ticks++;
+
+        if (!(tickStats.ticks % CONTROL_TICK_STATS_LOG_TICKS)) {
+            ESP_LOGD(TAG, "jitter: %" PRId32 "/%" PRId32 " us, perdidos: %" PRIu32 ", sin muestra nueva: %" PRIu32 ", fuera de periodo: %" PRIu32 ", ejecucion max: %" PRIu32 " us, latencia imu-motor max: %" PRIu32 " us, entradas descartadas: %" PRIu32,
+                tickStats.jitterMinUs, tickStats.jitterMaxUs, tickStats.missedTicks, tickStats.staleSamples, tickStats.offPeriodSamples, tickStats.execMaxUs, tickStats.latencyMaxUs, controlGetInputDrops());
+        }
+    }
+}
+
+esp_err_t controlTickInit(control_tick_config_t *config) {
+    tickConfig = *config;
+    tickStats = (control_tick_stats_t){
+        .jitterMinUs = INT32_MAX,
+        .jitterMaxUs = INT32_MIN,
+        .periodMeasuredUs = config->periodUs,
+    };
+    jitterAbsSumUs = 0;
+    latencySumUs = 0;
+    latencyCount = 0;
+    periodSumUs = 0;
+    periodCount = 0;
+    controlSetTickPeriodUs(config->periodUs);
+
+    if (xTaskCreatePinnedToCore(controlTickHandler, "control tick", 4096, NULL, config->priorityTask, &tickTaskHandle, config->core) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (config->source == CONTROL_TICK_SOURCE_IMU) {
+        ESP_LOGI(TAG, "Tick de control por muestra del IMU, periodo nominal %" PRIu32 " us", config->periodUs);
+        return ESP_OK;
+    }
+
+    const esp_timer_create_args_t timerArgs = {
+        .callback = controlTickTimerCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "control tick",
+    };
+    esp_err_t err = esp_timer_create(&timerArgs, &tickTimer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Tick de control cada %" PRIu32 " us", config->periodUs);
+    return esp_timer_start_periodic(tickTimer, config->periodUs);
+}
+
+void controlTickGetStats(control_tick_stats_t *stats) {
+    *stats = tickStats;
+    stats->inputDrops = controlGetInputDrops();
+    stats->jitterMeanAbsUs = tickStats.ticks > 1 ? (float)jitterAbsSumUs / (tickStats.ticks - 1) : 0;
+    stats->latencyMeanUs = latencyCount ? (float)latencySumUs / latencyCount : 0;
+}
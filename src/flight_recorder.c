@@ -0,0 +1,91 @@
+#include "string.h"
+#include "stdatomic.h"
+#include "esp_attr.h"
+
+#include "flight_recorder.h"
+
+#if (FLIGHT_RECORDER_RECORDS & (FLIGHT_RECORDER_RECORDS - 1))
+#error FLIGHT_RECORDER_RECORDS debe ser potencia de 2
+#endif
+
+/*
+ * Un solo escritor (tick de control). El disparo y el rearme llegan de otras tareas solo por los
+ * atomicos: el escritor deja de tocar el buffer al congelarse y recien ahi lo leen los demas.
+ */
+#if defined(CONFIG_SPIRAM_ALLOW_BSS_EXT_MEM)
+static EXT_RAM_BSS_ATTR flight_record_t records[FLIGHT_RECORDER_RECORDS];
+#else
+static flight_record_t records[FLIGHT_RECORDER_RECORDS];
+#endif
+
+static uint32_t writeCount;                             // registros escritos desde el ultimo rearme
+static uint32_t postTriggerLeft;
+static uint32_t triggerCycle;
+static atomic_uint triggerReason;
+static uint8_t triggerStatus;
+static atomic_bool frozen;
+
+void flightRecorderWrite(const flight_record_t *record) {
+    if (atomic_load_explicit(&frozen, memory_order_acquire)) {
+        return;
+    }
+
+    records[writeCount & (FLIGHT_RECORDER_RECORDS - 1)] = *record;
+    writeCount++;
+
+    if (atomic_load_explicit(&triggerReason, memory_order_acquire) != FLIGHT_RECORDER_TRIGGER_NONE) {
+        if (!postTriggerLeft) {                         // primer ciclo despues del disparo, un pedido congela en el acto
+            triggerCycle = record->cycle;
+            postTriggerLeft = atomic_load_explicit(&triggerReason, memory_order_relaxed) == FLIGHT_RECORDER_TRIGGER_REQUEST ?
+                1 : FLIGHT_RECORDER_POST_TRIGGER;
+        }
+        if (!--postTriggerLeft) {
+            atomic_store_explicit(&frozen, true, memory_order_release);
+        }
+    }
+}
+
+void flightRecorderTrigger(uint8_t reason, uint8_t statusCode) {
+    unsigned int expected = FLIGHT_RECORDER_TRIGGER_NONE;
+    if (atomic_compare_exchange_strong(&triggerReason, &expected, reason)) {
+        triggerStatus = statusCode;
+    }
+}
+
+bool flightRecorderIsFrozen(void) {
+    return atomic_load_explicit(&frozen, memory_order_acquire);
+}
+
+void flightRecorderGetInfo(flight_recorder_info_t *info) {
+    info->frozen = flightRecorderIsFrozen();
+    info->capacity = FLIGHT_RECORDER_RECORDS;
+    info->records = writeCount < FLIGHT_RECORDER_RECORDS ? writeCount : FLIGHT_RECORDER_RECORDS;
+    info->triggerReason = atomic_load_explicit(&triggerReason, memory_order_relaxed);
+    info->triggerStatus = triggerStatus;
+    info->triggerCycle = info->frozen ? triggerCycle : 0;
+}
+
+uint16_t flightRecorderRead(uint32_t first, flight_record_t *out, uint16_t maxRecords) {
+    if (!flightRecorderIsFrozen()) {
+        return 0;
+    }
+    uint32_t valid = writeCount < FLIGHT_RECORDER_RECORDS ? writeCount : FLIGHT_RECORDER_RECORDS;
+    uint32_t oldest = writeCount - valid;
+    uint16_t count = 0;
+
+    for (; count < maxRecords && first + count < valid; count++) {
+        out[count] = records[(oldest + first + count) & (FLIGHT_RECORDER_RECORDS - 1)];
+    }
+    return count;
+}
+
+void flightRecorderRearm(void) {
+    if (!flightRecorderIsFrozen()) {                    // grabando: el buffer es del escritor
+        return;
+    }
+    writeCount = 0;
+    postTriggerLeft = 0;
+    triggerCycle = 0;
+    atomic_store_explicit(&triggerReason, FLIGHT_RECORDER_TRIGGER_NONE, memory_order_relaxed);
+    atomic_store_explicit(&frozen, false, memory_order_release);
+}
@@ -0,0 +1,154 @@
+#include "imu_calibration.h"
+
+#include <math.h>
+#include <string.h>
+
+#define ROUNDS_EXPECTED     2                   // medir y verificar, para el progreso
+
+static void startRound(imu_calibration_t *calibration) {
+    calibration->count = 0;
+    calibration->settle = calibration->settleSamples;
+    memset(calibration->sum, 0, sizeof(calibration->sum));
+    memset(calibration->sumSq, 0, sizeof(calibration->sumSq));
+}
+
+static int16_t clampOffset(int32_t value) {
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : (int16_t)value);
+}
+
+/*
+ * Sale con error: si ya se escribieron offsets vuelve a los de antes y espera una ronda en RESTORING.
+ * @return true si hay que escribir los offsets de antes
+ */
+static bool fail(imu_calibration_t *calibration, uint8_t error) {
+    calibration->error = error;
+    if (memcmp(&calibration->offsets, &calibration->previous, sizeof(imu_offsets_t)) == 0) {
+        calibration->state = IMU_CALIBRATION_FAILED;
+        return false;
+    }
+    calibration->offsets = calibration->previous;
+    calibration->state = IMU_CALIBRATION_RESTORING;
+    startRound(calibration);
+    return true;
+}
+
+/*
+ * Cierra la ronda en curso.
+ * @return true si hay offsets nuevos (o los de antes, si fallo) para escribir
+ */
+static bool closeRound(imu_calibration_t *calibration) {
+    float invCount = 1.0f / calibration->count;
+    float error[IMU_CALIBRATION_AXES];
+    bool still = true;
+
+    for (uint8_t i = 0; i < IMU_CALIBRATION_AXES; i++) {
+        float mean = calibration->sum[i] * invCount;
+        float variance = calibration->sumSq[i] * invCount - mean * mean;
+        float std = variance > 0 ? sqrtf(variance) : 0;
+        float lsb = i < 3 ? calibration->accelLsbPerG : calibration->gyroLsbPerDps;
+        float stdMax = i < 3 ? IMU_CALIBRATION_ACCEL_STD_MAX_G : IMU_CALIBRATION_GYRO_STD_MAX_DPS;
+        if (std > stdMax * lsb) {
+            still = false;
+        }
+        error[i] = (calibration->ref[i] + mean) / lsb - (i == 2 ? 1.0f : 0);   // Z del acelerometro en +1 g
+    }
+
+    if (!still) {
+        if (++calibration->motionRounds >= IMU_CALIBRATION_MAX_MOTION) {
+            return fail(calibration, IMU_CALIBRATION_ERROR_MOTION);
+        }
+        startRound(calibration);                // misma ronda, de nuevo
+        return false;
+    }
+
+    calibration->accelResidualG = 0;
+    calibration->gyroResidualDps = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        calibration->accelResidualG = fmaxf(calibration->accelResidualG, fabsf(error[i]));
+        calibration->gyroResidualDps = fmaxf(calibration->gyroResidualDps, fabsf(error[3 + i]));
+    }
+    if (calibration->accelResidualG <= IMU_CALIBRATION_ACCEL_TOLERANCE_G &&
+        calibration->gyroResidualDps <= IMU_CALIBRATION_GYRO_TOLERANCE_DPS) {
+        calibration->state = IMU_CALIBRATION_DONE;
+        calibration->progress = 100;
+        return false;
+    }
+    if (calibration->round >= IMU_CALIBRATION_MAX_ROUNDS) {
+        return fail(calibration, IMU_CALIBRATION_ERROR_NOT_CONVERGED);
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        // Pasos de a 2 en el acelerometro para no tocar el bit 0
+        int32_t accelStep = 2 * lroundf(error[i] * IMU_CALIBRATION_ACCEL_OFFSET_LSB_PER_G / 2);
+        int32_t gyroStep = lroundf(error[3 + i] * IMU_CALIBRATION_GYRO_OFFSET_LSB_PER_DPS);
+        calibration->offsets.accel[i] = clampOffset(calibration->offsets.accel[i] - accelStep);
+        calibration->offsets.gyro[i] = clampOffset(calibration->offsets.gyro[i] - gyroStep);
+    }
+    calibration->round++;
+    startRound(calibration);
+    return true;
+}
+
+void imuCalibrationStart(imu_calibration_t *calibration, const imu_offsets_t *current, uint16_t sampleHz,
+                         float accelLsbPerG, float gyroLsbPerDps) {
+    memset(calibration, 0, sizeof(*calibration));
+    calibration->state = IMU_CALIBRATION_MEASURING;
+    calibration->round = 1;
+    calibration->roundSamples = (uint32_t)sampleHz * IMU_CALIBRATION_ROUND_MS / 1000;
+    if (calibration->roundSamples < 2) {
+        calibration->roundSamples = 2;
+    }
+    calibration->settleSamples = (uint32_t)sampleHz * IMU_CALIBRATION_SETTLE_MS / 1000;
+    calibration->accelLsbPerG = accelLsbPerG;
+    calibration->gyroLsbPerDps = gyroLsbPerDps;
+    calibration->offsets = *current;
+    calibration->previous = *current;
+    startRound(calibration);
+}
+
+bool imuCalibrationUpdate(imu_calibration_t *calibration, const int16_t accel[3], const int16_t gyro[3]) {
+    if (calibration->state != IMU_CALIBRATION_MEASURING && calibration->state != IMU_CALIBRATION_RESTORING) {
+        return false;
+    }
+    if (calibration->settle) {
+        calibration->settle--;
+        return false;
+    }
+
+    if (calibration->state == IMU_CALIBRATION_RESTORING) {
+        if (++calibration->count >= calibration->roundSamples) {
+            calibration->state = IMU_CALIBRATION_FAILED;
+        }
+        return false;
+    }
+
+    const int16_t *raw[2] = {accel, gyro};
+    if (calibration->count == 0) {
+        for (uint8_t i = 0; i < IMU_CALIBRATION_AXES; i++) {
+            calibration->ref[i] = raw[i / 3][i % 3];
+        }
+    }
+    for (uint8_t i = 0; i < IMU_CALIBRATION_AXES; i++) {
+        float delta = (float)(raw[i / 3][i % 3] - calibration->ref[i]);
+        calibration->sum[i] += delta;
+        calibration->sumSq[i] += delta * delta;
+    }
+
+    uint32_t done = (uint32_t)(calibration->round - 1) * calibration->roundSamples + calibration->count;
+    uint32_t progress = done * 100 / (ROUNDS_EXPECTED * calibration->roundSamples);
+    calibration->progress = progress > 99 ? 99 : progress;
+
+    if (++calibration->count < calibration->roundSamples) {
+        return false;
+    }
+    return closeRound(calibration);
+}
+
+bool imuCalibrationAbort(imu_calibration_t *calibration, uint8_t error) {
+    if (calibration->state == IMU_CALIBRATION_RESTORING) {
+        calibration->error = error;             // tampoco se pudieron volver a escribir los de antes
+        calibration->state = IMU_CALIBRATION_FAILED;
+        return false;
+    }
+    return fail(calibration, error);
+}
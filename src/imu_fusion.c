@@ -0,0 +1,279 @@
+#include "imu_fusion.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+#define RAD_TO_DEG      (180.0f / (float)M_PI)
+#define DEG_TO_RAD      ((float)M_PI / 180.0f)
+
+enum {
+    ANGLE_YAW,
+    ANGLE_PITCH,
+    ANGLE_ROLL
+};
+
+/*
+ * Velocidades del giroscopo (ejes del sensor) en el signo de los angulos de dmpGetYawPitchRoll:
+ * la gravedad en x crece al girar en -y, el yaw crece al girar en -z
+ */
+static inline void gyroToRates(const float gyro[3], float rates[3]) {
+    rates[ANGLE_YAW] = -gyro[2];
+    rates[ANGLE_PITCH] = -gyro[1];
+    rates[ANGLE_ROLL] = gyro[0];
+}
+
+/*
+ * Normaliza la aceleracion. Devuelve false si no sirve para corregir: nula o lejos de 1g (el robot
+ * acelera o golpea y el acelerometro no mide solo la gravedad)
+ */
+static inline bool accelNormalize(const float accel[3], float out[3]) {
+    float norm = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+    if (fabsf(norm - 1.0f) > IMU_FUSION_ACCEL_GATE_G) {
+        return false;
+    }
+    float invNorm = 1.0f / norm;
+    out[0] = accel[0] * invNorm;
+    out[1] = accel[1] * invNorm;
+    out[2] = accel[2] * invNorm;
+    return true;
+}
+
+static inline void quaternionNormalize(float q[4]) {
+    float invNorm = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    q[0] *= invNorm;
+    q[1] *= invNorm;
+    q[2] *= invNorm;
+    q[3] *= invNorm;
+}
+
+static inline float wrapPi(float angle) {
+    if (angle > (float)M_PI) {
+        return angle - 2.0f * (float)M_PI;
+    }
+    if (angle < -(float)M_PI) {
+        return angle + 2.0f * (float)M_PI;
+    }
+    return angle;
+}
+
+/*
+ * Primera muestra: inclinacion directa del acelerometro, yaw en cero. El cuaternion es el giro mas
+ * corto que lleva la gravedad medida al eje z, asi no hay que esperar que el filtro converja
+ */
+static void imuFusionSeed(imu_fusion_t *fusion, const float accel[3]) {
+    float a[3] = {0, 0, 1.0f};
+    float norm = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+    if (norm > 0) {
+        a[0] = accel[0] / norm;
+        a[1] = accel[1] / norm;
+        a[2] = accel[2] / norm;
+    }
+
+    if (a[2] > -0.999f) {
+        fusion->q[0] = 1.0f + a[2];
+        fusion->q[1] = a[1];
+        fusion->q[2] = -a[0];
+        fusion->q[3] = 0;
+        quaternionNormalize(fusion->q);
+    }
+    else {
+        fusion->q[0] = 0;                           // boca abajo, medio giro en x
+        fusion->q[1] = 1.0f;
+        fusion->q[2] = 0;
+        fusion->q[3] = 0;
+    }
+
+    fusion->gravity[0] = a[0];
+    fusion->gravity[1] = a[1];
+    fusion->gravity[2] = a[2];
+    fusion->yaw = 0;
+    fusion->initialized = true;
+}
+
+/*
+ * Complementario sobre el vector gravedad en lugar de angulos por eje: el giroscopo rota la gravedad
+ * estimada (dv/dt = v x w) y el acelerometro la corrige con constante de tiempo tau. Girar en yaw con el
+ * robot inclinado no mezcla pitch y roll, como pasa al integrar cada angulo por separado
+ */
+static void complementaryUpdate(imu_fusion_t *fusion, const float accel[3], const float gyro[3], float dt) {
+    float *v = fusion->gravity;
+    float rotated[3] = {
+        v[0] + (v[1] * gyro[2] - v[2] * gyro[1]) * dt,
+        v[1] + (v[2] * gyro[0] - v[0] * gyro[2]) * dt,
+        v[2] + (v[0] * gyro[1] - v[1] * gyro[0]) * dt,
+    };
+    // El yaw gira alrededor de la vertical: proyeccion de w sobre la gravedad
+    fusion->yaw = wrapPi(fusion->yaw - (v[0] * gyro[0] + v[1] * gyro[1] + v[2] * gyro[2]) * dt);
+
+    float a[3];
+    if (accelNormalize(accel, a)) {
+        float alpha = fusion->gain / (fusion->gain + dt);
+        for (uint8_t i = 0; i < 3; i++) {
+            rotated[i] = alpha * rotated[i] + (1.0f - alpha) * a[i];
+        }
+    }
+    float invNorm = 1.0f / sqrtf(rotated[0] * rotated[0] + rotated[1] * rotated[1] + rotated[2] * rotated[2]);
+    for (uint8_t i = 0; i < 3; i++) {
+        v[i] = rotated[i] * invNorm;
+    }
+}
+
+/*
+ * Madgwick, version IMU (sin magnetometro): qDot = 1/2 q * w - beta * gradiente normalizado de la
+ * diferencia entre la gravedad estimada y la medida
+ */
+static void madgwickUpdate(imu_fusion_t *fusion, const float accel[3], const float gyro[3], float dt) {
+    float *q = fusion->q;
+    float qDot0 = 0.5f * (-q[1] * gyro[0] - q[2] * gyro[1] - q[3] * gyro[2]);
+    float qDot1 = 0.5f * (q[0] * gyro[0] + q[2] * gyro[2] - q[3] * gyro[1]);
+    float qDot2 = 0.5f * (q[0] * gyro[1] - q[1] * gyro[2] + q[3] * gyro[0]);
+    float qDot3 = 0.5f * (q[0] * gyro[2] + q[1] * gyro[1] - q[2] * gyro[0]);
+
+    float a[3];
+    if (accelNormalize(accel, a)) {
+        float q0q0 = q[0] * q[0];
+        float q1q1 = q[1] * q[1];
+        float q2q2 = q[2] * q[2];
+        float q3q3 = q[3] * q[3];
+
+        float s0 = 4.0f * q[0] * q2q2 + 2.0f * q[2] * a[0] + 4.0f * q[0] * q1q1 - 2.0f * q[1] * a[1];
+        float s1 = 4.0f * q[1] * q3q3 - 2.0f * q[3] * a[0] + 4.0f * q0q0 * q[1] - 2.0f * q[0] * a[1] - 4.0f * q[1]
+                 + 8.0f * q[1] * q1q1 + 8.0f * q[1] * q2q2 + 4.0f * q[1] * a[2];
+        float s2 = 4.0f * q0q0 * q[2] + 2.0f * q[0] * a[0] + 4.0f * q[2] * q3q3 - 2.0f * q[3] * a[1] - 4.0f * q[2]
+                 + 8.0f * q[2] * q1q1 + 8.0f * q[2] * q2q2 + 4.0f * q[2] * a[2];
+        float s3 = 4.0f * q1q1 * q[3] - 2.0f * q[1] * a[0] + 4.0f * q2q2 * q[3] - 2.0f * q[2] * a[1];
+
+        float norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (norm > 0) {                             // gradiente nulo: la estimacion ya coincide
+            float step = fusion->gain / sqrtf(norm);
+            qDot0 -= step * s0;
+            qDot1 -= step * s1;
+            qDot2 -= step * s2;
+            qDot3 -= step * s3;
+        }
+    }
+
+    q[0] += qDot0 * dt;
+    q[1] += qDot1 * dt;
+    q[2] += qDot2 * dt;
+    q[3] += qDot3 * dt;
+    quaternionNormalize(q);
+}
+
+/*
+ * Mahony: el error es el producto vectorial entre la gravedad medida y la estimada, corrige al
+ * giroscopo con kp * error + ki * integral del error (el integral estima el sesgo)
+ */
+static void mahonyUpdate(imu_fusion_t *fusion, const float accel[3], const float gyro[3], float dt) {
+    float *q = fusion->q;
+    float g[3] = {gyro[0], gyro[1], gyro[2]};
+
+    float a[3];
+    if (accelNormalize(accel, a)) {
+        float vx = q[1] * q[3] - q[0] * q[2];       // media gravedad estimada
+        float vy = q[0] * q[1] + q[2] * q[3];
+        float vz = q[0] * q[0] - 0.5f + q[3] * q[3];
+        float error[3] = {
+            a[1] * vz - a[2] * vy,
+            a[2] * vx - a[0] * vz,
+            a[0] * vy - a[1] * vx,
+        };
+        for (uint8_t i = 0; i < 3; i++) {
+            fusion->integralError[i] += 2.0f * fusion->gainIntegral * error[i] * dt;
+            g[i] += 2.0f * fusion->gain * error[i];
+        }
+    }
+    for (uint8_t i = 0; i < 3; i++) {
+        g[i] = (g[i] + fusion->integralError[i]) * (0.5f * dt);
+    }
+
+    float qa = q[0], qb = q[1], qc = q[2];
+    q[0] += -qb * g[0] - qc * g[1] - q[3] * g[2];
+    q[1] += qa * g[0] + qc * g[2] - q[3] * g[1];
+    q[2] += qa * g[1] - qb * g[2] + q[3] * g[0];
+    q[3] += qa * g[2] + qb * g[1] - qc * g[0];
+    quaternionNormalize(q);
+}
+
+void imuFusionInit(imu_fusion_t *fusion, uint8_t engine) {
+    *fusion = (imu_fusion_t){
+        .engine = engine,
+        .q = {1.0f, 0, 0, 0},
+    };
+    switch (engine) {
+        case IMU_FUSION_COMPLEMENTARY:
+            fusion->gain = IMU_FUSION_COMPLEMENTARY_TAU_S;
+            break;
+        case IMU_FUSION_MADGWICK:
+            fusion->gain = IMU_FUSION_MADGWICK_BETA;
+            break;
+        case IMU_FUSION_MAHONY:
+            fusion->gain = IMU_FUSION_MAHONY_KP;
+            fusion->gainIntegral = IMU_FUSION_MAHONY_KI;
+            break;
+    }
+}
+
+void imuFusionUpdate(imu_fusion_t *fusion, const float accel[3], const float gyro[3], float dt) {
+    if (!fusion->initialized) {
+        imuFusionSeed(fusion, accel);
+    }
+
+    switch (fusion->engine) {
+        case IMU_FUSION_COMPLEMENTARY:
+            gyroToRates(gyro, fusion->rates);
+            complementaryUpdate(fusion, accel, gyro, dt);
+            break;
+        case IMU_FUSION_MADGWICK:
+            gyroToRates(gyro, fusion->rates);
+            madgwickUpdate(fusion, accel, gyro, dt);
+            break;
+        case IMU_FUSION_MAHONY: {
+            mahonyUpdate(fusion, accel, gyro, dt);
+            const float *bias = fusion->integralError;
+            float corrected[3] = {gyro[0] + bias[0], gyro[1] + bias[1], gyro[2] + bias[2]};
+            gyroToRates(corrected, fusion->rates);
+            break;
+        }
+    }
+}
+
+void imuFusionUpdateRaw(imu_fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3], float dt) {
+    const float accelScale = 1.0f / IMU_FUSION_ACCEL_LSB_PER_G;
+    const float gyroScale = DEG_TO_RAD / IMU_FUSION_GYRO_LSB_PER_DPS;
+    float a[3] = {accel[0] * accelScale, accel[1] * accelScale, accel[2] * accelScale};
+    float g[3] = {gyro[0] * gyroScale, gyro[1] * gyroScale, gyro[2] * gyroScale};
+    imuFusionUpdate(fusion, a, g, dt);
+}
+
+void imuFusionQuaternionToYpr(const float q[4], float ypr[3]) {
+    float gx = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    float gy = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    float gz = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+    ypr[ANGLE_YAW] = atan2f(2.0f * q[1] * q[2] - 2.0f * q[0] * q[3], 2.0f * q[0] * q[0] + 2.0f * q[1] * q[1] - 1.0f);
+    ypr[ANGLE_PITCH] = atan2f(gx, sqrtf(gy * gy + gz * gz));
+    ypr[ANGLE_ROLL] = atan2f(gy, gz);
+    if (gz < 0) {                                   // boca abajo, igual que dmpGetYawPitchRoll
+        ypr[ANGLE_PITCH] = (ypr[ANGLE_PITCH] > 0 ? (float)M_PI : -(float)M_PI) - ypr[ANGLE_PITCH];
+    }
+}
+
+void imuFusionGetOutput(const imu_fusion_t *fusion, imu_fusion_output_t *out) {
+    float ypr[3];
+    if (fusion->engine == IMU_FUSION_COMPLEMENTARY) {
+        const float *v = fusion->gravity;
+        ypr[ANGLE_YAW] = fusion->yaw;
+        ypr[ANGLE_PITCH] = atan2f(v[0], sqrtf(v[1] * v[1] + v[2] * v[2]));
+        ypr[ANGLE_ROLL] = atan2f(v[1], v[2]);
+    }
+    else {
+        imuFusionQuaternionToYpr(fusion->q, ypr);
+    }
+    out->yaw = ypr[ANGLE_YAW] * RAD_TO_DEG;
+    out->pitch = ypr[ANGLE_PITCH] * RAD_TO_DEG;
+    out->roll = ypr[ANGLE_ROLL] * RAD_TO_DEG;
+    out->rateYaw = fusion->rates[ANGLE_YAW] * RAD_TO_DEG;
+    out->ratePitch = fusion->rates[ANGLE_PITCH] * RAD_TO_DEG;
+    out->rateRoll = fusion->rates[ANGLE_ROLL] * RAD_TO_DEG;
+}
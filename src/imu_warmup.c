@@ -0,0 +1,100 @@
+#include "imu_warmup.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+static void resetWindow(imu_warmup_t *warmup) {
+    warmup->windowCount = 0;
+    warmup->pitchSum = 0;
+    warmup->pitchSumSq = 0;
+    memset(warmup->gyroSum, 0, sizeof(warmup->gyroSum));
+    memset(warmup->gyroSumSq, 0, sizeof(warmup->gyroSumSq));
+}
+
+static float windowStd(float sum, float sumSq, float invCount) {
+    float mean = sum * invCount;
+    float variance = sumSq * invCount - mean * mean;
+    return variance > 0 ? sqrtf(variance) : 0;
+}
+
+void imuWarmupInit(imu_warmup_t *warmup, uint16_t sampleHz, uint16_t maxSamples) {
+    memset(warmup, 0, sizeof(*warmup));
+    warmup->state = IMU_WARMUP_RUNNING;
+    warmup->windowSamples = (uint32_t)sampleHz * IMU_WARMUP_WINDOW_MS / 1000;
+    if (warmup->windowSamples < 2) {
+        warmup->windowSamples = 2;
+    }
+    warmup->maxSamples = maxSamples;
+}
+
+/*
+ * Cierra la ventana en curso.
+ * @return IMU_WARMUP_CORRECT si esta quieta con sesgo y quedan correcciones, si no state
+ */
+static uint8_t closeWindow(imu_warmup_t *warmup) {
+    float invCount = 1.0f / warmup->windowCount;
+    float previousMean = warmup->pitchMean;
+
+    warmup->pitchMean = warmup->pitchRef + warmup->pitchSum * invCount;
+    warmup->pitchStd = windowStd(warmup->pitchSum, warmup->pitchSumSq, invCount);
+    warmup->gyroStd = 0;
+    bool biasOk = true;
+    for (uint8_t i = 0; i < 3; i++) {
+        float std = windowStd(warmup->gyroSum[i], warmup->gyroSumSq[i], invCount);
+        if (std > warmup->gyroStd) {
+            warmup->gyroStd = std;
+        }
+        warmup->gyroBias[i] = warmup->gyroSum[i] * invCount;
+        if (fabsf(warmup->gyroBias[i]) > IMU_WARMUP_GYRO_BIAS_MAX_DPS) {
+            biasOk = false;
+        }
+    }
+    resetWindow(warmup);
+
+    if (warmup->pitchStd > IMU_WARMUP_PITCH_STD_MAX_DEG || warmup->gyroStd > IMU_WARMUP_GYRO_STD_MAX_DPS) {
+        warmup->hasPrevious = false;                // se movio: la media del giroscopo no es el sesgo
+        return warmup->state;
+    }
+    if (!biasOk && warmup->corrections < IMU_WARMUP_MAX_CORRECTIONS) {
+        warmup->corrections++;
+        warmup->hasPrevious = false;                // cambian los offsets, se vuelve a medir desde cero
+        return IMU_WARMUP_CORRECT;
+    }
+    if (warmup->hasPrevious) {
+        warmup->pitchDrift = warmup->pitchMean - previousMean;
+        if (biasOk && fabsf(warmup->pitchDrift) <= IMU_WARMUP_PITCH_DRIFT_MAX_DEG) {
+            warmup->state = IMU_WARMUP_SETTLED;
+        }
+    }
+    warmup->hasPrevious = true;
+    return warmup->state;
+}
+
+uint8_t imuWarmupUpdate(imu_warmup_t *warmup, float pitch, const float gyroDps[3]) {
+    if (warmup->state != IMU_WARMUP_RUNNING) {
+        return warmup->state;
+    }
+    warmup->samples++;
+
+    if (warmup->windowCount == 0) {
+        warmup->pitchRef = pitch;
+    }
+    float delta = pitch - warmup->pitchRef;
+    warmup->pitchSum += delta;
+    warmup->pitchSumSq += delta * delta;
+    for (uint8_t i = 0; i < 3; i++) {
+        warmup->gyroSum[i] += gyroDps[i];
+        warmup->gyroSumSq[i] += gyroDps[i] * gyroDps[i];
+    }
+
+    uint8_t result = warmup->state;
+    if (++warmup->windowCount >= warmup->windowSamples) {
+        result = closeWindow(warmup);
+    }
+    if (warmup->state == IMU_WARMUP_RUNNING && warmup->samples >= warmup->maxSamples) {
+        warmup->state = IMU_WARMUP_TIMEOUT;
+        result = warmup->state;
+    }
+    return result;
+}
@@ -0,0 +1,81 @@
+#include "string.h"
+#include "stdbool.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+#include "loop_timing.h"
+
+typedef struct {
+    uint32_t periodCycles[LOOP_TIMING_SAMPLES];
+    uint32_t execCycles[LOOP_TIMING_SAMPLES];
+    uint32_t count;                             // ciclos completos desde el arranque
+    uint32_t pendingStart;                      // inicio del ciclo en curso
+    uint32_t lastStart;                         // inicio del ultimo ciclo completo
+    bool     hasLastStart;
+} loop_timing_ring_t;
+
+static loop_timing_ring_t rings[LOOP_TIMING_COUNT];
+
+void loopTimingStart(uint8_t loop) {
+    rings[loop].pendingStart = esp_cpu_get_cycle_count();
+}
+
+void loopTimingEnd(uint8_t loop) {
+    loop_timing_ring_t *ring = &rings[loop];
+    uint32_t now = esp_cpu_get_cycle_count();
+
+    // El primer ciclo no tiene periodo, solo marca la referencia
+    if (ring->hasLastStart) {
+        uint32_t index = ring->count & (LOOP_TIMING_SAMPLES - 1);
+        ring->periodCycles[index] = ring->pendingStart - ring->lastStart;         // resta sin signo, tolera el desborde del contador
+        ring->execCycles[index] = now - ring->pendingStart;
+        ring->count++;
+    }
+    ring->lastStart = ring->pendingStart;
+    ring->hasLastStart = true;
+}
+
+static void sortCycles(uint32_t *values, uint16_t len) {
+    for (uint16_t i = 1; i < len; i++) {
+        uint32_t value = values[i];
+        uint16_t j = i;
+        while (j > 0 && values[j - 1] > value) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+}
+
+static void computeStats(uint32_t *values, uint16_t len, uint32_t cyclesPerUs,
+                         uint32_t *minUs, uint32_t *maxUs, uint32_t *meanUs, uint32_t *p99Us) {
+    uint64_t sum = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        sum += values[i];
+    }
+    sortCycles(values, len);
+    *minUs = values[0] / cyclesPerUs;
+    *maxUs = values[len - 1] / cyclesPerUs;
+    *meanUs = (uint32_t)(sum / len / cyclesPerUs);
+    *p99Us = values[(len * 99 + 99) / 100 - 1] / cyclesPerUs;
+}
+
+void loopTimingGetStats(uint8_t loop, loop_timing_stats_t *stats) {
+    uint32_t period[LOOP_TIMING_SAMPLES];
+    uint32_t exec[LOOP_TIMING_SAMPLES];
+    const loop_timing_ring_t *ring = &rings[loop];
+
+    memset(stats, 0, sizeof(*stats));
+    uint32_t count = ring->count;
+    uint16_t len = count < LOOP_TIMING_SAMPLES ? count : LOOP_TIMING_SAMPLES;
+    if (!len) {
+        return;
+    }
+    memcpy(period, ring->periodCycles, sizeof(period));
+    memcpy(exec, ring->execCycles, sizeof(exec));
+
+    uint32_t cyclesPerUs = esp_rom_get_cpu_ticks_per_us();
+    stats->samples = len;
+    computeStats(period, len, cyclesPerUs, &stats->periodMinUs, &stats->periodMaxUs, &stats->periodMeanUs, &stats->periodP99Us);
+    computeStats(exec, len, cyclesPerUs, &stats->execMinUs, &stats->execMaxUs, &stats->execMeanUs, &stats->execP99Us);
+}
@@ -1,91 +1,627 @@
 #include "../components/MPU6050/MPU6050_6Axis_MotionApps20.h"
 
 #include "mpu6050_wrapper.h"
+#include "imu_fusion.h"
+#include "mpu_fifo.h"
+#include "mpu_i2c.h"
+#include "imu_warmup.h"
+#include "imu_calibration.h"
+#include "storage_flash.h"
+#include "loop_timing.h"
+#include "main.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define MPU_INT_TIMEOUT_MS		100			// si no llega el flanco en este tiempo se lee igual la FIFO
+#define MPU_STATS_LOG_SAMPLES	1000
+#define MPU_TEMP_DECIMATION		100			// muestras por lectura de temperatura, cambia lento
+#define MPU_DMP_BASE_DIVIDER	4			// setRate sobre 1 kHz: la tasa que asume el firmware del DMP, 200 Hz
+#define MPU_DMP_BASE_RATE_HZ	(1000 / (MPU_DMP_BASE_DIVIDER + 1))
+// Divisor de la FIFO del DMP (D_0_22, banco 2 0x16) para entregar a CONTROL_TICK_PERIOD_US, ver CONTROL_TICK_FROM_IMU.
+// El firmware del componente trae 0x13 (10 Hz): se escribe en cada arranque, despues de dmpInitialize
+#define MPU_DMP_RATE_DIVIDER	(MPU_DMP_BASE_RATE_HZ * CONTROL_TICK_PERIOD_US / 1000000 - 1)
+#define MPU_DMP_RATE_HZ			(MPU_DMP_BASE_RATE_HZ / (MPU_DMP_RATE_DIVIDER + 1))
+// Periodo real de la FIFO con el divisor configurado: 10 ms (100 Hz, divisor 1 sobre los 200 Hz) con el tick de 10 ms
+#define MPU_DMP_PERIOD_US		((MPU_DMP_RATE_DIVIDER + 1) * (1000000 / MPU_DMP_BASE_RATE_HZ))
+#if IMU_FUSION_ENGINE == IMU_FUSION_DMP && \
+	(((MPU_DMP_BASE_RATE_HZ * CONTROL_TICK_PERIOD_US) % 1000000) || MPU_DMP_RATE_DIVIDER < 0 || MPU_DMP_RATE_DIVIDER > 255)
+#error CONTROL_TICK_PERIOD_US tiene que ser un multiplo del periodo del DMP (5 ms), hasta 1.28 s
+#endif
+#define MPU_DMP_WARMUP_SAMPLE_HZ	MPU_DMP_RATE_HZ		// el detector y la calibracion ven cada paquete de la FIFO
+#define MPU_DMP_WARMUP_MAX_SAMPLES	(10 * MPU_DMP_WARMUP_SAMPLE_HZ)	// 10 s, lo que se descartaba siempre antes del detector
+
+#if IMU_FUSION_ENGINE != IMU_FUSION_DMP
+#define IMU_FUSION_RATE_DIVIDER		(1000 / IMU_FUSION_RATE_HZ - 1)		// sobre 1 kHz, con DLPF
+#define IMU_FUSION_PERIOD_US		(1000000 / IMU_FUSION_RATE_HZ)
+#define IMU_FUSION_DECIMATION		(CONTROL_TICK_PERIOD_US / IMU_FUSION_PERIOD_US)
+#define IMU_FUSION_MAX_DT_S			(4 * IMU_FUSION_PERIOD_US * 1e-6f)
+#define IMU_FUSION_WARMUP_SAMPLE_HZ	(IMU_FUSION_RATE_HZ / IMU_FUSION_DECIMATION)	// el detector ve lo que sale a la cola
+#define IMU_FUSION_WARMUP_MAX_SAMPLES	IMU_FUSION_WARMUP_SAMPLE_HZ			// 1 s, lo que se descartaba antes del detector
+#if (1000 % IMU_FUSION_RATE_HZ) || (CONTROL_TICK_PERIOD_US % IMU_FUSION_PERIOD_US)
+#error IMU_FUSION_RATE_HZ tiene que dividir 1 kHz y CONTROL_TICK_PERIOD_US ser multiplo de su periodo
+#endif
+#endif
+
+static const char *TAG = "MPU6050";
+
 QueueHandle_t mpu6050QueueHandler;
 
 TaskHandle_t readHandler;
 mpu6050_init_t MpuConfigInit;
-uint8_t enableCalibrate = false;
 
-void mpu6050Handler(void*){
-	// quaternion_wrapper_t q;     		// [w, x, y, z]         quaternion container
-	// vector_float_wrapper_t gravity;	// [x, y, z]            gravity vector
-	Quaternion q;         				// [w, x, y, z]         quaternion container
-	VectorFloat gravity;    			// [x, y, z]            gravity vector
-	float ypr[3];                       // [yaw, pitch, roll]   yaw/pitch/roll container and gravity vector
-	uint16_t packetSize = 42;           // expected DMP packet size (default is 42 bytes)
-	uint16_t fifoCount;                 // count of all bytes currently in FIFO
-	uint8_t fifoBuffer[64];             // FIFO storage buffer
-	uint8_t mpuIntStatus;               // holds actual interrupt status byte from MPU
-	uint16_t contMeasure = 0;
+static mpu6050_stats_t mpuStats;
+static volatile int64_t lastIntUs;				// marca de tiempo del ultimo flanco INT, dato listo en la FIFO
+
+static portMUX_TYPE imuStatusMux = portMUX_INITIALIZER_UNLOCKED;
+static imu_status_t imuStatus;
+static imu_offsets_t imuOffsets;				// los que estan en los registros del MPU
+static bool offsetsToSave;
+static bool calibrationRequested;				// desde commsManager, con imuStatusMux
+static imu_calibration_t calibration;			// solo la tarea del MPU
+
+static void IRAM_ATTR mpu6050IsrHandler(void *arg) {
+	lastIntUs = esp_timer_get_time();
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	vTaskNotifyGiveFromISR(readHandler, &higherPriorityTaskWoken);
+	if (higherPriorityTaskWoken) {
+		portYIELD_FROM_ISR();
+	}
+}
 
-	MPU6050 mpu = MPU6050();
-	mpu.initialize();
-	mpu.dmpInitialize();
+/*
+ * Configura el pin INT del MPU para despertar a la tarea de lectura, si no es posible queda en polling
+ */
+static uint8_t mpu6050InitInterrupt(MPU6050 *mpu) {
+
+	if (!GPIO_IS_VALID_GPIO(MpuConfigInit.intGpio)) {
+		ESP_LOGW(TAG, "GPIO INT %d invalido, lectura por polling", MpuConfigInit.intGpio);
+		return MPU6050_READ_POLLING;
+	}
 
-	// This need to be setup individually
-	// mpu.setXGyroOffset(220);
-	// mpu.setYGyroOffset(76);
-	// mpu.setZGyroOffset(-85);
-	// mpu.setZAccelOffset(1788);
+	mpu->setInterruptMode(false);			// activo en alto
+	mpu->setInterruptDrive(false);			// push-pull
+	mpu->setInterruptLatch(false);			// pulso de 50us por cada paquete DMP
+
+	gpio_config_t intConfig = {
+		.pin_bit_mask = (1ULL << MpuConfigInit.intGpio),
+		.mode = GPIO_MODE_INPUT,
+		.pull_up_en = GPIO_PULLUP_DISABLE,
+		.pull_down_en = GPIO_PULLDOWN_ENABLE,
+		.intr_type = GPIO_INTR_POSEDGE,
+	};
+	ESP_ERROR_CHECK(gpio_config(&intConfig));
+
+	esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+	if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {		// INVALID_STATE: el servicio ya estaba instalado
+		ESP_LOGE(TAG, "Error instalando isr service: %d, lectura por polling", err);
+		return MPU6050_READ_POLLING;
+	}
+	ESP_ERROR_CHECK(gpio_isr_handler_add(MpuConfigInit.intGpio, mpu6050IsrHandler, NULL));
+	return MPU6050_READ_INTERRUPT;
+}
 
-	if (enableCalibrate) {
-		// mpu.CalibrateAccel(6);
-    // mpu.CalibrateGyro(6);
-		enableCalibrate = false;
+/*
+ * Fija la tasa de la FIFO del DMP a la del tick. Va despues de dmpInitialize, que carga el firmware con su divisor
+ */
+static void mpu6050SetDmpRate(MPU6050 *mpu) {
+	const uint8_t rate[2] = {0x00, MPU_DMP_RATE_DIVIDER};
+	uint8_t readBack[2] = {0};
+
+	mpu->setRate(MPU_DMP_BASE_DIVIDER);
+	mpu->writeMemoryBlock(rate, sizeof(rate), 0x02, 0x16);
+	mpu->readMemoryBlock(readBack, sizeof(readBack), 0x02, 0x16);
+	if (memcmp(rate, readBack, sizeof(rate))) {
+		ESP_LOGE(TAG, "No se pudo fijar la tasa del DMP: divisor leido 0x%02x, esperado 0x%02x", readBack[1], rate[1]);
+		return;
 	}
+	ESP_LOGI(TAG, "DMP a %d Hz (divisor 0x%02x)", MPU_DMP_RATE_HZ, MPU_DMP_RATE_DIVIDER);
+}
 
-	mpu.setDMPEnabled(true);
+/*
+ * Aplica los offsets de la NVS (los del ultimo arranque que se asento); si no hay quedan los de fabrica.
+ * Va despues de dmpInitialize, por I2Cdev
+ */
+static void mpu6050RestoreOffsets(MPU6050 *mpu) {
+	imu_offsets_t offsets;
+	uint8_t source = IMU_OFFSETS_FACTORY;
+	if (getFromStorageImuOffsets(&offsets)) {
+		mpu->setXAccelOffset(offsets.accel[0]);
+		mpu->setYAccelOffset(offsets.accel[1]);
+		mpu->setZAccelOffset(offsets.accel[2]);
+		mpu->setXGyroOffset(offsets.gyro[0]);
+		mpu->setYGyroOffset(offsets.gyro[1]);
+		mpu->setZGyroOffset(offsets.gyro[2]);
+		source = IMU_OFFSETS_STORED;
+	}
 
-	while(1){
-	    mpuIntStatus = mpu.getIntStatus();
-		// get current FIFO count
-		fifoCount = mpu.getFIFOCount();
+	// Se leen de vuelta: sin NVS son los de fabrica, y tambien confirma que se escribieron
+	offsets.accel[0] = mpu->getXAccelOffset();
+	offsets.accel[1] = mpu->getYAccelOffset();
+	offsets.accel[2] = mpu->getZAccelOffset();
+	offsets.gyro[0] = mpu->getXGyroOffset();
+	offsets.gyro[1] = mpu->getYGyroOffset();
+	offsets.gyro[2] = mpu->getZGyroOffset();
+
+	portENTER_CRITICAL(&imuStatusMux);
+	imuOffsets = offsets;
+	imuStatus.offsetsSource = source;
+	memcpy(imuStatus.gyroOffsets, offsets.gyro, sizeof(imuStatus.gyroOffsets));
+	portEXIT_CRITICAL(&imuStatusMux);
+	ESP_LOGI(TAG, "Offsets %s: accel %d %d %d, gyro %d %d %d", source == IMU_OFFSETS_STORED ? "de la NVS" : "de fabrica",
+		offsets.accel[0], offsets.accel[1], offsets.accel[2], offsets.gyro[0], offsets.gyro[1], offsets.gyro[2]);
+}
 
-	    if ((mpuIntStatus & 0x10) || fifoCount == 1024) {
-	        // reset so we can continue cleanly
-	        mpu.resetFIFO();
+/*
+ * Resta el sesgo medido a los offsets del giroscopo, los tres ejes en una transaccion por mpu_i2c
+ */
+static void mpu6050CorrectGyroOffsets(const float biasDps[3]) {
+	imu_offsets_t offsets = imuOffsets;
+	for (uint8_t i = 0; i < 3; i++) {
+		int32_t value = offsets.gyro[i] - lroundf(biasDps[i] * MPU_GYRO_OFFSET_LSB_PER_DPS);
+		offsets.gyro[i] = value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+	}
+	if (mpuI2cWriteWords(MPU_REG_XG_OFFS_USRH, offsets.gyro, 3) != ESP_OK) {
+		ESP_LOGW(TAG, "No se pudieron corregir los offsets del giroscopo");
+		return;
+	}
+
+	portENTER_CRITICAL(&imuStatusMux);
+	imuOffsets = offsets;
+	memcpy(imuStatus.gyroOffsets, offsets.gyro, sizeof(imuStatus.gyroOffsets));
+	portEXIT_CRITICAL(&imuStatusMux);
+	ESP_LOGI(TAG, "Sesgo %.2f %.2f %.2f grados/s, offsets del giroscopo %d %d %d", biasDps[0], biasDps[1], biasDps[2],
+		offsets.gyro[0], offsets.gyro[1], offsets.gyro[2]);
+}
+
+/*
+ * Una muestra del arranque: alimenta el detector y corrige los offsets del giroscopo si lo pide. Al
+ * asentarse (o vencer el maximo) marca la primera muestra y, si se asento, deja los offsets para guardar.
+ * Solo mientras el detector esta en IMU_WARMUP_RUNNING.
+ * @return true si la muestra ya va a la cola
+ */
+static bool mpu6050Warmup(imu_warmup_t *warmup, float pitch, const float gyroDps[3]) {
+	if (imuWarmupUpdate(warmup, pitch, gyroDps) == IMU_WARMUP_CORRECT) {
+		mpu6050CorrectGyroOffsets(warmup->gyroBias);
+	}
+	bool ready = warmup->state != IMU_WARMUP_RUNNING;
+	if (warmup->windowCount != 0 && !ready) {
+		return false;							// el estado solo cambia al cerrar una ventana
+	}
+
+	portENTER_CRITICAL(&imuStatusMux);
+	imuStatus.warmupState = warmup->state;
+	imuStatus.warmupSamples = warmup->samples - ready;
+	imuStatus.gyroCorrections = warmup->corrections;
+	imuStatus.gyroStd = warmup->gyroStd;
+	imuStatus.pitchStd = warmup->pitchStd;
+	imuStatus.pitchDrift = warmup->pitchDrift;
+	imuStatus.gyroBiasX = warmup->gyroBias[0];
+	imuStatus.gyroBiasY = warmup->gyroBias[1];
+	imuStatus.gyroBiasZ = warmup->gyroBias[2];
+	if (ready) {
+		imuStatus.firstSampleMs = esp_timer_get_time() / 1000;
+		// Un arranque asentado con offsets que no estaban en la NVS deja los de ahora como los ultimos buenos
+		offsetsToSave = warmup->state == IMU_WARMUP_SETTLED &&
+			(imuStatus.offsetsSource != IMU_OFFSETS_STORED || warmup->corrections);
+	}
+	portEXIT_CRITICAL(&imuStatusMux);
+
+	if (ready) {
+		ESP_LOGI(TAG, "Primera muestra a los %" PRIu32 " ms, %s tras %u muestras (pitch std %.3f, sesgo %.2f %.2f %.2f grados/s)",
+			imuStatus.firstSampleMs, warmup->state == IMU_WARMUP_SETTLED ? "asentado" : "sin asentarse",
+			imuStatus.warmupSamples, warmup->pitchStd, warmup->gyroBias[0], warmup->gyroBias[1], warmup->gyroBias[2]);
+	}
+	return ready;
+}
+
+/*
+ * Escribe los seis offsets entre dos muestras, cada sensor en una transaccion (los tres ejes juntos)
+ * @return false si alguna fallo, imuOffsets queda con lo que se lee de vuelta
+ */
+static bool mpu6050WriteOffsets(const imu_offsets_t *offsets) {
+	imu_offsets_t written = *offsets;
+	bool ok = mpuI2cWriteWords(MPU_REG_XA_OFFS_H, written.accel, 3) == ESP_OK &&
+		mpuI2cWriteWords(MPU_REG_XG_OFFS_USRH, written.gyro, 3) == ESP_OK;
+	if (!ok) {
+		mpuI2cReadWords(MPU_REG_XA_OFFS_H, written.accel, 3);
+		mpuI2cReadWords(MPU_REG_XG_OFFS_USRH, written.gyro, 3);
+	}
+
+	portENTER_CRITICAL(&imuStatusMux);
+	imuOffsets = written;
+	memcpy(imuStatus.gyroOffsets, written.gyro, sizeof(imuStatus.gyroOffsets));
+	portEXIT_CRITICAL(&imuStatusMux);
+	return ok;
+}
+
+/*
+ * Una muestra cruda para la calibracion pedida con mpu6050_recalibrate. Arranca despues del detector de
+ * arranque, escribe los offsets cuando el calibrador los pide y al terminar bien los deja para guardar.
+ * @return true mientras la calibracion esta en curso, la muestra se marca como calibrating
+ */
+static bool mpu6050CalibrationStep(const int16_t accel[3], const int16_t gyro[3], float gyroLsbPerDps, uint16_t sampleHz) {
+	if (calibration.state != IMU_CALIBRATION_MEASURING && calibration.state != IMU_CALIBRATION_RESTORING) {
+		if (imuStatus.warmupState == IMU_WARMUP_RUNNING) {
+			return false;							// el detector tambien corrige offsets, despues
+		}
+		portENTER_CRITICAL(&imuStatusMux);
+		bool start = calibrationRequested;
+		calibrationRequested = false;
+		portEXIT_CRITICAL(&imuStatusMux);
+		if (!start) {
+			return false;
+		}
+		imuCalibrationStart(&calibration, &imuOffsets, sampleHz, IMU_FUSION_ACCEL_LSB_PER_G, gyroLsbPerDps);
+		ESP_LOGI(TAG, "Calibrando IMU: rondas de %u muestras", calibration.roundSamples);
+	}
+
+	bool write = imuCalibrationUpdate(&calibration, accel, gyro);
+	while (write && !mpu6050WriteOffsets(&calibration.offsets)) {
+		write = imuCalibrationAbort(&calibration, IMU_CALIBRATION_ERROR_BUS);	// vuelve a los de antes, una vez
+	}
+	bool running = calibration.state == IMU_CALIBRATION_MEASURING || calibration.state == IMU_CALIBRATION_RESTORING;
+
+	portENTER_CRITICAL(&imuStatusMux);
+	imuStatus.calibrationState = calibration.state;
+	imuStatus.calibrationProgress = calibration.progress;
+	imuStatus.calibrationRound = calibration.round;
+	imuStatus.calibrationError = calibration.error;
+	imuStatus.accelResidual = calibration.accelResidualG;
+	imuStatus.gyroResidual = calibration.gyroResidualDps;
+	if (calibration.state == IMU_CALIBRATION_DONE) {
+		imuStatus.offsetsSource = IMU_OFFSETS_CALIBRATED;
+		offsetsToSave = true;
+	}
+	portEXIT_CRITICAL(&imuStatusMux);
+
+	if (calibration.state == IMU_CALIBRATION_DONE) {
+		ESP_LOGI(TAG, "IMU calibrado en %u rondas (error %.4f g, %.3f grados/s): accel %d %d %d, gyro %d %d %d",
+			calibration.round, calibration.accelResidualG, calibration.gyroResidualDps, calibration.offsets.accel[0],
+			calibration.offsets.accel[1], calibration.offsets.accel[2], calibration.offsets.gyro[0],
+			calibration.offsets.gyro[1], calibration.offsets.gyro[2]);
+	}
+	else if (calibration.state == IMU_CALIBRATION_FAILED) {
+		ESP_LOGW(TAG, "Calibracion del IMU fallida: error %u en la ronda %u", calibration.error, calibration.round);
+	}
+	if (!running) {
+		calibration.state = IMU_CALIBRATION_IDLE;	// el resultado queda en imuStatus
+	}
+	return running;
+}
+
+static void mpu6050LogStats(void) {
+	mpu6050_stats_t stats;
+	mpu6050_getStats(&stats);
+	ESP_LOGD(TAG, "transacciones/muestra: %.2f, bytes/muestra: %.1f, cpu/muestra: %.1f us (run time %.1f us), "
+		"errores i2c: %" PRIu32 ", desbordes fifo: %" PRIu32 ", timeouts: %" PRIu32,
+		stats.busTransactionsPerSample, stats.busBytesPerSample, stats.cpuTimeUsPerSample, stats.runTimeUsPerSample,
+		stats.i2cErrors, stats.fifoOverflows, stats.intTimeouts);
+}
+
+#if IMU_FUSION_ENGINE == IMU_FUSION_DMP
+/*
+ * Lee los paquetes del DMP de la FIFO en rafagas (mpuFifoDrain) y convierte el cuaternion a yaw, pitch
+ * y roll. Por ciclo: contador de la FIFO y una transaccion cada MPU_FIFO_BURST_PACKETS paquetes; el
+ * INT_STATUS solo en polling y la temperatura cada MPU_TEMP_DECIMATION muestras. El bus es el de
+ * mpu_i2c: el DMP ya tiene que estar habilitado
+ */
+static void mpu6050DmpLoop(void) {
+	float quaternions[MPU_FIFO_FORWARD_PACKETS][4];	// [w, x, y, z] de los paquetes a entregar, del mas viejo al mas nuevo
+	int16_t gyros[MPU_FIFO_FORWARD_PACKETS][3];		// crudo del DMP, solo para el detector de arranque
+	float ypr[3];                       // [yaw, pitch, roll]
+	float temp = 0;
+	uint16_t fifoCount;                 // count of all bytes currently in FIFO
+	const mpu_fifo_bus_t bus = {.read = mpuI2cReadFifo, .ctx = NULL};
+	imu_warmup_t warmup;
+	vector_queue_t held = {};			// ultima salida entregada antes de calibrar
+	bool holding = false;
+	bool wasCalibrating = false;
 
-	    // otherwise, check for DMP data ready interrupt frequently)
-	    } else if (mpuIntStatus & 0x02) {
-	        // wait for correct available data length, should be a VERY short wait
-	        while (fifoCount < packetSize) fifoCount = mpu.getFIFOCount();
+	imuWarmupInit(&warmup, MPU_DMP_WARMUP_SAMPLE_HZ, MPU_DMP_WARMUP_MAX_SAMPLES);
 
-	        // read a packet from FIFO
-	        mpu.getFIFOBytes(fifoBuffer, packetSize);
-	 		mpu.dmpGetQuaternion(&q, fifoBuffer);
-			mpu.dmpGetGravity(&gravity, &q);
-			mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
+	int64_t activeSince = esp_timer_get_time();
+	int64_t sampleUs = 0;
 
+	while(1){
+		if (mpuStats.readMode == MPU6050_READ_INTERRUPT) {
+			if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MPU_INT_TIMEOUT_MS))) {
+				mpuStats.intTimeouts++;
+			}
+			activeSince = esp_timer_get_time();
+			sampleUs = lastIntUs;
+		}
+		loopTimingStart(LOOP_TIMING_MPU);
+
+		// Con interrupcion alcanza el contador: 1024 no es multiplo del paquete, la FIFO solo llega a
+		// MPU_FIFO_SIZE desbordada. En polling el INT_STATUS dice si el DMP dejo un paquete
+		bool overflow = false;
+		if (mpuStats.readMode == MPU6050_READ_POLLING) {
+			uint8_t mpuIntStatus;
+			if (mpuI2cReadIntStatus(&mpuIntStatus) != ESP_OK) {
+				continue;
+			}
+			overflow = mpuIntStatus & MPU_INT_STATUS_FIFO_OFLOW;
+			if (!overflow && !(mpuIntStatus & MPU_INT_STATUS_DMP)) {
+				continue;
+			}
+		}
+		if (mpuI2cReadFifoCount(&fifoCount) != ESP_OK) {
+			mpuStats.cpuTimeUs += esp_timer_get_time() - activeSince;
+			continue;
+		}
+		if (mpuStats.readMode == MPU6050_READ_POLLING) {
+			// wait for correct available data length, should be a VERY short wait
+			while (!overflow && fifoCount < MPU_DMP_PACKET_SIZE) {
+				mpuI2cReadFifoCount(&fifoCount);
+			}
+		}
+
+		mpu_fifo_drain_t drain = {0};
+		if (!overflow) {
+			drain = mpuFifoDrain(&bus, fifoCount, quaternions, warmup.state == IMU_WARMUP_RUNNING ? gyros : NULL,
+				MPU_FIFO_FORWARD_PACKETS);
+		}
+		if (overflow || drain.overflow || drain.error) {
+	        // reset so we can continue cleanly
+			mpuI2cResetFifo();
+			mpuStats.fifoResets++;
+			if (!drain.error) {
+				mpuStats.fifoOverflows++;
+			}
+			mpuStats.cpuTimeUs += esp_timer_get_time() - activeSince;
+			continue;
+		}
+		if (!drain.decoded) {					// paquete incompleto, llega con el proximo flanco
+			mpuStats.cpuTimeUs += esp_timer_get_time() - activeSince;
+			continue;
+		}
+		mpuStats.skippedPackets += drain.packets - drain.decoded;
+		if (mpuStats.readMode == MPU6050_READ_POLLING) {
+			sampleUs = esp_timer_get_time();
+		}
+		if (!(mpuStats.samples % MPU_TEMP_DECIMATION)) {
+			mpuI2cReadTemperature(&temp);
+		}
+
+		// Calibracion en segundo plano: una lectura cruda por ciclo, solo mientras esta pedida o en curso
+		bool calibrating = false;
+		if (calibrationRequested || calibration.state != IMU_CALIBRATION_IDLE) {
+			int16_t accel[3], gyro[3];
+			calibrating = calibration.state != IMU_CALIBRATION_IDLE;
+			if (mpuI2cReadMotion6(accel, gyro, NULL) == ESP_OK) {
+				calibrating = mpu6050CalibrationStep(accel, gyro, IMU_FUSION_DMP_GYRO_LSB_PER_DPS, MPU_DMP_WARMUP_SAMPLE_HZ);
+			}
+		}
+		if (wasCalibrating && !calibrating) {
+			// El DMP siguio fusionando mientras cambiaban los offsets: se descarta lo que quedo en la FIFO despues
+			// de la ultima escritura y se espera que se asiente como en el arranque, con la salida en pausa
+			wasCalibrating = false;
+			mpuI2cResetFifo();
+			mpuStats.fifoResets++;
+			imuWarmupInit(&warmup, MPU_DMP_WARMUP_SAMPLE_HZ, MPU_DMP_WARMUP_MAX_SAMPLES);
+			mpuStats.cpuTimeUs += esp_timer_get_time() - activeSince;
+			continue;
+		}
+		wasCalibrating = calibrating;
+
+		// El mas nuevo es el del ultimo flanco, los anteriores salieron de a un periodo del DMP
+		for (uint8_t i = 0; i < drain.decoded; i++) {
+			imuFusionQuaternionToYpr(quaternions[i], ypr);		// dmpGetGravity + dmpGetYawPitchRoll
 			vector_queue_t newData = {
 				.yaw = ((ypr[0] * 180) / (float)M_PI),
 				.pitch = ((ypr[1] * 180) / (float)M_PI),
 				.roll = ((ypr[2] * 180) / (float)M_PI),
-				.temp = ((mpu.getTemperature() / 340.0f) + 36.53f)
+				.temp = temp,
+				.timestampUs = sampleUs - (int64_t)(drain.decoded - 1 - i) * MPU_DMP_PERIOD_US,
+				.calibrating = calibrating
 			};
 
-			if (contMeasure < 1000) { // 2500) {						// wait to stabilize measuments
-				contMeasure++;
+#ifdef IMU_FUSION_RECORD_DMP
+			// Crudo y salida del DMP de la misma muestra, el giroscopo queda en la escala del DMP (2000 grados/s)
+			int16_t accel[3], gyro[3];
+			if (i == drain.decoded - 1 && mpuI2cReadMotion6(accel, gyro, NULL) == ESP_OK) {
+				printf("DMP,%" PRId64 ",%d,%d,%d,%d,%d,%d,%.3f,%.3f,%.3f\n", newData.timestampUs, accel[0], accel[1], accel[2],
+					gyro[0], gyro[1], gyro[2], newData.yaw, newData.pitch, newData.roll);
+			}
+#endif
+
+			bool ready = warmup.state != IMU_WARMUP_RUNNING;
+			if (!ready) {							// hasta que el DMP se asiente no se entrega nada
+				const float gyroDps[3] = {gyros[i][0] / IMU_FUSION_DMP_GYRO_LSB_PER_DPS,
+					gyros[i][1] / IMU_FUSION_DMP_GYRO_LSB_PER_DPS, gyros[i][2] / IMU_FUSION_DMP_GYRO_LSB_PER_DPS};
+				ready = mpu6050Warmup(&warmup, newData.pitch, gyroDps);
 			}
-			else {
-            	xQueueSend(mpu6050QueueHandler,(void *) &newData, 1);
+			if (ready && !calibrating) {
+				held = newData;
+				holding = true;
 			}
-	    }
+			else if (holding) {
+				// Pausa: calibrando o asentandose despues, el tick sigue recibiendo muestras pero sin los
+				// saltos del cuaternion, con la ultima salida buena y la marca de tiempo de este paquete
+				newData.yaw = held.yaw;
+				newData.pitch = held.pitch;
+				newData.roll = held.roll;
+				newData.calibrating = true;
+				ready = true;
+			}
+			if (ready) {
+#ifdef MPU_FIFO_FORWARD_ALL
+				if (!xQueueSend(mpu6050QueueHandler, &newData, 0)) {		// el tick todavia no consumio la rafaga anterior
+					mpuStats.queueDrops++;
+				}
+#else
+            	xQueueOverwrite(mpu6050QueueHandler,(void *) &newData);		// el tick de control siempre toma la mas reciente
+#endif
+			}
+			mpuStats.samples++;
+		}
+
+		int64_t now = esp_timer_get_time();
+		mpuStats.cpuTimeUs += now - activeSince;
+		activeSince = now;							// en polling la tarea nunca se bloquea
+		loopTimingEnd(LOOP_TIMING_MPU);
 
-	    //Best result is to match with DMP refresh rate
-	    // Its last value in components/MPU6050/MPU6050_6Axis_MotionApps20.h file line 310
-	    // Now its 0x13, which means DMP is refreshed with 10Hz rate
-		// vTaskDelay(5/portTICK_PERIOD_MS);
+		if (mpuStats.samples / MPU_STATS_LOG_SAMPLES != (mpuStats.samples - drain.decoded) / MPU_STATS_LOG_SAMPLES) {
+			mpu6050LogStats();
+		}
 	}
+}
+
+#else
+/*
+ * Sin DMP: acelerometro y giroscopo crudos a IMU_FUSION_RATE_HZ, con el pin INT en dato listo.
+ * Las escalas tienen que coincidir con IMU_FUSION_ACCEL_LSB_PER_G e IMU_FUSION_GYRO_LSB_PER_DPS
+ */
+static void mpu6050InitRaw(MPU6050 *mpu) {
+	mpu->setFullScaleAccelRange(MPU6050_ACCEL_FS_2);
+	mpu->setFullScaleGyroRange(MPU6050_GYRO_FS_500);
+	mpu->setDLPFMode(MPU6050_DLPF_BW_98);		// con el DLPF activo el giroscopo muestrea a 1 kHz
+	mpu->setRate(IMU_FUSION_RATE_DIVIDER);
+	mpu->setIntDataReadyEnabled(true);
+}
+
+/*
+ * Una actualizacion de la fusion por muestra; la cola recibe una cada IMU_FUSION_DECIMATION, al
+ * ritmo del tick de control
+ */
+static void mpu6050FusionLoop(void) {
+	imu_fusion_t fusion;
+	int16_t accel[3], gyro[3];
+	float temp = 0;
+	uint16_t decimation = 0;
+	int64_t lastSampleUs = 0;
+	imu_warmup_t warmup;
+
+	imuFusionInit(&fusion, IMU_FUSION_ENGINE);
+	imuWarmupInit(&warmup, IMU_FUSION_WARMUP_SAMPLE_HZ, IMU_FUSION_WARMUP_MAX_SAMPLES);
+	int64_t activeSince = esp_timer_get_time();
+
+	while(1){
+		int64_t sampleUs;
+		if (mpuStats.readMode == MPU6050_READ_INTERRUPT) {
+			if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MPU_INT_TIMEOUT_MS))) {
+				mpuStats.intTimeouts++;
+			}
+			activeSince = esp_timer_get_time();
+			sampleUs = lastIntUs;
+		}
+		else {
+			uint8_t intStatus = 0;
+			while (!(intStatus & MPU_INT_STATUS_DATA_RDY)) {		// se limpia al leerlo
+				mpuI2cReadIntStatus(&intStatus);
+			}
+			sampleUs = esp_timer_get_time();
+		}
+		loopTimingStart(LOOP_TIMING_MPU);
+
+		// La temperatura viene en la misma lectura, entre acelerometro y giroscopo
+		if (mpuI2cReadMotion6(accel, gyro, &temp) != ESP_OK) {
+			mpuStats.cpuTimeUs += esp_timer_get_time() - activeSince;
+			continue;
+		}
+
+		// Un timeout o un atraso largo no se integra como un salto, se toma el periodo nominal
+		float dt = (sampleUs - lastSampleUs) * 1e-6f;
+		if (lastSampleUs == 0 || dt <= 0 || dt > IMU_FUSION_MAX_DT_S) {
+			dt = IMU_FUSION_PERIOD_US * 1e-6f;
+		}
+		lastSampleUs = sampleUs;
+		imuFusionUpdateRaw(&fusion, accel, gyro, dt);
+
+		bool calibrating = false;
+		if (calibrationRequested || calibration.state != IMU_CALIBRATION_IDLE) {
+			calibrating = mpu6050CalibrationStep(accel, gyro, IMU_FUSION_GYRO_LSB_PER_DPS, IMU_FUSION_RATE_HZ);
+		}
+
+		if (++decimation >= IMU_FUSION_DECIMATION) {
+			decimation = 0;
+			imu_fusion_output_t out;
+			imuFusionGetOutput(&fusion, &out);
+			vector_queue_t newData = {
+				.yaw = out.yaw,
+				.pitch = out.pitch,
+				.roll = out.roll,
+				.temp = temp,
+				.rateYaw = out.rateYaw,
+				.ratePitch = out.ratePitch,
+				.rateRoll = out.rateRoll,
+				.timestampUs = sampleUs,
+				.calibrating = calibrating
+			};
+
+			// El filtro arranca con la inclinacion del acelerometro, el detector espera que se asiente
+			bool ready = warmup.state != IMU_WARMUP_RUNNING;
+			if (!ready) {
+				const float gyroDps[3] = {gyro[0] / IMU_FUSION_GYRO_LSB_PER_DPS, gyro[1] / IMU_FUSION_GYRO_LSB_PER_DPS,
+					gyro[2] / IMU_FUSION_GYRO_LSB_PER_DPS};
+				ready = mpu6050Warmup(&warmup, out.pitch, gyroDps);
+			}
+			if (ready) {
+				xQueueOverwrite(mpu6050QueueHandler,(void *) &newData);
+			}
+		}
+
+		int64_t now = esp_timer_get_time();
+		mpuStats.cpuTimeUs += now - activeSince;
+		activeSince = now;
+		mpuStats.samples++;
+		loopTimingEnd(LOOP_TIMING_MPU);
+
+		if (!(mpuStats.samples % MPU_STATS_LOG_SAMPLES)) {
+			mpu6050LogStats();
+		}
+	}
+}
+#endif
+
+void mpu6050Handler(void*){
+	readHandler = xTaskGetCurrentTaskHandle();
+
+	MPU6050 mpu = MPU6050();
+	mpu.initialize();
+#if IMU_FUSION_ENGINE == IMU_FUSION_DMP
+	mpu.dmpInitialize();
+	mpu6050SetDmpRate(&mpu);
+#else
+	mpu6050InitRaw(&mpu);
+#endif
+
+	// Arranca con los offsets del ultimo arranque asentado, el detector corrige lo que falte del giroscopo
+	mpu6050RestoreOffsets(&mpu);
+
+	mpuStats.readMode = MPU6050_READ_POLLING;
+	if (MpuConfigInit.readMode == MPU6050_READ_INTERRUPT) {
+		mpuStats.readMode = mpu6050InitInterrupt(&mpu);
+	}
+	ESP_LOGI(TAG, "Modo de lectura: %s", mpuStats.readMode == MPU6050_READ_INTERRUPT ? "interrupcion" : "polling");
+
+#if IMU_FUSION_ENGINE == IMU_FUSION_DMP
+	mpu.setDMPEnabled(true);
+	mpu.resetFIFO();
+#endif
+
+	// Desde aca el MPU se lee solo por mpu_i2c, I2Cdev ya no tiene bus con MPU_I2C_ASYNC
+	ESP_ERROR_CHECK(mpuI2cBeginAsync());
+
+#if IMU_FUSION_ENGINE == IMU_FUSION_DMP
+	mpu6050DmpLoop();
+#else
+	ESP_LOGI(TAG, "Fusion en el MCU, motor %d a %d Hz", IMU_FUSION_ENGINE, IMU_FUSION_RATE_HZ);
+	mpu6050FusionLoop();
+#endif
 
 	vTaskDelete(NULL);
 }
@@ -94,25 +630,73 @@ void mpu6050_initialize(mpu6050_init_t *config) {
     
 	MpuConfigInit = *config;
 
-    i2c_config_t conf;
-	conf.mode = I2C_MODE_MASTER;
-	conf.sda_io_num = config->sdaGpio;
-	conf.scl_io_num = config->sclGpio;
-	conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
-	conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
-	conf.master.clk_speed = 400000;
-	conf.clk_flags = I2C_SCLK_SRC_FLAG_FOR_NOMAL;
-	ESP_ERROR_CHECK(i2c_param_config(I2C_NUM_0, &conf));
-	ESP_ERROR_CHECK(i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, 0, 0, ESP_INTR_FLAG_IRAM));
+	mpu_i2c_config_t i2cConfig = {
+		.sdaGpio = config->sdaGpio,
+		.sclGpio = config->sclGpio,
+		.clockHz = MPU_I2C_CLOCK_HZ,
+		.address = MPU_I2C_ADDRESS,
+	};
+	ESP_ERROR_CHECK(mpuI2cInit(&i2cConfig));			// driver legacy, el que usa I2Cdev
 
     xTaskCreatePinnedToCore(mpu6050Handler,"mpu6050_handler_wrapper",8096,NULL,config->priorityTask,&readHandler,config->core);
 }
 
-void mpu6050_recalibrate() {
-	// vTaskDelete(readHandler);
-	// enableCalibrate = true;
-	// i2c_driver_delete(I2C_NUM_0);
-	// mpu6050_initialize(&MpuConfigInit);
+void mpu6050_getStats(mpu6050_stats_t *stats) {
+	mpu_i2c_stats_t i2cStats;
+	mpuI2cGetStats(&i2cStats);
+
+	*stats = mpuStats;
+	stats->busTransactions = i2cStats.transactions;
+	stats->busBytes = i2cStats.bytes;
+	stats->i2cErrors = i2cStats.errors;
+	stats->i2cTransferUs = i2cStats.transferUs;
+	stats->i2cAsync = i2cStats.async;
+#if (configGENERATE_RUN_TIME_STATS == 1) && (configUSE_TRACE_FACILITY == 1)
+	// Contador de FreeRTOS: solo el tiempo en que la tarea tuvo la cpu, sin las esperas del bus
+	if (readHandler) {
+		TaskStatus_t taskStatus;
+		vTaskGetInfo(readHandler, &taskStatus, pdFALSE, eRunning);
+		stats->runTimeUs = taskStatus.ulRunTimeCounter;
+	}
+#endif
+	stats->busTransactionsPerSample = mpuStats.samples ? (float)stats->busTransactions / mpuStats.samples : 0;
+	stats->cpuTimeUsPerSample = mpuStats.samples ? (float)mpuStats.cpuTimeUs / mpuStats.samples : 0;
+	stats->busBytesPerSample = mpuStats.samples ? (float)stats->busBytes / mpuStats.samples : 0;
+	stats->runTimeUsPerSample = mpuStats.samples ? (float)stats->runTimeUs / mpuStats.samples : 0;
+}
+
+void mpu6050_getImuStatus(imu_status_t *status) {
+	portENTER_CRITICAL(&imuStatusMux);
+	*status = imuStatus;
+	portEXIT_CRITICAL(&imuStatusMux);
+}
+
+bool mpu6050_takeOffsetsToSave(imu_offsets_t *offsets) {
+	portENTER_CRITICAL(&imuStatusMux);
+	bool pending = offsetsToSave;
+	offsetsToSave = false;
+	*offsets = imuOffsets;
+	portEXIT_CRITICAL(&imuStatusMux);
+	return pending;
+}
+
+bool mpu6050_recalibrate(bool disarmed) {
+	portENTER_CRITICAL(&imuStatusMux);
+	bool busy = calibrationRequested || imuStatus.calibrationState == IMU_CALIBRATION_MEASURING ||
+		imuStatus.calibrationState == IMU_CALIBRATION_RESTORING;
+	if (!busy && !disarmed) {
+		imuStatus.calibrationState = IMU_CALIBRATION_FAILED;
+		imuStatus.calibrationError = IMU_CALIBRATION_ERROR_ARMED;
+	}
+	else if (!busy) {
+		calibrationRequested = true;
+		imuStatus.calibrationState = IMU_CALIBRATION_IDLE;
+		imuStatus.calibrationProgress = 0;
+		imuStatus.calibrationRound = 0;
+		imuStatus.calibrationError = IMU_CALIBRATION_ERROR_NONE;
+	}
+	portEXIT_CRITICAL(&imuStatusMux);
+	return !busy && disarmed;
 }
 
 // int mpu6050_testConnection() {
@@ -0,0 +1,50 @@
+#include "mpu_fifo.h"
+
+void mpuFifoDecodeQuaternion(const uint8_t *packet, float q[4]) {
+    // Parte alta de cada componente de 32 bits, en Q14
+    for (uint8_t i = 0; i < 4; i++) {
+        int16_t raw = (int16_t)((packet[4 * i] << 8) | packet[4 * i + 1]);
+        q[i] = raw / 16384.0f;
+    }
+}
+
+void mpuFifoDecodeGyro(const uint8_t *packet, int16_t gyro[3]) {
+    // Despues del cuaternion, parte alta de cada eje de 32 bits
+    for (uint8_t i = 0; i < 3; i++) {
+        gyro[i] = (int16_t)((packet[16 + 4 * i] << 8) | packet[16 + 4 * i + 1]);
+    }
+}
+
+mpu_fifo_drain_t mpuFifoDrain(const mpu_fifo_bus_t *bus, uint16_t fifoCount, float (*quaternions)[4], int16_t (*gyros)[3],
+                              uint8_t maxPackets) {
+    mpu_fifo_drain_t result = {0};
+    if (fifoCount >= MPU_FIFO_SIZE) {
+        result.overflow = 1;
+        return result;
+    }
+
+    uint16_t pending = fifoCount / MPU_DMP_PACKET_SIZE;
+    uint16_t skip = pending > maxPackets ? pending - maxPackets : 0;
+    uint8_t buffer[MPU_FIFO_BURST_BYTES];
+
+    while (pending) {
+        uint8_t packets = pending < MPU_FIFO_BURST_PACKETS ? pending : MPU_FIFO_BURST_PACKETS;
+        result.bursts++;
+        if (!bus->read(bus->ctx, buffer, packets * MPU_DMP_PACKET_SIZE)) {
+            result.error = 1;
+            break;
+        }
+
+        for (uint8_t i = 0; i < packets; i++, result.packets++) {
+            if (result.packets >= skip) {
+                const uint8_t *packet = &buffer[i * MPU_DMP_PACKET_SIZE];
+                if (gyros) {
+                    mpuFifoDecodeGyro(packet, gyros[result.decoded]);
+                }
+                mpuFifoDecodeQuaternion(packet, quaternions[result.decoded++]);
+            }
+        }
+        pending -= packets;
+    }
+    return result;
+}
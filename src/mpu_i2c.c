@@ -0,0 +1,257 @@
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "mpu_i2c.h"
+
+#if MPU_I2C_ASYNC_ENABLED
+#include "driver/i2c_master.h"
+// I2Cdev configura el MPU con el driver legacy y el lazo usa i2c_master: el IDF aborta al arrancar si
+// encuentra los dos enlazados, salvo que se saltee ese chequeo
+#ifndef CONFIG_I2C_SKIP_LEGACY_CONFLICT_CHECK
+#error MPU_I2C_ASYNC necesita CONFIG_I2C_SKIP_LEGACY_CONFLICT_CHECK en el sdkconfig (I2Cdev usa el driver legacy)
+#endif
+#elif defined(MPU_I2C_ASYNC)
+#warning MPU_I2C_ASYNC necesita ESP-IDF 5.2 o posterior, las lecturas van por el driver legacy
+#endif
+
+#define MPU_I2C_PORT                I2C_NUM_0
+#define MPU_I2C_TRANS_QUEUE_DEPTH   4
+
+static const char *TAG = "MPU_I2C";
+
+static mpu_i2c_config_t i2cConfig;
+static mpu_i2c_stats_t i2cStats;
+static uint8_t txBuffer[1 + 2 * MPU_I2C_MAX_WORDS];     // registro y valores: en async tiene que vivir hasta el callback
+
+#if MPU_I2C_ASYNC_ENABLED
+static i2c_master_bus_handle_t busHandle;
+static i2c_master_dev_handle_t devHandle;
+static SemaphoreHandle_t transferDone;
+static volatile i2c_master_event_t lastEvent;
+
+static bool IRAM_ATTR mpuI2cTransferDone(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *event, void *arg) {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    lastEvent = event->event;
+    xSemaphoreGiveFromISR(transferDone, &higherPriorityTaskWoken);
+    return higherPriorityTaskWoken == pdTRUE;
+}
+
+/*
+ * Encola la transaccion y duerme hasta el callback
+ */
+static esp_err_t mpuI2cTransferAsync(size_t txLen, uint8_t *rx, size_t rxLen) {
+    esp_err_t err = rx ? i2c_master_transmit_receive(devHandle, txBuffer, txLen, rx, rxLen, MPU_I2C_TIMEOUT_MS)
+                       : i2c_master_transmit(devHandle, txBuffer, txLen, MPU_I2C_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xSemaphoreTake(transferDone, pdMS_TO_TICKS(MPU_I2C_TIMEOUT_MS) + 1) != pdTRUE) {
+        // El buffer de lectura es del llamador: no se vuelve hasta que el driver lo suelte
+        i2c_master_bus_wait_all_done(busHandle, MPU_I2C_TIMEOUT_MS);
+        xSemaphoreTake(transferDone, 0);
+        return ESP_ERR_TIMEOUT;
+    }
+    return lastEvent == I2C_EVENT_DONE ? ESP_OK : ESP_FAIL;
+}
+#endif
+
+static esp_err_t mpuI2cTransfer(size_t txLen, uint8_t *rx, size_t rxLen) {
+    int64_t start = esp_timer_get_time();
+    esp_err_t err;
+#if MPU_I2C_ASYNC_ENABLED
+    if (i2cStats.async) {
+        err = mpuI2cTransferAsync(txLen, rx, rxLen);
+    }
+    else
+#endif
+    if (rx) {
+        err = i2c_master_write_read_device(MPU_I2C_PORT, i2cConfig.address, txBuffer, txLen, rx, rxLen,
+                                           pdMS_TO_TICKS(MPU_I2C_TIMEOUT_MS) + 1);
+    }
+    else {
+        err = i2c_master_write_to_device(MPU_I2C_PORT, i2cConfig.address, txBuffer, txLen,
+                                         pdMS_TO_TICKS(MPU_I2C_TIMEOUT_MS) + 1);
+    }
+
+    i2cStats.transferUs += esp_timer_get_time() - start;
+    i2cStats.transactions++;
+    if (err == ESP_OK) {
+        i2cStats.bytes += rx ? rxLen : txLen - 1;
+    }
+    else {
+        i2cStats.errors++;
+    }
+    return err;
+}
+
+esp_err_t mpuI2cInit(const mpu_i2c_config_t *config) {
+    i2cConfig = *config;
+
+    i2c_config_t conf;
+    memset(&conf, 0, sizeof(conf));
+    conf.mode = I2C_MODE_MASTER;
+    conf.sda_io_num = config->sdaGpio;
+    conf.scl_io_num = config->sclGpio;
+    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.master.clk_speed = config->clockHz;
+    conf.clk_flags = I2C_SCLK_SRC_FLAG_FOR_NOMAL;
+    esp_err_t err = i2c_param_config(MPU_I2C_PORT, &conf);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return i2c_driver_install(MPU_I2C_PORT, I2C_MODE_MASTER, 0, 0, ESP_INTR_FLAG_IRAM);
+}
+
+esp_err_t mpuI2cBeginAsync(void) {
+#if MPU_I2C_ASYNC_ENABLED
+    if (i2cStats.async) {
+        return ESP_OK;
+    }
+    transferDone = xSemaphoreCreateBinary();
+    if (transferDone == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = i2c_driver_delete(MPU_I2C_PORT);
+    if (err != ESP_OK) {
+        return err;
+    }
+    i2c_master_bus_config_t busConfig = {
+        .i2c_port = MPU_I2C_PORT,
+        .sda_io_num = i2cConfig.sdaGpio,
+        .scl_io_num = i2cConfig.sclGpio,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .trans_queue_depth = MPU_I2C_TRANS_QUEUE_DEPTH,        // con cola y callback el driver trabaja asincronico
+        .flags.enable_internal_pullup = true,
+    };
+    err = i2c_new_master_bus(&busConfig, &busHandle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    i2c_device_config_t devConfig = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = i2cConfig.address,
+        .scl_speed_hz = i2cConfig.clockHz,
+    };
+    err = i2c_master_bus_add_device(busHandle, &devConfig, &devHandle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const i2c_master_event_callbacks_t callbacks = {
+        .on_trans_done = mpuI2cTransferDone,
+    };
+    err = i2c_master_register_event_callbacks(devHandle, &callbacks, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    i2cStats.async = 1;
+    ESP_LOGI(TAG, "Lecturas por i2c_master asincronico");
+#endif
+    return ESP_OK;
+}
+
+static float mpuI2cTemperature(const uint8_t *raw) {
+    return (int16_t)((raw[0] << 8) | raw[1]) / 340.0f + 36.53f;
+}
+
+esp_err_t mpuI2cRead(uint8_t reg, uint8_t *data, size_t len) {
+    txBuffer[0] = reg;
+    return mpuI2cTransfer(1, data, len);
+}
+
+esp_err_t mpuI2cWrite(uint8_t reg, uint8_t value) {
+    txBuffer[0] = reg;
+    txBuffer[1] = value;
+    return mpuI2cTransfer(2, NULL, 0);
+}
+
+esp_err_t mpuI2cReadWords(uint8_t reg, int16_t *values, uint8_t count) {
+    uint8_t raw[2 * MPU_I2C_MAX_WORDS];
+    if (count > MPU_I2C_MAX_WORDS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = mpuI2cRead(reg, raw, 2 * count);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        values[i] = (int16_t)((raw[2 * i] << 8) | raw[2 * i + 1]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t mpuI2cWriteWords(uint8_t reg, const int16_t *values, uint8_t count) {
+    if (count > MPU_I2C_MAX_WORDS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    txBuffer[0] = reg;
+    for (uint8_t i = 0; i < count; i++) {
+        txBuffer[1 + 2 * i] = (uint16_t)values[i] >> 8;
+        txBuffer[2 + 2 * i] = values[i];
+    }
+    return mpuI2cTransfer(1 + 2 * count, NULL, 0);
+}
+
+esp_err_t mpuI2cUpdateBits(uint8_t reg, uint8_t mask, uint8_t value) {
+    uint8_t current;
+    esp_err_t err = mpuI2cRead(reg, &current, 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return mpuI2cWrite(reg, (current & ~mask) | (value & mask));
+}
+
+esp_err_t mpuI2cReadIntStatus(uint8_t *status) {
+    return mpuI2cRead(MPU_REG_INT_STATUS, status, 1);
+}
+
+esp_err_t mpuI2cReadFifoCount(uint16_t *count) {
+    uint8_t raw[2];
+    esp_err_t err = mpuI2cRead(MPU_REG_FIFO_COUNTH, raw, sizeof(raw));
+    *count = err == ESP_OK ? (uint16_t)((raw[0] << 8) | raw[1]) : 0;
+    return err;
+}
+
+esp_err_t mpuI2cResetFifo(void) {
+    return mpuI2cUpdateBits(MPU_REG_USER_CTRL, MPU_USER_CTRL_FIFO_RESET, MPU_USER_CTRL_FIFO_RESET);
+}
+
+bool mpuI2cReadFifo(void *ctx, uint8_t *data, uint8_t len) {
+    return mpuI2cRead(MPU_REG_FIFO_R_W, data, len) == ESP_OK;
+}
+
+esp_err_t mpuI2cReadMotion6(int16_t accel[3], int16_t gyro[3], float *celsius) {
+    uint8_t raw[14];                        // acelerometro, temperatura, giroscopo
+    esp_err_t err = mpuI2cRead(MPU_REG_ACCEL_XOUT_H, raw, sizeof(raw));
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (uint8_t i = 0; i < 3; i++) {
+        accel[i] = (int16_t)((raw[2 * i] << 8) | raw[2 * i + 1]);
+        gyro[i] = (int16_t)((raw[8 + 2 * i] << 8) | raw[8 + 2 * i + 1]);
+    }
+    if (celsius) {
+        *celsius = mpuI2cTemperature(&raw[6]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t mpuI2cReadTemperature(float *celsius) {
+    uint8_t raw[2];
+    esp_err_t err = mpuI2cRead(MPU_REG_TEMP_OUT_H, raw, sizeof(raw));
+    if (err == ESP_OK) {
+        *celsius = mpuI2cTemperature(raw);
+    }
+    return err;
+}
+
+void mpuI2cGetStats(mpu_i2c_stats_t *stats) {
+    *stats = i2cStats;
+}
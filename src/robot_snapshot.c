@@ -0,0 +1,60 @@
+#include "string.h"
+#include "stdbool.h"
+#include "stdatomic.h"
+
+#include "robot_snapshot.h"
+
+/*
+ * Doble buffer con un seqlock por slot: el escritor siempre escribe el slot que no esta publicado,
+ * asi un lector que interrumpe al escritor a mitad de la copia lee el slot anterior completo y no
+ * queda girando esperando que el escritor termine.
+ */
+typedef struct {
+    atomic_uint         seq;            // impar mientras se escribe el slot
+    robot_snapshot_t    data;
+} snapshot_slot_t;
+
+static snapshot_slot_t slots[2];
+static atomic_uint latestSlot;
+
+static atomic_uint publishCount;
+static atomic_uint readCount;
+static atomic_uint readRetryCount;
+
+void robotSnapshotPublish(const robot_snapshot_t *snapshot) {
+    uint32_t index = (atomic_load_explicit(&latestSlot, memory_order_relaxed) + 1) & 1;
+    snapshot_slot_t *slot = &slots[index];
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->data, snapshot, sizeof(slot->data));
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+    atomic_store_explicit(&latestSlot, index, memory_order_release);
+    atomic_fetch_add_explicit(&publishCount, 1, memory_order_relaxed);
+}
+
+void robotSnapshotRead(robot_snapshot_t *snapshot) {
+    while (true) {
+        uint32_t index = atomic_load_explicit(&latestSlot, memory_order_acquire);
+        snapshot_slot_t *slot = &slots[index];
+        uint32_t seqBefore = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if (!(seqBefore & 1)) {
+            memcpy(snapshot, &slot->data, sizeof(*snapshot));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seqBefore) {
+                break;
+            }
+        }
+        atomic_fetch_add_explicit(&readRetryCount, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&readCount, 1, memory_order_relaxed);
+}
+
+void robotSnapshotGetStats(robot_snapshot_stats_t *stats) {
+    stats->publishes = atomic_load_explicit(&publishCount, memory_order_relaxed);
+    stats->reads = atomic_load_explicit(&readCount, memory_order_relaxed);
+    stats->readRetries = atomic_load_explicit(&readRetryCount, memory_order_relaxed);
+}
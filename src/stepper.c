@@ -42,6 +42,8 @@ extern QueueHandle_t motorControlQueueHandler;
 static stepper_config_t configInit;
 motors_measurements_t motorsMeasurements;
 
+static uint8_t enabledMotors = 0xFF;               // estado aplicado, 0xFF: todavia sin aplicar
+
 static void setVelMotors(int16_t speedL,int16_t speedR);
 static void setEnableMotors(uint8_t enable);
 
@@ -49,20 +51,28 @@ motors_measurements_t getMeasMotors() {
     return motorsMeasurements;
 }
 
+void motorsSetOutput(const output_motors_t *output) {
+    if (output->enable) {
+        setVelMotors(output->motorL,output->motorR);
+    }
+    else {
+        setVelMotors(0,0);
+    }
+    if (output->enable != enabledMotors) {                  // solo en los cambios, no en cada ciclo
+        setEnableMotors(output->enable);
+    }
+}
+
+/*
+ * Atiende a quien publique en motorControlQueueHandler (ej: testHardwareVibration), se bloquea hasta cada comando
+ */
 static void controlHandler(void *pvParameters) {
 
     output_motors_t newVel;
     while(true) {
-        if (xQueueReceive(motorControlQueueHandler,&newVel,pdMS_TO_TICKS(1))) {
-            if (newVel.enable) {
-                setVelMotors(newVel.motorL,newVel.motorR);
-            }
-            else {
-                setVelMotors(0,0);
-            }
-            setEnableMotors(newVel.enable);                         // TODO: esto se va a llamar continuamente
+        if (xQueueReceive(motorControlQueueHandler,&newVel,portMAX_DELAY)) {
+            motorsSetOutput(&newVel);
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
@@ -215,10 +225,13 @@ void motorsInit(stepper_config_t config) {
 
     initPulseGenerator();
     initPositionSensor();
-    xTaskCreate(controlHandler,"motor control handler task",4096,NULL,5,NULL);
+    if (config.queueOutput) {
+        xTaskCreate(controlHandler,"motor control handler task",4096,NULL,5,NULL);
+    }
 }
 
 static void setEnableMotors(uint8_t enable) {
+    enabledMotors = enable;
     gpio_set_level(configInit.gpio_mot_enable,!enable);
     if (enable) {
         ledc_timer_resume(SPEED_MODE_TIMER,TIMER_MOT_L);
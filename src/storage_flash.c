@@ -22,6 +22,13 @@
 #define KEY_CENTER          "CENTER"
 #define KEY_SAFETY_LIM      "SAFETY_LIM"
 
+#define KEY_ACC_OFF_X       "ACC_OFF_X"
+#define KEY_ACC_OFF_Y       "ACC_OFF_Y"
+#define KEY_ACC_OFF_Z       "ACC_OFF_Z"
+#define KEY_GYR_OFF_X       "GYR_OFF_X"
+#define KEY_GYR_OFF_Y       "GYR_OFF_Y"
+#define KEY_GYR_OFF_Z       "GYR_OFF_Z"
+
 static const char *TAG = "Storage_flash";
 
 nvs_handle_t storageHandle;
@@ -102,3 +109,44 @@ robot_local_configs_t getFromStorageLocalConfig(void){
     return localConfig;
 }
 
+void storageImuOffsets(imu_offsets_t offsets){
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE1,NVS_READWRITE,&handle);
+    if( err != ESP_OK){
+        ESP_LOGE(TAG,"Error open nvs");
+        return;
+    }
+
+    nvs_set_i16(handle,KEY_ACC_OFF_X,offsets.accel[0]);
+    nvs_set_i16(handle,KEY_ACC_OFF_Y,offsets.accel[1]);
+    nvs_set_i16(handle,KEY_ACC_OFF_Z,offsets.accel[2]);
+
+    nvs_set_i16(handle,KEY_GYR_OFF_X,offsets.gyro[0]);
+    nvs_set_i16(handle,KEY_GYR_OFF_Y,offsets.gyro[1]);
+    nvs_set_i16(handle,KEY_GYR_OFF_Z,offsets.gyro[2]);
+
+    if( nvs_commit(handle) != ESP_OK ){
+        ESP_LOGE(TAG,"Error commit nvs");
+    }
+    nvs_close(handle);
+}
+
+bool getFromStorageImuOffsets(imu_offsets_t *offsets){
+
+    nvs_handle_t handle;
+    if( nvs_open(NAMESPACE1,NVS_READONLY,&handle) != ESP_OK){
+        return false;                                   // el namespace todavia no existe
+    }
+
+    // Se guardan juntos: si falta uno no se usa ninguno
+    bool found = nvs_get_i16(handle,KEY_ACC_OFF_X,&offsets->accel[0]) == ESP_OK &&
+                 nvs_get_i16(handle,KEY_ACC_OFF_Y,&offsets->accel[1]) == ESP_OK &&
+                 nvs_get_i16(handle,KEY_ACC_OFF_Z,&offsets->accel[2]) == ESP_OK &&
+                 nvs_get_i16(handle,KEY_GYR_OFF_X,&offsets->gyro[0]) == ESP_OK &&
+                 nvs_get_i16(handle,KEY_GYR_OFF_Y,&offsets->gyro[1]) == ESP_OK &&
+                 nvs_get_i16(handle,KEY_GYR_OFF_Z,&offsets->gyro[2]) == ESP_OK;
+
+    nvs_close(handle);
+    return found;
+}
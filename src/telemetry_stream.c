@@ -0,0 +1,168 @@
+#include "string.h"
+#include "stdatomic.h"
+
+#include "telemetry_stream.h"
+#include "comms.h"
+
+#if (TELEMETRY_STREAM_RING & (TELEMETRY_STREAM_RING - 1))
+#error TELEMETRY_STREAM_RING debe ser potencia de 2
+#endif
+
+#define FIELD_OFFSET(member)    ((uint8_t)offsetof(flight_record_t, member))
+
+static const uint8_t fieldOffsets[TELEMETRY_FIELDS_COUNT] = {
+    [TELEMETRY_FIELD_PITCH]             = FIELD_OFFSET(pitch),
+    [TELEMETRY_FIELD_ROLL]              = FIELD_OFFSET(roll),
+    [TELEMETRY_FIELD_YAW]               = FIELD_OFFSET(yaw),
+    [TELEMETRY_FIELD_PID_OUTPUT_ANGLE]  = FIELD_OFFSET(pidOutput[PID_ANGLE]),
+    [TELEMETRY_FIELD_PID_OUTPUT_POS]    = FIELD_OFFSET(pidOutput[PID_POS]),
+    [TELEMETRY_FIELD_PID_OUTPUT_SPEED]  = FIELD_OFFSET(pidOutput[PID_SPEED]),
+    [TELEMETRY_FIELD_PID_OUTPUT_YAW]    = FIELD_OFFSET(pidOutput[PID_YAW]),
+    [TELEMETRY_FIELD_PID_ITERM_ANGLE]   = FIELD_OFFSET(pidITerm[PID_ANGLE]),
+    [TELEMETRY_FIELD_PID_ITERM_POS]     = FIELD_OFFSET(pidITerm[PID_POS]),
+    [TELEMETRY_FIELD_PID_ITERM_SPEED]   = FIELD_OFFSET(pidITerm[PID_SPEED]),
+    [TELEMETRY_FIELD_PID_ITERM_YAW]     = FIELD_OFFSET(pidITerm[PID_YAW]),
+    [TELEMETRY_FIELD_SETPOINT_ANGLE]    = FIELD_OFFSET(setPoint[PID_ANGLE]),
+    [TELEMETRY_FIELD_SETPOINT_POS]      = FIELD_OFFSET(setPoint[PID_POS]),
+    [TELEMETRY_FIELD_SETPOINT_SPEED]    = FIELD_OFFSET(setPoint[PID_SPEED]),
+    [TELEMETRY_FIELD_SETPOINT_YAW]      = FIELD_OFFSET(setPoint[PID_YAW]),
+    [TELEMETRY_FIELD_MOTOR_L]           = FIELD_OFFSET(motorL),
+    [TELEMETRY_FIELD_MOTOR_R]           = FIELD_OFFSET(motorR),
+};
+
+typedef struct {
+    uint32_t timestampUs;
+    flight_record_t record;
+} telemetry_sample_t;
+
+/*
+ * Un escritor (tick de control) y un lector (comunicaciones), sincronizados solo por los indices.
+ * La suscripcion va en un atomico para que el escritor la lea sin locks.
+ */
+static telemetry_sample_t ring[TELEMETRY_STREAM_RING];
+static atomic_uint writeIndex;
+static atomic_uint readIndex;
+static atomic_uint subscription;                        // fieldMask, 0 = sin suscripcion
+static atomic_uint frameConfig;                         // decimation | samplesPerFrame << 8
+static uint8_t decimationCount;
+static telemetry_stream_stats_t stats;
+
+void telemetryStreamSubscribe(uint32_t fieldMask, uint8_t decimation, uint8_t samplesPerFrame) {
+    fieldMask &= (1UL << TELEMETRY_FIELDS_COUNT) - 1;
+    decimation = decimation ? decimation : 1;
+    samplesPerFrame = samplesPerFrame ? samplesPerFrame : 1;
+    if (samplesPerFrame > TELEMETRY_STREAM_RING / 2) {
+        samplesPerFrame = TELEMETRY_STREAM_RING / 2;
+    }
+    atomic_store_explicit(&frameConfig, decimation | (samplesPerFrame << 8), memory_order_relaxed);
+    atomic_store_explicit(&subscription, fieldMask, memory_order_release);
+}
+
+bool telemetryStreamIsActive(void) {
+    return atomic_load_explicit(&subscription, memory_order_relaxed) != 0;
+}
+
+void telemetryStreamWrite(const flight_record_t *record, int64_t timestampUs) {
+    if (!atomic_load_explicit(&subscription, memory_order_acquire)) {
+        return;
+    }
+    uint8_t decimation = atomic_load_explicit(&frameConfig, memory_order_relaxed) & 0xFF;
+    if (++decimationCount < decimation) {
+        return;
+    }
+    decimationCount = 0;
+
+    unsigned int write = atomic_load_explicit(&writeIndex, memory_order_relaxed);
+    if (write - atomic_load_explicit(&readIndex, memory_order_acquire) >= TELEMETRY_STREAM_RING) {
+        stats.overflows++;
+        return;
+    }
+    ring[write & (TELEMETRY_STREAM_RING - 1)] = (telemetry_sample_t){
+        .timestampUs = (uint32_t)timestampUs,
+        .record = *record,
+    };
+    atomic_store_explicit(&writeIndex, write + 1, memory_order_release);
+    stats.samples++;
+}
+
+static uint8_t *putVarint(uint8_t *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+static uint8_t *putLe(uint8_t *out, uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        *out++ = value >> (8 * i);
+    }
+    return out;
+}
+
+static int16_t getField(const flight_record_t *record, uint8_t field) {
+    int16_t value;
+    memcpy(&value, (const uint8_t *)record + fieldOffsets[field], sizeof(value));
+    return value;
+}
+
+size_t telemetryStreamBuildFrame(uint8_t *out, size_t outSize, int64_t nowUs) {
+    uint32_t fieldMask = atomic_load_explicit(&subscription, memory_order_acquire);
+    unsigned int read = atomic_load_explicit(&readIndex, memory_order_relaxed);
+    unsigned int pending = atomic_load_explicit(&writeIndex, memory_order_acquire) - read;
+
+    if (!fieldMask) {
+        atomic_store_explicit(&readIndex, read + pending, memory_order_release);
+        return 0;
+    }
+    uint8_t samplesPerFrame = atomic_load_explicit(&frameConfig, memory_order_relaxed) >> 8;
+    if (!pending || outSize < TELEMETRY_STREAM_HEADER_SIZE) {
+        return 0;
+    }
+    const telemetry_sample_t *first = &ring[read & (TELEMETRY_STREAM_RING - 1)];
+    if (pending < samplesPerFrame && (uint32_t)nowUs - first->timestampUs < TELEMETRY_STREAM_MAX_LATENCY_US) {
+        return 0;
+    }
+
+    uint8_t *pos = putLe(out, HEADER_PACKAGE_TELEMETRY_BATCH, 2);
+    pos += 2;                                           // largo, al final
+    pos = putLe(pos, fieldMask, 4);
+    pos = putLe(pos, first->timestampUs, 4);
+    pos = putLe(pos, first->record.cycle, 4);
+    uint8_t *countPos = pos++;
+
+    const size_t worstSample = 5 + 3 * __builtin_popcount(fieldMask);     // varint de 32 y zigzag de 17 bits
+    const telemetry_sample_t *prev = NULL;
+    uint8_t count = 0;
+
+    while (count < pending && count < samplesPerFrame && (size_t)(pos - out) + worstSample <= outSize) {
+        const telemetry_sample_t *sample = &ring[(read + count) & (TELEMETRY_STREAM_RING - 1)];
+        if (prev) {
+            pos = putVarint(pos, sample->timestampUs - prev->timestampUs);
+        }
+        for (uint8_t field = 0; field < TELEMETRY_FIELDS_COUNT; field++) {
+            if (fieldMask & (1UL << field)) {
+                int32_t delta = getField(&sample->record, field) - (prev ? getField(&prev->record, field) : 0);
+                pos = putVarint(pos, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+            }
+        }
+        prev = sample;
+        count++;
+    }
+    if (!count) {
+        return 0;
+    }
+
+    size_t len = pos - out;
+    *countPos = count;
+    putLe(out + 2, len, 2);
+    atomic_store_explicit(&readIndex, read + count, memory_order_release);
+    stats.frames++;
+    stats.bytes += len;
+    return len;
+}
+
+void telemetryStreamGetStats(telemetry_stream_stats_t *out) {
+    *out = stats;
+}
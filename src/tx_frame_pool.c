@@ -0,0 +1,143 @@
+#include "stdatomic.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "tx_frame_pool.h"
+
+#if TX_FRAME_POOL_RESERVED >= TX_FRAME_POOL_FRAMES
+#error La telemetria necesita frames fuera de la reserva
+#endif
+
+/*
+ * Las colas llevan punteros a los frames. Cada frame esta en una sola de ellas, en un slot o en
+ * manos de una tarea, asi ninguna se llena. Los slots se toman y reemplazan con intercambios
+ * atomicos; doorbell despierta al socket ante cualquier envio, con o sin cola.
+ */
+static tx_frame_t frames[TX_FRAME_POOL_FRAMES];
+static QueueHandle_t sharedFree;
+static QueueHandle_t reserveFree;
+static QueueHandle_t reliableQueue;
+static QueueHandle_t telemetryQueue;
+static QueueHandle_t doorbell;
+static _Atomic(tx_frame_t *) latest[TX_LATEST_COUNT];
+
+typedef struct {
+    atomic_uint submitted;
+    atomic_uint sent;
+    atomic_uint allocFailures;
+    atomic_uint drops;
+    atomic_uint overwritten;
+} tx_class_counters_t;
+
+static tx_class_counters_t counters[TX_CLASS_COUNT];
+
+static void count(atomic_uint *counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static void ringDoorbell(void) {
+    uint8_t token = 0;
+    xQueueOverwrite(doorbell, &token);
+}
+
+void txFramePoolInit(void) {
+    sharedFree = xQueueCreate(TX_FRAME_POOL_FRAMES, sizeof(tx_frame_t *));
+    reserveFree = xQueueCreate(TX_FRAME_POOL_RESERVED, sizeof(tx_frame_t *));
+    reliableQueue = xQueueCreate(TX_FRAME_POOL_FRAMES, sizeof(tx_frame_t *));
+    telemetryQueue = xQueueCreate(TX_FRAME_POOL_FRAMES, sizeof(tx_frame_t *));
+    doorbell = xQueueCreate(1, sizeof(uint8_t));
+
+    for (uint8_t i = 0; i < TX_FRAME_POOL_FRAMES; i++) {
+        tx_frame_t *frame = &frames[i];
+        frame->fromReserve = i < TX_FRAME_POOL_RESERVED;
+        xQueueSend(frame->fromReserve ? reserveFree : sharedFree, &frame, 0);
+    }
+}
+
+tx_frame_t *txFrameAlloc(uint8_t txClass) {
+    tx_frame_t *frame;
+    bool allocated = txClass == TX_CLASS_RELIABLE ?
+                     xQueueReceive(reserveFree, &frame, 0) || xQueueReceive(sharedFree, &frame, 0) :
+                     xQueueReceive(sharedFree, &frame, 0);
+    if (!allocated) {
+        count(&counters[txClass].allocFailures);
+        return NULL;
+    }
+    frame->len = 0;
+    frame->txClass = txClass;
+    return frame;
+}
+
+void txFrameSubmit(tx_frame_t *frame, uint16_t len) {
+    frame->len = len;
+    count(&counters[frame->txClass].submitted);
+    xQueueSend(frame->txClass == TX_CLASS_RELIABLE ? reliableQueue : telemetryQueue, &frame, 0);
+    ringDoorbell();
+}
+
+void txFrameSubmitLatest(tx_frame_t *frame, uint16_t len, uint8_t slot) {
+    frame->len = len;
+    count(&counters[frame->txClass].submitted);
+    tx_frame_t *stale = atomic_exchange_explicit(&latest[slot], frame, memory_order_acq_rel);
+    if (stale != NULL) {
+        count(&counters[stale->txClass].overwritten);
+        txFrameFree(stale);
+    }
+    ringDoorbell();
+}
+
+void txFrameFree(tx_frame_t *frame) {
+    xQueueSend(frame->fromReserve ? reserveFree : sharedFree, &frame, 0);
+}
+
+static tx_frame_t *takeNext(void) {
+    tx_frame_t *frame;
+    if (xQueueReceive(reliableQueue, &frame, 0)) {
+        return frame;
+    }
+    for (uint8_t slot = 0; slot < TX_LATEST_COUNT; slot++) {
+        frame = atomic_exchange_explicit(&latest[slot], NULL, memory_order_acq_rel);
+        if (frame != NULL) {
+            return frame;
+        }
+    }
+    if (xQueueReceive(telemetryQueue, &frame, 0)) {
+        return frame;
+    }
+    return NULL;
+}
+
+tx_frame_t *txFrameReceive(TickType_t ticksToWait) {
+    uint8_t token;
+    do {
+        tx_frame_t *frame = takeNext();
+        if (frame != NULL) {
+            return frame;
+        }
+    } while (xQueueReceive(doorbell, &token, ticksToWait));
+    return NULL;
+}
+
+void txFrameRelease(tx_frame_t *frame, bool frameSent) {
+    count(frameSent ? &counters[frame->txClass].sent : &counters[frame->txClass].drops);
+    txFrameFree(frame);
+}
+
+void txFramePoolFlush(void) {
+    tx_frame_t *frame;
+    while ((frame = takeNext()) != NULL) {
+        txFrameRelease(frame, false);
+    }
+}
+
+void txFramePoolGetStats(tx_frame_pool_stats_t *stats) {
+    for (uint8_t i = 0; i < TX_CLASS_COUNT; i++) {
+        stats->classes[i] = (tx_class_stats_t){
+            .submitted = atomic_load_explicit(&counters[i].submitted, memory_order_relaxed),
+            .sent = atomic_load_explicit(&counters[i].sent, memory_order_relaxed),
+            .allocFailures = atomic_load_explicit(&counters[i].allocFailures, memory_order_relaxed),
+            .drops = atomic_load_explicit(&counters[i].drops, memory_order_relaxed),
+            .overwritten = atomic_load_explicit(&counters[i].overwritten, memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,591 @@
+/*
+ * Cliente de carga: hace de app Android con los paquetes de include/comms.h, para medir cambios en
+ * las comunicaciones sin la app ni el robot.
+ *
+ * Escucha en HOST_IP_ADDR:PORT como la app y, por defecto, corre en el mismo proceso el firmware de
+ * comunicaciones (tcp_client_socket.c, comms.c, el pool de transmision) con una tarea que hace de
+ * commsManager. Envia control, configuracion de PID y comandos entramados a las tasas pedidas, y
+ * parsea lo que envia el robot (status, configuracion local, tiempos, contadores de transmision,
+ * telemetria por suscripcion, caja negra).
+ *
+ * Reporta por sentido paquetes y bytes por segundo, errores de parseo, descartes (colas del robot
+ * llenas, paquetes reemplazados o sin frame en el pool) y la latencia control -> status y
+ * comando -> respuesta. Para medir la latencia el commsManager de prueba devuelve el ultimo control
+ * en speedR y el numero de comando en safetyLimits de la configuracion local; el firmware no lo hace.
+ *
+ * --listen: espera al robot real en 0.0.0.0:8080 (la PC con la IP HOST_IP_ADDR del firmware). Ahi
+ * no hay latencia ni contadores del lado del robot, salvo los que llegan en HEADER_PACKAGE_TX_STATS.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "comms.h"
+#include "comms_frame.h"
+#include "comms_codec.h"
+#include "include/TCP_CLIENT.h"
+#include "tcp_client_socket.h"
+
+#define DEFAULT_SECONDS         10
+#define DEFAULT_CONTROL_HZ      50
+#define DEFAULT_COMMAND_HZ      2
+#define DEFAULT_SETTINGS_HZ     1
+#define PERIOD_COMMS_MANAGER_MS 25                      // el de src/main.c
+#define ACCEPT_TIMEOUT_MS       5000
+#define RX_BUFFER_SIZE          4096
+#define SEQUENCE_MAX            0x7FFF                  // control numerado 1..SEQUENCE_MAX en axisX
+#define COMMAND_SEQUENCE_MAX    600                     // el eco vuelve en safetyLimits * PRECISION_DECIMALS_COMMS, un uint16
+#define MAX_LATENCY_SAMPLES     100000
+
+QueueHandle_t newPidParamsQueueHandler;
+QueueHandle_t receiveControlQueueHandler;
+QueueHandle_t newCommandQueueHandler;
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double diff = *(const double *)a - *(const double *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+/* ---------- robot en el proceso ---------- */
+
+static struct {
+    uint32_t controls;
+    uint32_t settings;
+    uint32_t commands;
+} consumed;
+
+/*
+ * Hace de commsManager: consume una vez por ciclo cada cola y envia lo mismo que el firmware
+ * (configuracion al conectar y al guardar, status por ciclo, tiempos y contadores cada segundo)
+ */
+static void robotManagerTask(void *param) {
+    robot_local_configs_t localConfig = {0};
+    robot_snapshot_t snapshot = {
+        .status.statusCode = STATUS_ROBOT_STABILIZED,
+    };
+    uint8_t lastStateIsConnected = false;
+    uint8_t localConfigPending = false;
+    uint16_t contLoopTiming = 0;
+    uint16_t contLinkStatus = 0;
+    uint16_t contImuStatus = 0;
+    imu_status_t imuStatus = {
+        .warmupSamples = 112,
+        .firstSampleMs = 1480,
+        .warmupState = IMU_WARMUP_SETTLED,
+        .offsetsSource = IMU_OFFSETS_CALIBRATED,
+        .calibrationState = IMU_CALIBRATION_DONE,
+        .calibrationProgress = 100,
+        .calibrationRound = 2,
+        .accelResidual = 0.0012f,
+        .gyroResidual = 0.02f,
+    };
+
+    while (true) {
+        control_app_raw_t control;
+        pid_settings_comms_t settings;
+        command_app_raw_t command;
+
+        if (xQueueReceive(receiveControlQueueHandler, &control, 0)) {
+            snapshot.status.speedR = control.axisX;     // eco para medir la latencia
+            consumed.controls++;
+        }
+        if (xQueueReceive(newPidParamsQueueHandler, &settings, 0)) {
+            if (settings.indexPid < CANT_PIDS) {
+                localConfig.pids[settings.indexPid].kp = settings.kp;
+                localConfig.pids[settings.indexPid].ki = settings.ki;
+                localConfig.pids[settings.indexPid].kd = settings.kd;
+            }
+            consumed.settings++;
+        }
+        if (xQueueReceive(newCommandQueueHandler, &command, 0)) {
+            if (command.command == COMMAND_SAVE_LOCAL_CONFIG) {
+                localConfig.safetyLimits = command.value;   // eco, sin grabar la flash
+                localConfigPending = true;
+            }
+            consumed.commands++;
+        }
+
+        if (isTcpClientConnected()) {
+            if (!lastStateIsConnected) {
+                localConfigPending = true;
+            }
+            if (localConfigPending) {
+                localConfigPending = !sendLocalConfig(localConfig);
+            }
+            sendDynamicData(&snapshot);
+            if (++contLoopTiming >= PERIOD_LOOP_TIMING_MS / PERIOD_COMMS_MANAGER_MS) {
+                contLoopTiming = 0;
+                sendLoopTiming();
+                sendTxStats();
+            }
+            if (++contLinkStatus >= PERIOD_LINK_STATUS_MS / PERIOD_COMMS_MANAGER_MS) {
+                contLinkStatus = 0;
+                sendLinkStatus();
+            }
+            if (++contImuStatus >= PERIOD_IMU_STATUS_MS / PERIOD_COMMS_MANAGER_MS) {
+                contImuStatus = 0;
+                sendImuStatus(&imuStatus);
+            }
+            sendTelemetryBatch();
+        }
+        lastStateIsConnected = isTcpClientConnected();
+        vTaskDelay(pdMS_TO_TICKS(PERIOD_COMMS_MANAGER_MS));
+    }
+}
+
+/* ---------- app ---------- */
+
+enum {
+    PACKET_CONTROL,
+    PACKET_SETTINGS,
+    PACKET_COMMAND,
+    PACKET_STATUS,
+    PACKET_LOCAL_CONFIG,
+    PACKET_LOOP_TIMING,
+    PACKET_TX_STATS,
+    PACKET_LINK_STATUS,
+    PACKET_IMU_STATUS,
+    PACKET_TELEMETRY_BATCH,
+    PACKET_FLIGHT_RECORDER,
+    PACKET_TYPES
+};
+
+static const char *packetNames[PACKET_TYPES] = {
+    "control", "settings", "comando", "status", "config local", "tiempos", "contadores tx",
+    "enlace", "imu", "telemetria", "caja negra",
+};
+
+typedef struct {
+    uint32_t packets[PACKET_TYPES];
+    uint64_t bytes[PACKET_TYPES];
+} traffic_t;
+
+typedef struct {
+    double *samplesUs;
+    uint32_t count;
+} latency_t;
+
+typedef struct {
+    traffic_t sent;
+    traffic_t received;
+    uint32_t corrupted;                                 // frames enviados con un byte alterado a proposito
+    uint32_t parseErrors;                               // headers desconocidos o largos invalidos del robot
+    uint32_t discardedBytes;                            // bytes salteados para resincronizar
+    double controlSentUs[SEQUENCE_MAX + 1];
+    double commandSentUs[COMMAND_SEQUENCE_MAX + 1];
+    uint16_t lastControlEcho;
+    uint16_t lastCommandEcho;
+    uint32_t controlEchoes;
+    uint32_t commandEchoes;
+    latency_t controlLatency;
+    latency_t commandLatency;
+    tx_frame_pool_stats_t lastTxStats;
+    uint8_t txStatsValid;
+    comms_link_status_t lastLinkStatus;
+    uint8_t linkStatusValid;
+    imu_status_t lastImuStatus;
+    uint8_t imuStatusValid;
+} app_state_t;
+
+static app_state_t app;
+
+static void addLatency(latency_t *latency, double valueUs) {
+    if (latency->count < MAX_LATENCY_SAMPLES) {
+        latency->samplesUs[latency->count++] = valueUs;
+    }
+}
+
+static int sendPacket(int sock, uint8_t type, const uint8_t *payload, uint16_t len, double corruptRate) {
+    uint8_t frame[COMMS_FRAME_MAX_PAYLOAD + COMMS_FRAME_OVERHEAD];
+    size_t frameLen = commsFrameEncode(frame, sizeof(frame), payload, len);
+    if (corruptRate > 0 && rand() < corruptRate * RAND_MAX) {
+        frame[COMMS_FRAME_HEADER_SIZE + rand() % len] ^= 0x10;    // un bit del payload, el CRC lo tiene que ver
+        app.corrupted++;
+    }
+    if (send(sock, frame, frameLen, MSG_NOSIGNAL) != (ssize_t)frameLen) {
+        return -1;
+    }
+    app.sent.packets[type]++;
+    app.sent.bytes[type] += frameLen;
+    return 0;
+}
+
+/*
+ * Largo del paquete del robot que empieza en data, 0 si el header no es conocido.
+ * Los paquetes del robot a la app no van entramados, el header define el largo.
+ */
+static size_t robotPacketSize(const uint8_t *data, size_t available, uint8_t *type) {
+    switch (commsGetU16(data)) {
+        case HEADER_PACKAGE_STATUS:          *type = PACKET_STATUS;          return COMMS_PACKET_SIZE_Status;
+        case HEADER_PACKAGE_LOCAL_CONFIG:    *type = PACKET_LOCAL_CONFIG;    return COMMS_PACKET_SIZE_LocalConfig;
+        case HEADER_PACKAGE_LOOP_TIMING:     *type = PACKET_LOOP_TIMING;     return COMMS_PACKET_SIZE_LoopTiming;
+        case HEADER_PACKAGE_TX_STATS:        *type = PACKET_TX_STATS;        return COMMS_PACKET_SIZE_TxStats;
+        case HEADER_PACKAGE_LINK_STATUS:     *type = PACKET_LINK_STATUS;     return COMMS_PACKET_SIZE_LinkStatus;
+        case HEADER_PACKAGE_IMU_STATUS:      *type = PACKET_IMU_STATUS;      return COMMS_PACKET_SIZE_ImuStatus;
+        case HEADER_PACKAGE_FLIGHT_RECORDER: *type = PACKET_FLIGHT_RECORDER; return COMMS_PACKET_SIZE_FlightRecorder;
+        case HEADER_PACKAGE_TELEMETRY_BATCH:
+            *type = PACKET_TELEMETRY_BATCH;
+            if (available < 4) {
+                return SIZE_MAX;                        // todavia no llego el largo
+            }
+            size_t len = commsGetU16(data + 2);
+            return (len >= TELEMETRY_STREAM_HEADER_SIZE && len <= TELEMETRY_STREAM_FRAME_MAX) ? len : 0;
+        default:
+            return 0;
+    }
+}
+
+static void handleRobotPacket(uint8_t type, const uint8_t *data, size_t size, double arrivalUs) {
+    app.received.packets[type]++;
+    app.received.bytes[type] += size;
+
+    if (type == PACKET_STATUS) {
+        robot_dynamic_data_t status;
+        if (!commsDecodeStatus(data, size, &status)) {
+            app.parseErrors++;
+            return;
+        }
+        uint16_t echo = status.speedR;
+        if (echo > 0 && echo <= SEQUENCE_MAX && echo != app.lastControlEcho && app.controlSentUs[echo] > 0) {
+            addLatency(&app.controlLatency, arrivalUs - app.controlSentUs[echo]);
+            app.controlSentUs[echo] = 0;
+            app.controlEchoes++;
+        }
+        app.lastControlEcho = echo;
+    }
+    else if (type == PACKET_LOCAL_CONFIG) {
+        robot_local_configs_t config;
+        if (!commsDecodeLocalConfig(data, size, &config)) {
+            app.parseErrors++;
+            return;
+        }
+        uint16_t echo = roundf(config.safetyLimits);
+        if (echo > 0 && echo <= COMMAND_SEQUENCE_MAX && echo != app.lastCommandEcho && app.commandSentUs[echo] > 0) {
+            addLatency(&app.commandLatency, arrivalUs - app.commandSentUs[echo]);
+            app.commandSentUs[echo] = 0;
+            app.commandEchoes++;
+        }
+        app.lastCommandEcho = echo;
+    }
+    else if (type == PACKET_TX_STATS) {
+        app.txStatsValid = commsDecodeTxStats(data, size, &app.lastTxStats);
+    }
+    else if (type == PACKET_LINK_STATUS) {
+        app.linkStatusValid = commsDecodeLinkStatus(data, size, &app.lastLinkStatus);
+    }
+    else if (type == PACKET_IMU_STATUS) {
+        app.imuStatusValid = commsDecodeImuStatus(data, size, &app.lastImuStatus);
+    }
+}
+
+/*
+ * Parsea todo lo completo en buffer. Ante un header desconocido saltea de a un byte hasta encontrar
+ * uno conocido, como tendria que hacer la app.
+ * @return bytes consumidos
+ */
+static size_t parseRobotStream(const uint8_t *buffer, size_t len, double arrivalUs) {
+    size_t pos = 0;
+    uint8_t resyncing = false;
+    while (len - pos >= sizeof(uint16_t)) {
+        uint8_t type;
+        size_t size = robotPacketSize(buffer + pos, len - pos, &type);
+        if (size == 0) {
+            if (!resyncing) {
+                app.parseErrors++;
+                resyncing = true;
+            }
+            app.discardedBytes++;
+            pos++;
+            continue;
+        }
+        if (size == SIZE_MAX || len - pos < size) {
+            break;
+        }
+        resyncing = false;
+        handleRobotPacket(type, buffer + pos, size, arrivalUs);
+        pos += size;
+    }
+    return pos;
+}
+
+static int openServer(const char *ip, uint16_t port) {
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    addr.sin_addr.s_addr = inet_addr(ip);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) || listen(server, 1)) {
+        perror("bind/listen");
+        close(server);
+        return -1;
+    }
+    return server;
+}
+
+static void printLatency(const char *name, latency_t *latency) {
+    if (!latency->count) {
+        printf("%-26s sin muestras\n", name);
+        return;
+    }
+    qsort(latency->samplesUs, latency->count, sizeof(double), compareDouble);
+    uint32_t n = latency->count;
+    printf("%-26s %6u muestras  p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f ms\n", name, n,
+           latency->samplesUs[n / 2] / 1000, latency->samplesUs[n * 90 / 100] / 1000,
+           latency->samplesUs[n * 99 / 100] / 1000, latency->samplesUs[n - 1] / 1000);
+}
+
+static void printTraffic(const char *direction, const traffic_t *traffic, double seconds) {
+    uint32_t packets = 0;
+    uint64_t bytes = 0;
+    for (uint8_t i = 0; i < PACKET_TYPES; i++) {
+        packets += traffic->packets[i];
+        bytes += traffic->bytes[i];
+    }
+    printf("%s: %.1f paquetes/s, %.2f KB/s\n", direction, packets / seconds, bytes / seconds / 1024);
+    for (uint8_t i = 0; i < PACKET_TYPES; i++) {
+        if (traffic->packets[i]) {
+            printf("    %-14s %7u  %7.1f/s  %7.2f KB/s\n", packetNames[i], traffic->packets[i],
+                   traffic->packets[i] / seconds, traffic->bytes[i] / seconds / 1024);
+        }
+    }
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --seconds N      duracion (%d)\n"
+           "  --control HZ     paquetes de control por segundo, 0 = ninguno (%d)\n"
+           "  --command HZ     comandos COMMAND_SAVE_LOCAL_CONFIG por segundo (%d)\n"
+           "  --settings HZ    configuraciones de PID por segundo (%d)\n"
+           "  --corrupt P      fraccion de frames enviados con un bit alterado (0)\n"
+           "  --listen         espera al robot real en 0.0.0.0:8080; ojo que cada comando graba la flash\n"
+           "  --log            habilita los ESP_LOGx del firmware\n",
+           prog, DEFAULT_SECONDS, DEFAULT_CONTROL_HZ, DEFAULT_COMMAND_HZ, DEFAULT_SETTINGS_HZ);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = DEFAULT_SECONDS;
+    double controlHz = DEFAULT_CONTROL_HZ;
+    double commandHz = DEFAULT_COMMAND_HZ;
+    double settingsHz = DEFAULT_SETTINGS_HZ;
+    double corruptRate = 0;
+    uint8_t listenMode = false;
+
+    static const struct option options[] = {
+        {"seconds",  required_argument, 0, 's'},
+        {"control",  required_argument, 0, 'c'},
+        {"command",  required_argument, 0, 'm'},
+        {"settings", required_argument, 0, 'p'},
+        {"corrupt",  required_argument, 0, 'x'},
+        {"listen",   no_argument,       0, 'L'},
+        {"log",      no_argument,       0, 'l'},
+        {"help",     no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:c:m:p:x:Llh", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': seconds = strtoul(optarg, NULL, 10); break;
+            case 'c': controlHz = atof(optarg); break;
+            case 'm': commandHz = atof(optarg); break;
+            case 'p': settingsHz = atof(optarg); break;
+            case 'x': corruptRate = atof(optarg); break;
+            case 'L': listenMode = true; break;
+            case 'l': hostLogEnable = 1; break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!seconds || controlHz < 0 || commandHz < 0 || settingsHz < 0 || corruptRate < 0 || corruptRate > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    app.controlLatency.samplesUs = calloc(MAX_LATENCY_SAMPLES, sizeof(double));
+    app.commandLatency.samplesUs = calloc(MAX_LATENCY_SAMPLES, sizeof(double));
+    if (!app.controlLatency.samplesUs || !app.commandLatency.samplesUs) {
+        return 1;
+    }
+
+    int server = openServer(listenMode ? "0.0.0.0" : HOST_IP_ADDR, listenMode ? 8080 : PORT);
+    if (server < 0) {
+        return 1;
+    }
+    if (!listenMode) {
+        newPidParamsQueueHandler = xQueueCreate(1, sizeof(pid_settings_comms_t));
+        receiveControlQueueHandler = xQueueCreate(1, sizeof(control_app_raw_t));
+        newCommandQueueHandler = xQueueCreate(1, sizeof(command_app_raw_t));
+        tcpClientSocketInit();
+        commsInit();
+        xTaskCreate(robotManagerTask, "robot manager", 4096, NULL, 5, NULL);
+        tcpClientSocketStart();
+    }
+
+    struct pollfd acceptFd = {.fd = server, .events = POLLIN};
+    if (poll(&acceptFd, 1, listenMode ? -1 : ACCEPT_TIMEOUT_MS) != 1) {
+        fprintf(stderr, "el robot no se conecto\n");
+        return 1;
+    }
+    int sock = accept(server, NULL, NULL);
+    if (sock < 0) {
+        perror("accept");
+        return 1;
+    }
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    static uint8_t rxBuffer[RX_BUFFER_SIZE];
+    size_t rxLen = 0;
+    uint16_t controlSeq = 0, commandSeq = 0;
+    uint8_t settingsIndex = 0;
+    double startUs = nowUs();
+    double endUs = startUs + seconds * 1e6;
+    double nextControlUs = startUs, nextCommandUs = startUs, nextSettingsUs = startUs;
+    uint8_t connected = true;
+    srand(1);
+
+    while (connected && nowUs() < endUs) {
+        double now = nowUs();
+        uint8_t packet[COMMS_FRAME_MAX_PAYLOAD];
+
+        if (controlHz > 0 && now >= nextControlUs) {
+            controlSeq = controlSeq % SEQUENCE_MAX + 1;
+            control_app_raw_t control = {
+                .axisX = controlSeq,
+            };
+            app.controlSentUs[controlSeq] = now;
+            size_t len = commsEncodeControl(packet, sizeof(packet), &control);
+            connected = !sendPacket(sock, PACKET_CONTROL, packet, len, corruptRate);
+            nextControlUs += 1e6 / controlHz;
+        }
+        if (commandHz > 0 && now >= nextCommandUs) {
+            commandSeq = commandSeq % COMMAND_SEQUENCE_MAX + 1;
+            command_app_raw_t command = {
+                .command = COMMAND_SAVE_LOCAL_CONFIG,
+                .value = commandSeq,
+            };
+            app.commandSentUs[commandSeq] = now;
+            size_t len = commsEncodeCommand(packet, sizeof(packet), &command);
+            connected = connected && !sendPacket(sock, PACKET_COMMAND, packet, len, corruptRate);
+            nextCommandUs += 1e6 / commandHz;
+        }
+        if (settingsHz > 0 && now >= nextSettingsUs) {
+            pid_settings_comms_t settings = {
+                .indexPid = settingsIndex,
+                .kp = 1.0f + settingsIndex / 100.0f,
+                .ki = 0.1f,
+                .kd = 0.01f,
+            };
+            settingsIndex = (settingsIndex + 1) % CANT_PIDS;
+            size_t len = commsEncodeSettings(packet, sizeof(packet), &settings);
+            connected = connected && !sendPacket(sock, PACKET_SETTINGS, packet, len, corruptRate);
+            nextSettingsUs += 1e6 / settingsHz;
+        }
+
+        // Espera hasta el proximo envio o hasta que llegue algo del robot
+        double nextUs = endUs;
+        if (controlHz > 0 && nextControlUs < nextUs) nextUs = nextControlUs;
+        if (commandHz > 0 && nextCommandUs < nextUs) nextUs = nextCommandUs;
+        if (settingsHz > 0 && nextSettingsUs < nextUs) nextUs = nextSettingsUs;
+        int timeoutMs = nextUs > now ? (int)((nextUs - now) / 1000) : 0;
+
+        struct pollfd pfd = {.fd = sock, .events = POLLIN};
+        if (poll(&pfd, 1, timeoutMs) == 1) {
+            ssize_t len = recv(sock, rxBuffer + rxLen, sizeof(rxBuffer) - rxLen, 0);
+            if (len <= 0) {
+                connected = false;
+                break;
+            }
+            rxLen += len;
+            size_t used = parseRobotStream(rxBuffer, rxLen, nowUs());
+            memmove(rxBuffer, rxBuffer + used, rxLen - used);
+            rxLen -= used;
+        }
+    }
+    double elapsed = (nowUs() - startUs) / 1e6;
+
+    // Lo que quedo en camino no cuenta como perdido
+    vTaskDelay(pdMS_TO_TICKS(4 * PERIOD_COMMS_MANAGER_MS));
+    comms_rx_stats_t robotRx;
+    if (!listenMode) {
+        commsGetRxStats(&robotRx);
+    }
+
+    printf("%u s%s, control %.0f Hz, comandos %.0f Hz, settings %.0f Hz, %u frames alterados\n",
+           seconds, connected ? "" : " (el robot se desconecto)", controlHz, commandHz, settingsHz, app.corrupted);
+    printTraffic("app -> robot", &app.sent, elapsed);
+    printTraffic("robot -> app", &app.received, elapsed);
+    printf("errores de parseo en la app: %u (%u bytes salteados)\n", app.parseErrors, app.discardedBytes);
+
+    uint32_t sentFrames = 0;
+    for (uint8_t i = 0; i < PACKET_TYPES; i++) {
+        sentFrames += app.sent.packets[i];
+    }
+    int result = (!connected || app.parseErrors || !app.received.packets[PACKET_STATUS]) ? 2 : 0;
+
+    if (!listenMode) {
+        printf("robot: %u frames validos, %u CRC, %u largo, %u bytes salteados, %u desconocidos, %u largo de paquete\n",
+               robotRx.frames.frames, robotRx.frames.crcErrors, robotRx.frames.lengthErrors,
+               robotRx.frames.discardedBytes, robotRx.unknownPackets, robotRx.badLength);
+        printf("robot: %u a las colas de commsManager, %u descartados o reemplazados con la cola llena; consumidos %u control, %u settings, %u comandos\n",
+               robotRx.queued, robotRx.queueDrops, consumed.controls, consumed.settings, consumed.commands);
+        printf("eco de control %u de %u enviados, de comandos %u de %u\n",
+               app.controlEchoes, app.sent.packets[PACKET_CONTROL], app.commandEchoes, app.sent.packets[PACKET_COMMAND]);
+        printLatency("control -> status", &app.controlLatency);
+        printLatency("comando -> config local", &app.commandLatency);
+
+        // Todo frame sano tiene que llegar y todo frame alterado rechazarse por CRC
+        if (robotRx.frames.frames != sentFrames - app.corrupted || robotRx.frames.crcErrors < app.corrupted ||
+            robotRx.unknownPackets || robotRx.badLength) {
+            result = 2;
+        }
+    }
+    if (app.txStatsValid) {
+        for (uint8_t i = 0; i < TX_CLASS_COUNT; i++) {
+            const tx_class_stats_t *txClass = &app.lastTxStats.classes[i];
+            printf("robot tx %-10s enviados %u, sin frame %u, descartados %u, reemplazados %u\n",
+                   i == TX_CLASS_RELIABLE ? "confiable" : "telemetria", txClass->sent, txClass->allocFailures,
+                   txClass->drops, txClass->overwritten);
+        }
+    }
+    if (app.linkStatusValid) {
+        const comms_link_status_t *link = &app.lastLinkStatus;
+        printf("robot enlace: failsafe %s (%u activaciones), antiguedad control %u ms, settings %u ms, comando %u ms\n",
+               link->failsafeActive ? "activo" : "inactivo", link->failsafeCount, link->ageMs[COMMS_STREAM_CONTROL],
+               link->ageMs[COMMS_STREAM_SETTINGS], link->ageMs[COMMS_STREAM_COMMAND]);
+    }
+    if (app.imuStatusValid) {
+        const imu_status_t *imu = &app.lastImuStatus;
+        static const char *sources[] = {"de fabrica", "de la NVS", "calibrados"};
+        printf("robot imu: primera muestra a los %u ms, %u descartadas, estado %u, offsets %s\n", imu->firstSampleMs,
+               imu->warmupSamples, imu->warmupState, imu->offsetsSource <= IMU_OFFSETS_CALIBRATED ? sources[imu->offsetsSource] : "?");
+        printf("robot imu: calibracion estado %u, %u%% en la ronda %u, error %u, residuo %.4f g %.2f grados/s\n",
+               imu->calibrationState, imu->calibrationProgress, imu->calibrationRound, imu->calibrationError,
+               imu->accelResidual, imu->gyroResidual);
+    }
+
+    close(sock);
+    close(server);
+    return result;
+}
@@ -0,0 +1,199 @@
+/*
+ * Calibracion del IMU en segundo plano (src/imu_calibration.c) contra un MPU simulado.
+ *
+ * El sensor devuelve lecturas crudas (escala del DMP o de la fusion, --fusion) con un sesgo por eje,
+ * ruido y los offsets de los registros: 2048 LSB/g en el acelerometro y 32.8 LSB por grado/s en el
+ * giroscopo, por una ganancia del escenario (1: el paso del registro es exacto) y con el retardo del DLPF.
+ * Cuando imuCalibrationUpdate lo pide se escriben los offsets, como mpu6050WriteOffsets. Escenarios:
+ *  - quieto:     sesgos de fabrica, sin moverse
+ *  - ganancia:   igual con los pasos del registro un 20% cortos, hace falta otra ronda
+ *  - golpe:      un golpe de 0.3 s en la segunda ronda, se descarta y se repite
+ *  - movimiento: no se queda quieto, tiene que fallar sin tocar los offsets
+ *  - levantado:  se mueve desde la segunda ronda, ya con offsets escritos: falla y vuelve a los de antes
+ *  - bus:        la primera escritura falla a medias (solo el acelerometro): imuCalibrationAbort vuelve a los de antes
+ *
+ * Reporta por escenario rondas, rondas con movimiento, duracion, el error real que queda y el costo de
+ * cada llamada (la tarea del MPU la hace una vez por muestra). Sale con 2 si un escenario que debe
+ * terminar bien no lo hace, si queda fuera de la tolerancia (con el margen del ruido), si cambio el bit 0
+ * de algun offset del acelerometro o si el que falla no deja los offsets de antes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "main.h"
+#include "imu_calibration.h"
+#include "imu_fusion.h"
+
+#define DMP_BASE_RATE_HZ        200                                     // MPU_DMP_BASE_RATE_HZ de mpu6050_wrapper.cpp
+#define DMP_SAMPLE_HZ           (DMP_BASE_RATE_HZ / (DMP_BASE_RATE_HZ * CONTROL_TICK_PERIOD_US / 1000000))  // MPU_DMP_WARMUP_SAMPLE_HZ: una lectura por paquete
+#define ACCEL_NOISE_G           0.003f
+#define GYRO_NOISE_DPS          0.05f
+#define DLPF_TAU_S              0.02f
+#define MAX_SECONDS             60
+#define ACCEL_MARGIN_G          0.002f                                  // ruido de la media y paso de 2 LSB del registro
+#define GYRO_MARGIN_DPS         0.03f
+
+typedef struct {
+    const char *name;
+    float gain;                                         // respuesta real del registro de offset
+    float moveFromS;                                    // negativo: quieto siempre
+    float moveForS;                                     // negativo: hasta el final
+    uint8_t mustSucceed;
+    uint8_t busFailRound;                               // la escritura al pasar a esta ronda falla a medias, 0: nunca
+} scenario_t;
+
+static unsigned int seed = 1;
+
+static float gaussian(void) {
+    float u1 = (rand_r(&seed) + 1.0f) / (RAND_MAX + 2.0f);
+    float u2 = (rand_r(&seed) + 1.0f) / (RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int16_t toRaw(float value) {
+    float raw = roundf(value);
+    return raw > INT16_MAX ? INT16_MAX : (raw < INT16_MIN ? INT16_MIN : (int16_t)raw);
+}
+
+static void usage(const char *name) {
+    printf("uso: %s [--fusion] [--seed N]\n", name);
+}
+
+int main(int argc, char **argv) {
+    uint16_t sampleHz = DMP_SAMPLE_HZ;
+    float gyroLsbPerDps = IMU_FUSION_DMP_GYRO_LSB_PER_DPS;
+
+    static const struct option options[] = {
+        {"fusion", no_argument,       0, 'f'},
+        {"seed",   required_argument, 0, 's'},
+        {"help",   no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "fs:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'f': sampleHz = IMU_FUSION_RATE_HZ; gyroLsbPerDps = IMU_FUSION_GYRO_LSB_PER_DPS; break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    const scenario_t scenarios[] = {
+        {"quieto",     1.0f, -1,   0,    true,  0},
+        {"ganancia",   0.8f, -1,   0,    true,  0},
+        {"golpe",      1.0f, 2.5f, 0.3f, true,  0},
+        {"movimiento", 1.0f, 0,    -1,   false, 0},
+        {"levantado",  1.0f, 2.5f, -1,   false, 0},
+        {"bus",        1.0f, -1,   0,    false, 2},
+    };
+    // Sesgos con los offsets de fabrica, en g y grados/s
+    const float accelBias[3] = {0.031f, -0.018f, 0.052f};
+    const float gyroBias[3] = {1.6f, -0.9f, 0.45f};
+    const imu_offsets_t factory = {{-1520, 831, 1204}, {47, -12, 5}};
+
+    printf("%u muestras/s, giroscopo %.1f LSB/grado/s, rondas de %d ms, tolerancia %.3f g y %.2f grados/s\n\n",
+           sampleHz, gyroLsbPerDps, IMU_CALIBRATION_ROUND_MS, IMU_CALIBRATION_ACCEL_TOLERANCE_G,
+           IMU_CALIBRATION_GYRO_TOLERANCE_DPS);
+    printf("%-11s %-10s %7s %10s %8s %11s %11s %10s %9s %9s\n", "escenario", "resultado", "rondas", "movimiento",
+           "s", "error g", "error dps", "restaura", "ns medio", "ns max");
+
+    int errors = 0;
+    for (uint8_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        const scenario_t *scenario = &scenarios[s];
+        imu_calibration_t calibration;
+        imu_offsets_t registers = factory;
+        float effective[6] = {0};                       // efecto de los offsets escritos, tras el DLPF
+        float alpha = 1.0f - expf(-1.0f / (DLPF_TAU_S * sampleHz));
+        double totalNs = 0, maxNs = 0;
+        uint32_t n;
+
+        imuCalibrationStart(&calibration, &registers, sampleHz, IMU_FUSION_ACCEL_LSB_PER_G, gyroLsbPerDps);
+        for (n = 0; n < (uint32_t)MAX_SECONDS * sampleHz; n++) {
+            float t = (float)n / sampleHz;
+            bool moving = scenario->moveFromS >= 0 && t >= scenario->moveFromS &&
+                (scenario->moveForS < 0 || t < scenario->moveFromS + scenario->moveForS);
+
+            int16_t accel[3], gyro[3];
+            for (uint8_t i = 0; i < 3; i++) {
+                float accelTarget = scenario->gain * (registers.accel[i] - factory.accel[i]) / IMU_CALIBRATION_ACCEL_OFFSET_LSB_PER_G;
+                float gyroTarget = scenario->gain * (registers.gyro[i] - factory.gyro[i]) / IMU_CALIBRATION_GYRO_OFFSET_LSB_PER_DPS;
+                effective[i] += alpha * (accelTarget - effective[i]);
+                effective[3 + i] += alpha * (gyroTarget - effective[3 + i]);
+
+                float g = (i == 2 ? 1.0f : 0) + accelBias[i] + effective[i] + ACCEL_NOISE_G * gaussian();
+                float rate = gyroBias[i] + effective[3 + i] + GYRO_NOISE_DPS * gaussian();
+                if (moving) {
+                    g += 0.1f * sinf(2.0f * (float)M_PI * (1.3f + i) * t);
+                    rate += 20.0f * cosf(2.0f * (float)M_PI * (0.7f + i) * t);
+                }
+                accel[i] = toRaw(g * IMU_FUSION_ACCEL_LSB_PER_G);
+                gyro[i] = toRaw(rate * gyroLsbPerDps);
+            }
+
+            double start = nowNs();
+            bool apply = imuCalibrationUpdate(&calibration, accel, gyro);
+            double elapsed = nowNs() - start;
+            totalNs += elapsed;
+            if (elapsed > maxNs) {
+                maxNs = elapsed;
+            }
+            // Como mpu6050CalibrationStep: si la escritura falla se aborta y se escriben los de antes
+            while (apply) {
+                if (calibration.round == scenario->busFailRound && calibration.state == IMU_CALIBRATION_MEASURING) {
+                    memcpy(registers.accel, calibration.offsets.accel, sizeof(registers.accel));
+                    apply = imuCalibrationAbort(&calibration, IMU_CALIBRATION_ERROR_BUS);
+                    continue;
+                }
+                registers = calibration.offsets;
+                apply = false;
+            }
+            if (calibration.state == IMU_CALIBRATION_DONE || calibration.state == IMU_CALIBRATION_FAILED) {
+                break;
+            }
+        }
+
+        // Error real con los offsets que quedaron, sin ruido
+        float accelError = 0, gyroError = 0;
+        for (uint8_t i = 0; i < 3; i++) {
+            float accelOffset = scenario->gain * (registers.accel[i] - factory.accel[i]) / IMU_CALIBRATION_ACCEL_OFFSET_LSB_PER_G;
+            float gyroOffset = scenario->gain * (registers.gyro[i] - factory.gyro[i]) / IMU_CALIBRATION_GYRO_OFFSET_LSB_PER_DPS;
+            accelError = fmaxf(accelError, fabsf(accelBias[i] + accelOffset));
+            gyroError = fmaxf(gyroError, fabsf(gyroBias[i] + gyroOffset));
+        }
+        bool done = calibration.state == IMU_CALIBRATION_DONE;
+        bool restored = memcmp(&registers, &factory, sizeof(factory)) == 0;
+        for (uint8_t i = 0; i < 3; i++) {
+            if ((registers.accel[i] ^ factory.accel[i]) & 1) {
+                errors++;                               // bit 0 reservado
+            }
+        }
+
+        printf("%-11s %-10s %7u %10u %8.2f %11.4f %11.3f %10s %9.0f %9.0f\n", scenario->name,
+               done ? "ok" : (calibration.state == IMU_CALIBRATION_FAILED ? "fallo" : "sin fin"), calibration.round,
+               calibration.motionRounds, (float)n / sampleHz, accelError, gyroError, restored ? "si" : "no",
+               totalNs / (n + 1), maxNs);
+
+        if (scenario->mustSucceed) {
+            if (!done || accelError > IMU_CALIBRATION_ACCEL_TOLERANCE_G + ACCEL_MARGIN_G ||
+                gyroError > IMU_CALIBRATION_GYRO_TOLERANCE_DPS + GYRO_MARGIN_DPS) {
+                errors++;
+            }
+        }
+        else if (calibration.state != IMU_CALIBRATION_FAILED || !restored ||
+                 (scenario->busFailRound && calibration.error != IMU_CALIBRATION_ERROR_BUS)) {
+            errors++;
+        }
+    }
+    printf("\n%s\n", errors ? "ERROR: algun escenario no cumple" : "ok");
+    return errors ? 2 : 0;
+}
@@ -0,0 +1,364 @@
+/*
+ * Codec de paquetes (src/comms_codec.c): costo por paquete y verificacion del formato.
+ *
+ * Por cada paquete de COMMS_PACKETS arma bytes aleatorios en el cable (con los headers y CONST en
+ * su valor), los decodifica y los vuelve a codificar: tienen que salir identicos, tambien los campos
+ * escalados (ida y vuelta exacta gracias al redondeo). En los enteros compara ademas lo decodificado
+ * contra un memcpy del struct de comms.h, que es lo que lee la app. Verifica que se rechacen un largo
+ * o un header distintos y la saturacion de los escalados.
+ *
+ * Rendimiento: ns por encode y decode de cada paquete, contra un memcpy del struct (lo que se hacia
+ * antes con los paquetes enteros) y contra las conversiones con double que habia antes para la
+ * configuracion local y los settings de PID. Sale con 2 si algo no cuadra.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "comms.h"
+#include "comms_codec.h"
+
+#define DEFAULT_ITERATIONS      1000000
+#define DEFAULT_CHECKS          20000
+#define LEGACY_PRECISION        100.00                  // el PRECISION_DECIMALS_COMMS anterior, en double
+
+typedef size_t (*encode_fn_t)(uint8_t *out, size_t outSize, const void *in);
+typedef bool (*decode_fn_t)(const uint8_t *in, size_t len, void *out);
+
+typedef struct {
+    const char *name;
+    uint16_t header;
+    encode_fn_t encode;
+    decode_fn_t decode;
+    size_t packetSize;
+    uint8_t onlyIntegers;                               // el tipo en memoria es el mismo struct de comms.h
+} packet_info_t;
+
+#define BENCH_WRAPPERS(name, header, type, layout) \
+    static size_t encode##name(uint8_t *out, size_t outSize, const void *in) { \
+        return commsEncode##name(out, outSize, in); \
+    } \
+    static bool decode##name(const uint8_t *in, size_t len, void *out) { \
+        return commsDecode##name(in, len, out); \
+    }
+COMMS_PACKETS(BENCH_WRAPPERS)
+
+#define BENCH_PACKET_INFO(name, header, type, layout) \
+    {#name, header, encode##name, decode##name, COMMS_PACKET_SIZE_##name, 0},
+
+static packet_info_t packets[] = {
+    COMMS_PACKETS(BENCH_PACKET_INFO)
+};
+#define PACKET_COUNT    (sizeof(packets) / sizeof(packets[0]))
+
+static volatile uint32_t sink;
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void putLe16(uint8_t *out, uint16_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+/*
+ * Bytes aleatorios validos para el paquete: header y campos CONST en su valor
+ */
+static void randomWire(const packet_info_t *packet, uint8_t *wire) {
+    for (size_t i = 0; i < packet->packetSize; i++) {
+        wire[i] = rand();
+    }
+    putLe16(wire, packet->header);
+    if (packet->header == HEADER_PACKAGE_STATUS_UDP) {
+        putLe16(wire + 4, HEADER_PACKAGE_STATUS);
+    }
+    else if (packet->header == HEADER_PACKAGE_TX_STATS) {
+        putLe16(wire + 2, TX_CLASS_COUNT);
+    }
+    else if (packet->header == HEADER_PACKAGE_LINK_STATUS) {
+        wire[3] = COMMS_STREAM_COUNT;
+    }
+}
+
+/* ---------- conversiones anteriores, para comparar ---------- */
+
+static void legacyEncodeLocalConfig(const robot_local_configs_t *localConfig, robot_local_configs_comms_t *raw) {
+    raw->headerPackage = HEADER_PACKAGE_LOCAL_CONFIG;
+    raw->centerAngle = localConfig->centerAngle * LEGACY_PRECISION;
+    raw->safetyLimits = localConfig->safetyLimits * LEGACY_PRECISION;
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        raw->pid[i] = (pid_params_raw_t){
+            .kp = localConfig->pids[i].kp * LEGACY_PRECISION,
+            .ki = localConfig->pids[i].ki * LEGACY_PRECISION,
+            .kd = localConfig->pids[i].kd * LEGACY_PRECISION,
+        };
+    }
+}
+
+static void legacyDecodeSettings(const uint8_t *payload, pid_settings_comms_t *settings) {
+    pid_settings_app_raw_t raw;
+    memcpy(&raw, payload, sizeof(raw));
+    settings->indexPid = raw.indexPid;
+    settings->safetyLimits = raw.safetyLimits / LEGACY_PRECISION;
+    settings->centerAngle = raw.centerAngle / LEGACY_PRECISION;
+    settings->kp = raw.kp / LEGACY_PRECISION;
+    settings->ki = raw.ki / LEGACY_PRECISION;
+    settings->kd = raw.kd / LEGACY_PRECISION;
+}
+
+/* ---------- verificacion ---------- */
+
+static int checkPacket(const packet_info_t *packet, uint32_t checks) {
+    uint8_t wire[TX_FRAME_SIZE], again[TX_FRAME_SIZE];
+    uint8_t native[512];
+    int errors = 0;
+
+    for (uint32_t n = 0; n < checks; n++) {
+        randomWire(packet, wire);
+        memset(native, 0, sizeof(native));
+        if (!packet->decode(wire, packet->packetSize, native)) {
+            printf("  %s: no decodifica un paquete valido\n", packet->name);
+            return 1;
+        }
+        size_t len = packet->encode(again, sizeof(again), native);
+        if (len != packet->packetSize || memcmp(wire, again, len)) {
+            errors++;
+        }
+        // Los paquetes de enteros tienen que quedar igual que leyendo el struct de comms.h. Los
+        // headerPackage en memoria no los toca el codec
+        if (packet->onlyIntegers) {
+            memcpy(native, wire, 2);
+            if (packet->header == HEADER_PACKAGE_STATUS_UDP) {
+                memcpy(native + 4, wire + 4, 2);
+            }
+            if (memcmp(native, wire, packet->packetSize)) {
+                errors++;
+            }
+        }
+    }
+
+    randomWire(packet, wire);
+    if (packet->decode(wire, packet->packetSize - 1, native) || packet->decode(wire, packet->packetSize + 1, native)) {
+        printf("  %s: acepta un largo distinto\n", packet->name);
+        errors++;
+    }
+    putLe16(wire, packet->header ^ 0x0100);
+    if (packet->decode(wire, packet->packetSize, native)) {
+        printf("  %s: acepta otro header\n", packet->name);
+        errors++;
+    }
+    if (packet->encode(again, packet->packetSize - 1, native)) {
+        printf("  %s: codifica en un buffer chico\n", packet->name);
+        errors++;
+    }
+    return errors;
+}
+
+/*
+ * Escalados: saturacion, redondeo y diferencia con las conversiones en double anteriores
+ */
+static int checkScaled(uint32_t checks) {
+    int errors = 0;
+    uint8_t wire[COMMS_PACKET_SIZE_LocalConfig];
+    robot_local_configs_comms_t raw;
+
+    robot_local_configs_t extreme = {
+        .centerAngle = -1000.0f,                        // satura a -32768
+        .safetyLimits = 1000.0f,                        // satura a 65535
+        .pids[0] = {.kp = -1.0f, .ki = 0.004f, .kd = 0.006f},   // 0, 0 y 1 (redondeo)
+    };
+    commsEncodeLocalConfig(wire, sizeof(wire), &extreme);
+    memcpy(&raw, wire, sizeof(raw));
+    if (raw.centerAngle != -32768 || raw.safetyLimits != 65535 || raw.pid[0].kp != 0 || raw.pid[0].ki != 0 ||
+        raw.pid[0].kd != 1) {
+        printf("  LocalConfig: saturacion o redondeo incorrectos (%d %u %u %u %u)\n", raw.centerAngle,
+               raw.safetyLimits, raw.pid[0].kp, raw.pid[0].ki, raw.pid[0].kd);
+        errors++;
+    }
+
+    // Valores con dos decimales, como los que carga la app: la conversion anterior truncaba
+    uint32_t fields = 0, legacyOff = 0;
+    for (uint32_t n = 0; n < checks; n++) {
+        robot_local_configs_t config = {
+            .centerAngle = (rand() % 2000 - 1000) / 100.0f,
+            .safetyLimits = (rand() % 9000) / 100.0f,
+        };
+        for (uint8_t i = 0; i < CANT_PIDS; i++) {
+            config.pids[i] = (pid_floats_t){
+                .kp = (rand() % 60000) / 100.0f,
+                .ki = (rand() % 60000) / 100.0f,
+                .kd = (rand() % 60000) / 100.0f,
+            };
+        }
+        robot_local_configs_comms_t legacy;
+        legacyEncodeLocalConfig(&config, &legacy);
+        commsEncodeLocalConfig(wire, sizeof(wire), &config);
+        memcpy(&raw, wire, sizeof(raw));
+
+        robot_local_configs_t decoded;
+        commsDecodeLocalConfig(wire, sizeof(wire), &decoded);
+        if (fabsf(decoded.centerAngle - config.centerAngle) > 0.005f ||
+            fabsf(decoded.safetyLimits - config.safetyLimits) > 0.005f) {
+            errors++;
+        }
+        int diffs = (raw.centerAngle != legacy.centerAngle) + (raw.safetyLimits != legacy.safetyLimits);
+        for (uint8_t i = 0; i < CANT_PIDS; i++) {
+            diffs += (raw.pid[i].kp != legacy.pid[i].kp) + (raw.pid[i].ki != legacy.pid[i].ki) +
+                     (raw.pid[i].kd != legacy.pid[i].kd);
+            if (fabsf(decoded.pids[i].kp - config.pids[i].kp) > 0.005f) {
+                errors++;
+            }
+        }
+        fields += 2 + 3 * CANT_PIDS;
+        legacyOff += diffs;
+    }
+    printf("escalados: la conversion anterior (double, truncando) difiere en %.2f%% de los campos con dos decimales\n",
+           100.0 * legacyOff / fields);
+
+    // Settings: lo decodificado tiene que coincidir con la division en double anterior
+    for (uint32_t n = 0; n < checks; n++) {
+        uint8_t settingsWire[COMMS_PACKET_SIZE_Settings];
+        randomWire(&(packet_info_t){.header = HEADER_PACKAGE_SETTINGS, .packetSize = sizeof(settingsWire)}, settingsWire);
+        pid_settings_comms_t decoded, legacy;
+        commsDecodeSettings(settingsWire, sizeof(settingsWire), &decoded);
+        legacyDecodeSettings(settingsWire, &legacy);
+        if (decoded.indexPid != legacy.indexPid || fabsf(decoded.kp - legacy.kp) > 1e-4f ||
+            fabsf(decoded.centerAngle - legacy.centerAngle) > 1e-4f ||
+            fabsf(decoded.safetyLimits - legacy.safetyLimits) > 1e-4f) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/* ---------- rendimiento ---------- */
+
+static void benchPacket(const packet_info_t *packet, uint32_t iterations) {
+    uint8_t wire[TX_FRAME_SIZE], out[TX_FRAME_SIZE];
+    uint8_t native[512];
+    randomWire(packet, wire);
+    packet->decode(wire, packet->packetSize, native);
+
+    double start = nowNs();
+    for (uint32_t i = 0; i < iterations; i++) {
+        native[4] = i;                                  // que el compilador no saque el encode del lazo
+        sink += packet->encode(out, sizeof(out), native);
+        sink += out[packet->packetSize - 1];
+    }
+    double encodeNs = (nowNs() - start) / iterations;
+
+    start = nowNs();
+    for (uint32_t i = 0; i < iterations; i++) {
+        wire[4] = i;
+        sink += packet->decode(wire, packet->packetSize, native);
+        sink += native[4];
+    }
+    double decodeNs = (nowNs() - start) / iterations;
+
+    start = nowNs();
+    for (uint32_t i = 0; i < iterations; i++) {
+        wire[4] = i;
+        memcpy(out, wire, packet->packetSize);
+        __asm__ volatile("" : : "r"(out) : "memory");
+        sink += out[4];
+    }
+    double memcpyNs = (nowNs() - start) / iterations;
+
+    printf("%-20s %4zu B  encode %6.1f ns  decode %6.1f ns  memcpy %5.1f ns\n", packet->name, packet->packetSize,
+           encodeNs, decodeNs, memcpyNs);
+}
+
+static void benchLegacy(uint32_t iterations) {
+    robot_local_configs_t config = {.centerAngle = 1.23f, .safetyLimits = 45.6f};
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        config.pids[i] = (pid_floats_t){.kp = 12.34f, .ki = 0.56f, .kd = 7.89f};
+    }
+    robot_local_configs_comms_t raw;
+    double start = nowNs();
+    for (uint32_t i = 0; i < iterations; i++) {
+        config.centerAngle = i & 0xFF;
+        legacyEncodeLocalConfig(&config, &raw);
+        __asm__ volatile("" : : "r"(&raw) : "memory");
+        sink += raw.safetyLimits;
+    }
+    double encodeNs = (nowNs() - start) / iterations;
+
+    uint8_t wire[COMMS_PACKET_SIZE_Settings];
+    randomWire(&(packet_info_t){.header = HEADER_PACKAGE_SETTINGS, .packetSize = sizeof(wire)}, wire);
+    pid_settings_comms_t settings;
+    start = nowNs();
+    for (uint32_t i = 0; i < iterations; i++) {
+        wire[4] = i;
+        legacyDecodeSettings(wire, &settings);
+        __asm__ volatile("" : : "r"(&settings) : "memory");
+        sink += settings.indexPid;
+    }
+    double decodeNs = (nowNs() - start) / iterations;
+
+    printf("%-20s         encode LocalConfig %6.1f ns  decode Settings %6.1f ns\n", "anterior (double)",
+           encodeNs, decodeNs);
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --iterations N   repeticiones por paquete para medir (%d)\n"
+           "  --checks N       paquetes aleatorios a verificar por tipo (%d)\n"
+           "  --seed N         semilla\n",
+           prog, DEFAULT_ITERATIONS, DEFAULT_CHECKS);
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = DEFAULT_ITERATIONS;
+    uint32_t checks = DEFAULT_CHECKS;
+    unsigned seed = 1;
+
+    static const struct option options[] = {
+        {"iterations", required_argument, 0, 'n'},
+        {"checks",     required_argument, 0, 'c'},
+        {"seed",       required_argument, 0, 's'},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:s:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': iterations = strtoul(optarg, NULL, 10); break;
+            case 'c': checks = strtoul(optarg, NULL, 10); break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!iterations) {
+        usage(argv[0]);
+        return 1;
+    }
+    srand(seed);
+
+    // Los paquetes sin campos escalados se leen en memoria con el mismo struct que documenta el formato
+    for (uint8_t i = 0; i < PACKET_COUNT; i++) {
+        uint16_t header = packets[i].header;
+        packets[i].onlyIntegers = header != HEADER_PACKAGE_SETTINGS && header != HEADER_PACKAGE_LOCAL_CONFIG &&
+                                  header != HEADER_PACKAGE_TX_STATS && header != HEADER_PACKAGE_LINK_STATUS &&
+                                  header != HEADER_PACKAGE_IMU_STATUS;
+    }
+
+    int errors = 0;
+    for (uint8_t i = 0; i < PACKET_COUNT; i++) {
+        errors += checkPacket(&packets[i], checks);
+    }
+    errors += checkScaled(checks);
+    printf("verificacion: %u paquetes aleatorios por tipo, %d errores\n\n", checks, errors);
+
+    for (uint8_t i = 0; i < PACKET_COUNT; i++) {
+        benchPacket(&packets[i], iterations);
+    }
+    benchLegacy(iterations);
+
+    return errors ? 2 : 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * Failsafe de control (controlDeadman en src/comms.c): cuanto tarda el joystick en cero despues de
+ * que la app deja de enviar control, y que se envie una sola vez.
+ *
+ * Hace de app en loopback con el firmware de comunicaciones en el mismo proceso. Repite ciclos:
+ * envia control a --control Hz durante --burst ms (axisX distinto de cero) y se calla --gap ms. Un
+ * hilo lee receiveControlQueueHandler como commsManager y marca cuando llega el cero. Reporta el
+ * retraso del cero respecto del ultimo control menos COMMS_CONTROL_TIMEOUT_US, los ceros por silencio
+ * (tiene que ser 1) y los ceros falsos con control llegando. Con --load N corre N hilos ocupando CPU.
+ * Al final compara la antiguedad del ultimo control de commsGetLinkStatus con la medida.
+ * Con --edge N repite N silencios que terminan con un control justo cuando vence el deadman (+-2 ms):
+ * lo ultimo en la cola tiene que ser ese control y el failsafe quedar inactivo.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "comms.h"
+#include "comms_codec.h"
+#include "comms_frame.h"
+#include "include/TCP_CLIENT.h"
+#include "tcp_client_socket.h"
+
+#define DEFAULT_CYCLES          5
+#define DEFAULT_CONTROL_HZ      50
+#define DEFAULT_BURST_MS        300
+#define DEFAULT_GAP_MS          1300                    // tiene que pasar COMMS_CONTROL_TIMEOUT_US
+#define MAX_LATE_US             5000                    // retraso tolerado sobre COMMS_CONTROL_TIMEOUT_US
+#define ACCEPT_TIMEOUT_MS       5000
+#define EDGE_SPREAD_US          2000                    // el control de --edge llega hasta 2 ms antes o despues del vencimiento
+
+QueueHandle_t newPidParamsQueueHandler;
+QueueHandle_t receiveControlQueueHandler;
+QueueHandle_t newCommandQueueHandler;
+
+static atomic_int_fast64_t lastControlSentUs;
+static atomic_uint zerosReceived;
+static atomic_int_fast64_t lastZeroUs;
+static atomic_uint controlsReceived;
+static atomic_int lastAxisX;
+static atomic_int loadRunning = 1;
+
+static int64_t nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int compareInt64(const void *a, const void *b) {
+    int64_t diff = *(const int64_t *)a - *(const int64_t *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+/* Hace de commsManager leyendo el control, pero bloqueado en la cola para marcar el momento exacto */
+static void consumerTask(void *param) {
+    while (true) {
+        control_app_raw_t control;
+        if (xQueueReceive(receiveControlQueueHandler, &control, portMAX_DELAY)) {
+            atomic_store(&lastAxisX, control.axisX);
+            if (control.axisX == 0 && control.axisY == 0) {
+                atomic_store(&lastZeroUs, nowUs());
+                atomic_fetch_add(&zerosReceived, 1);
+            }
+            else {
+                atomic_fetch_add(&controlsReceived, 1);
+            }
+        }
+    }
+}
+
+static void *loadThread(void *arg) {
+    volatile uint64_t spin = 0;
+    while (atomic_load(&loadRunning)) {
+        spin++;
+    }
+    return NULL;
+}
+
+static int sendControl(int sock, int16_t axisX) {
+    control_app_raw_t control = {.axisX = axisX, .axisY = 1};
+    uint8_t packet[COMMS_PACKET_SIZE_Control];
+    uint8_t frame[COMMS_PACKET_SIZE_Control + COMMS_FRAME_OVERHEAD];
+    commsEncodeControl(packet, sizeof(packet), &control);
+    size_t len = commsFrameEncode(frame, sizeof(frame), packet, sizeof(packet));
+    return send(sock, frame, len, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+/* Descarta lo que envia el robot, la app no lo necesita aca */
+static void drain(int sock, int timeoutMs) {
+    uint8_t buffer[1024];
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    while (poll(&pfd, 1, timeoutMs) == 1 && recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+        timeoutMs = 0;
+    }
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --cycles N       silencios a medir (%d)\n"
+           "  --control HZ     control durante la rafaga (%d)\n"
+           "  --burst MS       duracion de la rafaga de control (%d)\n"
+           "  --gap MS         silencio despues de cada rafaga (%d)\n"
+           "  --load N         hilos ocupando CPU durante la medicion (0)\n"
+           "  --edge N         silencios que terminan con un control al vencer el deadman (0)\n"
+           "  --log            habilita los ESP_LOGx del firmware\n",
+           prog, DEFAULT_CYCLES, DEFAULT_CONTROL_HZ, DEFAULT_BURST_MS, DEFAULT_GAP_MS);
+}
+
+int main(int argc, char **argv) {
+    uint32_t cycles = DEFAULT_CYCLES;
+    uint32_t controlHz = DEFAULT_CONTROL_HZ;
+    uint32_t burstMs = DEFAULT_BURST_MS;
+    uint32_t gapMs = DEFAULT_GAP_MS;
+    uint32_t load = 0;
+    uint32_t edges = 0;
+
+    static const struct option options[] = {
+        {"cycles",  required_argument, 0, 'n'},
+        {"control", required_argument, 0, 'c'},
+        {"burst",   required_argument, 0, 'b'},
+        {"gap",     required_argument, 0, 'g'},
+        {"load",    required_argument, 0, 'L'},
+        {"edge",    required_argument, 0, 'e'},
+        {"log",     no_argument,       0, 'l'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:b:g:L:e:lh", options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': cycles = strtoul(optarg, NULL, 10); break;
+            case 'c': controlHz = strtoul(optarg, NULL, 10); break;
+            case 'b': burstMs = strtoul(optarg, NULL, 10); break;
+            case 'g': gapMs = strtoul(optarg, NULL, 10); break;
+            case 'L': load = strtoul(optarg, NULL, 10); break;
+            case 'e': edges = strtoul(optarg, NULL, 10); break;
+            case 'l': hostLogEnable = 1; break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!cycles || !controlHz || !burstMs || gapMs * 1000ULL <= COMMS_CONTROL_TIMEOUT_US + MAX_LATE_US) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    addr.sin_addr.s_addr = inet_addr(HOST_IP_ADDR);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) || listen(server, 1)) {
+        perror("bind/listen");
+        return 1;
+    }
+
+    newPidParamsQueueHandler = xQueueCreate(1, sizeof(pid_settings_comms_t));
+    receiveControlQueueHandler = xQueueCreate(1, sizeof(control_app_raw_t));
+    newCommandQueueHandler = xQueueCreate(1, sizeof(command_app_raw_t));
+    tcpClientSocketInit();
+    commsInit();
+    xTaskCreate(consumerTask, "consumer", 4096, NULL, 5, NULL);
+    tcpClientSocketStart();
+
+    struct pollfd acceptFd = {.fd = server, .events = POLLIN};
+    if (poll(&acceptFd, 1, ACCEPT_TIMEOUT_MS) != 1) {
+        fprintf(stderr, "el robot no se conecto\n");
+        return 1;
+    }
+    int sock = accept(server, NULL, NULL);
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    pthread_t *loadThreads = calloc(load ? load : 1, sizeof(pthread_t));
+    for (uint32_t i = 0; i < load; i++) {
+        pthread_create(&loadThreads[i], NULL, loadThread, NULL);
+    }
+
+    int64_t *lateUs = calloc(cycles, sizeof(int64_t));
+    uint32_t measured = 0, missing = 0, repeated = 0, falseZeros = 0;
+    int16_t axisX = 0;
+    comms_link_status_t link;
+
+    for (uint32_t cycle = 0; cycle < cycles; cycle++) {
+        // Rafaga de control: no puede llegar ningun cero
+        uint32_t zerosBefore = atomic_load(&zerosReceived);
+        int64_t burstEndUs = nowUs() + burstMs * 1000LL;
+        int64_t nextUs = nowUs();
+        while (nowUs() < burstEndUs) {
+            axisX = axisX % 1000 + 1;
+            atomic_store(&lastControlSentUs, nowUs());
+            if (sendControl(sock, axisX)) {
+                fprintf(stderr, "el robot se desconecto\n");
+                return 1;
+            }
+            nextUs += 1000000 / controlHz;
+            int64_t waitUs = nextUs - nowUs();
+            drain(sock, waitUs > 0 ? waitUs / 1000 : 0);
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));                   // el ultimo control llega a la cola
+        falseZeros += atomic_load(&zerosReceived) - zerosBefore;
+
+        // Silencio: un solo cero, COMMS_CONTROL_TIMEOUT_US despues del ultimo control
+        zerosBefore = atomic_load(&zerosReceived);
+        int64_t gapEndUs = atomic_load(&lastControlSentUs) + gapMs * 1000LL;
+        while (nowUs() < gapEndUs) {
+            drain(sock, 10);
+        }
+        commsGetLinkStatus(&link);
+        uint32_t zeros = atomic_load(&zerosReceived) - zerosBefore;
+        if (!zeros) {
+            missing++;
+            continue;
+        }
+        repeated += zeros - 1;
+        lateUs[measured++] = atomic_load(&lastZeroUs) - atomic_load(&lastControlSentUs) - COMMS_CONTROL_TIMEOUT_US;
+    }
+    // Borde: el control llega mientras vence el deadman, el cero no lo puede pisar
+    uint32_t edgeZeroed = 0, edgeFailsafe = 0, edgeExpired = 0;
+    for (uint32_t edge = 0; edge < edges; edge++) {
+        axisX = axisX % 1000 + 1;
+        atomic_store(&lastControlSentUs, nowUs());
+        sendControl(sock, axisX);
+        int64_t edgeUs = atomic_load(&lastControlSentUs) + COMMS_CONTROL_TIMEOUT_US + rand() % (2 * EDGE_SPREAD_US + 1) - EDGE_SPREAD_US;
+        vTaskDelay(pdMS_TO_TICKS(5));                   // el control rearmo el deadman
+        commsGetLinkStatus(&link);
+        uint32_t failsafeBefore = link.failsafeCount;
+        while (nowUs() < edgeUs) {
+            drain(sock, 0);
+        }
+        axisX = axisX % 1000 + 1;
+        atomic_store(&lastControlSentUs, nowUs());
+        sendControl(sock, axisX);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        commsGetLinkStatus(&link);
+        edgeExpired += link.failsafeCount != failsafeBefore;    // vencio antes de que llegara, vale
+        edgeZeroed += atomic_load(&lastAxisX) != axisX;
+        edgeFailsafe += link.failsafeActive;
+        int64_t waitEndUs = atomic_load(&lastControlSentUs) + COMMS_CONTROL_TIMEOUT_US + 20000;      // vence con el ultimo
+        while (nowUs() < waitEndUs) {
+            drain(sock, 10);
+        }
+    }
+
+    atomic_store(&loadRunning, 0);
+    for (uint32_t i = 0; i < load; i++) {
+        pthread_join(loadThreads[i], NULL);
+    }
+    int64_t linkAgeMs = (nowUs() - atomic_load(&lastControlSentUs)) / 1000;
+    commsGetLinkStatus(&link);
+
+    printf("%u silencios de %u ms despues de %u ms de control a %u Hz, %u hilos de carga\n",
+           cycles, gapMs, burstMs, controlHz, load);
+    if (measured) {
+        qsort(lateUs, measured, sizeof(int64_t), compareInt64);
+        printf("cero despues de %d ms sin control: min %+.2f  p50 %+.2f  max %+.2f ms\n",
+               COMMS_CONTROL_TIMEOUT_US / 1000, lateUs[0] / 1000.0, lateUs[measured / 2] / 1000.0,
+               lateUs[measured - 1] / 1000.0);
+    }
+    printf("ceros: %u silencios sin cero, %u ceros repetidos, %u ceros con control llegando\n",
+           missing, repeated, falseZeros);
+    if (edges) {
+        printf("bordes: %u controles al vencer el deadman, %u pisados por el cero, %u con failsafe activo, %u vencieron antes\n",
+               edges, edgeZeroed, edgeFailsafe, edgeExpired);
+    }
+    printf("link status: control hace %u ms (medido %lld), failsafe %s, %u activaciones, %u controles\n",
+           link.ageMs[COMMS_STREAM_CONTROL], (long long)linkAgeMs, link.failsafeActive ? "activo" : "inactivo",
+           link.failsafeCount, link.packets[COMMS_STREAM_CONTROL]);
+
+    int64_t ageError = (int64_t)link.ageMs[COMMS_STREAM_CONTROL] - linkAgeMs;
+    int result = missing || repeated || falseZeros || !link.failsafeActive || link.failsafeCount != cycles + edges + edgeExpired ||
+                 edgeZeroed || edgeFailsafe ||
+                 ageError < -5 || ageError > 5 || (measured && lateUs[measured - 1] > MAX_LATE_US) ||
+                 (measured && lateUs[0] < 0);
+
+    free(lateUs);
+    free(loadThreads);
+    close(sock);
+    close(server);
+    return result ? 2 : 0;
+}
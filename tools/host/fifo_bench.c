@@ -0,0 +1,390 @@
+/*
+ * Lectura de la FIFO del DMP: una transaccion por paquete (lectura anterior) contra rafagas con mpuFifoDrain.
+ *
+ * Simula en tiempo virtual la FIFO del MPU6050 (1024 bytes, un paquete de 42 cada --dmp-us con su flanco
+ * INT) y la tarea lectora: despierta --wake-us despues del flanco y a veces se atrasa (otra tarea, WiFi),
+ * con lo que se juntan paquetes; un atraso largo desborda la FIFO. Cada transaccion I2C ocupa el bus
+ * (direccion + registro + direccion de lectura + datos, 9 bits por byte a --bus-hz) y los paquetes que
+ * llegan mientras tanto quedan para la proxima lectura. Los atrasos son los mismos para cada estrategia.
+ *
+ * Cada paquete lleva su numero de secuencia en el cuaternion: se verifica que se entregue el mas nuevo
+ * que habia en la FIFO y, entregando todos, que salgan en orden, sin repetir y sin huecos fuera de los
+ * descartes contados.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "mpu_fifo.h"
+
+#define DEFAULT_SECONDS         60
+#define DEFAULT_DMP_US          10000               // CONTROL_TICK_PERIOD_US
+#define DEFAULT_WAKE_US         30
+#define DEFAULT_BUS_HZ          400000
+#define DEFAULT_STALL_PROB      0.02
+#define DEFAULT_STALL_US        30000
+#define DEFAULT_LONG_STALL_PROB 0.0005
+#define LONG_STALL_US           300000              // mas que la FIFO entera a 100 Hz (24 paquetes)
+#define TEMP_DECIMATION         100                 // MPU_TEMP_DECIMATION
+#define TRANSACTION_OVERHEAD    3                   // direccion + registro + direccion de lectura
+#define FIFO_PACKETS            (MPU_FIFO_SIZE / MPU_DMP_PACKET_SIZE)
+#define TIMING_REPS             200000
+
+enum {
+    STRATEGY_LEGACY,                                // INT_STATUS + contador + un paquete por transaccion + temperatura
+    STRATEGY_BURST,                                 // contador + rafagas, entrega el mas nuevo
+    STRATEGY_BURST_ALL,                             // contador + rafagas, entrega todos (MPU_FIFO_FORWARD_ALL)
+    STRATEGY_COUNT
+};
+
+static const char *strategyNames[STRATEGY_COUNT] = {"un paquete por lectura", "rafaga, el mas nuevo", "rafaga, todos"};
+
+typedef struct {
+    double busHz;
+    double dmpUs;
+    double now;                                     // reloj virtual en us
+    uint32_t produced;                              // paquetes escritos por el DMP, el proximo es produced
+    uint32_t head;                                  // secuencia del paquete mas viejo en la FIFO
+    uint32_t count;                                 // paquetes completos en la FIFO
+    uint8_t overflowed;
+    uint32_t lost;                                  // paquetes perdidos por desborde o reset
+    uint64_t transactions;
+    uint64_t bytes;
+    double busUs;
+} fifo_sim_t;
+
+typedef struct {
+    uint32_t samples;                               // muestras entregadas a la cola
+    uint32_t wakes;
+    uint32_t deliveries;                            // ciclos que entregaron al menos una muestra
+    uint32_t overflows;
+    uint32_t skipped;
+    uint32_t mismatches;
+    double latencySumUs;                            // del flanco del paquete entregado al final de la lectura
+    double latencyMaxUs;
+    uint64_t transactions;
+    uint64_t bytes;
+    double busUs;
+    uint32_t lost;
+    uint32_t produced;
+} strategy_result_t;
+
+static void fifoAdvance(fifo_sim_t *sim) {
+    uint32_t due = (uint32_t)(sim->now / sim->dmpUs);
+    while (sim->produced < due) {
+        if (sim->overflowed || sim->count == FIFO_PACKETS) {
+            // Se pisan los bytes mas viejos: el contador queda en 1024 y los paquetes desalineados
+            sim->overflowed = 1;
+            sim->lost++;
+        }
+        else {
+            if (!sim->count) {
+                sim->head = sim->produced;
+            }
+            sim->count++;
+        }
+        sim->produced++;
+    }
+}
+
+static void busTransaction(fifo_sim_t *sim, uint32_t bytes) {
+    double us = (TRANSACTION_OVERHEAD + bytes) * 9 * 1e6 / sim->busHz;
+    sim->now += us;
+    sim->busUs += us;
+    sim->transactions++;
+    sim->bytes += bytes;
+}
+
+static uint16_t fifoCount(fifo_sim_t *sim) {
+    fifoAdvance(sim);
+    uint16_t count = sim->overflowed ? MPU_FIFO_SIZE : sim->count * MPU_DMP_PACKET_SIZE;
+    busTransaction(sim, 2);
+    return count;
+}
+
+static void fifoReset(fifo_sim_t *sim) {
+    fifoAdvance(sim);
+    if (!sim->overflowed) {
+        sim->lost += sim->count;
+    }
+    sim->count = 0;
+    sim->overflowed = 0;
+    busTransaction(sim, 1);
+}
+
+static void encodePacket(uint8_t *packet, uint32_t seq) {
+    memset(packet, 0xA5, MPU_DMP_PACKET_SIZE);      // lo que no es la parte alta del cuaternion no se usa
+    int16_t raw[4] = {16384, (int16_t)(seq & 0x3FFF), (int16_t)((seq >> 14) & 0x3FFF), 0};
+    for (uint8_t i = 0; i < 4; i++) {
+        packet[4 * i] = (uint8_t)(raw[i] >> 8);
+        packet[4 * i + 1] = (uint8_t)raw[i];
+    }
+}
+
+static uint32_t decodeSeq(const float q[4]) {
+    return (uint32_t)lrintf(q[1] * 16384.0f) | ((uint32_t)lrintf(q[2] * 16384.0f) << 14);
+}
+
+/*
+ * getFIFOBytes: los datos salen al principio de la transaccion, lo que llega despues queda en la FIFO
+ */
+static bool fifoRead(void *ctx, uint8_t *data, uint8_t len) {
+    fifo_sim_t *sim = ctx;
+    fifoAdvance(sim);
+    for (uint8_t i = 0; i + MPU_DMP_PACKET_SIZE <= len; i += MPU_DMP_PACKET_SIZE) {
+        if (sim->count) {
+            encodePacket(&data[i], sim->head++);
+            sim->count--;
+        }
+        else {
+            memset(&data[i], 0, MPU_DMP_PACKET_SIZE);      // leer de mas devuelve basura, no deberia pasar
+        }
+    }
+    busTransaction(sim, len);
+    return true;
+}
+
+/*
+ * Un ciclo de la tarea lectora despues del flanco, como mpu6050DmpLoop en modo interrupcion.
+ * expectedNext: secuencia que deberia seguir a la ultima entregada (0xFFFFFFFF despues de un reset)
+ */
+static void readerCycle(uint8_t strategy, fifo_sim_t *sim, strategy_result_t *res, uint32_t *expectedNext) {
+    const mpu_fifo_bus_t bus = {.read = fifoRead, .ctx = sim};
+    float quaternions[MPU_FIFO_BURST_PACKETS][4];
+    uint32_t seqs[MPU_FIFO_BURST_PACKETS];
+    uint8_t decoded = 0;
+    uint32_t skipped = 0;
+
+    uint8_t overflow = 0;
+    if (strategy == STRATEGY_LEGACY) {
+        fifoAdvance(sim);
+        overflow = sim->overflowed;                 // bit FIFO_OFLOW_INT del INT_STATUS
+        busTransaction(sim, 1);
+    }
+    uint16_t count = fifoCount(sim);
+    uint32_t newest = sim->count ? sim->head + sim->count - 1 : 0;
+
+    if (overflow || count == MPU_FIFO_SIZE) {
+        fifoReset(sim);
+        res->overflows++;
+        *expectedNext = 0xFFFFFFFF;
+        return;
+    }
+    if (count < MPU_DMP_PACKET_SIZE) {
+        return;
+    }
+
+    if (strategy == STRATEGY_LEGACY) {
+        uint8_t packet[MPU_DMP_PACKET_SIZE];
+        while (count >= 2 * MPU_DMP_PACKET_SIZE) {          // descarta los viejos de a uno
+            fifoRead(sim, packet, MPU_DMP_PACKET_SIZE);
+            count -= MPU_DMP_PACKET_SIZE;
+            skipped++;
+        }
+        fifoRead(sim, packet, MPU_DMP_PACKET_SIZE);
+        mpuFifoDecodeQuaternion(packet, quaternions[0]);
+        decoded = 1;
+        busTransaction(sim, 2);                             // temperatura en cada muestra
+    }
+    else {
+        mpu_fifo_drain_t drain = mpuFifoDrain(&bus, count, quaternions, NULL,
+            strategy == STRATEGY_BURST_ALL ? MPU_FIFO_BURST_PACKETS : 1);
+        decoded = drain.decoded;
+        skipped = drain.packets - drain.decoded;
+        if (!(res->samples % TEMP_DECIMATION)) {
+            busTransaction(sim, 2);
+        }
+    }
+
+    for (uint8_t i = 0; i < decoded; i++) {
+        seqs[i] = decodeSeq(quaternions[i]);
+    }
+    // El ultimo entregado es el mas nuevo que habia al leer el contador, los anteriores consecutivos
+    if (seqs[decoded - 1] != newest) {
+        res->mismatches++;
+    }
+    for (uint8_t i = 1; i < decoded; i++) {
+        if (seqs[i] != seqs[i - 1] + 1) {
+            res->mismatches++;
+        }
+    }
+    if (*expectedNext != 0xFFFFFFFF && seqs[0] != *expectedNext + skipped) {
+        res->mismatches++;
+    }
+    *expectedNext = seqs[decoded - 1] + 1;
+
+    double latencyUs = sim->now - (newest + 1) * sim->dmpUs;      // el paquete s llega con el flanco s + 1
+    res->latencySumUs += latencyUs;
+    if (latencyUs > res->latencyMaxUs) {
+        res->latencyMaxUs = latencyUs;
+    }
+    res->deliveries++;
+    res->samples += decoded;
+    res->skipped += skipped;
+}
+
+static strategy_result_t runStrategy(uint8_t strategy, const float *stallUs, uint32_t intCount, double dmpUs,
+                                     double wakeUs, double busHz) {
+    fifo_sim_t sim = {.busHz = busHz, .dmpUs = dmpUs};
+    strategy_result_t res = {0};
+    uint32_t expectedNext = 0xFFFFFFFF;
+    uint32_t takenInts = 0;                         // flancos consumidos por ulTaskNotifyTake
+
+    while (1) {
+        // Flancos llegados mientras corria el ciclo anterior (el flanco k llega en k * dmpUs): la notificacion
+        // ya esta dada y vuelve enseguida
+        uint32_t pendingInts = (uint32_t)(sim.now / dmpUs);
+        if (pendingInts > takenInts) {
+            sim.now += wakeUs;
+        }
+        else {
+            uint32_t next = takenInts + 1;
+            if (next >= intCount) {
+                break;
+            }
+            sim.now = next * dmpUs + wakeUs + stallUs[next];
+        }
+        takenInts = (uint32_t)(sim.now / dmpUs);
+        if (takenInts >= intCount) {
+            break;
+        }
+        res.wakes++;
+        readerCycle(strategy, &sim, &res, &expectedNext);
+    }
+
+    fifoAdvance(&sim);
+    res.transactions = sim.transactions;
+    res.bytes = sim.bytes;
+    res.busUs = sim.busUs;
+    res.lost = sim.lost;
+    res.produced = sim.produced;
+    return res;
+}
+
+static bool nullRead(void *ctx, uint8_t *data, uint8_t len) {
+    memcpy(data, ctx, len);
+    return true;
+}
+
+static double drainNsPerPacket(void) {
+    static uint8_t burst[MPU_FIFO_BURST_BYTES];
+    for (uint8_t i = 0; i < MPU_FIFO_BURST_PACKETS; i++) {
+        encodePacket(&burst[i * MPU_DMP_PACKET_SIZE], i);
+    }
+    const mpu_fifo_bus_t bus = {.read = nullRead, .ctx = burst};
+    float quaternions[MPU_FIFO_BURST_PACKETS][4];
+    volatile float sink = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < TIMING_REPS; i++) {
+        mpuFifoDrain(&bus, MPU_FIFO_BURST_BYTES, quaternions, NULL, MPU_FIFO_BURST_PACKETS);
+        sink += quaternions[MPU_FIFO_BURST_PACKETS - 1][1];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return ns / ((double)TIMING_REPS * MPU_FIFO_BURST_PACKETS);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "uso: %s [--seconds N] [--dmp-us US] [--wake-us US] [--bus-hz HZ] [--stall-prob P] [--stall-us US]\n"
+        "          [--long-stall-prob P] [--seed N]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    double seconds = DEFAULT_SECONDS;
+    double dmpUs = DEFAULT_DMP_US;
+    double wakeUs = DEFAULT_WAKE_US;
+    double busHz = DEFAULT_BUS_HZ;
+    double stallProb = DEFAULT_STALL_PROB;
+    double stallMaxUs = DEFAULT_STALL_US;
+    double longStallProb = DEFAULT_LONG_STALL_PROB;
+    unsigned seed = 1;
+
+    static const struct option options[] = {
+        {"seconds", required_argument, NULL, 's'},
+        {"dmp-us", required_argument, NULL, 'd'},
+        {"wake-us", required_argument, NULL, 'w'},
+        {"bus-hz", required_argument, NULL, 'b'},
+        {"stall-prob", required_argument, NULL, 'p'},
+        {"stall-us", required_argument, NULL, 'u'},
+        {"long-stall-prob", required_argument, NULL, 'l'},
+        {"seed", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:d:w:b:p:u:l:r:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': seconds = atof(optarg); break;
+            case 'd': dmpUs = atof(optarg); break;
+            case 'w': wakeUs = atof(optarg); break;
+            case 'b': busHz = atof(optarg); break;
+            case 'p': stallProb = atof(optarg); break;
+            case 'u': stallMaxUs = atof(optarg); break;
+            case 'l': longStallProb = atof(optarg); break;
+            case 'r': seed = (unsigned)atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (seconds <= 0 || dmpUs <= 0 || busHz <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint32_t intCount = (uint32_t)(seconds * 1e6 / dmpUs);
+    float *stallUs = calloc(intCount + 1, sizeof(float));
+    if (!stallUs) {
+        return 1;
+    }
+    srand(seed);
+    for (uint32_t i = 0; i <= intCount; i++) {
+        double r = rand() / (double)RAND_MAX;
+        if (r < longStallProb) {
+            stallUs[i] = LONG_STALL_US;
+        }
+        else if (r < longStallProb + stallProb) {
+            stallUs[i] = (float)(stallMaxUs * (rand() / (double)RAND_MAX));
+        }
+    }
+
+    printf("DMP cada %.0f us, %.1f s, bus %.0f kHz, despertar %.0f us, atrasos %.1f%% hasta %.0f us, %.2f%% de %d us\n",
+           dmpUs, seconds, busHz / 1000, wakeUs, stallProb * 100, stallMaxUs, longStallProb * 100, LONG_STALL_US);
+    printf("%-24s %8s %8s %8s %9s %9s %9s %8s %8s %9s %9s %6s\n", "estrategia", "muestras", "trans/m", "bytes/m",
+           "bus us/m", "bus %", "lat media", "lat max", "desbord", "saltados", "perdidos", "error");
+
+    int failed = 0;
+    strategy_result_t results[STRATEGY_COUNT];
+    for (uint8_t s = 0; s < STRATEGY_COUNT; s++) {
+        strategy_result_t *r = &results[s];
+        *r = runStrategy(s, stallUs, intCount, dmpUs, wakeUs, busHz);
+        double samples = r->samples ? r->samples : 1;
+        printf("%-24s %8u %8.2f %8.1f %9.1f %8.2f%% %8.0fus %6.0fus %8u %9u %9u %6u\n", strategyNames[s], r->samples,
+               r->transactions / samples, r->bytes / samples, r->busUs / samples, 100.0 * r->busUs / (seconds * 1e6),
+               r->latencySumUs / (r->deliveries ? r->deliveries : 1), r->latencyMaxUs, r->overflows, r->skipped, r->lost,
+               r->mismatches);
+        if (r->mismatches || !r->samples) {
+            failed = 1;
+        }
+    }
+    // Con rafagas no puede haber mas transacciones por muestra que leyendo de a un paquete
+    if (results[STRATEGY_BURST].transactions > results[STRATEGY_LEGACY].transactions) {
+        printf("rafagas con mas transacciones que la lectura de a un paquete\n");
+        failed = 1;
+    }
+
+    printf("mpuFifoDrain en el host: %.1f ns por paquete decodificado (rafaga de %d, sin bus)\n", drainNsPerPacket(),
+           MPU_FIFO_BURST_PACKETS);
+    free(stallUs);
+
+    if (failed) {
+        printf("FALLO: secuencia entregada incorrecta\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,431 @@
+/*
+ * Entramado del canal TCP (src/comms_frame.c): rendimiento del parser y fuzzing.
+ *
+ * Rendimiento: un stream de paquetes reales (control, comando, settings) entramados, entregado en
+ * lecturas de tamaño aleatorio como las del stream buffer. Reporta MB/s y frames/s.
+ * Fuzzing: frames con payload aleatorio, partidos y juntados en cualquier punto, con basura entre
+ * frames y bits invertidos en algunos. Todo frame intacto tiene que salir igual y en orden, y ninguno
+ * alterado puede salir. Con --corpus DIR ademas reproduce cada archivo entero y byte a byte y
+ * verifica que den los mismos frames; --write-corpus DIR genera las semillas del corpus.
+ * Sale con 2 si algo no cuadra.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <dirent.h>
+
+#include "comms.h"
+#include "comms_frame.h"
+
+#define DEFAULT_BENCH_BYTES     (64 * 1024 * 1024)
+#define DEFAULT_FUZZ_ITERS      2000
+#define FUZZ_FRAMES_PER_ITER    200
+#define FUZZ_CLOSING_BYTE       0xCC
+#define MAX_FILE_SIZE           (1024 * 1024)
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} byte_stream_t;
+
+typedef struct {
+    uint8_t payload[COMMS_FRAME_MAX_PAYLOAD];
+    uint16_t len;
+    uint8_t intact;
+} fuzz_frame_t;
+
+/*
+ * xorshift64*: los bits bajos de rand() de glibc son lineales en GF(2), igual que el CRC, y generan
+ * colisiones de CRC mucho mas seguido que 1/65536
+ */
+static uint64_t rngState = 1;
+
+static void rngSeed(uint32_t seed) {
+    rngState = 0x9E3779B97F4A7C15ULL * (seed + 1);
+}
+
+static uint32_t rng(void) {
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (uint32_t)((rngState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void streamAppend(byte_stream_t *stream, const void *data, size_t len) {
+    if (stream->len + len > stream->cap) {
+        stream->cap = (stream->len + len) * 2;
+        stream->data = realloc(stream->data, stream->cap);
+    }
+    memcpy(&stream->data[stream->len], data, len);
+    stream->len += len;
+}
+
+static void streamAppendFrame(byte_stream_t *stream, const void *payload, uint16_t len) {
+    uint8_t frame[COMMS_FRAME_MAX_PAYLOAD + COMMS_FRAME_OVERHEAD];
+    streamAppend(stream, frame, commsFrameEncode(frame, sizeof(frame), payload, len));
+}
+
+/*
+ * Entrega el stream al parser en lecturas de 1..maxChunk bytes (0: de a una lectura lo mas grande posible)
+ * y llama a onFrame por cada frame extraido
+ */
+static void feedStream(comms_frame_parser_t *parser, const uint8_t *data, size_t len, size_t maxChunk,
+                       void (*onFrame)(const comms_frame_t *frame, void *ctx), void *ctx) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t space;
+        uint8_t *dest = commsFrameParserWritePtr(parser, &space);
+        size_t chunk = maxChunk ? 1 + (size_t)rng() % maxChunk : space;
+        if (chunk > space) {
+            chunk = space;
+        }
+        if (chunk > len - pos) {
+            chunk = len - pos;
+        }
+        memcpy(dest, &data[pos], chunk);                // lo que hace xStreamBufferReceive
+        commsFrameParserCommit(parser, chunk);
+        pos += chunk;
+
+        comms_frame_t frame;
+        while (commsFrameParserNext(parser, &frame)) {
+            onFrame(&frame, ctx);
+        }
+    }
+}
+
+static void countFrame(const comms_frame_t *frame, void *ctx) {
+    uint64_t *bytes = ctx;
+    *bytes += frame->len;
+}
+
+static int runThroughput(size_t totalBytes) {
+    byte_stream_t stream = {0};
+    control_app_raw_t control = {.headerPackage = HEADER_PACKAGE_CONTROL};
+    command_app_raw_t command = {.headerPackage = HEADER_PACKAGE_COMMAND, .command = COMMAND_MOVE_FORWARD};
+    pid_settings_app_raw_t settings = {.headerPackage = HEADER_PACKAGE_SETTINGS, .kp = 150};
+    uint32_t frames = 0;
+
+    while (stream.len < totalBytes) {
+        control.axisX = (int16_t)frames;
+        control.axisY = (int16_t)~frames;
+        streamAppendFrame(&stream, &control, sizeof(control));
+        if (!(frames % 8)) {
+            command.value = (int16_t)frames;
+            streamAppendFrame(&stream, &command, sizeof(command));
+            frames++;
+        }
+        if (!(frames % 32)) {
+            settings.indexPid = frames % CANT_PIDS;
+            streamAppendFrame(&stream, &settings, sizeof(settings));
+            frames++;
+        }
+        frames++;
+    }
+
+    comms_frame_parser_t parser;
+    commsFrameParserInit(&parser);
+    uint64_t payloadBytes = 0;
+    rngSeed(1);
+    double start = nowNs();
+    feedStream(&parser, stream.data, stream.len, 100, countFrame, &payloadBytes);
+    double elapsedNs = nowNs() - start;
+
+    printf("rendimiento: %.1f MB en lecturas de 1..100 bytes: %.1f MB/s, %.2f Mframes/s, %.1f ns/frame\n",
+           stream.len / 1e6, stream.len / elapsedNs * 1e3, parser.stats.frames / elapsedNs * 1e3,
+           elapsedNs / parser.stats.frames);
+    int result = 0;
+    if (parser.stats.frames != frames || parser.stats.crcErrors || parser.stats.discardedBytes) {
+        printf("  ERROR: %u frames de %u, %u errores de crc, %u bytes descartados\n", parser.stats.frames, frames,
+               parser.stats.crcErrors, parser.stats.discardedBytes);
+        result = 2;
+    }
+    free(stream.data);
+    return result;
+}
+
+typedef struct {
+    const fuzz_frame_t *expected;
+    uint32_t count;
+    uint32_t next;                                      // proximo frame intacto esperado
+    uint32_t unexpected;                                // frames entregados que no son ninguno de los intactos
+    uint32_t missing;                                   // intactos salteados
+} fuzz_check_t;
+
+/*
+ * Un frame falso (basura que pasa el CRC, ~1/65536 por intento) se come los bytes de los frames que
+ * tapa: se cuentan como perdidos y se sigue comparando desde el frame entregado
+ */
+static void checkFrame(const comms_frame_t *frame, void *ctx) {
+    fuzz_check_t *check = ctx;
+    for (uint32_t i = check->next; i < check->count; i++) {
+        const fuzz_frame_t *want = &check->expected[i];
+        if (want->intact && want->len == frame->len && !memcmp(want->payload, frame->payload, frame->len)) {
+            for (; check->next < i; check->next++) {
+                check->missing += check->expected[check->next].intact;
+            }
+            check->next = i + 1;
+            return;
+        }
+    }
+    check->unexpected++;
+}
+
+/*
+ * Frames de cierre: los que quedaron detras de un frame truncado salen recien al completarlo
+ */
+static void checkFrameOrClosing(const comms_frame_t *frame, void *ctx) {
+    if (frame->len == 1 && frame->payload[0] == FUZZ_CLOSING_BYTE) {
+        return;
+    }
+    checkFrame(frame, ctx);
+}
+
+static int runFuzz(uint32_t iterations, uint32_t seed) {
+    static fuzz_frame_t frames[FUZZ_FRAMES_PER_ITER];
+    uint64_t totalFrames = 0, totalIntact = 0, missing = 0, unexpected = 0;
+    comms_frame_stats_t totals = {0};
+
+    rngSeed(seed);
+    for (uint32_t iter = 0; iter < iterations; iter++) {
+        byte_stream_t stream = {0};
+
+        for (uint32_t i = 0; i < FUZZ_FRAMES_PER_ITER; i++) {
+            fuzz_frame_t *frame = &frames[i];
+            frame->len = rng() % (COMMS_FRAME_MAX_PAYLOAD + 1);
+            for (uint16_t b = 0; b < frame->len; b++) {
+                frame->payload[b] = rng();
+            }
+            frame->intact = true;
+
+            if (!(rng() % 8)) {                        // basura entre frames, a veces con un sincronismo falso
+                uint8_t garbage[40];
+                uint8_t garbageLen = 1 + rng() % sizeof(garbage);
+                for (uint8_t b = 0; b < garbageLen; b++) {
+                    garbage[b] = (rng() % 4) ? rng() : COMMS_FRAME_SYNC_0 + (b & 1) * (COMMS_FRAME_SYNC_1 - COMMS_FRAME_SYNC_0);
+                }
+                streamAppend(&stream, garbage, garbageLen);
+            }
+
+            uint8_t encoded[COMMS_FRAME_MAX_PAYLOAD + COMMS_FRAME_OVERHEAD];
+            size_t encodedLen = commsFrameEncode(encoded, sizeof(encoded), frame->payload, frame->len);
+            if (!(rng() % 10)) {                       // bit invertido en cualquier parte del frame
+                uint16_t bit = rng() % (encodedLen * 8);
+                encoded[bit / 8] ^= 1 << (bit % 8);
+                frame->intact = false;
+            }
+            else if (!(rng() % 50)) {                  // frame truncado
+                encodedLen = 1 + rng() % (encodedLen - 1);
+                frame->intact = false;
+            }
+            streamAppend(&stream, encoded, encodedLen);
+            totalIntact += frame->intact;
+        }
+
+        comms_frame_parser_t parser;
+        commsFrameParserInit(&parser);
+        fuzz_check_t check = {.expected = frames, .count = FUZZ_FRAMES_PER_ITER};
+        size_t maxChunk = (iter % 3 == 0) ? 1 : (iter % 3 == 1) ? 7 : 300;
+        feedStream(&parser, stream.data, stream.len, maxChunk, checkFrame, &check);
+
+        // Un frame truncado al final puede dejar esperando al parser: cerrar con un frame conocido
+        fuzz_frame_t closing = {.payload = {FUZZ_CLOSING_BYTE}, .len = 1};
+        uint8_t encoded[COMMS_FRAME_MAX_PAYLOAD + COMMS_FRAME_OVERHEAD];
+        size_t closingLen = commsFrameEncode(encoded, sizeof(encoded), closing.payload, closing.len);
+        for (uint8_t repeat = 0; repeat < 2 * COMMS_FRAME_MAX_PAYLOAD / closingLen + 2; repeat++) {
+            feedStream(&parser, encoded, closingLen, 0, checkFrameOrClosing, &check);
+        }
+
+        for (uint32_t i = check.next; i < FUZZ_FRAMES_PER_ITER; i++) {
+            check.missing += frames[i].intact;
+        }
+        missing += check.missing;
+        unexpected += check.unexpected;
+        totalFrames += FUZZ_FRAMES_PER_ITER;
+        totals.crcErrors += parser.stats.crcErrors;
+        totals.lengthErrors += parser.stats.lengthErrors;
+        totals.discardedBytes += parser.stats.discardedBytes;
+        free(stream.data);
+    }
+
+    // Cada CRC rechazado es un intento de frame falso: con CRC16 se espera que pase 1 de cada 65536
+    double expectedFalse = totals.crcErrors / 65536.0;
+    printf("fuzzing: %u iteraciones, %lu frames (%lu intactos): %lu perdidos, %lu falsos (esperados %.1f por CRC16); "
+           "crc %u, largo %u, bytes descartados %u\n", iterations, (unsigned long)totalFrames,
+           (unsigned long)totalIntact, (unsigned long)missing, (unsigned long)unexpected, expectedFalse,
+           totals.crcErrors, totals.lengthErrors, totals.discardedBytes);
+
+    // Un frame perdido solo se acepta si lo tapo un falso (a lo sumo un frame maximo de bytes cada uno)
+    uint32_t maxHiddenPerFalse = (COMMS_FRAME_MAX_PAYLOAD + COMMS_FRAME_OVERHEAD) / COMMS_FRAME_OVERHEAD;
+    if (missing > unexpected * maxHiddenPerFalse || unexpected > 4 * expectedFalse + 3) {
+        printf("  ERROR: perdidas sin explicar o demasiados frames falsos\n");
+        return 2;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint8_t data[MAX_FILE_SIZE];
+    size_t len;
+    uint32_t frames;
+} corpus_output_t;
+
+static void collectFrame(const comms_frame_t *frame, void *ctx) {
+    corpus_output_t *out = ctx;
+    if (out->len + frame->len + 2 <= sizeof(out->data)) {
+        out->data[out->len++] = frame->len & 0xFF;
+        out->data[out->len++] = frame->len >> 8;
+        memcpy(&out->data[out->len], frame->payload, frame->len);
+        out->len += frame->len;
+    }
+    out->frames++;
+}
+
+static int runCorpus(const char *dirPath) {
+    DIR *dir = opendir(dirPath);
+    if (!dir) {
+        perror(dirPath);
+        return 1;
+    }
+    static uint8_t data[MAX_FILE_SIZE];
+    static corpus_output_t whole, byByte;
+    uint32_t files = 0, mismatches = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dirPath, entry->d_name);
+        FILE *file = fopen(path, "rb");
+        if (!file) {
+            continue;
+        }
+        size_t len = fread(data, 1, sizeof(data), file);
+        fclose(file);
+
+        comms_frame_parser_t parser;
+        whole.len = whole.frames = 0;
+        byByte.len = byByte.frames = 0;
+        commsFrameParserInit(&parser);
+        feedStream(&parser, data, len, 0, collectFrame, &whole);
+        commsFrameParserInit(&parser);
+        feedStream(&parser, data, len, 1, collectFrame, &byByte);
+
+        bool same = whole.len == byByte.len && !memcmp(whole.data, byByte.data, whole.len);
+        printf("  %-28s %5zu bytes: %u frames%s\n", entry->d_name, len, whole.frames, same ? "" : "  DISTINTO byte a byte");
+        mismatches += !same;
+        files++;
+    }
+    closedir(dir);
+    printf("corpus: %u archivos, %u distintos\n", files, mismatches);
+    return mismatches ? 2 : 0;
+}
+
+static int writeSeed(const char *dirPath, const char *name, const byte_stream_t *stream) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dirPath, name);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    fwrite(stream->data, 1, stream->len, file);
+    fclose(file);
+    return 0;
+}
+
+static int writeCorpus(const char *dirPath) {
+    control_app_raw_t control = {.headerPackage = HEADER_PACKAGE_CONTROL, .axisX = 50, .axisY = -20};
+    pid_settings_app_raw_t settings = {.headerPackage = HEADER_PACKAGE_SETTINGS, .indexPid = PID_ANGLE, .kp = 150, .kd = 30};
+    command_app_raw_t command = {.headerPackage = HEADER_PACKAGE_COMMAND, .command = COMMAND_DUMP_FLIGHT_RECORDER};
+    uint8_t garbage[] = {0x00, COMMS_FRAME_SYNC_0, 0x13, COMMS_FRAME_SYNC_0, COMMS_FRAME_SYNC_1, 0xFF, 0xFF, 0x42};
+    byte_stream_t stream = {0};
+    int err = 0;
+
+    streamAppendFrame(&stream, &control, sizeof(control));
+    err |= writeSeed(dirPath, "control.bin", &stream);
+
+    streamAppendFrame(&stream, &settings, sizeof(settings));
+    streamAppendFrame(&stream, &command, sizeof(command));
+    err |= writeSeed(dirPath, "coalesced.bin", &stream);
+
+    stream.len = 0;
+    streamAppend(&stream, garbage, sizeof(garbage));
+    streamAppendFrame(&stream, &control, sizeof(control));
+    err |= writeSeed(dirPath, "garbage_then_frame.bin", &stream);
+
+    stream.len = 0;
+    streamAppendFrame(&stream, &settings, sizeof(settings));
+    stream.data[stream.len - 1] ^= 0x01;
+    streamAppendFrame(&stream, &control, sizeof(control));
+    err |= writeSeed(dirPath, "bad_crc_then_frame.bin", &stream);
+
+    stream.len = 0;
+    uint8_t oversize[] = {COMMS_FRAME_SYNC_0, COMMS_FRAME_SYNC_1, 0xFF, 0x7F};
+    streamAppend(&stream, oversize, sizeof(oversize));
+    streamAppendFrame(&stream, &command, sizeof(command));
+    err |= writeSeed(dirPath, "oversize_len_then_frame.bin", &stream);
+
+    stream.len = 0;
+    streamAppendFrame(&stream, &control, sizeof(control));
+    stream.len -= 3;                                    // frame cortado al final
+    err |= writeSeed(dirPath, "truncated.bin", &stream);
+
+    free(stream.data);
+    return err ? 1 : 0;
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --bytes N          bytes del stream de rendimiento (%d)\n"
+           "  --iterations N     iteraciones de fuzzing (%d)\n"
+           "  --seed N           semilla del fuzzing (1)\n"
+           "  --corpus DIR       reproduce los archivos del corpus\n"
+           "  --write-corpus DIR genera las semillas del corpus y sale\n",
+           prog, DEFAULT_BENCH_BYTES, DEFAULT_FUZZ_ITERS);
+}
+
+int main(int argc, char **argv) {
+    size_t benchBytes = DEFAULT_BENCH_BYTES;
+    uint32_t iterations = DEFAULT_FUZZ_ITERS;
+    uint32_t seed = 1;
+    const char *corpusDir = NULL;
+
+    static const struct option options[] = {
+        {"bytes",        required_argument, 0, 'b'},
+        {"iterations",   required_argument, 0, 'i'},
+        {"seed",         required_argument, 0, 's'},
+        {"corpus",       required_argument, 0, 'c'},
+        {"write-corpus", required_argument, 0, 'w'},
+        {"help",         no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:i:s:c:w:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'b': benchBytes = strtoul(optarg, NULL, 10); break;
+            case 'i': iterations = strtoul(optarg, NULL, 10); break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            case 'c': corpusDir = optarg; break;
+            case 'w': return writeCorpus(optarg);
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    int result = runThroughput(benchBytes);
+    result |= runFuzz(iterations, seed);
+    if (corpusDir) {
+        result |= runCorpus(corpusDir);
+    }
+    return result;
+}
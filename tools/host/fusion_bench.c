@@ -0,0 +1,425 @@
+/*
+ * Motores de fusion de imu_fusion.c: costo por actualizacion y error de angulos.
+ *
+ * Sin --dmp genera el movimiento de un robot balanceandose (pitch de dos frecuencias, roll chico,
+ * giros en yaw) integrando un cuaternion de referencia, y de ahi las lecturas crudas de getMotion6
+ * con las escalas de la fusion: gravedad + aceleracion lineal + vibracion de los motores + ruido en
+ * el acelerometro (filtrado como el DLPF), sesgo residual + ruido en el giroscopo, cuantizadas a int16. Cada motor procesa
+ * las mismas muestras a --rate Hz y se compara contra la referencia, despues de --warmup segundos.
+ *
+ * Con --dmp lee un log del firmware con IMU_FUSION_RECORD_DMP (lineas DMP,us,ax,ay,az,gx,gy,gz,yaw,
+ * pitch,roll: crudo de getMotion6 y salida del DMP del mismo paquete) y compara cada motor contra el
+ * DMP a la tasa del DMP. El yaw se compara como cambio desde la primera muestra.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "imu_fusion.h"
+
+#define DEFAULT_SECONDS     60
+#define DEFAULT_RATE_HZ     1000
+#define DEFAULT_WARMUP_S    2.0
+#define TRUTH_SUBSTEPS      10                      // pasos de integracion de la referencia por muestra
+#define SENSOR_DLPF_HZ      98.0                    // MPU6050_DLPF_BW_98
+#define TIMING_REPS         20
+#define MAX_PITCH_RMS_DEG   2.0                     // en la simulacion, un error de signo o de escala da bastante mas
+
+typedef struct {
+    int16_t accel[3];
+    int16_t gyro[3];
+    float dt;
+    float ref[3];                                   // yaw, pitch, roll de referencia en grados
+    float refRates[3];                              // velocidades de referencia en grados/s, signo de los angulos
+} fusion_sample_t;
+
+typedef struct {
+    fusion_sample_t *samples;
+    uint32_t len;
+    float gyroLsbPerDps;
+    uint8_t fromDmp;
+} fusion_trace_t;
+
+typedef struct {
+    double sumSq[3];
+    double maxAbs[3];
+    double rateSumSq;
+    uint32_t count;
+    float finalYawError;
+} fusion_error_t;
+
+static const struct {
+    uint8_t engine;
+    const char *name;
+} engines[] = {
+    {IMU_FUSION_COMPLEMENTARY, "complementario"},
+    {IMU_FUSION_MADGWICK,      "madgwick"},
+    {IMU_FUSION_MAHONY,        "mahony"},
+};
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+
+static volatile float sink;                         // evita que el compilador descarte los lazos medidos
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static inline uint64_t readCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double gaussian(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static int16_t saturate16(double value) {
+    value = round(value);
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : (int16_t)value;
+}
+
+static double wrap180(double angle) {
+    while (angle > 180) {
+        angle -= 360;
+    }
+    while (angle < -180) {
+        angle += 360;
+    }
+    return angle;
+}
+
+/* Velocidad angular de referencia en los ejes del sensor, rad/s */
+static void truthRates(double t, double w[3]) {
+    const double pitchAmp[2] = {8.0 * M_PI / 180, 1.5 * M_PI / 180};
+    const double pitchHz[2] = {0.7, 4.0};
+    const double rollAmp = 2.0 * M_PI / 180, rollHz = 0.3;
+
+    // Pitch del robot: d(pitch)/dt = -wy (convencion de dmpGetYawPitchRoll)
+    double pitchRate = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+        pitchRate += pitchAmp[i] * 2 * M_PI * pitchHz[i] * cos(2 * M_PI * pitchHz[i] * t);
+    }
+    w[0] = rollAmp * 2 * M_PI * rollHz * cos(2 * M_PI * rollHz * t);
+    w[1] = -pitchRate;
+    // Giros de 90 grados en 1.5 s cada 6 s, alternando el sentido
+    double phase = fmod(t, 6.0);
+    w[2] = phase < 1.5 ? (((int)(t / 6.0)) % 2 ? 1 : -1) * (M_PI / 2) / 1.5 : 0;
+}
+
+static void quaternionIntegrate(double q[4], const double w[3], double dt) {
+    double dq[4] = {
+        0.5 * (-q[1] * w[0] - q[2] * w[1] - q[3] * w[2]),
+        0.5 * (q[0] * w[0] + q[2] * w[2] - q[3] * w[1]),
+        0.5 * (q[0] * w[1] - q[1] * w[2] + q[3] * w[0]),
+        0.5 * (q[0] * w[2] + q[1] * w[1] - q[2] * w[0]),
+    };
+    double norm = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        q[i] += dq[i] * dt;
+        norm += q[i] * q[i];
+    }
+    norm = sqrt(norm);
+    for (uint8_t i = 0; i < 4; i++) {
+        q[i] /= norm;
+    }
+}
+
+static int traceSynthetic(fusion_trace_t *trace, double seconds, uint32_t rateHz) {
+    trace->len = seconds * rateHz;
+    trace->samples = calloc(trace->len, sizeof(fusion_sample_t));
+    trace->gyroLsbPerDps = IMU_FUSION_GYRO_LSB_PER_DPS;
+    if (!trace->samples) {
+        return -1;
+    }
+
+    const double gyroBiasDps[3] = {0.3, -0.5, 0.4};  // residuo despues de calibrar
+    const double gyroNoiseDps = 0.05;
+    const double accelNoiseG = 0.004;
+    const double linearAccelG = 0.15;               // el robot acelera y frena para mantener el equilibrio
+    const double vibrationG = 0.2, vibrationHz = 180; // pasos de los motores
+    const double dt = 1.0 / rateHz;
+    const double subDt = dt / TRUTH_SUBSTEPS;
+    const double dlpfAlpha = 1.0 - exp(-2 * M_PI * SENSOR_DLPF_HZ * subDt);
+    double q[4] = {1, 0, 0, 0};
+    double accelFiltered[2][3] = {{0, 0, 1}, {0, 0, 1}};
+    double t = 0;
+
+    for (uint32_t n = 0; n < trace->len; n++) {
+        double w[3];
+        for (uint8_t k = 0; k < TRUTH_SUBSTEPS; k++) {
+            double tk = t + (k + 0.5) * subDt;
+            truthRates(tk, w);
+            quaternionIntegrate(q, w, subDt);
+
+            // Aceleracion en los ejes del sensor, por el DLPF del MPU (dos polos en SENSOR_DLPF_HZ)
+            double linear = linearAccelG * sin(2 * M_PI * 0.7 * tk + 0.5);
+            double vibration = vibrationG * sin(2 * M_PI * vibrationHz * tk);
+            double accel[3] = {
+                2 * (q[1] * q[3] - q[0] * q[2]) + linear + vibration,
+                2 * (q[0] * q[1] + q[2] * q[3]),
+                q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3] + 0.5 * vibration,
+            };
+            for (uint8_t i = 0; i < 3; i++) {
+                accelFiltered[0][i] += dlpfAlpha * (accel[i] - accelFiltered[0][i]);
+                accelFiltered[1][i] += dlpfAlpha * (accelFiltered[0][i] - accelFiltered[1][i]);
+            }
+        }
+        t += dt;
+        truthRates(t, w);
+
+        fusion_sample_t *sample = &trace->samples[n];
+        float qf[4] = {q[0], q[1], q[2], q[3]};
+        float ypr[3];
+        imuFusionQuaternionToYpr(qf, ypr);
+        for (uint8_t i = 0; i < 3; i++) {
+            sample->ref[i] = ypr[i] * 180 / M_PI;
+        }
+        sample->refRates[0] = -w[2] * 180 / M_PI;
+        sample->refRates[1] = -w[1] * 180 / M_PI;
+        sample->refRates[2] = w[0] * 180 / M_PI;
+
+        for (uint8_t i = 0; i < 3; i++) {
+            sample->accel[i] = saturate16((accelFiltered[1][i] + accelNoiseG * gaussian()) * IMU_FUSION_ACCEL_LSB_PER_G);
+            double gyroDps = w[i] * 180 / M_PI + gyroBiasDps[i] + gyroNoiseDps * gaussian();
+            sample->gyro[i] = saturate16(gyroDps * IMU_FUSION_GYRO_LSB_PER_DPS);
+        }
+        sample->dt = dt;
+    }
+    return 0;
+}
+
+static int traceLoadDmp(fusion_trace_t *trace, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    uint32_t capacity = 1024;
+    trace->samples = malloc(capacity * sizeof(fusion_sample_t));
+    trace->len = 0;
+    trace->gyroLsbPerDps = IMU_FUSION_DMP_GYRO_LSB_PER_DPS;
+    trace->fromDmp = 1;
+
+    char line[256];
+    long long lastUs = 0;
+    float firstYaw = 0;
+    while (fgets(line, sizeof(line), file)) {
+        const char *start = strstr(line, "DMP,");   // el monitor puede anteponer otros caracteres
+        long long us;
+        int a[3], g[3];
+        float yaw, pitch, roll;
+        if (!start || sscanf(start, "DMP,%lld,%d,%d,%d,%d,%d,%d,%f,%f,%f", &us, &a[0], &a[1], &a[2],
+                             &g[0], &g[1], &g[2], &yaw, &pitch, &roll) != 10) {
+            continue;
+        }
+        if (trace->len == capacity) {
+            capacity *= 2;
+            trace->samples = realloc(trace->samples, capacity * sizeof(fusion_sample_t));
+        }
+        fusion_sample_t *sample = &trace->samples[trace->len];
+        for (uint8_t i = 0; i < 3; i++) {
+            sample->accel[i] = a[i];
+            sample->gyro[i] = g[i];
+        }
+        if (!trace->len) {
+            firstYaw = yaw;
+        }
+        sample->dt = trace->len && us > lastUs ? (us - lastUs) * 1e-6f : 0.01f;
+        sample->ref[0] = wrap180(yaw - firstYaw);
+        sample->ref[1] = pitch;
+        sample->ref[2] = roll;
+        sample->refRates[0] = -g[2] / trace->gyroLsbPerDps;
+        sample->refRates[1] = -g[1] / trace->gyroLsbPerDps;
+        sample->refRates[2] = g[0] / trace->gyroLsbPerDps;
+        lastUs = us;
+        trace->len++;
+    }
+    fclose(file);
+    if (!trace->len) {
+        fprintf(stderr, "%s: sin lineas DMP (firmware con IMU_FUSION_RECORD_DMP)\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void toUnits(const fusion_trace_t *trace, const fusion_sample_t *sample, float accel[3], float gyro[3]) {
+    const float gyroScale = (float)M_PI / 180.0f / trace->gyroLsbPerDps;
+    for (uint8_t i = 0; i < 3; i++) {
+        accel[i] = sample->accel[i] / IMU_FUSION_ACCEL_LSB_PER_G;
+        gyro[i] = sample->gyro[i] * gyroScale;
+    }
+}
+
+static void runEngine(const fusion_trace_t *trace, uint8_t engine, uint32_t warmupSamples, fusion_error_t *error) {
+    imu_fusion_t fusion;
+    imuFusionInit(&fusion, engine);
+    memset(error, 0, sizeof(*error));
+
+    for (uint32_t n = 0; n < trace->len; n++) {
+        const fusion_sample_t *sample = &trace->samples[n];
+        float accel[3], gyro[3];
+        toUnits(trace, sample, accel, gyro);
+        imuFusionUpdate(&fusion, accel, gyro, sample->dt);
+
+        imu_fusion_output_t out;
+        imuFusionGetOutput(&fusion, &out);
+        float angles[3] = {out.yaw, out.pitch, out.roll};
+        double errors[3];
+        for (uint8_t i = 0; i < 3; i++) {
+            errors[i] = wrap180(angles[i] - sample->ref[i]);
+        }
+        error->finalYawError = errors[0];
+        if (n < warmupSamples) {
+            continue;
+        }
+        for (uint8_t i = 0; i < 3; i++) {
+            error->sumSq[i] += errors[i] * errors[i];
+            error->maxAbs[i] = fmax(error->maxAbs[i], fabs(errors[i]));
+        }
+        double rateError = out.ratePitch - sample->refRates[1];
+        error->rateSumSq += rateError * rateError;
+        error->count++;
+    }
+}
+
+/* ns y ciclos del host por imuFusionUpdate, mas el costo de imuFusionGetOutput */
+static void timeEngine(const fusion_trace_t *trace, uint8_t engine, double *updateNs, double *updateCycles,
+                       double *outputNs) {
+    uint32_t len = trace->len;
+    float (*accel)[3] = malloc(len * sizeof(*accel));
+    float (*gyro)[3] = malloc(len * sizeof(*gyro));
+    for (uint32_t n = 0; n < len; n++) {
+        toUnits(trace, &trace->samples[n], accel[n], gyro[n]);
+    }
+
+    imu_fusion_t fusion;
+    double bestNs = 1e30, bestCycles = 1e30;
+    for (uint8_t rep = 0; rep < TIMING_REPS; rep++) {
+        imuFusionInit(&fusion, engine);
+        double start = nowNs();
+        uint64_t startCycles = readCycles();
+        for (uint32_t n = 0; n < len; n++) {
+            imuFusionUpdate(&fusion, accel[n], gyro[n], trace->samples[n].dt);
+        }
+        uint64_t cycles = readCycles() - startCycles;
+        double elapsed = nowNs() - start;
+        sink = fusion.q[0] + fusion.gravity[0];
+        bestNs = fmin(bestNs, elapsed / len);
+        bestCycles = fmin(bestCycles, (double)cycles / len);
+    }
+
+    imu_fusion_output_t out;
+    double bestOutputNs = 1e30;
+    for (uint8_t rep = 0; rep < TIMING_REPS; rep++) {
+        double start = nowNs();
+        for (uint32_t n = 0; n < len; n++) {
+            fusion.q[1] = n * 1e-7f;                 // que no sea invariante del lazo
+            imuFusionGetOutput(&fusion, &out);
+            sink = out.pitch;
+        }
+        bestOutputNs = fmin(bestOutputNs, (nowNs() - start) / len);
+    }
+    *outputNs = bestOutputNs;
+    *updateNs = bestNs;
+    *updateCycles = bestCycles;
+    free(accel);
+    free(gyro);
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --seconds N      duracion de la simulacion (%d)\n"
+           "  --rate HZ        tasa de getMotion6 simulada (%d)\n"
+           "  --warmup S       segundos iniciales sin medir error (%.1f)\n"
+           "  --dmp LOG        log del firmware con IMU_FUSION_RECORD_DMP en lugar de la simulacion\n"
+           "  --seed N         semilla del ruido (1)\n",
+           prog, DEFAULT_SECONDS, DEFAULT_RATE_HZ, DEFAULT_WARMUP_S);
+}
+
+int main(int argc, char **argv) {
+    double seconds = DEFAULT_SECONDS;
+    uint32_t rateHz = DEFAULT_RATE_HZ;
+    double warmupS = DEFAULT_WARMUP_S;
+    const char *dmpPath = NULL;
+    unsigned seed = 1;
+
+    static const struct option options[] = {
+        {"seconds", required_argument, 0, 's'},
+        {"rate",    required_argument, 0, 'r'},
+        {"warmup",  required_argument, 0, 'w'},
+        {"dmp",     required_argument, 0, 'd'},
+        {"seed",    required_argument, 0, 'S'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:r:w:d:S:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': seconds = atof(optarg); break;
+            case 'r': rateHz = strtoul(optarg, NULL, 10); break;
+            case 'w': warmupS = atof(optarg); break;
+            case 'd': dmpPath = optarg; break;
+            case 'S': seed = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (seconds <= warmupS || !rateHz) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    srand(seed);
+    fusion_trace_t trace = {0};
+    if (dmpPath ? traceLoadDmp(&trace, dmpPath) : traceSynthetic(&trace, seconds, rateHz)) {
+        return 1;
+    }
+    double traceSeconds = 0;
+    for (uint32_t n = 0; n < trace.len; n++) {
+        traceSeconds += trace.samples[n].dt;
+    }
+    uint32_t warmupSamples = trace.len * (warmupS / traceSeconds);
+
+    if (trace.fromDmp) {
+        printf("%s: %u muestras en %.1f s (%.0f Hz), error respecto del DMP\n", dmpPath, trace.len, traceSeconds,
+               trace.len / traceSeconds);
+    }
+    else {
+        printf("simulacion: %.0f s a %u Hz, error respecto de la referencia despues de %.1f s\n", seconds, rateHz, warmupS);
+    }
+    printf("%-15s %10s %10s %10s %10s %10s %10s %12s %10s %10s\n", "motor", "pitch rms", "pitch max", "roll rms",
+           "roll max", "yaw final", "rate rms", "update ns", "ciclos", "salida ns");
+
+    int result = 0;
+    for (uint8_t e = 0; e < ENGINE_COUNT; e++) {
+        fusion_error_t error;
+        double updateNs, updateCycles, outputNs;
+        runEngine(&trace, engines[e].engine, warmupSamples, &error);
+        timeEngine(&trace, engines[e].engine, &updateNs, &updateCycles, &outputNs);
+
+        double pitchRms = sqrt(error.sumSq[1] / error.count);
+        printf("%-15s %10.3f %10.3f %10.3f %10.3f %+10.2f %10.3f %12.1f %10.0f %10.1f\n", engines[e].name,
+               pitchRms, error.maxAbs[1], sqrt(error.sumSq[2] / error.count), error.maxAbs[2], error.finalYawError,
+               sqrt(error.rateSumSq / error.count), updateNs, updateCycles, outputNs);
+
+        if (!trace.fromDmp && !(pitchRms <= MAX_PITCH_RMS_DEG)) {
+            result = 2;
+        }
+    }
+    printf("angulos en grados, rate: d(pitch)/dt en grados/s; ciclos del TSC del host por actualizacion (0 sin TSC)\n");
+
+    free(trace.samples);
+    return result;
+}
@@ -0,0 +1,138 @@
+/*
+ * Implementacion host de esp_timer sobre timerfd. El callback corre en el hilo del timer, como en
+ * ESP_TIMER_TASK; si el hilo se atrasa se llama una vez por cada vencimiento perdido. El hilo vive
+ * desde el primer start hasta esp_timer_delete, asi reiniciar un timer de una vez es barato.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+
+#include "esp_timer.h"
+
+struct host_esp_timer_s {
+    esp_timer_create_args_t args;
+    int fd;
+    pthread_t thread;
+    int threadStarted;
+    volatile int running;                               // armado, como esp_timer_is_active
+    volatile int periodic;
+    volatile int deleted;
+};
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *timerThread(void *arg) {
+    esp_timer_handle_t timer = arg;
+
+    // Prioridad de tiempo real si el usuario tiene permiso, si no queda en la normal
+    struct sched_param param = {.sched_priority = sched_get_priority_max(SCHED_FIFO)};
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    while (!timer->deleted) {
+        uint64_t expirations;
+        if (read(timer->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            continue;
+        }
+        if (timer->args.skip_unhandled_events || !timer->periodic) {
+            expirations = 1;
+        }
+        if (!timer->periodic) {
+            timer->running = 0;
+            if (!timer->deleted) {
+                timer->args.callback(timer->args.arg);
+            }
+            continue;
+        }
+        while (expirations-- && timer->running) {
+            timer->args.callback(timer->args.arg);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *outHandle) {
+    if (args == NULL || args->callback == NULL || outHandle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer_handle_t timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (timer->fd < 0) {
+        free(timer);
+        return ESP_FAIL;
+    }
+    timer->args = *args;
+    *outHandle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t timeoutUs, int periodic) {
+    if (timer->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct timespec value = {.tv_sec = timeoutUs / 1000000, .tv_nsec = (timeoutUs % 1000000) * 1000};
+    if (!value.tv_sec && !value.tv_nsec) {
+        value.tv_nsec = 1;                              // 0 desarma el timerfd
+    }
+    struct itimerspec spec = {
+        .it_interval = periodic ? value : (struct timespec){0},
+        .it_value = value,
+    };
+    timer->periodic = periodic;
+    timer->running = 1;
+    if (!timer->threadStarted) {
+        if (pthread_create(&timer->thread, NULL, timerThread, timer)) {
+            timer->running = 0;
+            return ESP_ERR_NO_MEM;
+        }
+        timer->threadStarted = 1;
+    }
+    if (timerfd_settime(timer->fd, 0, &spec, NULL)) {
+        timer->running = 0;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return startTimer(timer, period, 1);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    return startTimer(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Como en esp_timer, un callback que ya estaba corriendo termina igual
+    timer->running = 0;
+    struct itimerspec spec = {0};
+    timerfd_settime(timer->fd, 0, &spec, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (timer->threadStarted) {
+        // Un vencimiento inmediato despierta al hilo para que vea deleted
+        timer->deleted = 1;
+        struct itimerspec spec = {.it_value = {.tv_nsec = 1}};
+        timerfd_settime(timer->fd, 0, &spec, NULL);
+        pthread_join(timer->thread, NULL);
+    }
+    close(timer->fd);
+    free(timer);
+    return ESP_OK;
+}
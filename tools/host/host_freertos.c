@@ -0,0 +1,396 @@
+/*
+ * Implementacion host de los servicios de FreeRTOS usados por el firmware.
+ * Las colas son thread safe (pthreads) para poder usarlas desde varios hilos,
+ * las tareas son pthreads y sus notificaciones un contador con mutex/cond.
+ * Los stream buffers son un buffer circular de bytes con la misma logica de espera que las colas.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/stream_buffer.h"
+#include "driver/gpio.h"
+
+int hostLogEnable = 0;
+uint8_t hostGpioLevel[HOST_GPIO_COUNT];
+
+struct host_queue_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    UBaseType_t     length;
+    UBaseType_t     itemSize;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    uint8_t         *storage;
+};
+
+static void ticksToDeadline(TickType_t ticks, struct timespec *deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    uint64_t ns = (uint64_t)deadline->tv_nsec + ((uint64_t)ticks * 1000000000ULL) / configTICK_RATE_HZ;
+    deadline->tv_sec += ns / 1000000000ULL;
+    deadline->tv_nsec = ns % 1000000000ULL;
+}
+
+/*
+ * Espera un cambio en la cola, devuelve false si vencio el timeout
+ */
+static int waitChange(QueueHandle_t queue, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == 0) {
+        return 0;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+        return 1;
+    }
+    return pthread_cond_timedwait(&queue->changed, &queue->lock, deadline) != ETIMEDOUT;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->storage = calloc(length, itemSize ? itemSize : 1);       // itemSize 0: semaforo
+    if (queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->itemSize = itemSize;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->storage);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+    struct timespec deadline;
+    ticksToDeadline(ticksToWait, &deadline);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (!waitChange(queue, ticksToWait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->itemSize) {
+        memcpy(queue->storage + tail * queue->itemSize, item, queue->itemSize);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->itemSize) {
+        memcpy(queue->storage + queue->head * queue->itemSize, item, queue->itemSize);
+    }
+    queue->count = 1;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+static BaseType_t queueGet(QueueHandle_t queue, void *item, TickType_t ticksToWait, int remove) {
+    struct timespec deadline;
+    ticksToDeadline(ticksToWait, &deadline);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (!waitChange(queue, ticksToWait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->itemSize) {
+        memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+    }
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+    return queueGet(queue, item, ticksToWait, 1);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+    return queueGet(queue, item, ticksToWait, 0);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+struct host_stream_buffer_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    size_t          size;
+    size_t          triggerLevel;
+    size_t          head;
+    size_t          count;
+    uint8_t         *storage;
+};
+
+static int streamWaitChange(StreamBufferHandle_t buffer, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == 0) {
+        return 0;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(&buffer->changed, &buffer->lock);
+        return 1;
+    }
+    return pthread_cond_timedwait(&buffer->changed, &buffer->lock, deadline) != ETIMEDOUT;
+}
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t triggerLevel) {
+    StreamBufferHandle_t buffer = calloc(1, sizeof(*buffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->storage = malloc(size);
+    if (buffer->storage == NULL) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->size = size;
+    buffer->triggerLevel = triggerLevel ? triggerLevel : 1;
+    pthread_mutex_init(&buffer->lock, NULL);
+    pthread_cond_init(&buffer->changed, NULL);
+    return buffer;
+}
+
+void vStreamBufferDelete(StreamBufferHandle_t buffer) {
+    pthread_mutex_destroy(&buffer->lock);
+    pthread_cond_destroy(&buffer->changed);
+    free(buffer->storage);
+    free(buffer);
+}
+
+/* Como en FreeRTOS espera lugar para todo el bloque y al vencer el timeout escribe lo que entre */
+size_t xStreamBufferSend(StreamBufferHandle_t buffer, const void *data, size_t len, TickType_t ticksToWait) {
+    struct timespec deadline;
+    ticksToDeadline(ticksToWait, &deadline);
+
+    pthread_mutex_lock(&buffer->lock);
+    while (buffer->size - buffer->count < len) {
+        if (!streamWaitChange(buffer, ticksToWait, &deadline)) {
+            break;
+        }
+    }
+    size_t space = buffer->size - buffer->count;
+    size_t written = len < space ? len : space;
+    for (size_t i = 0; i < written; i++) {
+        buffer->storage[(buffer->head + buffer->count + i) % buffer->size] = ((const uint8_t *)data)[i];
+    }
+    buffer->count += written;
+    if (written) {
+        pthread_cond_broadcast(&buffer->changed);
+    }
+    pthread_mutex_unlock(&buffer->lock);
+    return written;
+}
+
+/* Solo bloquea con el buffer vacio, hasta juntar triggerLevel bytes o vencer el timeout */
+size_t xStreamBufferReceive(StreamBufferHandle_t buffer, void *data, size_t len, TickType_t ticksToWait) {
+    struct timespec deadline;
+    ticksToDeadline(ticksToWait, &deadline);
+
+    pthread_mutex_lock(&buffer->lock);
+    if (buffer->count == 0) {
+        while (buffer->count < buffer->triggerLevel) {
+            if (!streamWaitChange(buffer, ticksToWait, &deadline)) {
+                break;
+            }
+        }
+    }
+    size_t read = len < buffer->count ? len : buffer->count;
+    for (size_t i = 0; i < read; i++) {
+        ((uint8_t *)data)[i] = buffer->storage[(buffer->head + i) % buffer->size];
+    }
+    buffer->head = (buffer->head + read) % buffer->size;
+    buffer->count -= read;
+    if (read) {
+        pthread_cond_broadcast(&buffer->changed);
+    }
+    pthread_mutex_unlock(&buffer->lock);
+    return read;
+}
+
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t buffer) {
+    pthread_mutex_lock(&buffer->lock);
+    size_t space = buffer->size - buffer->count;
+    pthread_mutex_unlock(&buffer->lock);
+    return space;
+}
+
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t buffer) {
+    pthread_mutex_lock(&buffer->lock);
+    size_t count = buffer->count;
+    pthread_mutex_unlock(&buffer->lock);
+    return count;
+}
+
+BaseType_t xStreamBufferIsFull(StreamBufferHandle_t buffer) {
+    return xStreamBufferSpacesAvailable(buffer) == 0;
+}
+
+BaseType_t xStreamBufferReset(StreamBufferHandle_t buffer) {
+    pthread_mutex_lock(&buffer->lock);
+    buffer->head = 0;
+    buffer->count = 0;
+    pthread_cond_broadcast(&buffer->changed);
+    pthread_mutex_unlock(&buffer->lock);
+    return pdPASS;
+}
+
+struct host_task_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  notified;
+    uint32_t        notifyValue;
+    TaskFunction_t  function;
+    void            *parameters;
+};
+
+static __thread TaskHandle_t currentTask;
+static atomic_uint liveTasks;                           // solo las creadas con xTaskCreate, no main
+
+static TaskHandle_t taskAlloc(TaskFunction_t function, void *parameters) {
+    TaskHandle_t task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    task->function = function;
+    task->parameters = parameters;
+    return task;
+}
+
+static void *taskEntry(void *arg) {
+    currentTask = arg;
+    currentTask->function(currentTask->parameters);
+    atomic_fetch_sub(&liveTasks, 1);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t coreId) {
+    TaskHandle_t task = taskAlloc(function, parameters);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    if (createdTask) {
+        *createdTask = task;
+    }
+    pthread_t thread;
+    atomic_fetch_add(&liveTasks, 1);
+    if (pthread_create(&thread, NULL, taskEntry, task)) {
+        atomic_fetch_sub(&liveTasks, 1);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == currentTask) {
+        atomic_fetch_sub(&liveTasks, 1);
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = {
+        .tv_sec = ticks / configTICK_RATE_HZ,
+        .tv_nsec = (long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ),
+    };
+    while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * configTICK_RATE_HZ + ts.tv_nsec / (1000000000L / configTICK_RATE_HZ));
+}
+
+/* Los hilos que no crearon una tarea (main) reciben un handle al pedirlo, para poder ser notificados */
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (currentTask == NULL) {
+        currentTask = taskAlloc(NULL, NULL);
+    }
+    return currentTask;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    return atomic_load(&liveTasks);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notifyValue++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken) {
+    xTaskNotifyGive(task);
+    if (higherPriorityTaskWoken) {
+        *higherPriorityTaskWoken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    ticksToDeadline(ticksToWait, &deadline);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notifyValue == 0 && ticksToWait != 0) {
+        if (ticksToWait == portMAX_DELAY) {
+            pthread_cond_wait(&task->notified, &task->lock);
+        }
+        else if (pthread_cond_timedwait(&task->notified, &task->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notifyValue;
+    if (value) {
+        task->notifyValue = clearCountOnExit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
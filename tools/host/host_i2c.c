@@ -0,0 +1,251 @@
+/*
+ * Bus I2C falso para el host: un hilo atiende las transacciones en orden, llama al dispositivo
+ * simulado de la direccion al empezar cada una y ocupa el bus el tiempo que tardaria en salir
+ * (start, direccion, datos y ACK a 9 bits por byte a la velocidad configurada, repeated start si lee).
+ *
+ * El driver legacy (i2c_master_write_read_device...) bloquea al llamador hasta el final, como
+ * i2c_master_cmd_begin. i2c_master con callback registrado vuelve enseguida y el callback corre en el
+ * hilo del bus, donde el firmware lo tendria en la ISR.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "driver/i2c.h"
+#include "driver/i2c_master.h"
+
+#define HOST_I2C_QUEUE_DEPTH    8
+#define HOST_I2C_ADDRESSES      128
+
+typedef struct {
+    uint8_t address;
+    uint32_t clockHz;
+    const uint8_t *tx;
+    size_t txLen;
+    uint8_t *rx;
+    size_t rxLen;
+    i2c_master_dev_handle_t dev;                    // NULL: llamada legacy, se despierta al llamador
+    volatile int done;
+    esp_err_t result;
+} host_i2c_transfer_t;
+
+struct host_i2c_bus_s {
+    int unused;
+};
+
+struct host_i2c_dev_s {
+    uint8_t address;
+    uint32_t clockHz;
+    i2c_master_event_callbacks_t callbacks;
+    void *userData;
+};
+
+static pthread_mutex_t busLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t busChanged = PTHREAD_COND_INITIALIZER;
+static host_i2c_transfer_t *pending[HOST_I2C_QUEUE_DEPTH];
+static uint32_t pendingHead;
+static uint32_t pendingCount;
+static int busThreadStarted;
+static uint32_t legacyClockHz = 100000;
+static int legacyInstalled;
+static struct host_i2c_bus_s masterBus;
+static host_i2c_device_t devices[HOST_I2C_ADDRESSES];
+static double nackRate;
+static unsigned int nackSeed = 1;
+
+void hostI2cAttach(uint8_t address, const host_i2c_device_t *device) {
+    devices[address & (HOST_I2C_ADDRESSES - 1)] = *device;
+}
+
+void hostI2cSetNackRate(double rate) {
+    nackRate = rate;
+}
+
+static void sleepUntil(const struct timespec *deadline) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR);
+}
+
+static void *busThread(void *arg) {
+    while (1) {
+        pthread_mutex_lock(&busLock);
+        while (pendingCount == 0) {
+            pthread_cond_wait(&busChanged, &busLock);
+        }
+        host_i2c_transfer_t *transfer = pending[pendingHead];
+        pthread_mutex_unlock(&busLock);
+
+        // start + direccion + escritura, y si lee repeated start + direccion + lectura, 9 bits por byte
+        size_t bytes = 1 + transfer->txLen + (transfer->rxLen ? 1 + transfer->rxLen : 0);
+        uint64_t durationNs = (uint64_t)bytes * 9 * 1000000000ULL / transfer->clockHz;
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += durationNs;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        const host_i2c_device_t *device = &devices[transfer->address & (HOST_I2C_ADDRESSES - 1)];
+        int nack = nackRate > 0 && rand_r(&nackSeed) < nackRate * RAND_MAX;
+        if (!nack && device->transfer) {
+            nack = !device->transfer(device->ctx, transfer->tx, transfer->txLen, transfer->rx, transfer->rxLen);
+        }
+        else if (!device->transfer) {
+            nack = 1;
+        }
+        sleepUntil(&deadline);
+
+        i2c_master_dev_handle_t dev = transfer->dev;
+        transfer->result = nack ? ESP_FAIL : ESP_OK;
+        if (dev) {
+            free(transfer);
+            if (dev->callbacks.on_trans_done) {
+                i2c_master_event_data_t event = {.event = nack ? I2C_EVENT_NACK : I2C_EVENT_DONE};
+                dev->callbacks.on_trans_done(dev, &event, dev->userData);
+            }
+        }
+
+        pthread_mutex_lock(&busLock);
+        if (!dev) {
+            transfer->done = 1;
+        }
+        pendingHead = (pendingHead + 1) % HOST_I2C_QUEUE_DEPTH;
+        pendingCount--;
+        pthread_cond_broadcast(&busChanged);
+        pthread_mutex_unlock(&busLock);
+    }
+    return NULL;
+}
+
+static esp_err_t enqueue(host_i2c_transfer_t *transfer) {
+    pthread_mutex_lock(&busLock);
+    if (!busThreadStarted) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, busThread, NULL)) {
+            pthread_mutex_unlock(&busLock);
+            return ESP_FAIL;
+        }
+        pthread_detach(thread);
+        busThreadStarted = 1;
+    }
+    while (pendingCount == HOST_I2C_QUEUE_DEPTH) {
+        pthread_cond_wait(&busChanged, &busLock);
+    }
+    pending[(pendingHead + pendingCount) % HOST_I2C_QUEUE_DEPTH] = transfer;
+    pendingCount++;
+    pthread_cond_broadcast(&busChanged);
+    pthread_mutex_unlock(&busLock);
+    return ESP_OK;
+}
+
+static esp_err_t legacyTransfer(uint8_t address, const uint8_t *tx, size_t txLen, uint8_t *rx, size_t rxLen) {
+    if (!legacyInstalled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_i2c_transfer_t transfer = {
+        .address = address, .clockHz = legacyClockHz, .tx = tx, .txLen = txLen, .rx = rx, .rxLen = rxLen,
+    };
+    esp_err_t err = enqueue(&transfer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pthread_mutex_lock(&busLock);
+    while (!transfer.done) {
+        pthread_cond_wait(&busChanged, &busLock);
+    }
+    pthread_mutex_unlock(&busLock);
+    return transfer.result;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config) {
+    legacyClockHz = config->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, int mode, size_t rxBufLen, size_t txBufLen, int intrAllocFlags) {
+    if (legacyInstalled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    legacyInstalled = 1;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port) {
+    if (!legacyInstalled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    legacyInstalled = 0;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t address, const uint8_t *writeBuffer, size_t writeSize,
+                                       uint8_t *readBuffer, size_t readSize, TickType_t ticksToWait) {
+    return legacyTransfer(address, writeBuffer, writeSize, readBuffer, readSize);
+}
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t address, const uint8_t *writeBuffer, size_t writeSize,
+                                     TickType_t ticksToWait) {
+    return legacyTransfer(address, writeBuffer, writeSize, NULL, 0);
+}
+
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t address, uint8_t *readBuffer, size_t readSize,
+                                      TickType_t ticksToWait) {
+    return legacyTransfer(address, NULL, 0, readBuffer, readSize);
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config, i2c_master_bus_handle_t *retBus) {
+    if (legacyInstalled) {
+        return ESP_ERR_INVALID_STATE;               // el puerto sigue tomado por el driver legacy
+    }
+    *retBus = &masterBus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *retDev) {
+    i2c_master_dev_handle_t dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->address = config->device_address;
+    dev->clockHz = config->scl_speed_hz;
+    *retDev = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t dev, const i2c_master_event_callbacks_t *callbacks,
+                                              void *userData) {
+    dev->callbacks = *callbacks;
+    dev->userData = userData;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *writeBuffer, size_t writeSize,
+                                      uint8_t *readBuffer, size_t readSize, int timeoutMs) {
+    host_i2c_transfer_t *transfer = calloc(1, sizeof(*transfer));
+    if (transfer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *transfer = (host_i2c_transfer_t){
+        .address = dev->address, .clockHz = dev->clockHz, .tx = writeBuffer, .txLen = writeSize,
+        .rx = readBuffer, .rxLen = readSize, .dev = dev,
+    };
+    esp_err_t err = enqueue(transfer);
+    if (err != ESP_OK) {
+        free(transfer);
+    }
+    return err;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *writeBuffer, size_t writeSize, int timeoutMs) {
+    return i2c_master_transmit_receive(dev, writeBuffer, writeSize, NULL, 0, timeoutMs);
+}
+
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus, int timeoutMs) {
+    pthread_mutex_lock(&busLock);
+    while (pendingCount) {
+        pthread_cond_wait(&busChanged, &busLock);
+    }
+    pthread_mutex_unlock(&busLock);
+    return ESP_OK;
+}
@@ -0,0 +1,396 @@
+/*
+ * Transporte I2C de las lecturas del MPU6050 (mpu_i2c.c) sobre el bus falso de host_i2c.c.
+ *
+ * Un MPU simulado (FIFO del DMP con un paquete cada --dmp-us, INT_STATUS, contador, USER_CTRL y
+ * temperatura) cuelga del bus a 400 kHz; un esp_timer hace de DMP y notifica a la tarea lectora como el
+ * flanco INT. La tarea corre el ciclo de mpu6050DmpLoop en modo interrupcion (contador, mpuFifoDrain,
+ * temperatura cada MPU_TEMP_DECIMATION) con tres transportes, --seconds cada uno:
+ *   i2cdev:  como I2Cdev sobre el driver legacy, seleccion de registro con stop y despues la lectura
+ *   legacy:  mpu_i2c con el driver legacy, escritura + repeated start + lectura en una transaccion
+ *   async:   mpu_i2c despues de mpuI2cBeginAsync, i2c_master con callback y la tarea en un semaforo
+ * Reporta transacciones y us de bus por muestra, cpu de la tarea por muestra (CLOCK_THREAD_CPUTIME_ID,
+ * lo que en el robot da runTimeUs), latencia del flanco a la entrega y errores. Cada paquete lleva su
+ * secuencia: sale con 2 si se entrega uno que no es el mas nuevo o fuera de orden. Con --nack-rate el
+ * bus falla al azar y el lazo tiene que recuperarse reseteando la FIFO.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/i2c.h"
+#include "mpu_i2c.h"
+#include "mpu_fifo.h"
+
+#define DEFAULT_SECONDS     5
+#define DEFAULT_DMP_US      10000               // CONTROL_TICK_PERIOD_US
+#define TEMP_DECIMATION     100                 // MPU_TEMP_DECIMATION
+#define TEMP_RAW            1700                // 41.5 grados
+#define INT_TIMEOUT_MS      100                 // MPU_INT_TIMEOUT_MS
+#define FIFO_PACKETS        (MPU_FIFO_SIZE / MPU_DMP_PACKET_SIZE)
+
+enum {
+    TRANSPORT_I2CDEV,
+    TRANSPORT_LEGACY,
+    TRANSPORT_ASYNC,
+    TRANSPORT_COUNT
+};
+
+static const char *transportNames[TRANSPORT_COUNT] = {"i2cdev (legacy)", "mpu_i2c legacy", "mpu_i2c async"};
+
+/* MPU simulado, lo tocan el hilo del bus y el esp_timer del DMP */
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t produced;                          // secuencia del proximo paquete
+    uint32_t head;                              // secuencia del mas viejo en la FIFO
+    uint32_t count;                             // paquetes completos
+    uint8_t overflowed;
+    uint8_t intStatus;
+    uint8_t userCtrl;
+    uint8_t selectedReg;                        // ultimo registro escrito sin dato (I2Cdev)
+    uint32_t newestAtCount;                     // secuencia mas nueva en la ultima lectura del contador
+    uint32_t transactions;
+    double busUs;
+    uint32_t lost;
+} mpu_model_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t cycles;
+    uint32_t resets;
+    uint32_t mismatches;
+    uint32_t intTimeouts;
+    double latencySumUs;
+    double latencyMaxUs;
+    double cpuUs;
+} reader_result_t;
+
+static mpu_model_t model = {.lock = PTHREAD_MUTEX_INITIALIZER, .userCtrl = 0xC0};    // DMP_EN | FIFO_EN
+static TaskHandle_t readerTask;
+static volatile int64_t lastIntUs;
+static volatile int readerStop;
+static volatile int readerDone;
+static uint8_t readerTransport;
+static reader_result_t readerResult;
+
+static void encodePacket(uint8_t *packet, uint32_t seq) {
+    memset(packet, 0xA5, MPU_DMP_PACKET_SIZE);
+    int16_t raw[4] = {16384, (int16_t)(seq & 0x3FFF), (int16_t)((seq >> 14) & 0x3FFF), 0};
+    for (uint8_t i = 0; i < 4; i++) {
+        packet[4 * i] = (uint8_t)(raw[i] >> 8);
+        packet[4 * i + 1] = (uint8_t)raw[i];
+    }
+}
+
+static uint32_t decodeSeq(const float q[4]) {
+    return (uint32_t)lrintf(q[1] * 16384.0f) | ((uint32_t)lrintf(q[2] * 16384.0f) << 14);
+}
+
+static void modelRead(uint8_t reg, uint8_t *rx, size_t rxLen) {
+    memset(rx, 0, rxLen);
+    switch (reg) {
+        case MPU_REG_INT_STATUS:
+            rx[0] = model.intStatus;
+            model.intStatus = 0;                // se limpia al leerlo
+            break;
+        case MPU_REG_FIFO_COUNTH: {
+            uint16_t count = model.overflowed ? MPU_FIFO_SIZE : model.count * MPU_DMP_PACKET_SIZE;
+            rx[0] = count >> 8;
+            if (rxLen > 1) {
+                rx[1] = count & 0xFF;
+            }
+            model.newestAtCount = model.count ? model.head + model.count - 1 : 0;
+            break;
+        }
+        case MPU_REG_FIFO_R_W:
+            for (size_t i = 0; i + MPU_DMP_PACKET_SIZE <= rxLen && model.count; i += MPU_DMP_PACKET_SIZE) {
+                encodePacket(&rx[i], model.head++);
+                model.count--;
+            }
+            break;
+        case MPU_REG_TEMP_OUT_H:
+            rx[0] = (uint16_t)TEMP_RAW >> 8;
+            if (rxLen > 1) {
+                rx[1] = TEMP_RAW & 0xFF;
+            }
+            break;
+        case MPU_REG_USER_CTRL:
+            rx[0] = model.userCtrl;
+            break;
+    }
+}
+
+static bool modelTransfer(void *ctx, const uint8_t *tx, size_t txLen, uint8_t *rx, size_t rxLen) {
+    pthread_mutex_lock(&model.lock);
+    model.transactions++;
+    model.busUs += (1 + txLen + (rxLen ? 1 + rxLen : 0)) * 9 * 1e6 / MPU_I2C_CLOCK_HZ;
+    if (txLen >= 2) {                           // escritura de registro
+        if (tx[0] == MPU_REG_USER_CTRL) {
+            if (tx[1] & MPU_USER_CTRL_FIFO_RESET) {
+                model.lost += model.overflowed ? 0 : model.count;
+                model.count = 0;
+                model.overflowed = 0;
+            }
+            model.userCtrl = tx[1] & ~MPU_USER_CTRL_FIFO_RESET;
+        }
+    }
+    else if (txLen == 1) {
+        model.selectedReg = tx[0];
+        if (rxLen) {
+            modelRead(tx[0], rx, rxLen);
+        }
+    }
+    else if (rxLen) {
+        modelRead(model.selectedReg, rx, rxLen);
+    }
+    pthread_mutex_unlock(&model.lock);
+    return true;
+}
+
+static void dmpTick(void *arg) {
+    pthread_mutex_lock(&model.lock);
+    if (model.overflowed || model.count == FIFO_PACKETS) {
+        model.overflowed = 1;
+        model.intStatus |= MPU_INT_STATUS_FIFO_OFLOW;
+        model.lost++;
+    }
+    else {
+        if (!model.count) {
+            model.head = model.produced;
+        }
+        model.count++;
+        model.intStatus |= MPU_INT_STATUS_DMP;
+    }
+    model.produced++;
+    pthread_mutex_unlock(&model.lock);
+
+    lastIntUs = esp_timer_get_time();
+    if (readerTask) {
+        vTaskNotifyGiveFromISR(readerTask, NULL);
+    }
+}
+
+/*
+ * Lecturas como las hace I2Cdev: readBytes selecciona el registro con una escritura y stop y despues
+ * lee; writeBit lee el registro y lo vuelve a escribir
+ */
+static esp_err_t i2cdevRead(uint8_t reg, uint8_t *data, size_t len) {
+    esp_err_t err = i2c_master_write_to_device(I2C_NUM_0, MPU_I2C_ADDRESS, &reg, 1, 10);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return i2c_master_read_from_device(I2C_NUM_0, MPU_I2C_ADDRESS, data, len, 10);
+}
+
+static bool i2cdevReadFifo(void *ctx, uint8_t *data, uint8_t len) {
+    return i2cdevRead(MPU_REG_FIFO_R_W, data, len) == ESP_OK;
+}
+
+static esp_err_t readFifoCount(uint16_t *count) {
+    if (readerTransport != TRANSPORT_I2CDEV) {
+        return mpuI2cReadFifoCount(count);
+    }
+    uint8_t raw[2];
+    esp_err_t err = i2cdevRead(MPU_REG_FIFO_COUNTH, raw, 2);
+    *count = err == ESP_OK ? (uint16_t)((raw[0] << 8) | raw[1]) : 0;
+    return err;
+}
+
+static void resetFifo(void) {
+    if (readerTransport != TRANSPORT_I2CDEV) {
+        mpuI2cResetFifo();
+        return;
+    }
+    uint8_t userCtrl;
+    if (i2cdevRead(MPU_REG_USER_CTRL, &userCtrl, 1) == ESP_OK) {
+        uint8_t write[2] = {MPU_REG_USER_CTRL, userCtrl | MPU_USER_CTRL_FIFO_RESET};
+        i2c_master_write_to_device(I2C_NUM_0, MPU_I2C_ADDRESS, write, 2, 10);
+    }
+}
+
+static void readTemperature(float *temp) {
+    if (readerTransport != TRANSPORT_I2CDEV) {
+        mpuI2cReadTemperature(temp);
+        return;
+    }
+    uint8_t raw[2];
+    if (i2cdevRead(MPU_REG_TEMP_OUT_H, raw, 2) == ESP_OK) {
+        *temp = (int16_t)((raw[0] << 8) | raw[1]) / 340.0f + 36.53f;
+    }
+}
+
+static double threadCpuUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * El ciclo de mpu6050DmpLoop en modo interrupcion, entregando solo el mas nuevo
+ */
+static void readerHandler(void *arg) {
+    const mpu_fifo_bus_t bus = {
+        .read = readerTransport == TRANSPORT_I2CDEV ? i2cdevReadFifo : mpuI2cReadFifo,
+        .ctx = NULL,
+    };
+    reader_result_t *res = &readerResult;
+    float quaternions[1][4];
+    float temp = NAN;
+    uint32_t lastSeq = 0;
+    int hasLast = 0;
+
+    readerTask = xTaskGetCurrentTaskHandle();
+    double cpuStart = threadCpuUs();
+    while (!readerStop) {
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INT_TIMEOUT_MS))) {
+            res->intTimeouts++;
+        }
+        int64_t sampleUs = lastIntUs;
+        res->cycles++;
+
+        uint16_t fifoCount;
+        if (readFifoCount(&fifoCount) != ESP_OK) {
+            continue;
+        }
+        pthread_mutex_lock(&model.lock);
+        uint32_t newest = model.newestAtCount;
+        pthread_mutex_unlock(&model.lock);
+
+        mpu_fifo_drain_t drain = mpuFifoDrain(&bus, fifoCount, quaternions, NULL, 1);
+        if (drain.overflow || drain.error) {
+            resetFifo();
+            res->resets++;
+            hasLast = 0;
+            continue;
+        }
+        if (!drain.decoded) {
+            continue;
+        }
+        if (!(res->samples % TEMP_DECIMATION)) {
+            readTemperature(&temp);
+        }
+
+        uint32_t seq = decodeSeq(quaternions[0]);
+        if (seq != newest || (hasLast && seq <= lastSeq) || (!isnan(temp) && fabsf(temp - (TEMP_RAW / 340.0f + 36.53f)) > 0.01f)) {
+            res->mismatches++;
+        }
+        lastSeq = seq;
+        hasLast = 1;
+
+        double latencyUs = esp_timer_get_time() - sampleUs;
+        res->latencySumUs += latencyUs;
+        if (latencyUs > res->latencyMaxUs) {
+            res->latencyMaxUs = latencyUs;
+        }
+        res->samples++;
+    }
+    res->cpuUs = threadCpuUs() - cpuStart;
+    readerTask = NULL;
+    readerDone = 1;
+    vTaskDelete(NULL);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "uso: %s [--seconds N] [--dmp-us US] [--nack-rate P]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    double seconds = DEFAULT_SECONDS;
+    double dmpUs = DEFAULT_DMP_US;
+    double nackRate = 0;
+
+    static const struct option options[] = {
+        {"seconds", required_argument, NULL, 's'},
+        {"dmp-us", required_argument, NULL, 'd'},
+        {"nack-rate", required_argument, NULL, 'n'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:d:n:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': seconds = atof(optarg); break;
+            case 'd': dmpUs = atof(optarg); break;
+            case 'n': nackRate = atof(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (seconds <= 0 || dmpUs < 1000) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const host_i2c_device_t device = {.transfer = modelTransfer, .ctx = NULL};
+    hostI2cAttach(MPU_I2C_ADDRESS, &device);
+    hostI2cSetNackRate(nackRate);
+    mpu_i2c_config_t config = {.sdaGpio = 18, .sclGpio = 17, .clockHz = MPU_I2C_CLOCK_HZ, .address = MPU_I2C_ADDRESS};
+    ESP_ERROR_CHECK(mpuI2cInit(&config));
+
+    esp_timer_handle_t dmpTimer;
+    const esp_timer_create_args_t timerArgs = {.callback = dmpTick, .name = "dmp"};
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &dmpTimer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(dmpTimer, (uint64_t)dmpUs));
+
+    printf("DMP cada %.0f us, bus %d kHz, %.1f s por transporte, NACK %.2f%%\n", dmpUs, MPU_I2C_CLOCK_HZ / 1000,
+           seconds, nackRate * 100);
+    printf("%-18s %8s %8s %9s %9s %10s %9s %8s %7s %7s %6s\n", "transporte", "muestras", "trans/m", "bus us/m",
+           "cpu us/m", "espera us/m", "lat media", "lat max", "errores", "resets", "error");
+
+    int failed = 0;
+    for (uint8_t t = 0; t < TRANSPORT_COUNT; t++) {
+        if (t == TRANSPORT_ASYNC) {
+            ESP_ERROR_CHECK(mpuI2cBeginAsync());
+        }
+        mpu_i2c_stats_t before;
+        mpuI2cGetStats(&before);
+        pthread_mutex_lock(&model.lock);
+        model.transactions = 0;
+        model.busUs = 0;
+        pthread_mutex_unlock(&model.lock);
+
+        memset(&readerResult, 0, sizeof(readerResult));
+        readerTransport = t;
+        readerStop = 0;
+        readerDone = 0;
+        xTaskCreatePinnedToCore(readerHandler, "mpu_reader", 4096, NULL, 5, NULL, APP_CPU_NUM);
+        vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+        readerStop = 1;
+        while (!readerDone) {
+            vTaskDelay(1);
+        }
+
+        mpu_i2c_stats_t after;
+        mpuI2cGetStats(&after);
+        reader_result_t *r = &readerResult;
+        double samples = r->samples ? r->samples : 1;
+        uint32_t errors = after.errors - before.errors;
+        double waitUs = (double)(after.transferUs - before.transferUs);
+        if (t == TRANSPORT_I2CDEV) {
+            errors = 0;                         // no pasa por mpu_i2c, los fallos se ven como resets
+            waitUs = NAN;
+        }
+        printf("%-18s %8u %8.2f %9.1f %9.2f %10.1f %8.0fus %6.0fus %7u %7u %6u\n", transportNames[t], r->samples,
+               model.transactions / samples, model.busUs / samples, r->cpuUs / samples, waitUs / samples,
+               r->latencySumUs / samples, r->latencyMaxUs, errors, r->resets, r->mismatches);
+        if (r->mismatches || !r->samples || (nackRate == 0 && r->resets)) {
+            failed = 1;
+        }
+        if (t == TRANSPORT_ASYNC && !after.async) {
+            printf("mpuI2cBeginAsync no paso el bus a i2c_master\n");
+            failed = 1;
+        }
+    }
+    esp_timer_stop(dmpTimer);
+
+    if (failed) {
+        printf("FALLO: muestra entregada incorrecta o resets sin errores de bus\n");
+        return 2;
+    }
+    return 0;
+}
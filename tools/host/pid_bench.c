@@ -0,0 +1,280 @@
+/*
+ * Comparacion del motor PID en float (src/PID.c) contra el de punto fijo (src/PID_fixed.c).
+ *
+ * Ambos motores procesan la misma señal con las ganancias de controlLoadDefaultConfig y el
+ * periodo PERIOD_IMU_MS. La señal sale de una traza grabada con robot_sim --csv (columnas
+ * pitch y setPoint) o, si no se pasa ninguna, de una oscilacion amortiguada con ruido.
+ * Reporta ns por llamada de cada motor y el error de salida del punto fijo respecto del float.
+ * Ademas compara el costo por ciclo de calcular los CANT_PIDS lazos con llamadas a pidCalculate
+ * contra una sola llamada a pidCalculateBatch, verificando que den el mismo resultado.
+ * Los tiempos son del host: en el ESP32 la diferencia depende de la FPU del core.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "main.h"
+#include "control.h"
+#include "PID.h"
+#include "PID_fixed.h"
+
+#define DEFAULT_SAMPLES     20000
+#define DEFAULT_REPS        50
+#define MAX_SAMPLES         1000000
+
+QueueHandle_t mpu6050QueueHandler;
+QueueHandle_t motorControlQueueHandler;
+
+typedef struct {
+    float *input;
+    float *setPoint;
+    uint32_t len;
+} pid_trace_t;
+
+static volatile float sink;                 // evita que el compilador descarte los lazos medidos
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int traceAlloc(pid_trace_t *trace, uint32_t len) {
+    trace->input = calloc(len, sizeof(float));
+    trace->setPoint = calloc(len, sizeof(float));
+    trace->len = 0;
+    return (trace->input && trace->setPoint) ? 0 : -1;
+}
+
+/* Lee t,pitch,setPoint,... de robot_sim --csv */
+static int traceLoadCsv(pid_trace_t *trace, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    if (traceAlloc(trace, MAX_SAMPLES)) {
+        fclose(file);
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) && trace->len < MAX_SAMPLES) {
+        float t, pitch, setPoint;
+        if (sscanf(line, "%f,%f,%f", &t, &pitch, &setPoint) == 3) {
+            trace->input[trace->len] = pitch;
+            trace->setPoint[trace->len] = setPoint;
+            trace->len++;
+        }
+    }
+    fclose(file);
+    if (!trace->len) {
+        fprintf(stderr, "%s: sin muestras validas\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int traceSynthetic(pid_trace_t *trace, uint32_t len) {
+    if (traceAlloc(trace, len)) {
+        return -1;
+    }
+    srand(1);
+    for (uint32_t i = 0; i < len; i++) {
+        double t = i * PERIOD_IMU_MS / 1000.0;
+        double noise = ((double)rand() / RAND_MAX - 0.5) * 0.4;
+        trace->input[i] = (float)(8.0 * exp(-fmod(t, 10.0) / 3.0) * sin(2.0 * M_PI * 1.5 * t) + noise);
+        trace->setPoint[i] = (fmod(t, 20.0) < 10.0) ? 0.0f : 2.0f;
+    }
+    trace->len = len;
+    return 0;
+}
+
+static void runFloat(uint8_t numPid, const pid_trace_t *trace, float *output) {
+    pidClearTerms(numPid);
+    for (uint32_t i = 0; i < trace->len; i++) {
+        pidSetSetPoint(numPid, trace->setPoint[i]);
+        output[i] = pidCalculate(numPid, trace->input[i]);
+    }
+}
+
+static void runFixed(pid_fixed_t *pid, const pid_trace_t *trace, float *output) {
+    pidFixedClearTerms(pid);
+    for (uint32_t i = 0; i < trace->len; i++) {
+        pidFixedSetSetPoint(pid, trace->setPoint[i] / 100.0f);
+        output[i] = pidFixedCalculate(pid, trace->input[i]);
+    }
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --trace FILE     traza de robot_sim --csv (por defecto señal sintetica)\n"
+           "  --samples N      muestras de la señal sintetica (%d)\n"
+           "  --reps N         repeticiones de la medicion de tiempo (%d)\n",
+           prog, DEFAULT_SAMPLES, DEFAULT_REPS);
+}
+
+int main(int argc, char **argv) {
+    const char *tracePath = NULL;
+    uint32_t samples = DEFAULT_SAMPLES;
+    uint32_t reps = DEFAULT_REPS;
+
+    static const struct option options[] = {
+        {"trace",   required_argument, 0, 't'},
+        {"samples", required_argument, 0, 'n'},
+        {"reps",    required_argument, 0, 'r'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:n:r:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 't': tracePath = optarg; break;
+            case 'n': samples = strtoul(optarg, NULL, 10); break;
+            case 'r': reps = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!samples || samples > MAX_SAMPLES || !reps) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    pid_trace_t trace;
+    if (tracePath ? traceLoadCsv(&trace, tracePath) : traceSynthetic(&trace, samples)) {
+        return 1;
+    }
+
+    robot_local_configs_t localConfig = {0};
+    controlLoadDefaultConfig(&localConfig);
+
+    pid_init_t pidConfig;
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pidConfig.sampleTimeInMs[i] = PERIOD_IMU_MS;
+    }
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pidConfig.pids[i] = localConfig.pids[i];
+    }
+    if (pidInit(pidConfig) != ESP_OK) {
+        return 1;
+    }
+
+    float *outFloat = calloc(trace.len, sizeof(float));
+    float *outFixed = calloc(trace.len, sizeof(float));
+    if (!outFloat || !outFixed) {
+        return 1;
+    }
+
+    static const char *pidNames[CANT_PIDS] = {"PID_ANGLE", "PID_POS", "PID_SPEED", "PID_YAW"};
+    printf("%s, %u muestras, periodo %d ms\n", tracePath ? tracePath : "señal sintetica", trace.len, PERIOD_IMU_MS);
+    printf("%-10s %6s %6s %6s %12s %12s %12s %12s\n", "pid", "kp", "ki", "kd", "float ns", "fixed ns", "err max", "err rms");
+
+    int result = 0;
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pid_fixed_t pidFixed;
+        pidFixedSetConstants(&pidFixed, localConfig.pids[i].kp, localConfig.pids[i].ki, localConfig.pids[i].kd,
+                             PERIOD_IMU_MS / 1000.0f);
+        pidSetEnable(i);
+
+        runFloat(i, &trace, outFloat);
+        runFixed(&pidFixed, &trace, outFixed);
+
+        double errMax = 0, errSq = 0;
+        for (uint32_t n = 0; n < trace.len; n++) {
+            double err = fabs((double)outFloat[n] - outFixed[n]);
+            errMax = fmax(errMax, err);
+            errSq += err * err;
+        }
+
+        double start = nowNs();
+        for (uint32_t r = 0; r < reps; r++) {
+            runFloat(i, &trace, outFloat);
+            sink = outFloat[trace.len - 1];
+        }
+        double floatNs = (nowNs() - start) / ((double)reps * trace.len);
+
+        start = nowNs();
+        for (uint32_t r = 0; r < reps; r++) {
+            runFixed(&pidFixed, &trace, outFixed);
+            sink = outFixed[trace.len - 1];
+        }
+        double fixedNs = (nowNs() - start) / ((double)reps * trace.len);
+
+        printf("%-10s %6.2f %6.2f %6.2f %12.2f %12.2f %12.6f %12.6f\n", pidNames[i],
+               localConfig.pids[i].kp, localConfig.pids[i].ki, localConfig.pids[i].kd,
+               floatNs, fixedNs, errMax, sqrt(errSq / trace.len));
+
+        // salida normalizada [-1;1]: un error de 1e-3 ya es un paso de velocidad visible en los motores
+        if (errMax > 1e-3) {
+            result = 2;
+        }
+    }
+
+    // Ciclo completo: los CANT_PIDS lazos habilitados, cada uno con la señal desfasada para que no sean iguales
+    float (*cycleInputs)[CANT_PIDS] = calloc(trace.len, sizeof(*cycleInputs));
+    if (!cycleInputs) {
+        return 1;
+    }
+    for (uint32_t n = 0; n < trace.len; n++) {
+        for (uint8_t i = 0; i < CANT_PIDS; i++) {
+            cycleInputs[n][i] = trace.input[(n + i * 37) % trace.len];
+        }
+    }
+
+    float scalarOut[CANT_PIDS], batchOut[CANT_PIDS];
+    uint32_t mismatches = 0;
+
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pidClearTerms(i);
+    }
+    for (uint32_t n = 0; n < trace.len; n++) {
+        for (uint8_t i = 0; i < CANT_PIDS; i++) {
+            scalarOut[i] = pidCalculate(i, cycleInputs[n][i]);
+        }
+        outFloat[n] = scalarOut[0] + scalarOut[1] + scalarOut[2] + scalarOut[3];
+    }
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pidClearTerms(i);
+    }
+    for (uint32_t n = 0; n < trace.len; n++) {
+        pidCalculateBatch(PID_MASK_ALL, cycleInputs[n], batchOut);
+        outFixed[n] = batchOut[0] + batchOut[1] + batchOut[2] + batchOut[3];
+        mismatches += outFloat[n] != outFixed[n];
+    }
+
+    double start = nowNs();
+    for (uint32_t r = 0; r < reps; r++) {
+        for (uint32_t n = 0; n < trace.len; n++) {
+            for (uint8_t i = 0; i < CANT_PIDS; i++) {
+                scalarOut[i] = pidCalculate(i, cycleInputs[n][i]);
+            }
+            sink = scalarOut[0];
+        }
+    }
+    double scalarNs = (nowNs() - start) / ((double)reps * trace.len);
+
+    start = nowNs();
+    for (uint32_t r = 0; r < reps; r++) {
+        for (uint32_t n = 0; n < trace.len; n++) {
+            pidCalculateBatch(PID_MASK_ALL, cycleInputs[n], batchOut);
+            sink = batchOut[0];
+        }
+    }
+    double batchNs = (nowNs() - start) / ((double)reps * trace.len);
+
+    printf("\nciclo de %d PID: %d x pidCalculate %.2f ns, pidCalculateBatch %.2f ns (%.0f%% menos), %u ciclos distintos\n",
+           CANT_PIDS, CANT_PIDS, scalarNs, batchNs, 100.0 * (scalarNs - batchNs) / scalarNs, mismatches);
+    if (mismatches) {
+        result = 2;
+    }
+
+    free(cycleInputs);
+    free(outFloat);
+    free(outFixed);
+    return result;
+}
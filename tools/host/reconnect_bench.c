@@ -0,0 +1,276 @@
+/*
+ * Tiempo de reconexion: desde que una estacion se asocia al AP (WIFI_EVENT_AP_STACONNECTED, que en
+ * TCP_CLIENT.c llama a tcpClientSocketStart) hasta que la app recibe el primer status.
+ *
+ * El benchmark hace de app en loopback y repite ciclos de desconexion: la estacion se va
+ * (tcpClientSocketStop, se cierra la conexion y el socket de escucha), pasa --off ms sin app, la
+ * estacion vuelve (tcpClientSocketStart) y la app empieza a escuchar --app-delay ms despues, como
+ * el telefono que todavia no tiene IP o la app que no abrio el server. Una tarea que hace de
+ * commsManager envia la configuracion local al conectar y un status cada PERIOD_COMMS_MANAGER_MS.
+ * Verifica ademas que la cantidad de tareas no crezca con las reconexiones.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "comms.h"
+#include "include/TCP_CLIENT.h"
+#include "tcp_client_socket.h"
+
+#define DEFAULT_CYCLES          20
+#define DEFAULT_OFF_MS          700                     // suficiente para que el backoff llegue a TCP_CLIENT_RETRY_MS
+#define DEFAULT_APP_DELAY_MS    0
+#define PERIOD_COMMS_MANAGER_MS 25                      // el de src/main.c
+#define FIRST_STATUS_TIMEOUT_MS 3000
+
+QueueHandle_t newPidParamsQueueHandler;
+QueueHandle_t receiveControlQueueHandler;
+QueueHandle_t newCommandQueueHandler;
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double diff = *(const double *)a - *(const double *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+/* Hace de commsManager: configuracion al conectar y despues un status por ciclo */
+static void feederTask(void *param) {
+    uint8_t lastStateIsConnected = false;
+    uint8_t localConfigPending = false;
+
+    while (true) {
+        if (isTcpClientConnected()) {
+            if (!lastStateIsConnected) {
+                localConfigPending = true;
+            }
+            if (localConfigPending) {
+                robot_local_configs_t config = {0};
+                localConfigPending = !sendLocalConfig(config);
+            }
+            robot_snapshot_t snapshot = {
+                .status.statusCode = STATUS_ROBOT_STABILIZED,
+            };
+            sendDynamicData(&snapshot);
+        }
+        lastStateIsConnected = isTcpClientConnected();
+        vTaskDelay(pdMS_TO_TICKS(PERIOD_COMMS_MANAGER_MS));
+    }
+}
+
+static int listenLoopback(void) {
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PORT),
+    };
+    addr.sin_addr.s_addr = inet_addr(HOST_IP_ADDR);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) || listen(server, 1)) {
+        perror("bind/listen");
+        close(server);
+        return -1;
+    }
+    return server;
+}
+
+static int readExact(int app, void *data, size_t size, double deadlineUs) {
+    uint8_t *dest = data;
+    size_t received = 0;
+    while (received < size) {
+        int timeoutMs = (deadlineUs - nowUs()) / 1000;
+        struct pollfd pfd = {.fd = app, .events = POLLIN};
+        if (timeoutMs <= 0 || poll(&pfd, 1, timeoutMs) != 1) {
+            return -1;
+        }
+        ssize_t len = recv(app, dest + received, size - received, 0);
+        if (len <= 0) {
+            return -1;
+        }
+        received += len;
+    }
+    return 0;
+}
+
+/*
+ * Acepta al robot y lee hasta el primer status, salteando la configuracion local que va antes.
+ * @return socket de la app, -1 si no llego a tiempo
+ */
+static int waitFirstStatus(int server, double startUs, double *connectUs, double *firstStatusUs) {
+    double deadlineUs = startUs + FIRST_STATUS_TIMEOUT_MS * 1000.0;
+    struct pollfd pfd = {.fd = server, .events = POLLIN};
+    if (poll(&pfd, 1, FIRST_STATUS_TIMEOUT_MS) != 1) {
+        return -1;
+    }
+    int app = accept(server, NULL, NULL);
+    if (app < 0) {
+        return -1;
+    }
+    *connectUs = nowUs() - startUs;
+
+    uint16_t header;
+    while (!readExact(app, &header, sizeof(header), deadlineUs)) {
+        uint8_t body[TX_FRAME_SIZE];
+        size_t size;
+        if (header == HEADER_PACKAGE_STATUS) {
+            size = sizeof(robot_dynamic_data_t);
+        }
+        else if (header == HEADER_PACKAGE_LOCAL_CONFIG) {
+            size = sizeof(robot_local_configs_comms_t);
+        }
+        else {
+            break;
+        }
+        if (readExact(app, body, size - sizeof(header), deadlineUs)) {
+            break;
+        }
+        if (header == HEADER_PACKAGE_STATUS) {
+            *firstStatusUs = nowUs() - startUs;
+            return app;
+        }
+    }
+    close(app);
+    return -1;
+}
+
+static void printPercentiles(const char *name, double *valuesUs, uint32_t count) {
+    qsort(valuesUs, count, sizeof(double), compareDouble);
+    printf("%-28s min %6.1f  p50 %6.1f  p90 %6.1f  max %6.1f ms\n", name, valuesUs[0] / 1000,
+           valuesUs[count / 2] / 1000, valuesUs[count * 90 / 100] / 1000, valuesUs[count - 1] / 1000);
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --cycles N       reconexiones a medir (%d)\n"
+           "  --off MS         tiempo sin estacion entre ciclos (%d)\n"
+           "  --app-delay MS   la app empieza a escuchar este tiempo despues de asociarse (%d)\n"
+           "  --log            habilita los ESP_LOGx del firmware\n",
+           prog, DEFAULT_CYCLES, DEFAULT_OFF_MS, DEFAULT_APP_DELAY_MS);
+}
+
+int main(int argc, char **argv) {
+    uint32_t cycles = DEFAULT_CYCLES;
+    uint32_t offMs = DEFAULT_OFF_MS;
+    uint32_t appDelayMs = DEFAULT_APP_DELAY_MS;
+
+    static const struct option options[] = {
+        {"cycles",    required_argument, 0, 'n'},
+        {"off",       required_argument, 0, 'o'},
+        {"app-delay", required_argument, 0, 'a'},
+        {"log",       no_argument,       0, 'l'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:o:a:lh", options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': cycles = strtoul(optarg, NULL, 10); break;
+            case 'o': offMs = strtoul(optarg, NULL, 10); break;
+            case 'a': appDelayMs = strtoul(optarg, NULL, 10); break;
+            case 'l': hostLogEnable = 1; break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!cycles) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    newPidParamsQueueHandler = xQueueCreate(1, sizeof(pid_settings_comms_t));
+    receiveControlQueueHandler = xQueueCreate(1, sizeof(control_app_raw_t));
+    newCommandQueueHandler = xQueueCreate(1, sizeof(command_app_raw_t));
+    tcpClientSocketInit();
+    commsInit();
+    xTaskCreate(feederTask, "feeder", 4096, NULL, 5, NULL);
+
+    // Primera conexion, fuera de la medicion: crea las tareas del socket
+    int server = listenLoopback();
+    if (server < 0) {
+        return 1;
+    }
+    tcpClientSocketStart();
+    double connectUs, firstStatusUs;
+    int app = waitFirstStatus(server, nowUs(), &connectUs, &firstStatusUs);
+    if (app < 0) {
+        fprintf(stderr, "el robot no se conecto\n");
+        return 1;
+    }
+    UBaseType_t baselineTasks = uxTaskGetNumberOfTasks();
+
+    double *connectMs = calloc(cycles, sizeof(double));
+    double *firstStatusMs = calloc(cycles, sizeof(double));
+    if (!connectMs || !firstStatusMs) {
+        return 1;
+    }
+    uint32_t measured = 0, failed = 0;
+    UBaseType_t maxTasks = baselineTasks;
+
+    for (uint32_t i = 0; i < cycles; i++) {
+        // La estacion se va: WIFI_EVENT_AP_STADISCONNECTED y la app desaparece
+        tcpClientSocketStop();
+        close(app);
+        close(server);
+        double leaveUs = nowUs();
+        while (isTcpClientConnected() && nowUs() - leaveUs < FIRST_STATUS_TIMEOUT_MS * 1000.0) {
+            vTaskDelay(1);
+        }
+        vTaskDelay(pdMS_TO_TICKS(offMs));
+
+        // Vuelve: WIFI_EVENT_AP_STACONNECTED, la app escucha appDelayMs despues
+        double startUs = nowUs();
+        tcpClientSocketStart();
+        if (appDelayMs) {
+            vTaskDelay(pdMS_TO_TICKS(appDelayMs));
+        }
+        server = listenLoopback();
+        if (server < 0) {
+            return 1;
+        }
+        app = waitFirstStatus(server, startUs, &connectUs, &firstStatusUs);
+        if (app < 0) {
+            failed++;
+            continue;
+        }
+        connectMs[measured] = connectUs;
+        firstStatusMs[measured] = firstStatusUs;
+        measured++;
+
+        UBaseType_t tasks = uxTaskGetNumberOfTasks();
+        if (tasks > maxTasks) {
+            maxTasks = tasks;
+        }
+    }
+    close(app);
+    close(server);
+
+    printf("%u reconexiones, %u ms sin estacion, app lista %u ms despues de asociarse: %u medidas, %u fallidas\n",
+           cycles, offMs, appDelayMs, measured, failed);
+    if (measured) {
+        printPercentiles("asociacion -> connect", connectMs, measured);
+        printPercentiles("asociacion -> primer status", firstStatusMs, measured);
+    }
+    printf("tareas: %u despues de la primera conexion, maximo %u durante las reconexiones\n",
+           (unsigned)baselineTasks, (unsigned)maxTasks);
+
+    free(connectMs);
+    free(firstStatusMs);
+    return (failed || maxTasks > baselineTasks) ? 2 : 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Caja negra (src/flight_recorder.c): costo de flightRecorderWrite y verificacion de la captura.
+ *
+ * Escribe registros numerados a maxima velocidad para medir ns por registro, despues dispara un
+ * error en medio de la grabacion y verifica que se congela FLIGHT_RECORDER_POST_TRIGGER registros
+ * despues, que la lectura por tramos sale en orden del mas viejo al mas nuevo sin huecos, que un
+ * segundo disparo no pisa al primero y que el rearme vuelve a grabar. Sale con 2 si algo no cuadra.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "flight_recorder.h"
+#include "comms.h"
+
+#define DEFAULT_WRITES      10000000
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fillRecord(flight_record_t *record, uint32_t cycle) {
+    memset(record, 0, sizeof(*record));
+    record->cycle = cycle;
+    record->pitch = (int16_t)cycle;
+    record->roll = (int16_t)(cycle * 3);
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        record->pidOutput[i] = (int16_t)(cycle + i);
+    }
+    record->motorL = (int16_t)~cycle;
+    record->statusCode = STATUS_ROBOT_STABILIZED;
+}
+
+static int checkCapture(uint32_t expectedLast, const char *name) {
+    flight_recorder_info_t info;
+    flightRecorderGetInfo(&info);
+    if (!info.frozen || info.records != FLIGHT_RECORDER_RECORDS) {
+        printf("%s: congelado %d, registros %u (esperados %d)\n", name, info.frozen, info.records, FLIGHT_RECORDER_RECORDS);
+        return -1;
+    }
+
+    // Lectura por tramos, como la descarga por TCP
+    flight_record_t chunk[FLIGHT_RECORDER_CHUNK_RECORDS];
+    uint32_t expected = expectedLast - info.records + 1;
+    for (uint32_t first = 0; first < info.records; first += FLIGHT_RECORDER_CHUNK_RECORDS) {
+        uint16_t count = flightRecorderRead(first, chunk, FLIGHT_RECORDER_CHUNK_RECORDS);
+        for (uint16_t i = 0; i < count; i++, expected++) {
+            flight_record_t reference;
+            fillRecord(&reference, expected);
+            if (memcmp(&reference, &chunk[i], sizeof(reference))) {
+                printf("%s: registro %u con ciclo %u, esperado %u\n", name, first + i, chunk[i].cycle, expected);
+                return -1;
+            }
+        }
+    }
+    printf("%s: %u registros, ciclos %u..%u, disparo %d en ciclo %u\n", name, info.records,
+           expectedLast - info.records + 1, expectedLast, info.triggerReason, info.triggerCycle);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t writes = DEFAULT_WRITES;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n': writes = strtoul(optarg, NULL, 10); break;
+            default:
+                printf("uso: %s [-n escrituras (%d)]\n", argv[0], DEFAULT_WRITES);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    printf("registro: %zu bytes, capacidad: %d registros (%zu KB), post-disparo: %d\n", sizeof(flight_record_t),
+           FLIGHT_RECORDER_RECORDS, sizeof(flight_record_t) * FLIGHT_RECORDER_RECORDS / 1024, FLIGHT_RECORDER_POST_TRIGGER);
+
+    flight_record_t record;
+    uint32_t cycle = 0;
+    double start = nowNs();
+    for (uint32_t i = 0; i < writes; i++) {
+        record.cycle = ++cycle;
+        record.pitch = (int16_t)i;
+        flightRecorderWrite(&record);
+    }
+    printf("flightRecorderWrite: %.2f ns por registro\n", (nowNs() - start) / writes);
+
+    int result = 0;
+
+    // Disparo por error en medio de la grabacion: la captura termina POST_TRIGGER registros despues
+    for (uint32_t i = 0; i < 3 * FLIGHT_RECORDER_RECORDS; i++) {
+        if (i == FLIGHT_RECORDER_RECORDS) {
+            flightRecorderTrigger(FLIGHT_RECORDER_TRIGGER_ERROR_STATUS, STATUS_ROBOT_ERROR_LIMIT_SPEED);
+        }
+        if (i == FLIGHT_RECORDER_RECORDS + 10) {
+            flightRecorderTrigger(FLIGHT_RECORDER_TRIGGER_SAFETY_LIMIT, STATUS_ROBOT_STABILIZED);      // no debe pisar al primero
+        }
+        fillRecord(&record, ++cycle);
+        flightRecorderWrite(&record);
+    }
+    uint32_t firstCycle = cycle - 3 * FLIGHT_RECORDER_RECORDS + 1;
+    if (checkCapture(firstCycle + FLIGHT_RECORDER_RECORDS + FLIGHT_RECORDER_POST_TRIGGER - 1, "error")) {
+        result = 2;
+    }
+
+    // Rearme y pedido de descarga: congela en el ciclo siguiente
+    flightRecorderRearm();
+    for (uint32_t i = 0; i < 2 * FLIGHT_RECORDER_RECORDS; i++) {
+        fillRecord(&record, ++cycle);
+        flightRecorderWrite(&record);
+    }
+    flightRecorderTrigger(FLIGHT_RECORDER_TRIGGER_REQUEST, STATUS_ROBOT_STABILIZED);
+    for (uint32_t i = 0; i < 10; i++) {
+        fillRecord(&record, ++cycle);
+        flightRecorderWrite(&record);
+    }
+    if (checkCapture(cycle - 9, "pedido")) {
+        result = 2;
+    }
+    return result;
+}
@@ -0,0 +1,352 @@
+/*
+ * Simulador host a lazo cerrado del robot.
+ *
+ * Compila src/control.c y src/PID.c tal cual estan en el firmware y los corre contra
+ * un modelo de pendulo invertido sobre ruedas, respetando las mismas colas y cadencias
+ * que las tareas reales (tick de control: muestra -> controlCascadeUpdate -> motores,
+ * mediciones de motores cada 25ms desde commsManager). El tiempo es simulado, no se duerme.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#include "main.h"
+#include "control.h"
+#include "comms.h"
+#include "PID.h"
+#include "flight_recorder.h"
+
+#define SIM_GRAVITY             9.81
+#define SIM_STEP_S              0.0005                  // paso de integracion de la planta
+#define SIM_COMMS_PERIOD_MS     25                      // vTaskDelay de commsManager
+#define SIM_FALLEN_DEG          80.0
+
+// Parametros de planta no medidos: estimados para que las ganancias de controlLoadDefaultConfig equilibren
+#if defined(HARDWARE_S3)
+    #define SIM_HW_NAME                 "HARDWARE_S3"
+    #define SIM_COM_HEIGHT_M            0.45                                // largo efectivo del pendulo
+    #define SIM_MOTOR_TAU_S             0.1                                 // respuesta del lazo de velocidad de la MCB
+    #define SIM_MAX_WHEEL_SPEED         (1000.0 * DIST_PER_REV / 60.0)      // comando de la MCB en rpm
+#else
+    #define SIM_HW_NAME                 "HARDWARE_PROTOTYPE"
+    #define SIM_COM_HEIGHT_M            0.08
+    #define SIM_MOTOR_TAU_S             0.03
+    #define SIM_MAX_WHEEL_SPEED         4.0
+#endif
+#define SIM_TRACK_WIDTH_M               (DIST_PER_REV / M_PI)               // separacion entre ruedas ~ diametro de rueda
+
+#define SIM_STR_(x)     #x
+#define SIM_STR(x)      SIM_STR_(x)
+
+QueueHandle_t mpu6050QueueHandler;
+QueueHandle_t motorControlQueueHandler;
+
+typedef struct {
+    double theta;           // inclinacion real respecto del equilibrio [rad], positiva hacia adelante
+    double omega;           // [rad/s]
+    double velL;            // velocidad lineal de cada rueda [m/s]
+    double velR;
+    double travelL;         // recorrido de cada rueda [m]
+    double travelR;
+    double yaw;             // [rad]
+    double cmdL;            // comando aplicado por el driver de motores [m/s]
+    double cmdR;
+} plant_state_t;
+
+typedef struct {
+    double seconds;
+    double pushDeg;
+    double pushAt;
+    double settleBandDeg;
+    double noiseDeg;
+    uint32_t imuPeriodMs;
+    float kp, ki, kd;
+    uint8_t overrideGains;
+    double comHeight;
+    double motorTau;
+    double maxWheelSpeed;
+    const char *csvPath;
+} sim_config_t;
+
+static uint32_t noiseSeed = 0x12345678;
+
+static double noise(double amplitude) {
+    noiseSeed = noiseSeed * 1664525u + 1013904223u;
+    return amplitude * ((double)(noiseSeed >> 8) / (double)(1u << 24) * 2.0 - 1.0);
+}
+
+static double cmdToVelocity(const sim_config_t *config, int16_t command) {
+    return command * (config->maxWheelSpeed / 1000.0);
+}
+
+static int32_t travelToSteps(double travel) {
+    return (int32_t)lround((travel / DIST_PER_REV) * STEPS_PER_REV);
+}
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void plantStep(plant_state_t *plant, const sim_config_t *config, double dt) {
+    double accL = (plant->cmdL - plant->velL) / config->motorTau;
+    double accR = (plant->cmdR - plant->velR) / config->motorTau;
+    double acc = (accL + accR) / 2.0;
+
+    // Pendulo sobre carro con velocidad comandada: la aceleracion de las ruedas endereza el pendulo
+    double alpha = (SIM_GRAVITY * sin(plant->theta) + acc * cos(plant->theta)) / config->comHeight;
+
+    if (fabs(plant->theta) * 180.0 / M_PI >= SIM_FALLEN_DEG) {
+        alpha = 0;
+        plant->omega = 0;
+    }
+
+    plant->omega += alpha * dt;
+    plant->theta += plant->omega * dt;
+    plant->velL += accL * dt;
+    plant->velR += accR * dt;
+    plant->travelL += plant->velL * dt;
+    plant->travelR += plant->velR * dt;
+    plant->yaw += ((plant->velL - plant->velR) / SIM_TRACK_WIDTH_M) * dt;
+}
+
+static void usage(const char *name) {
+    printf("Uso: %s [opciones]\n"
+           "  --seconds S      tiempo simulado (10)\n"
+           "  --push DEG       perturbacion de inclinacion aplicada (1)\n"
+           "  --push-at S      instante de la perturbacion (2)\n"
+           "  --band DEG       banda de establecimiento (0.5)\n"
+           "  --noise DEG      ruido uniforme sobre el pitch medido (0)\n"
+           "  --imu-ms MS      periodo del tick de control (" SIM_STR(PERIOD_IMU_MS) ")\n"
+           "  --com-height M   largo efectivo del pendulo (" SIM_STR(SIM_COM_HEIGHT_M) ")\n"
+           "  --motor-tau S    constante de tiempo de los motores (" SIM_STR(SIM_MOTOR_TAU_S) ")\n"
+           "  --wheel-speed V  velocidad de rueda con comando 1000 [m/s]\n"
+           "  --kp/--ki/--kd   constantes de PID_ANGLE, ki y kd por segundo (por defecto las de controlLoadDefaultConfig)\n"
+           "  --csv FILE       traza por muestra de IMU\n"
+           "  --verbose        habilita los ESP_LOG del firmware\n", name);
+}
+
+static int parseArgs(int argc, char **argv, sim_config_t *config) {
+    static struct option options[] = {
+        {"seconds", required_argument, 0, 's'},
+        {"push",    required_argument, 0, 'p'},
+        {"push-at", required_argument, 0, 'a'},
+        {"band",    required_argument, 0, 'b'},
+        {"noise",   required_argument, 0, 'n'},
+        {"imu-ms",  required_argument, 0, 'i'},
+        {"kp",      required_argument, 0, 'P'},
+        {"ki",      required_argument, 0, 'I'},
+        {"kd",      required_argument, 0, 'D'},
+        {"com-height", required_argument, 0, 'L'},
+        {"motor-tau", required_argument, 0, 'T'},
+        {"wheel-speed", required_argument, 0, 'W'},
+        {"csv",     required_argument, 0, 'c'},
+        {"verbose", no_argument,       0, 'v'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': config->seconds = atof(optarg); break;
+            case 'p': config->pushDeg = atof(optarg); break;
+            case 'a': config->pushAt = atof(optarg); break;
+            case 'b': config->settleBandDeg = atof(optarg); break;
+            case 'n': config->noiseDeg = atof(optarg); break;
+            case 'i': config->imuPeriodMs = atoi(optarg); break;
+            case 'P': config->kp = atof(optarg); config->overrideGains |= 1; break;
+            case 'I': config->ki = atof(optarg); config->overrideGains |= 2; break;
+            case 'D': config->kd = atof(optarg); config->overrideGains |= 4; break;
+            case 'L': config->comHeight = atof(optarg); break;
+            case 'T': config->motorTau = atof(optarg); break;
+            case 'W': config->maxWheelSpeed = atof(optarg); break;
+            case 'c': config->csvPath = optarg; break;
+            case 'v': hostLogEnable = 1; break;
+            default: usage(argv[0]); return -1;
+        }
+    }
+    if (config->imuPeriodMs == 0 || config->seconds <= 0 || config->comHeight <= 0 || config->motorTau <= 0 || config->maxWheelSpeed <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    sim_config_t config = {
+        .seconds = 10.0,
+        .pushDeg = 1.0,
+        .pushAt = 2.0,
+        .settleBandDeg = 0.5,
+        .imuPeriodMs = PERIOD_IMU_MS,
+        .comHeight = SIM_COM_HEIGHT_M,
+        .motorTau = SIM_MOTOR_TAU_S,
+        .maxWheelSpeed = SIM_MAX_WHEEL_SPEED,
+    };
+    if (parseArgs(argc, argv, &config)) {
+        return 1;
+    }
+
+    // Misma secuencia de arranque que app_main
+    setStatusRobot(STATUS_ROBOT_INIT);
+    mpu6050QueueHandler = xQueueCreate(1, sizeof(vector_queue_t));
+    motorControlQueueHandler = xQueueCreate(1, sizeof(output_motors_t));
+
+    controlLoadDefaultConfig(&statusRobot.localConfig);
+    if (config.overrideGains & 1) statusRobot.localConfig.pids[PID_ANGLE].kp = config.kp;
+    if (config.overrideGains & 2) statusRobot.localConfig.pids[PID_ANGLE].ki = config.ki;
+    if (config.overrideGains & 4) statusRobot.localConfig.pids[PID_ANGLE].kd = config.kd;
+
+    pid_init_t pidConfig;
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pidConfig.sampleTimeInMs[i] = controlGetPidPeriodMs(i);
+    }
+    pidConfig.sampleTimeInMs[PID_ANGLE] = config.imuPeriodMs;
+    memcpy(pidConfig.pids, statusRobot.localConfig.pids, sizeof(pidConfig.pids));
+    if (pidInit(pidConfig) != ESP_OK) {
+        fprintf(stderr, "pidInit fallo\n");
+        return 1;
+    }
+    setStatusRobot(STATUS_ROBOT_ARMED);
+
+    FILE *csv = NULL;
+    if (config.csvPath) {
+        csv = fopen(config.csvPath, "w");
+        if (!csv) {
+            perror(config.csvPath);
+            return 1;
+        }
+        fprintf(csv, "t,pitch,setPoint,motorL,motorR,posCms,status\n");
+    }
+
+    plant_state_t plant = {0};
+    const float centerAngle = statusRobot.localConfig.centerAngle;
+    const uint64_t totalSteps = (uint64_t)(config.seconds / SIM_STEP_S);
+    const uint64_t pushStep = (uint64_t)(config.pushAt / SIM_STEP_S);
+    const uint64_t imuSteps = (uint64_t)llround(config.imuPeriodMs / 1000.0 / SIM_STEP_S);
+    const uint64_t commsSteps = (uint64_t)llround(SIM_COMMS_PERIOD_MS / 1000.0 / SIM_STEP_S);
+
+    uint64_t tickNs = 0, tickCalls = 0;
+    double peakDeg = 0, overshootDeg = 0, lastOutsideBand = -1;
+    int8_t pushSign = config.pushDeg >= 0 ? 1 : -1;
+    uint8_t fell = false, stabilizedBeforePush = false;
+
+    uint64_t wallStart = nowNs();
+
+    for (uint64_t step = 0; step < totalSteps; step++) {
+        double t = step * SIM_STEP_S;
+
+        if (step == pushStep) {
+            stabilizedBeforePush = statusRobot.statusCode == STATUS_ROBOT_STABILIZED;
+            plant.theta += config.pushDeg * M_PI / 180.0;
+        }
+
+        if (step % imuSteps == 0) {
+            double yawDeg = fmod(plant.yaw * 180.0 / M_PI + 180.0, 360.0);
+            vector_queue_t sample = {
+                .pitch = plant.theta * 180.0 / M_PI + centerAngle + noise(config.noiseDeg),
+                .roll = 0,
+                .yaw = (yawDeg < 0 ? yawDeg + 360.0 : yawDeg) - 180.0,
+                .temp = 30,
+            };
+            xQueueSend(mpu6050QueueHandler, &sample, 0);
+
+            // Mismo orden que controlTickHandler: muestra, lazo de angulo y salida a motores
+            vector_queue_t newAngles;
+            if (xQueueReceive(mpu6050QueueHandler, &newAngles, 0)) {
+                uint64_t start = nowNs();
+                controlCascadeUpdate(&newAngles);
+                tickNs += nowNs() - start;
+                tickCalls++;
+            }
+            xQueueOverwrite(motorControlQueueHandler, &speedMotors);
+
+            output_motors_t newVel;
+            if (xQueueReceive(motorControlQueueHandler, &newVel, 0)) {
+                plant.cmdL = newVel.enable ? cmdToVelocity(&config, newVel.motorL) : 0;
+                plant.cmdR = newVel.enable ? cmdToVelocity(&config, newVel.motorR) : 0;
+            }
+
+            if (csv) {
+                fprintf(csv, "%.4f,%.4f,%.4f,%d,%d,%.3f,%d\n", t, newAngles.pitch,
+                        statusRobot.localConfig.pids[PID_ANGLE].setPoint,
+                        speedMotors.motorL, speedMotors.motorR, statusRobot.actualDistInCms, statusRobot.statusCode);
+            }
+        }
+
+        if (step % commsSteps == 0) {
+            // Equivalente a commsManager: mediciones de la MCB/steppers
+            statusRobot.posInMetersL = pos2mts(travelToSteps(-plant.travelL));
+            statusRobot.posInMetersR = pos2mts(travelToSteps(-plant.travelR));
+        }
+
+        plantStep(&plant, &config, SIM_STEP_S);
+
+        double thetaDeg = plant.theta * 180.0 / M_PI;
+        if (fabs(thetaDeg) >= SIM_FALLEN_DEG) {
+            fell = true;
+        }
+        if (step >= pushStep) {
+            if (fabs(thetaDeg) > peakDeg) {
+                peakDeg = fabs(thetaDeg);
+            }
+            if (thetaDeg * pushSign < -overshootDeg) {
+                overshootDeg = -thetaDeg * pushSign;
+            }
+            if (fabs(thetaDeg) > config.settleBandDeg) {
+                lastOutsideBand = t;
+            }
+        }
+    }
+
+    double wallSec = (nowNs() - wallStart) / 1e9;
+    if (csv) {
+        fclose(csv);
+    }
+
+    printf("Hardware: %s, tick: %ums, PID_ANGLE kp: %.2f ki: %.2f kd: %.3f\n",
+           SIM_HW_NAME, config.imuPeriodMs,
+           statusRobot.localConfig.pids[PID_ANGLE].kp, statusRobot.localConfig.pids[PID_ANGLE].ki,
+           statusRobot.localConfig.pids[PID_ANGLE].kd);
+    printf("Perturbacion: %.2f deg en t=%.2fs, estabilizado antes: %s\n",
+           config.pushDeg, config.pushAt, stabilizedBeforePush ? "si" : "no");
+
+    double settleTime = lastOutsideBand < config.pushAt ? 0 : lastOutsideBand - config.pushAt;
+    uint8_t settled = !fell && lastOutsideBand < config.seconds - 10 * config.imuPeriodMs / 1000.0;
+    if (settled) {
+        printf("Establecimiento (+-%.2f deg): %.3f s\n", config.settleBandDeg, settleTime);
+    }
+    else {
+        printf("Establecimiento (+-%.2f deg): no establece\n", config.settleBandDeg);
+    }
+    printf("Pico: %.2f deg, sobrepico: %.2f deg (%.1f%%)\n", peakDeg, overshootDeg,
+           config.pushDeg != 0 ? 100.0 * overshootDeg / fabs(config.pushDeg) : 0.0);
+    printf("Estado final: %d%s, posicion: %.1f cms\n", statusRobot.statusCode, fell ? " (CAIDO)" : "",
+           statusRobot.actualDistInCms);
+    printf("Costo por tick: controlCascadeUpdate %.1f ns\n", tickCalls ? (double)tickNs / tickCalls : 0.0);
+
+    control_stage_stats_t stageStats[CONTROL_STAGES_COUNT];
+    controlGetStageStats(stageStats);
+    for (uint8_t i = 0; i < CONTROL_STAGES_COUNT; i++) {
+        printf("  etapa %-6s cada %u ticks: %u ciclos calculados, latencia max %u us\n", stageStats[i].name,
+               stageStats[i].decimation, stageStats[i].runs, stageStats[i].maxLatencyUs);
+    }
+    flight_recorder_info_t recorder;
+    flightRecorderGetInfo(&recorder);
+    printf("Caja negra: %u registros, %s", recorder.records, recorder.frozen ? "congelada" : "grabando");
+    if (recorder.triggerReason != FLIGHT_RECORDER_TRIGGER_NONE) {
+        printf(", disparo %d (estado %d) en ciclo %u", recorder.triggerReason, recorder.triggerStatus, recorder.triggerCycle);
+    }
+    printf("\n");
+    printf("Tiempo real: %.3f s para %.1f s simulados (x%.0f)\n", wallSec, config.seconds, config.seconds / wallSec);
+
+    return settled ? 0 : 2;
+}
@@ -0,0 +1,111 @@
+/*
+ * Carga del snapshot de estado (src/robot_snapshot.c) desde varios hilos.
+ *
+ * Un escritor publica a maxima velocidad snapshots donde todos los campos derivan del mismo
+ * numero de ciclo, y varios lectores verifican que cada copia leida pertenece a un unico ciclo.
+ * Reporta lecturas por segundo, reintentos y snapshots mezclados (debe ser 0).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "robot_snapshot.h"
+
+#define DEFAULT_READERS     4
+#define DEFAULT_SECONDS     2
+
+static atomic_int running = 1;
+static atomic_ulong tornCount;
+static atomic_ulong staleCount;         // ciclos que retroceden para un mismo lector
+
+static void fillSnapshot(robot_snapshot_t *snapshot, uint32_t cycle) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->cycle = cycle;
+    snapshot->status.actualPitch = (float)(cycle & 0xffff);
+    snapshot->status.actualRoll = -(float)(cycle & 0xffff);
+    snapshot->status.actualYaw = (float)(cycle & 0xff);
+    snapshot->status.speedL = (int16_t)cycle;
+    snapshot->status.speedR = (int16_t)~cycle;
+    snapshot->status.statusCode = (uint16_t)(cycle >> 3);
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        snapshot->status.localConfig.pids[i].setPoint = (float)((cycle + i) & 0xffff);
+    }
+    snapshot->speedMotors.motorL = (int16_t)cycle;
+    snapshot->speedMotors.motorR = (int16_t)(cycle * 3);
+    snapshot->attitudeControlMotor.motorL = (int16_t)(cycle * 5);
+}
+
+static int isConsistent(const robot_snapshot_t *snapshot) {
+    robot_snapshot_t expected;
+    fillSnapshot(&expected, snapshot->cycle);
+    return memcmp(&expected, snapshot, sizeof(expected)) == 0;
+}
+
+static void *writerThread(void *arg) {
+    robot_snapshot_t snapshot;
+    uint32_t cycle = 0;
+    while (atomic_load(&running)) {
+        fillSnapshot(&snapshot, ++cycle);
+        robotSnapshotPublish(&snapshot);
+    }
+    return NULL;
+}
+
+static void *readerThread(void *arg) {
+    robot_snapshot_t snapshot;
+    uint32_t lastCycle = 0;
+    while (atomic_load(&running)) {
+        robotSnapshotRead(&snapshot);
+        if (!isConsistent(&snapshot)) {
+            atomic_fetch_add(&tornCount, 1);
+        }
+        if (snapshot.cycle < lastCycle) {
+            atomic_fetch_add(&staleCount, 1);
+        }
+        lastCycle = snapshot.cycle;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int readers = argc > 1 ? atoi(argv[1]) : DEFAULT_READERS;
+    int seconds = argc > 2 ? atoi(argv[2]) : DEFAULT_SECONDS;
+    if (readers <= 0 || seconds <= 0) {
+        printf("Uso: %s [lectores] [segundos]\n", argv[0]);
+        return 1;
+    }
+
+    robot_snapshot_t first;
+    fillSnapshot(&first, 0);
+    robotSnapshotPublish(&first);
+
+    pthread_t writer;
+    pthread_t *readerThreads = calloc(readers, sizeof(pthread_t));
+    pthread_create(&writer, NULL, writerThread, NULL);
+    for (int i = 0; i < readers; i++) {
+        pthread_create(&readerThreads[i], NULL, readerThread, NULL);
+    }
+
+    sleep(seconds);
+    atomic_store(&running, 0);
+    pthread_join(writer, NULL);
+    for (int i = 0; i < readers; i++) {
+        pthread_join(readerThreads[i], NULL);
+    }
+    free(readerThreads);
+
+    robot_snapshot_stats_t stats;
+    robotSnapshotGetStats(&stats);
+    printf("Snapshot de %zu bytes, %d lectores, %d s\n", sizeof(robot_snapshot_t), readers, seconds);
+    printf("Publicaciones: %.2f M/s, lecturas: %.2f M/s, reintentos: %.3f%%\n",
+           stats.publishes / 1e6 / seconds, stats.reads / 1e6 / seconds,
+           stats.reads ? 100.0 * stats.readRetries / stats.reads : 0.0);
+    printf("Snapshots mezclados: %lu, retrocesos de ciclo: %lu\n",
+           (unsigned long)atomic_load(&tornCount), (unsigned long)atomic_load(&staleCount));
+
+    return atomic_load(&tornCount) || atomic_load(&staleCount) ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef __HOST_DRIVER_GPIO_H__
+#define __HOST_DRIVER_GPIO_H__
+
+// Reemplazo host de driver/gpio.h, las salidas se registran en hostGpioLevel
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define HOST_GPIO_COUNT     64
+
+typedef int gpio_num_t;
+
+extern uint8_t hostGpioLevel[HOST_GPIO_COUNT];
+
+static inline esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level) {
+    if (gpio < 0 || gpio >= HOST_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hostGpioLevel[gpio] = level;
+    return ESP_OK;
+}
+
+static inline int gpio_get_level(gpio_num_t gpio) {
+    if (gpio < 0 || gpio >= HOST_GPIO_COUNT) {
+        return 0;
+    }
+    return hostGpioLevel[gpio];
+}
+
+#endif
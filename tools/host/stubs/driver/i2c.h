@@ -0,0 +1,56 @@
+#ifndef __HOST_DRIVER_I2C_H__
+#define __HOST_DRIVER_I2C_H__
+
+// Reemplazo host del driver I2C legacy sobre el bus falso de host_i2c.c: la llamada bloquea hasta que
+// la transaccion termina de salir por el bus, como i2c_master_cmd_begin
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0                   0
+#define I2C_MODE_MASTER             1
+#define GPIO_PULLUP_ENABLE          1
+#define I2C_SCLK_SRC_FLAG_FOR_NOMAL 0
+#define ESP_INTR_FLAG_IRAM          (1 << 10)
+
+typedef struct {
+    int mode;
+    int sda_io_num;
+    int scl_io_num;
+    int sda_pullup_en;
+    int scl_pullup_en;
+    struct {
+        uint32_t clk_speed;
+    } master;
+    uint32_t clk_flags;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config);
+esp_err_t i2c_driver_install(i2c_port_t port, int mode, size_t rxBufLen, size_t txBufLen, int intrAllocFlags);
+esp_err_t i2c_driver_delete(i2c_port_t port);
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t address, const uint8_t *writeBuffer, size_t writeSize,
+                                       uint8_t *readBuffer, size_t readSize, TickType_t ticksToWait);
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t address, const uint8_t *writeBuffer, size_t writeSize,
+                                     TickType_t ticksToWait);
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t address, uint8_t *readBuffer, size_t readSize,
+                                      TickType_t ticksToWait);
+
+/*
+ * Dispositivo simulado en una direccion: transfer recibe lo escrito y llena lo leido al empezar la
+ * transaccion, devuelve false para responder NACK
+ */
+typedef struct {
+    bool (*transfer)(void *ctx, const uint8_t *tx, size_t txLen, uint8_t *rx, size_t rxLen);
+    void *ctx;
+} host_i2c_device_t;
+
+void hostI2cAttach(uint8_t address, const host_i2c_device_t *device);
+void hostI2cSetNackRate(double rate);              // fraccion de transacciones que fallan con NACK
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __HOST_DRIVER_I2C_MASTER_H__
+#define __HOST_DRIVER_I2C_MASTER_H__
+
+// Reemplazo host de i2c_master (ESP-IDF >= 5.2) sobre el bus falso de host_i2c.c. Con callback
+// registrado las transacciones vuelven enseguida y el callback corre en el hilo del bus, como en la ISR
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+
+typedef struct host_i2c_bus_s *i2c_master_bus_handle_t;
+typedef struct host_i2c_dev_s *i2c_master_dev_handle_t;
+
+typedef enum {
+    I2C_CLK_SRC_DEFAULT,
+} i2c_clock_source_t;
+
+typedef enum {
+    I2C_ADDR_BIT_LEN_7,
+} i2c_addr_bit_len_t;
+
+typedef struct {
+    i2c_port_t i2c_port;
+    gpio_num_t sda_io_num;
+    gpio_num_t scl_io_num;
+    i2c_clock_source_t clk_source;
+    uint8_t glitch_ignore_cnt;
+    int intr_priority;
+    size_t trans_queue_depth;
+    struct {
+        uint32_t enable_internal_pullup: 1;
+    } flags;
+} i2c_master_bus_config_t;
+
+typedef struct {
+    i2c_addr_bit_len_t dev_addr_length;
+    uint16_t device_address;
+    uint32_t scl_speed_hz;
+} i2c_device_config_t;
+
+typedef enum {
+    I2C_EVENT_ALIVE,
+    I2C_EVENT_DONE,
+    I2C_EVENT_NACK,
+} i2c_master_event_t;
+
+typedef struct {
+    i2c_master_event_t event;
+} i2c_master_event_data_t;
+
+typedef bool (*i2c_master_callback_t)(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *eventData, void *arg);
+
+typedef struct {
+    i2c_master_callback_t on_trans_done;
+} i2c_master_event_callbacks_t;
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config, i2c_master_bus_handle_t *retBus);
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *retDev);
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t dev, const i2c_master_event_callbacks_t *callbacks,
+                                              void *userData);
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *writeBuffer, size_t writeSize,
+                                      uint8_t *readBuffer, size_t readSize, int timeoutMs);
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *writeBuffer, size_t writeSize, int timeoutMs);
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus, int timeoutMs);
+
+#endif
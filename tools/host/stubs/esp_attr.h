@@ -0,0 +1,9 @@
+#ifndef __HOST_ESP_ATTR_H__
+#define __HOST_ESP_ATTR_H__
+
+// Reemplazo host: sin secciones de memoria especiales
+
+#define IRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __HOST_ESP_CPU_H__
+#define __HOST_ESP_CPU_H__
+
+// Reemplazo host del contador de ciclos: un "ciclo" por ns de CLOCK_MONOTONIC
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint32_t esp_cpu_get_cycle_count(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __HOST_ESP_IDF_VERSION_H__
+#define __HOST_ESP_IDF_VERSION_H__
+
+// Reemplazo host: se declara el IDF mas nuevo que soportan los stubs (i2c_master asincronico)
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch)    (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION                             ESP_IDF_VERSION_VAL(5, 2, 0)
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+// Reemplazo host de esp_log.h, los logs se habilitan con hostLogEnable
+
+#include <stdio.h>
+
+extern int hostLogEnable;
+
+#define HOST_LOG(level, tag, format, ...) do {                              \
+        if (hostLogEnable) {                                                \
+            printf(level " (%s): " format "\n", tag, ##__VA_ARGS__);        \
+        }                                                                   \
+    } while(0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG("D", tag, format, ##__VA_ARGS__)
+
+#endif
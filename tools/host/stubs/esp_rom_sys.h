@@ -0,0 +1,12 @@
+#ifndef __HOST_ESP_ROM_SYS_H__
+#define __HOST_ESP_ROM_SYS_H__
+
+// Reemplazo host: el contador de ciclos de esp_cpu.h cuenta ns
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_get_cpu_ticks_per_us(void) {
+    return 1000;
+}
+
+#endif
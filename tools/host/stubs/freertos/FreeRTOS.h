@@ -0,0 +1,38 @@
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+// Reemplazo host de FreeRTOS: 1 tick = 1 ms, las esperas usan el reloj del sistema
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_FULL           0
+
+#define configTICK_RATE_HZ      1000
+#define configMAX_PRIORITIES    25
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+// Secciones criticas de ESP-IDF (spinlock entre cores), un mutex en el host
+typedef struct {
+    pthread_mutex_t lock;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    {PTHREAD_MUTEX_INITIALIZER}
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(&(mux)->lock)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(&(mux)->lock)
+
+#define PRO_CPU_NUM             0
+#define APP_CPU_NUM             1
+
+#endif
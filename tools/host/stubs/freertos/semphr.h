@@ -0,0 +1,23 @@
+#ifndef __HOST_FREERTOS_SEMPHR_H__
+#define __HOST_FREERTOS_SEMPHR_H__
+
+// Reemplazo host de semaforos binarios: como en FreeRTOS, una cola de largo 1 sin datos
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary()                    xQueueCreate(1, 0)
+#define vSemaphoreDelete(sem)                       vQueueDelete(sem)
+#define xSemaphoreGive(sem)                         xQueueSend((sem), NULL, 0)
+#define xSemaphoreTake(sem, ticks)                  xQueueReceive((sem), NULL, (ticks))
+#define xSemaphoreGiveFromISR(sem, woken)           hostSemaphoreGiveFromISR((sem), (woken))
+
+static inline BaseType_t hostSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higherPriorityTaskWoken) {
+    if (higherPriorityTaskWoken) {
+        *higherPriorityTaskWoken = pdTRUE;
+    }
+    return xQueueSend(sem, NULL, 0);
+}
+
+#endif
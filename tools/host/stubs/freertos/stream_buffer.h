@@ -0,0 +1,19 @@
+#ifndef __HOST_FREERTOS_STREAM_BUFFER_H__
+#define __HOST_FREERTOS_STREAM_BUFFER_H__
+
+// Reemplazo host de los stream buffers: un lector bloqueado se despierta al llegar al trigger level
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_stream_buffer_s *StreamBufferHandle_t;
+
+StreamBufferHandle_t xStreamBufferCreate(size_t size, size_t triggerLevel);
+void vStreamBufferDelete(StreamBufferHandle_t buffer);
+size_t xStreamBufferSend(StreamBufferHandle_t buffer, const void *data, size_t len, TickType_t ticksToWait);
+size_t xStreamBufferReceive(StreamBufferHandle_t buffer, void *data, size_t len, TickType_t ticksToWait);
+size_t xStreamBufferSpacesAvailable(StreamBufferHandle_t buffer);
+size_t xStreamBufferBytesAvailable(StreamBufferHandle_t buffer);
+BaseType_t xStreamBufferIsFull(StreamBufferHandle_t buffer);
+BaseType_t xStreamBufferReset(StreamBufferHandle_t buffer);
+
+#endif
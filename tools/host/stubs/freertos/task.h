@@ -0,0 +1,27 @@
+#ifndef __HOST_FREERTOS_TASK_H__
+#define __HOST_FREERTOS_TASK_H__
+
+// Reemplazo host de tareas y notificaciones: cada tarea es un pthread, sin prioridades ni afinidad de core
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task_s *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t coreId);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+
+#define xTaskCreate(function, name, stack, parameters, priority, created) \
+        xTaskCreatePinnedToCore(function, name, stack, parameters, priority, created, -1)
+#define portYIELD_FROM_ISR()
+
+#endif
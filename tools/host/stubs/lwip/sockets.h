@@ -0,0 +1,15 @@
+#ifndef __HOST_LWIP_SOCKETS_H__
+#define __HOST_LWIP_SOCKETS_H__
+
+// Reemplazo host de lwip/sockets.h: la API de lwIP es la de sockets BSD, se usa la del sistema
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * Latencia de ida y vuelta de un comando por el camino TCP del firmware, sobre loopback.
+ *
+ * El benchmark hace de app: escucha en 127.0.0.1:PORT y espera que se conecte la tarea de
+ * tcp_client_socket.c, igual que el robot se conecta a la app. Cada comando va entramado
+ * (comms_frame.h) y lo recibe communicationHandler de src/comms.c, que lo deja en
+ * newCommandQueueHandler. Una tarea que hace de commsManager lo toma de la cola y responde
+ * con sendDynamicData, con el valor del comando en statusCode para emparejar la respuesta.
+ * La RTT medida es la del transporte: en el firmware se suma la espera de commsManager
+ * (PERIOD_COMMS_MANAGER_MS) hasta que lee la cola.
+ * Despues pide una rafaga de status seguidos, mas rapido de lo que el socket los saca, con una
+ * configuracion local intercalada cada BURST_CONFIG_EVERY, para forzar las clases del pool de
+ * transmision (tx_frame_pool.h): los status pendientes se reemplazan por el mas nuevo y se cuentan,
+ * las configuraciones tienen que llegar todas y en orden, y nada puede llegar cortado.
+ * Al final cierra la conexion y mide cuanto tarda el robot en darse cuenta.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "comms.h"
+#include "comms_frame.h"
+#include "tx_frame_pool.h"
+#include "include/TCP_CLIENT.h"
+#include "tcp_client_socket.h"
+
+#define DEFAULT_COUNT           500
+#define DEFAULT_INTERVAL_MS     5
+#define REPLY_TIMEOUT_MS        1000
+#define ACCEPT_TIMEOUT_MS       5000
+#define DEFAULT_BURST           256
+#define BURST_COMMAND           COMMAND_MOVE_FORWARD    // el responder no lo ejecuta, pide la rafaga
+#define BURST_STATUS_BASE       0x8000                  // statusCode de la rafaga, no choca con los de la RTT
+#define BURST_IDLE_MS           200
+#define BURST_CONFIG_EVERY      16                      // una configuracion local (clase confiable) cada tantos status
+
+QueueHandle_t newPidParamsQueueHandler;
+QueueHandle_t receiveControlQueueHandler;
+QueueHandle_t newCommandQueueHandler;
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double diff = *(const double *)a - *(const double *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+/* Hace de commsManager: responde cada comando en cuanto sale de la cola */
+static void responderTask(void *param) {
+    command_app_raw_t command;
+    while (true) {
+        if (!xQueueReceive(newCommandQueueHandler, &command, portMAX_DELAY)) {
+            continue;
+        }
+        if (command.command == BURST_COMMAND) {
+            for (uint16_t i = 0; i < (uint16_t)command.value; i++) {
+                robot_snapshot_t snapshot = {
+                    .status.statusCode = BURST_STATUS_BASE + i,
+                };
+                sendDynamicData(&snapshot);
+                if (i % BURST_CONFIG_EVERY == 0) {
+                    robot_local_configs_t config = {
+                        .safetyLimits = i / BURST_CONFIG_EVERY,
+                    };
+                    while (!sendLocalConfig(config)) {
+                        vTaskDelay(1);                  // como commsManager, reintenta en el proximo ciclo
+                    }
+                }
+            }
+            continue;
+        }
+        robot_snapshot_t snapshot = {
+            .status.statusCode = (uint16_t)command.value,
+        };
+        sendDynamicData(&snapshot);
+    }
+}
+
+static int listenLoopback(void) {
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PORT),
+    };
+    addr.sin_addr.s_addr = inet_addr(HOST_IP_ADDR);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) || listen(server, 1)) {
+        perror("bind/listen");
+        close(server);
+        return -1;
+    }
+    return server;
+}
+
+static int acceptRobot(int server) {
+    struct pollfd pfd = {.fd = server, .events = POLLIN};
+    if (poll(&pfd, 1, ACCEPT_TIMEOUT_MS) != 1) {
+        fprintf(stderr, "el robot no se conecto en %d ms\n", ACCEPT_TIMEOUT_MS);
+        return -1;
+    }
+    int app = accept(server, NULL, NULL);
+    if (app < 0) {
+        perror("accept");
+        return -1;
+    }
+    int noDelay = 1;
+    setsockopt(app, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return app;
+}
+
+/* Lee exactamente size bytes, -1 si vence el timeout */
+static int readExact(int app, void *data, size_t size, int timeoutMs) {
+    uint8_t *dest = data;
+    size_t received = 0;
+    while (received < size) {
+        struct pollfd pfd = {.fd = app, .events = POLLIN};
+        if (poll(&pfd, 1, timeoutMs) != 1) {
+            return -1;
+        }
+        ssize_t len = recv(app, dest + received, size - received, 0);
+        if (len <= 0) {
+            return -1;
+        }
+        received += len;
+    }
+    return 0;
+}
+
+static int readReply(int app, robot_dynamic_data_t *reply) {
+    return readExact(app, reply, sizeof(*reply), REPLY_TIMEOUT_MS);
+}
+
+/*
+ * Pide la rafaga y lee paquetes hasta que el robot deja de enviar. Cada status tiene que tener
+ * statusCode creciente y cada configuracion el numero siguiente; un paquete cortado desincroniza
+ * el stream y aparece como header desconocido.
+ * @return 0 si no se perdio ninguna configuracion y los status recibidos, reemplazados y sin frame
+ * suman la rafaga
+ */
+static int burstTest(int app, uint16_t burst) {
+    tx_frame_pool_stats_t before, after;
+    txFramePoolGetStats(&before);
+
+    command_app_raw_t command = {
+        .headerPackage = HEADER_PACKAGE_COMMAND,
+        .command = BURST_COMMAND,
+        .value = (int16_t)burst,
+    };
+    uint8_t frame[sizeof(command) + COMMS_FRAME_OVERHEAD];
+    size_t frameLen = commsFrameEncode(frame, sizeof(frame), &command, sizeof(command));
+    if (send(app, frame, frameLen, 0) != (ssize_t)frameLen) {
+        perror("send");
+        return -1;
+    }
+
+    uint32_t received = 0, configs = 0, corrupted = 0;
+    int32_t lastCode = -1;
+    uint16_t header;
+    while (!readExact(app, &header, sizeof(header), BURST_IDLE_MS)) {
+        if (header == HEADER_PACKAGE_STATUS) {
+            robot_dynamic_data_t status = {.headerPackage = header};
+            if (readExact(app, (uint8_t *)&status + sizeof(header), sizeof(status) - sizeof(header), REPLY_TIMEOUT_MS)) {
+                break;
+            }
+            if (status.statusCode < BURST_STATUS_BASE || (int32_t)status.statusCode <= lastCode) {
+                corrupted++;
+            }
+            lastCode = status.statusCode;
+            received++;
+        }
+        else if (header == HEADER_PACKAGE_LOCAL_CONFIG) {
+            robot_local_configs_comms_t config = {.headerPackage = header};
+            if (readExact(app, (uint8_t *)&config + sizeof(header), sizeof(config) - sizeof(header), REPLY_TIMEOUT_MS)) {
+                break;
+            }
+            if (config.safetyLimits != configs * PRECISION_DECIMALS_COMMS) {
+                corrupted++;
+            }
+            configs++;
+        }
+        else {
+            corrupted++;
+            break;                                      // stream desincronizado, no hay forma de seguir
+        }
+    }
+    txFramePoolGetStats(&after);
+
+    const tx_class_stats_t *reliable = &after.classes[TX_CLASS_RELIABLE];
+    const tx_class_stats_t *telemetry = &after.classes[TX_CLASS_TELEMETRY];
+    uint32_t expectedConfigs = (burst + BURST_CONFIG_EVERY - 1) / BURST_CONFIG_EVERY;
+    uint32_t overwritten = telemetry->overwritten - before.classes[TX_CLASS_TELEMETRY].overwritten;
+    uint32_t allocFailures = telemetry->allocFailures - before.classes[TX_CLASS_TELEMETRY].allocFailures;
+    uint32_t drops = telemetry->drops - before.classes[TX_CLASS_TELEMETRY].drops +
+                     reliable->drops - before.classes[TX_CLASS_RELIABLE].drops;
+    printf("rafaga de %u status: %u recibidos, %u reemplazados por uno mas nuevo, %u sin frame libre\n",
+           burst, received, overwritten, allocFailures);
+    printf("  %u de %u configuraciones (%u reintentos sin frame), %u descartados, %u corruptos\n",
+           configs, expectedConfigs, reliable->allocFailures - before.classes[TX_CLASS_RELIABLE].allocFailures,
+           drops, corrupted);
+    return (corrupted || drops || configs != expectedConfigs || received + overwritten + allocFailures != burst) ? -1 : 0;
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --count N        comandos a enviar (%d)\n"
+           "  --interval MS    pausa media entre comandos, con jitter para no engancharse a un periodo (%d)\n"
+           "  --burst N        status de la rafaga contra el pool de transmision, con configuraciones\n"
+           "                   intercaladas; 0 la saltea (%d)\n"
+           "  --log            habilita los ESP_LOGx del firmware\n",
+           prog, DEFAULT_COUNT, DEFAULT_INTERVAL_MS, DEFAULT_BURST);
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = DEFAULT_COUNT;
+    uint32_t intervalMs = DEFAULT_INTERVAL_MS;
+    uint32_t burst = DEFAULT_BURST;
+
+    static const struct option options[] = {
+        {"count",    required_argument, 0, 'n'},
+        {"interval", required_argument, 0, 'i'},
+        {"burst",    required_argument, 0, 'b'},
+        {"log",      no_argument,       0, 'l'},
+        {"help",     no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:i:b:lh", options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'i': intervalMs = strtoul(optarg, NULL, 10); break;
+            case 'b': burst = strtoul(optarg, NULL, 10); break;
+            case 'l': hostLogEnable = 1; break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!count || burst > INT16_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    newPidParamsQueueHandler = xQueueCreate(1, sizeof(pid_settings_comms_t));
+    receiveControlQueueHandler = xQueueCreate(1, sizeof(control_app_raw_t));
+    newCommandQueueHandler = xQueueCreate(1, sizeof(command_app_raw_t));
+
+    int server = listenLoopback();
+    if (server < 0) {
+        return 1;
+    }
+    tcpClientSocketInit();
+    commsInit();
+    tcpClientSocketStart();
+    int app = acceptRobot(server);
+    if (app < 0) {
+        return 1;
+    }
+    xTaskCreate(responderTask, "responder", 4096, NULL, 5, NULL);
+
+    double *rttUs = calloc(count, sizeof(double));
+    if (!rttUs) {
+        return 1;
+    }
+    uint32_t replies = 0, lost = 0, mismatched = 0;
+    srand(1);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (intervalMs) {
+            vTaskDelay(pdMS_TO_TICKS(intervalMs / 2 + rand() % intervalMs + 1));
+        }
+
+        command_app_raw_t command = {
+            .headerPackage = HEADER_PACKAGE_COMMAND,
+            .command = COMMAND_VIBRATION_TEST,
+            .value = (int16_t)(i & 0x7fff),
+        };
+        uint8_t frame[sizeof(command) + COMMS_FRAME_OVERHEAD];
+        size_t frameLen = commsFrameEncode(frame, sizeof(frame), &command, sizeof(command));
+
+        double start = nowUs();
+        if (send(app, frame, frameLen, 0) != (ssize_t)frameLen) {
+            perror("send");
+            return 1;
+        }
+        robot_dynamic_data_t reply;
+        if (readReply(app, &reply)) {
+            lost++;
+            continue;
+        }
+        double elapsed = nowUs() - start;
+        if (reply.headerPackage != HEADER_PACKAGE_STATUS || reply.statusCode != (uint16_t)command.value) {
+            mismatched++;
+            continue;
+        }
+        rttUs[replies++] = elapsed;
+    }
+
+    int burstResult = burst ? burstTest(app, burst) : 0;
+
+    // El robot tiene que ver el cierre y quedar listo para reconectarse. Sin el socket de escucha
+    // no puede volver a conectarse enseguida y tapar la desconexion entre dos lecturas
+    close(server);
+    close(app);
+    double closeStart = nowUs();
+    while (isTcpClientConnected() && nowUs() - closeStart < 10 * TCP_CLIENT_WAIT_MS * 1000.0) {
+        vTaskDelay(1);
+    }
+    double closeMs = (nowUs() - closeStart) / 1000.0;
+    int closeDetected = !isTcpClientConnected();
+
+    printf("%u comandos, pausa media %u ms: %u respuestas, %u perdidas, %u desordenadas\n",
+           count, intervalMs, replies, lost, mismatched);
+    int result = 0;
+    if (replies) {
+        qsort(rttUs, replies, sizeof(double), compareDouble);
+        double sum = 0;
+        for (uint32_t i = 0; i < replies; i++) {
+            sum += rttUs[i];
+        }
+        printf("RTT us: min %.0f  p50 %.0f  p90 %.0f  p99 %.0f  max %.0f  media %.0f\n",
+               rttUs[0], rttUs[replies / 2], rttUs[replies * 90 / 100], rttUs[replies * 99 / 100],
+               rttUs[replies - 1], sum / replies);
+    }
+    if (closeDetected) {
+        printf("cierre de la app detectado en %.1f ms\n", closeMs);
+    } else {
+        printf("el robot no detecto el cierre de la app\n");
+        result = 2;
+    }
+    if (lost || mismatched || burstResult) {
+        result = 2;
+    }
+
+    free(rttUs);
+    return result;
+}
@@ -0,0 +1,316 @@
+/*
+ * Telemetria por suscripcion (src/telemetry_stream.c): tamaño y costo de los frames.
+ *
+ * Genera registros de control como los del tick (oscilacion amortiguada con ruido), los escribe con
+ * telemetryStreamWrite a la tasa del tick y arma frames como commsManager, cada PERIOD_COMMS_MS.
+ * Cada frame se decodifica con el decodificador de referencia de este archivo (el que tiene que
+ * replicar la app) y se compara campo a campo con lo escrito. Reporta bytes por muestra, frames por
+ * segundo (envios por el socket) y ns por muestra del escritor y del armado, contra mandar un
+ * robot_dynamic_data_t por muestra. Sale con 2 si algo no coincide.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "telemetry_stream.h"
+#include "comms.h"
+
+#define DEFAULT_SECONDS     20
+#define PERIOD_COMMS_MS     25                          // commsManager
+#define MAX_DECODED         256
+
+typedef struct {
+    uint32_t timestampUs;
+    uint32_t cycle;
+    int16_t  fields[TELEMETRY_FIELDS_COUNT];
+} decoded_sample_t;
+
+typedef struct {
+    const char *name;
+    uint32_t fieldMask;
+    uint8_t  decimation;
+    uint8_t  samplesPerFrame;
+} scenario_t;
+
+#define BIT(field)  (1UL << (field))
+#define MASK_ANGLE_TUNING   (BIT(TELEMETRY_FIELD_PITCH) | BIT(TELEMETRY_FIELD_PID_OUTPUT_ANGLE) | \
+                             BIT(TELEMETRY_FIELD_PID_ITERM_ANGLE) | BIT(TELEMETRY_FIELD_SETPOINT_ANGLE) | \
+                             BIT(TELEMETRY_FIELD_MOTOR_L) | BIT(TELEMETRY_FIELD_MOTOR_R))
+#define MASK_ALL            (BIT(TELEMETRY_FIELDS_COUNT) - 1)
+
+static const scenario_t scenarios[] = {
+    {"angulo, 1 por frame",    MASK_ANGLE_TUNING, 1, 1},
+    {"angulo, 4 por frame",    MASK_ANGLE_TUNING, 1, 4},
+    {"angulo, 16 por frame",   MASK_ANGLE_TUNING, 1, 16},
+    {"pitch, 16 por frame",    BIT(TELEMETRY_FIELD_PITCH), 1, 16},
+    {"todos, 8 por frame",     MASK_ALL, 1, 8},
+    {"todos, 1/2, 8 por frame", MASK_ALL, 2, 8},
+};
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t getLe(const uint8_t *in, uint8_t bytes) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        value |= (uint32_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static int getVarint(const uint8_t **pos, const uint8_t *end, uint32_t *value) {
+    *value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (*pos >= end) {
+            return -1;
+        }
+        uint8_t byte = *(*pos)++;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Decodificador de referencia del formato de telemetry_stream.h, -1 si el frame esta mal formado */
+static int decodeFrame(const uint8_t *frame, size_t len, uint32_t *fieldMask, decoded_sample_t *out, int max) {
+    if (len < TELEMETRY_STREAM_HEADER_SIZE || getLe(frame, 2) != HEADER_PACKAGE_TELEMETRY_BATCH ||
+        getLe(frame + 2, 2) != len) {
+        return -1;
+    }
+    *fieldMask = getLe(frame + 4, 4);
+    uint32_t timestampUs = getLe(frame + 8, 4);
+    uint32_t cycle = getLe(frame + 12, 4);
+    int count = frame[16];
+    const uint8_t *pos = frame + TELEMETRY_STREAM_HEADER_SIZE;
+    const uint8_t *end = frame + len;
+    int16_t prev[TELEMETRY_FIELDS_COUNT] = {0};
+
+    if (count > max) {
+        return -1;
+    }
+    for (int n = 0; n < count; n++) {
+        uint32_t value;
+        if (n > 0) {
+            if (getVarint(&pos, end, &value)) {
+                return -1;
+            }
+            timestampUs += value;
+        }
+        out[n].timestampUs = timestampUs;
+        out[n].cycle = cycle;                           // solo se conoce el de la primera
+        memset(out[n].fields, 0, sizeof(out[n].fields));
+        for (uint8_t field = 0; field < TELEMETRY_FIELDS_COUNT; field++) {
+            if (*fieldMask & (1UL << field)) {
+                if (getVarint(&pos, end, &value)) {
+                    return -1;
+                }
+                int32_t delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+                prev[field] += delta;
+                out[n].fields[field] = prev[field];
+            }
+        }
+    }
+    return pos == end ? count : -1;
+}
+
+static int16_t clamp16(double value) {
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (int16_t)lrint(value);
+}
+
+/* Un ciclo de control plausible: oscilacion amortiguada del pitch y el resto derivado de ella */
+static void makeRecord(uint32_t cycle, flight_record_t *record, int16_t fields[TELEMETRY_FIELDS_COUNT]) {
+    double t = cycle * PERIOD_IMU_MS / 1000.0;
+    double noise = ((double)rand() / RAND_MAX - 0.5);
+    double pitch = 8.0 * exp(-fmod(t, 10.0) / 3.0) * sin(2.0 * M_PI * 1.5 * t) + noise * 0.3;
+    double output = -pitch / 15.0;
+
+    memset(record, 0, sizeof(*record));
+    record->cycle = cycle;
+    record->pitch = clamp16(pitch * FLIGHT_RECORDER_SCALE_ANGLE);
+    record->roll = clamp16((1.5 + noise * 0.2) * FLIGHT_RECORDER_SCALE_ANGLE);
+    record->yaw = clamp16(fmod(t * 20.0, 360.0) * FLIGHT_RECORDER_SCALE_ANGLE);
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        record->pidOutput[i] = clamp16(output / (i + 1) * FLIGHT_RECORDER_SCALE_PID);
+        record->pidITerm[i] = clamp16(output / (4 * (i + 1)) * FLIGHT_RECORDER_SCALE_PID);
+        record->setPoint[i] = (fmod(t, 20.0) < 10.0) ? 0 : 200 * (i + 1);
+    }
+    record->motorL = clamp16(output * 1000);
+    record->motorR = clamp16(output * 1000 + noise * 10);
+
+    const int16_t values[TELEMETRY_FIELDS_COUNT] = {
+        record->pitch, record->roll, record->yaw,
+        record->pidOutput[0], record->pidOutput[1], record->pidOutput[2], record->pidOutput[3],
+        record->pidITerm[0], record->pidITerm[1], record->pidITerm[2], record->pidITerm[3],
+        record->setPoint[0], record->setPoint[1], record->setPoint[2], record->setPoint[3],
+        record->motorL, record->motorR,
+    };
+    memcpy(fields, values, sizeof(values));
+}
+
+static int runScenario(const scenario_t *scenario, uint32_t cycles) {
+    // lo que se escribio en el ring, para comparar con lo decodificado
+    decoded_sample_t *expected = calloc(cycles, sizeof(*expected));
+    if (!expected) {
+        return -1;
+    }
+    uint32_t expectedCount = 0, expectedRead = 0;
+    uint32_t frames = 0, bytes = 0, mismatches = 0;
+    double writeNs = 0, buildNs = 0;
+    telemetry_stream_stats_t before, after;
+    uint8_t frame[TELEMETRY_STREAM_FRAME_MAX];
+    decoded_sample_t decoded[MAX_DECODED];
+
+    srand(1);
+    telemetryStreamSubscribe(0, 1, 1);                  // descarta lo que quedo del escenario anterior
+    telemetryStreamBuildFrame(frame, sizeof(frame), 0);
+    telemetryStreamGetStats(&before);
+    telemetryStreamSubscribe(scenario->fieldMask, scenario->decimation, scenario->samplesPerFrame);
+
+    uint32_t commsEvery = PERIOD_COMMS_MS * 1000 / CONTROL_TICK_PERIOD_US;
+    for (uint32_t cycle = 1; cycle <= cycles; cycle++) {
+        flight_record_t record;
+        int16_t fields[TELEMETRY_FIELDS_COUNT];
+        makeRecord(cycle, &record, fields);
+        uint32_t timestampUs = cycle * CONTROL_TICK_PERIOD_US + rand() % 200;        // jitter del DMP
+
+        double start = nowNs();
+        telemetryStreamWrite(&record, timestampUs);
+        writeNs += nowNs() - start;
+
+        if (cycle % scenario->decimation == 0) {
+            expected[expectedCount].timestampUs = timestampUs;
+            expected[expectedCount].cycle = cycle;
+            for (uint8_t field = 0; field < TELEMETRY_FIELDS_COUNT; field++) {
+                expected[expectedCount].fields[field] = (scenario->fieldMask & (1UL << field)) ? fields[field] : 0;
+            }
+            expectedCount++;
+        }
+
+        if (cycle % commsEvery == 0 || cycle == cycles) {
+            for (uint8_t i = 0; i < TELEMETRY_BATCH_FRAMES_PER_CYCLE; i++) {
+                int64_t now = cycle == cycles ? timestampUs + TELEMETRY_STREAM_MAX_LATENCY_US : timestampUs;
+                start = nowNs();
+                size_t len = telemetryStreamBuildFrame(frame, sizeof(frame), now);
+                buildNs += nowNs() - start;
+                if (!len) {
+                    break;
+                }
+                uint32_t fieldMask;
+                int count = decodeFrame(frame, len, &fieldMask, decoded, MAX_DECODED);
+                if (count <= 0 || fieldMask != scenario->fieldMask || decoded[0].cycle != expected[expectedRead].cycle) {
+                    mismatches++;
+                    break;
+                }
+                for (int n = 0; n < count; n++, expectedRead++) {
+                    mismatches += decoded[n].timestampUs != expected[expectedRead].timestampUs ||
+                                  memcmp(decoded[n].fields, expected[expectedRead].fields, sizeof(decoded[n].fields));
+                }
+                frames++;
+                bytes += len;
+            }
+        }
+    }
+    telemetryStreamGetStats(&after);
+
+    double seconds = cycles * CONTROL_TICK_PERIOD_US / 1e6;
+    uint32_t samples = after.samples - before.samples;
+    printf("%-24s %2d campos %7.1f %8.1f %9.1f %8.1f %8.1f %8.1f %6u\n", scenario->name,
+           __builtin_popcount(scenario->fieldMask), samples / seconds, (double)bytes / samples, frames / seconds,
+           bytes / seconds / 1024, writeNs / cycles, buildNs / (samples ? samples : 1),
+           after.overflows - before.overflows);
+
+    int result = 0;
+    if (mismatches || expectedRead != expectedCount || after.overflows != before.overflows) {
+        printf("  %u diferencias, %u de %u muestras decodificadas\n", mismatches, expectedRead, expectedCount);
+        result = 2;
+    }
+    free(expected);
+    return result;
+}
+
+/* El ring lleno descarta y cuenta, y al vaciarse sigue entregando en orden */
+static int checkOverflow(void) {
+    uint8_t frame[TELEMETRY_STREAM_FRAME_MAX];
+    telemetry_stream_stats_t before, after;
+
+    telemetryStreamSubscribe(0, 1, 1);
+    telemetryStreamBuildFrame(frame, sizeof(frame), 0);
+    telemetryStreamGetStats(&before);
+    telemetryStreamSubscribe(BIT(TELEMETRY_FIELD_PITCH), 1, 8);
+
+    flight_record_t record;
+    int16_t fields[TELEMETRY_FIELDS_COUNT];
+    for (uint32_t cycle = 1; cycle <= TELEMETRY_STREAM_RING + 10; cycle++) {
+        makeRecord(cycle, &record, fields);
+        telemetryStreamWrite(&record, cycle * CONTROL_TICK_PERIOD_US);
+    }
+    uint32_t drained = 0;
+    size_t len;
+    decoded_sample_t decoded[MAX_DECODED];
+    while ((len = telemetryStreamBuildFrame(frame, sizeof(frame), 0))) {
+        uint32_t fieldMask;
+        int count = decodeFrame(frame, len, &fieldMask, decoded, MAX_DECODED);
+        if (count <= 0 || decoded[0].cycle != drained + 1) {
+            printf("buffer lleno: frame %u mal decodificado\n", drained);
+            return 2;
+        }
+        drained += count;
+    }
+    telemetryStreamGetStats(&after);
+    printf("\nbuffer lleno: %u descartadas (esperadas 10), %u entregadas de %u\n",
+           after.overflows - before.overflows, drained, TELEMETRY_STREAM_RING);
+    return (after.overflows - before.overflows == 10 && drained == TELEMETRY_STREAM_RING) ? 0 : 2;
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --seconds N      segundos simulados por escenario (%d)\n",
+           prog, DEFAULT_SECONDS);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = DEFAULT_SECONDS;
+
+    static const struct option options[] = {
+        {"seconds", required_argument, 0, 's'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': seconds = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!seconds) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint32_t cycles = seconds * 1000000 / CONTROL_TICK_PERIOD_US;
+    printf("tick de control %d us, commsManager cada %d ms, status completo %zu bytes por muestra\n",
+           CONTROL_TICK_PERIOD_US, PERIOD_COMMS_MS, sizeof(robot_dynamic_data_t));
+    printf("%-24s %9s %7s %8s %9s %8s %8s %8s %6s\n", "escenario", "", "muest/s", "B/muest", "frames/s",
+           "KB/s", "wr ns", "arm ns", "perd");
+
+    int result = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        int scenarioResult = runScenario(&scenarios[i], cycles);
+        if (scenarioResult) {
+            result = scenarioResult < 0 ? 1 : scenarioResult;
+        }
+    }
+    if (checkOverflow()) {
+        result = 2;
+    }
+    return result;
+}
@@ -0,0 +1,214 @@
+/*
+ * Corre el tick de control (src/control_tick.c) en tiempo real sobre el esp_timer host (timerfd).
+ *
+ * Un hilo hace de tarea del MPU y deja muestras con marca de tiempo en mpu6050QueueHandler a su
+ * propia tasa, como el DMP. El tick lo da el esp_timer (sin sincronizar con el IMU) o cada muestra
+ * (--source imu), y la salida va directo a un driver de motores simulado. Al final reporta el jitter
+ * de cada tick respecto del periodo, ticks perdidos, ticks sin muestra nueva, el peor tiempo de
+ * ejecucion, la latencia de la muestra del IMU al comando aplicado, y las ventanas de
+ * loop_timing del tick y del lazo de actitud (lo mismo que viaja en HEADER_PACKAGE_LOOP_TIMING).
+ * El jitter en Linux depende del scheduler del host: sirve para validar la medicion, no como cifra del ESP32.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "main.h"
+#include "control.h"
+#include "control_tick.h"
+#include "comms.h"
+#include "PID.h"
+#include "loop_timing.h"
+#include "robot_snapshot.h"
+
+#ifdef CONTROL_TICK_FROM_IMU
+#define DEFAULT_SOURCE      CONTROL_TICK_SOURCE_IMU
+#else
+#define DEFAULT_SOURCE      CONTROL_TICK_SOURCE_TIMER
+#endif
+
+QueueHandle_t mpu6050QueueHandler;
+QueueHandle_t motorControlQueueHandler;
+
+static volatile int running = 1;
+static uint32_t imuPeriodUs;
+static int64_t imuGapStartUs, imuGapEndUs;          // el IMU deja de entregar en este intervalo
+static output_motors_t appliedOutput;
+
+static void motorOutput(const output_motors_t *output) {
+    appliedOutput = *output;
+}
+
+static void *imuProducer(void *arg) {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint32_t count = 0;
+
+    while (running) {
+        next.tv_nsec += imuPeriodUs * 1000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        vector_queue_t sample = {
+            .pitch = statusRobot.localConfig.centerAngle + 0.5f * sinf(count++ * 0.05f),
+            .temp = 30,
+            .timestampUs = esp_timer_get_time(),
+        };
+        if (sample.timestampUs >= imuGapStartUs && sample.timestampUs < imuGapEndUs) {
+            continue;
+        }
+        xQueueOverwrite(mpu6050QueueHandler, &sample);
+    }
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --seconds S      duracion (5)\n"
+           "  --period-us US   periodo del tick (CONTROL_TICK_PERIOD_US = %d)\n"
+           "  --imu-us US      periodo de las muestras del IMU (igual al tick)\n"
+           "  --source S       timer | imu (%s)\n"
+           "  --imu-gap-ms MS  el IMU deja de entregar MS a mitad de la corrida (0)\n",
+           prog, CONTROL_TICK_PERIOD_US, DEFAULT_SOURCE == CONTROL_TICK_SOURCE_IMU ? "imu" : "timer");
+}
+
+int main(int argc, char **argv) {
+    double seconds = 5;
+    uint32_t periodUs = CONTROL_TICK_PERIOD_US;
+    imuPeriodUs = 0;
+    uint8_t source = DEFAULT_SOURCE;
+    double imuGapMs = 0;
+
+    static const struct option options[] = {
+        {"seconds",   required_argument, 0, 's'},
+        {"period-us", required_argument, 0, 'p'},
+        {"imu-us",    required_argument, 0, 'i'},
+        {"source",    required_argument, 0, 'c'},
+        {"imu-gap-ms", required_argument, 0, 'g'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:p:i:c:g:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 's': seconds = atof(optarg); break;
+            case 'p': periodUs = strtoul(optarg, NULL, 10); break;
+            case 'i': imuPeriodUs = strtoul(optarg, NULL, 10); break;
+            case 'g': imuGapMs = atof(optarg); break;
+            case 'c': source = strcmp(optarg, "imu") ? CONTROL_TICK_SOURCE_TIMER : CONTROL_TICK_SOURCE_IMU; break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!imuPeriodUs) {
+        imuPeriodUs = periodUs;
+    }
+    if (seconds <= 0 || periodUs < 100 || imuPeriodUs < 100) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    setStatusRobot(STATUS_ROBOT_INIT);
+    mpu6050QueueHandler = xQueueCreate(1, sizeof(vector_queue_t));
+    motorControlQueueHandler = xQueueCreate(1, sizeof(output_motors_t));
+    controlLoadDefaultConfig(&statusRobot.localConfig);
+
+    pid_init_t pidConfig;
+    memcpy(pidConfig.pids, statusRobot.localConfig.pids, sizeof(pidConfig.pids));
+    for (uint8_t i = 0; i < CANT_PIDS; i++) {
+        pidConfig.sampleTimeInMs[i] = controlGetPidPeriodMs(i);
+    }
+    if (pidInit(pidConfig) != ESP_OK) {
+        fprintf(stderr, "pidInit fallo\n");
+        return 1;
+    }
+    setStatusRobot(STATUS_ROBOT_ARMED);
+    controlInputInit();
+
+    imuGapStartUs = esp_timer_get_time() + (int64_t)(seconds * 500000);
+    imuGapEndUs = imuGapStartUs + (int64_t)(imuGapMs * 1000);
+    pthread_t producer;
+    pthread_create(&producer, NULL, imuProducer, NULL);
+
+    control_tick_config_t configTick = {
+        .periodUs = periodUs,
+        .priorityTask = IMU_HANDLER_PRIORITY,
+        .core = IMU_HANDLER_CORE,
+        .source = source,
+        .motorOutput = motorOutput,
+    };
+    if (controlTickInit(&configTick) != ESP_OK) {
+        fprintf(stderr, "controlTickInit fallo\n");
+        return 1;
+    }
+
+    // Ganancias nuevas y guardado en el mismo ciclo de commsManager, a mitad del hueco si lo hay: el snapshot
+    // que marca el guardado tiene que traer las ganancias nuevas
+    vTaskDelay(pdMS_TO_TICKS(seconds * 500 + imuGapMs / 2));
+    pid_floats_t newGains = statusRobot.localConfig.pids[PID_SPEED];
+    newGains.kp += 1;
+    controlPostInput(&(control_input_t){.type = CONTROL_INPUT_PID_SETTINGS, .pid = {.numPid = PID_SPEED, .gains = newGains}});
+    controlPostInput(&(control_input_t){.type = CONTROL_INPUT_SAVE_LOCAL_CONFIG});
+    vTaskDelay(pdMS_TO_TICKS(seconds * 500 - imuGapMs / 2));
+    running = 0;
+    pthread_join(producer, NULL);
+
+    control_tick_stats_t stats;
+    controlTickGetStats(&stats);
+
+    printf("tick: %" PRIu32 " us (%s), imu: %" PRIu32 " us, %.1f s\n", periodUs,
+           source == CONTROL_TICK_SOURCE_IMU ? "por muestra" : "timer", imuPeriodUs, seconds);
+    printf("ticks: %" PRIu32 " (esperados %.0f), perdidos: %" PRIu32 ", sin muestra nueva: %" PRIu32 ", imu perdido: %" PRIu32 ", fuera de periodo: %" PRIu32 "\n",
+           stats.ticks, seconds * 1e6 / periodUs, stats.missedTicks, stats.staleSamples, stats.imuLost, stats.offPeriodSamples);
+    printf("periodo medido entre muestras de la cascada: %" PRIu32 " us, PID recalculados %" PRIu32 " veces (dt de PID_ANGLE %.2f ms)\n",
+           stats.periodMeasuredUs, stats.periodUpdates, controlGetPidPeriodMs(PID_ANGLE));
+    printf("jitter: min %" PRId32 " us, max %" PRId32 " us, medio |%.1f| us\n",
+           stats.jitterMinUs, stats.jitterMaxUs, stats.jitterMeanAbsUs);
+    robot_snapshot_stats_t snapshotStats;
+    robot_snapshot_t snapshot;
+    robotSnapshotGetStats(&snapshotStats);
+    robotSnapshotRead(&snapshot);
+    printf("ejecucion max: %" PRIu32 " us, estado final: %d (snapshot %d, %" PRIu32 " publicados), entradas descartadas: %" PRIu32 "\n",
+           stats.execMaxUs, statusRobot.statusCode, snapshot.status.statusCode, snapshotStats.publishes, stats.inputDrops);
+    printf("latencia imu -> motor: media %.1f us, max %" PRIu32 " us\n", stats.latencyMeanUs, stats.latencyMaxUs);
+
+    static const struct {
+        uint8_t loop;
+        const char *name;
+    } loops[] = {
+        {LOOP_TIMING_CONTROL_TICK, "control_tick"},
+        {LOOP_TIMING_ATTITUDE,     "attitude"},
+    };
+    printf("\n%-13s %8s %28s %28s\n", "lazo", "muestras", "periodo min/media/p99/max us", "ejec min/media/p99/max us");
+    for (uint8_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++) {
+        loop_timing_stats_t timing;
+        loopTimingGetStats(loops[i].loop, &timing);
+        printf("%-13s %8u %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 "   %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 "\n",
+               loops[i].name, timing.samples,
+               timing.periodMinUs, timing.periodMeanUs, timing.periodP99Us, timing.periodMaxUs,
+               timing.execMinUs, timing.execMeanUs, timing.execP99Us, timing.execMaxUs);
+    }
+    // Un snapshot por tick, tambien sin muestra nueva: commsManager ve el estado y las entradas aplicadas
+    if (snapshotStats.publishes < stats.ticks) {        // el tick sigue corriendo: publica antes de contarse
+        printf("ERROR: el snapshot no se publica en cada tick\n");
+        return 2;
+    }
+    if (snapshot.localConfigSaves != 1 || snapshot.status.localConfig.pids[PID_SPEED].kp != newGains.kp) {
+        printf("ERROR: el guardado no trae las ganancias recibidas antes (%" PRIu32 " guardados, kp %.3f, esperado %.3f)\n",
+               snapshot.localConfigSaves, snapshot.status.localConfig.pids[PID_SPEED].kp, newGains.kp);
+        return 2;
+    }
+    return 0;
+}
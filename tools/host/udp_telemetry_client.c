@@ -0,0 +1,406 @@
+/*
+ * Cliente de la telemetria UDP (TELEMETRY_UDP en main.h): hace de app, acepta la conexion TCP del robot
+ * y recibe los datagramas HEADER_PACKAGE_STATUS_UDP contando recibidos, perdidos, desordenados y
+ * duplicados a partir del numero de secuencia (16 bits, se extiende a 32 al recibir).
+ *
+ * --listen: espera al robot real en 0.0.0.0 (la PC tiene que tener la IP HOST_IP_ADDR del firmware)
+ * e imprime las estadisticas cada segundo.
+ * Por defecto corre el firmware en el mismo proceso sobre loopback (tcp_client_socket.c y
+ * sendDynamicData de src/comms.c), con perdidas, desorden y duplicados inyectados entre el socket y
+ * el contador, y verifica que el contador de exactamente lo inyectado.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "comms.h"
+#include "include/TCP_CLIENT.h"
+#include "tcp_client_socket.h"
+
+#define SEQ_WINDOW              1024                    // cuanto puede llegar tarde un datagrama y contarse como desordenado
+#define DEFAULT_COUNT           5000
+#define DEFAULT_PERIOD_MS       1
+#define MAX_HELD                8
+#define ACCEPT_TIMEOUT_MS       5000
+
+QueueHandle_t newPidParamsQueueHandler;
+QueueHandle_t receiveControlQueueHandler;
+QueueHandle_t newCommandQueueHandler;
+
+typedef struct {
+    bool     started;
+    uint32_t first;                                     // secuencias extendidas a 32 bits
+    uint32_t highest;
+    uint8_t  seen[SEQ_WINDOW / 8];
+    uint32_t received;
+    uint32_t lost;                                      // huecos que todavia no llegaron
+    uint32_t reordered;                                 // llegaron despues de uno posterior
+    uint32_t duplicates;
+    uint32_t tooLate;                                   // fuera de la ventana, se descartan
+} seq_stats_t;
+
+static bool seqSeen(const seq_stats_t *stats, uint32_t seq) {
+    return stats->seen[(seq % SEQ_WINDOW) / 8] & (1 << (seq % 8));
+}
+
+static void seqMark(seq_stats_t *stats, uint32_t seq, bool seen) {
+    uint8_t *byte = &stats->seen[(seq % SEQ_WINDOW) / 8];
+    *byte = seen ? (*byte | (1 << (seq % 8))) : (*byte & ~(1 << (seq % 8)));
+}
+
+static void seqStatsUpdate(seq_stats_t *stats, uint16_t sequence) {
+    if (!stats->started) {
+        stats->started = true;
+        stats->first = stats->highest = sequence;
+        seqMark(stats, sequence, true);
+        stats->received++;
+        return;
+    }
+
+    int16_t delta = (int16_t)(sequence - (uint16_t)stats->highest);
+    uint32_t seq = stats->highest + delta;
+
+    if (delta > 0) {
+        if (delta > SEQ_WINDOW) {
+            memset(stats->seen, 0, sizeof(stats->seen));
+        }
+        else {
+            for (uint32_t missing = stats->highest + 1; missing != seq; missing++) {
+                seqMark(stats, missing, false);
+            }
+        }
+        stats->lost += delta - 1;
+        stats->highest = seq;
+        seqMark(stats, seq, true);
+        stats->received++;
+    }
+    else if (delta == 0) {
+        stats->duplicates++;
+    }
+    else if (-delta >= SEQ_WINDOW || (int32_t)(seq - stats->first) < 0) {
+        stats->tooLate++;
+    }
+    else if (seqSeen(stats, seq)) {
+        stats->duplicates++;
+    }
+    else {
+        seqMark(stats, seq, true);
+        stats->lost--;
+        stats->reordered++;
+        stats->received++;
+    }
+}
+
+static void seqStatsPrint(const char *prefix, const seq_stats_t *stats) {
+    uint32_t expected = stats->started ? stats->highest - stats->first + 1 : 0;
+    printf("%s recibidos %u, perdidos %u (%.2f%%), desordenados %u, duplicados %u, tarde %u\n", prefix,
+           stats->received, stats->lost, expected ? 100.0 * stats->lost / expected : 0.0,
+           stats->reordered, stats->duplicates, stats->tooLate);
+}
+
+/* Valores esperados calculados sobre el orden en que el inyector entrego los datagramas */
+typedef struct {
+    uint8_t  *delivered;
+    uint32_t minSeq;
+    uint32_t maxSeq;
+    uint32_t distinct;
+    bool     started;
+    uint32_t reordered;
+    uint32_t duplicates;
+} truth_t;
+
+static void truthDeliver(truth_t *truth, uint32_t index) {
+    if (truth->delivered[index]) {
+        truth->duplicates++;
+        return;
+    }
+    truth->delivered[index] = 1;
+    truth->distinct++;
+    if (!truth->started) {
+        truth->started = true;
+        truth->minSeq = truth->maxSeq = index;
+    }
+    else if (index < truth->maxSeq) {
+        truth->reordered++;
+    }
+    else {
+        truth->maxSeq = index;
+    }
+}
+
+typedef struct {
+    uint32_t index;
+    uint16_t sequence;
+    uint8_t  releaseAfter;
+} held_datagram_t;
+
+typedef struct {
+    double dropRate;
+    double reorderRate;
+    double duplicateRate;
+    held_datagram_t held[MAX_HELD];
+    uint8_t heldCount;
+} impairment_t;
+
+static double randUnit(void) {
+    return (double)rand() / ((double)RAND_MAX + 1);
+}
+
+static void deliver(seq_stats_t *stats, truth_t *truth, uint32_t index, uint16_t sequence) {
+    seqStatsUpdate(stats, sequence);
+    if (truth) {
+        truthDeliver(truth, index);
+    }
+}
+
+/* Pasa un datagrama por el inyector: lo pierde, lo retiene unos datagramas o lo duplica */
+static void impair(impairment_t *imp, seq_stats_t *stats, truth_t *truth, uint32_t index, uint16_t sequence) {
+    for (uint8_t i = 0; i < imp->heldCount;) {
+        if (--imp->held[i].releaseAfter == 0) {
+            deliver(stats, truth, imp->held[i].index, imp->held[i].sequence);
+            imp->held[i] = imp->held[--imp->heldCount];
+        }
+        else {
+            i++;
+        }
+    }
+
+    // el primero pasa siempre, es la referencia del contador
+    if (index > 0 && randUnit() < imp->dropRate) {
+        return;
+    }
+    if (index > 0 && imp->heldCount < MAX_HELD && randUnit() < imp->reorderRate) {
+        imp->held[imp->heldCount++] = (held_datagram_t){index, sequence, 1 + rand() % 3};
+        return;
+    }
+    deliver(stats, truth, index, sequence);
+    if (randUnit() < imp->duplicateRate) {
+        deliver(stats, truth, index, sequence);
+    }
+}
+
+static void impairFlush(impairment_t *imp, seq_stats_t *stats, truth_t *truth) {
+    for (uint8_t i = 0; i < imp->heldCount; i++) {
+        deliver(stats, truth, imp->held[i].index, imp->held[i].sequence);
+    }
+    imp->heldCount = 0;
+}
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int openSocket(int type, const char *ip, uint16_t port) {
+    int sock = socket(AF_INET, type, 0);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (type == SOCK_DGRAM) {
+        int size = 1 << 20;                             // que el kernel no pierda por llenarse el buffer
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    addr.sin_addr.s_addr = inet_addr(ip);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || (type == SOCK_STREAM && listen(sock, 1))) {
+        perror("bind/listen");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Hace de commsManager: un status por periodo mientras el robot este conectado */
+static uint32_t feederPeriodMs;
+static volatile uint32_t feederRemaining;
+
+static void feederTask(void *param) {
+    while (feederRemaining) {
+        if (isTcpClientConnected()) {
+            robot_snapshot_t snapshot = {
+                .status.statusCode = STATUS_ROBOT_STABILIZED,
+            };
+            sendDynamicData(&snapshot);
+            feederRemaining--;
+        }
+        vTaskDelay(pdMS_TO_TICKS(feederPeriodMs));
+    }
+    vTaskDelete(NULL);
+}
+
+static void usage(const char *prog) {
+    printf("uso: %s [opciones]\n"
+           "  --listen         recibe del robot real en 0.0.0.0, puertos TCP %d y UDP %d\n"
+           "  --seconds N      duracion con --listen (0 = sin fin)\n"
+           "  --count N        datagramas del firmware en loopback (%d)\n"
+           "  --period MS      periodo del status en loopback, 0 = lo mas rapido posible (%d)\n"
+           "  --drop P         probabilidad de perder un datagrama (0.02)\n"
+           "  --reorder P      probabilidad de retrasarlo 1 a 3 datagramas (0.02)\n"
+           "  --duplicate P    probabilidad de duplicarlo (0.01)\n"
+           "  --seed N         semilla del inyector\n",
+           prog, 8080, 8081, DEFAULT_COUNT, DEFAULT_PERIOD_MS);
+}
+
+int main(int argc, char **argv) {
+    bool listenMode = false;
+    uint32_t seconds = 0;
+    uint32_t count = DEFAULT_COUNT;
+    impairment_t imp = {.dropRate = 0.02, .reorderRate = 0.02, .duplicateRate = 0.01};
+    unsigned seed = 1;
+    feederPeriodMs = DEFAULT_PERIOD_MS;
+
+    static const struct option options[] = {
+        {"listen",    no_argument,       0, 'L'},
+        {"seconds",   required_argument, 0, 's'},
+        {"count",     required_argument, 0, 'n'},
+        {"period",    required_argument, 0, 'p'},
+        {"drop",      required_argument, 0, 'd'},
+        {"reorder",   required_argument, 0, 'r'},
+        {"duplicate", required_argument, 0, 'u'},
+        {"seed",      required_argument, 0, 'S'},
+        {"help",      no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "Ls:n:p:d:r:u:S:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'L': listenMode = true; break;
+            case 's': seconds = strtoul(optarg, NULL, 10); break;
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'p': feederPeriodMs = strtoul(optarg, NULL, 10); break;
+            case 'd': imp.dropRate = atof(optarg); break;
+            case 'r': imp.reorderRate = atof(optarg); break;
+            case 'u': imp.duplicateRate = atof(optarg); break;
+            case 'S': seed = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!count) {
+        usage(argv[0]);
+        return 1;
+    }
+    srand(seed);
+
+    const char *ip = listenMode ? "0.0.0.0" : HOST_IP_ADDR;
+    uint16_t tcpPort = listenMode ? 8080 : PORT;
+    int server = openSocket(SOCK_STREAM, ip, tcpPort);
+    int udp = openSocket(SOCK_DGRAM, ip, tcpPort + 1);
+    if (server < 0 || udp < 0) {
+        return 1;
+    }
+
+    if (!listenMode) {
+        newPidParamsQueueHandler = xQueueCreate(1, sizeof(pid_settings_comms_t));
+        receiveControlQueueHandler = xQueueCreate(1, sizeof(control_app_raw_t));
+        newCommandQueueHandler = xQueueCreate(1, sizeof(command_app_raw_t));
+        tcpClientSocketInit();
+        commsInit();
+        tcpClientSocketStart();
+    }
+
+    struct pollfd pfd = {.fd = server, .events = POLLIN};
+    if (poll(&pfd, 1, listenMode ? -1 : ACCEPT_TIMEOUT_MS) != 1) {
+        fprintf(stderr, "el robot no se conecto\n");
+        return 1;
+    }
+    int app = accept(server, NULL, NULL);
+    if (app < 0) {
+        perror("accept");
+        return 1;
+    }
+    printf("robot conectado, status por UDP en el puerto %u\n", tcpPort + 1);
+
+    seq_stats_t stats = {0};
+    truth_t truth = {0};
+    if (!listenMode) {
+        truth.delivered = calloc(count, 1);
+        feederRemaining = count;
+        xTaskCreate(feederTask, "feeder", 4096, NULL, 5, NULL);
+    }
+
+    uint32_t arrivals = 0;
+    uint32_t transportErrors = 0;                       // en loopback no deberia perderse ni desordenarse nada antes del inyector
+    double start = nowMs(), lastPrint = start;
+    while (true) {
+        struct pollfd fds[2] = {{.fd = udp, .events = POLLIN}, {.fd = app, .events = POLLIN}};
+        int ready = poll(fds, 2, 200);
+
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            uint8_t drain[256];                         // lo que llegue por TCP (config, tiempos) no se usa
+            if (recv(app, drain, sizeof(drain), 0) <= 0) {
+                printf("el robot cerro la conexion\n");
+                break;
+            }
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            robot_udp_status_t datagram;
+            ssize_t len = recv(udp, &datagram, sizeof(datagram), 0);
+            if (len == sizeof(datagram) && datagram.headerPackage == HEADER_PACKAGE_STATUS_UDP) {
+                if (listenMode) {
+                    seqStatsUpdate(&stats, datagram.sequence);
+                }
+                else {
+                    transportErrors += datagram.sequence != (uint16_t)arrivals;
+                    impair(&imp, &stats, &truth, arrivals, datagram.sequence);
+                }
+                arrivals++;
+            }
+        }
+
+        double now = nowMs();
+        if (listenMode) {
+            if (now - lastPrint >= 1000) {
+                lastPrint = now;
+                seqStatsPrint("", &stats);
+            }
+            if (seconds && now - start >= seconds * 1000.0) {
+                break;
+            }
+        }
+        else if (arrivals == count || (ready == 0 && !feederRemaining)) {
+            break;
+        }
+    }
+
+    if (listenMode) {
+        seqStatsPrint("total:", &stats);
+        return 0;
+    }
+
+    impairFlush(&imp, &stats, &truth);
+    uint32_t truthLost = truth.started ? (truth.maxSeq - truth.minSeq + 1) - truth.distinct : 0;
+    seqStatsPrint("contador:", &stats);
+    printf("inyectado: perdidos %u, desordenados %u, duplicados %u (llegaron %u de %u, %u fuera de orden en el transporte)\n",
+           truthLost, truth.reordered, truth.duplicates, arrivals, count, transportErrors);
+
+    int result = 0;
+    if (arrivals != count || transportErrors) {
+        printf("loopback perdio o desordeno datagramas antes del inyector\n");
+        result = 2;
+    }
+    if (stats.lost != truthLost || stats.reordered != truth.reordered || stats.duplicates != truth.duplicates ||
+        stats.tooLate) {
+        printf("el contador no coincide con lo inyectado\n");
+        result = 2;
+    }
+    free(truth.delivered);
+    close(app);
+    return result;
+}
@@ -0,0 +1,206 @@
+/*
+ * Detector de arranque del IMU (src/imu_warmup.c) contra el descarte fijo de 1000 muestras de antes.
+ *
+ * Simula la salida del DMP a MPU_DMP_WARMUP_SAMPLE_HZ (la tasa de la FIFO con el divisor configurado): el pitch converge a la inclinacion real con una
+ * constante de tiempo (--tau) mas ruido, y el giroscopo del paquete (escala del DMP, cuantizado) trae
+ * el sesgo menos los offsets de los registros (32.8 LSB por grado/s) mas ruido. Cuando el detector
+ * devuelve IMU_WARMUP_CORRECT se corrigen los offsets como mpu6050CorrectGyroOffsets. Escenarios:
+ *  - nvs:        offsets restaurados, sesgo residual chico, quieto desde el arranque
+ *  - fabrica:    sin offsets en la NVS, sesgo de varios grados/s
+ *  - en mano:    se mueve los primeros --handled s y despues queda quieto
+ *  - movimiento: no queda quieto nunca, tiene que vencer el maximo sin asentarse
+ *
+ * Reporta por escenario el tiempo hasta la primera muestra (medio, p95, maximo), cuantas corridas se
+ * asentaron, correcciones, el error de pitch contra la inclinacion al entregar y el sesgo que queda.
+ * Sale con 2 si nvs o fabrica no se asientan, si se asienta moviendose, si el pitch entregado esta a
+ * mas de 0.15 grados de la inclinacion o si queda un sesgo mayor a IMU_WARMUP_GYRO_BIAS_MAX_DPS.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "main.h"
+#include "imu_warmup.h"
+#include "imu_fusion.h"
+#include "mpu_i2c.h"
+
+#define DMP_BASE_RATE_HZ        200                                 // MPU_DMP_BASE_RATE_HZ de mpu6050_wrapper.cpp
+#define SAMPLE_HZ               (DMP_BASE_RATE_HZ / (DMP_BASE_RATE_HZ * CONTROL_TICK_PERIOD_US / 1000000))  // MPU_DMP_WARMUP_SAMPLE_HZ
+#define DMP_MAX_SAMPLES         (10 * SAMPLE_HZ)                    // MPU_DMP_WARMUP_MAX_SAMPLES, el descarte fijo de antes
+#define DEFAULT_RUNS            200
+#define PITCH_NOISE_DEG         0.01f
+#define GYRO_NOISE_DPS          0.05f
+#define MAX_PITCH_ERROR_DEG     0.15f
+
+typedef struct {
+    const char *name;
+    float bias[3];                                      // grados/s con los offsets iniciales
+    float stillFromS;                                   // antes se mueve; negativo: no se queda quieto nunca
+    uint8_t mustSettle;
+} scenario_t;
+
+typedef struct {
+    float settleS[DEFAULT_RUNS * 50];
+    uint32_t runs;
+    uint32_t settled;
+    uint32_t correctionsMax;
+    uint32_t earlySettles;                              // asentado mientras se movia
+    float pitchErrorMax;
+    float biasMax;
+} result_t;
+
+static unsigned int seed = 1;
+
+static float gaussian(void) {
+    float u1 = (rand_r(&seed) + 1.0f) / (RAND_MAX + 2.0f);
+    float u2 = (rand_r(&seed) + 1.0f) / (RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+static int compareFloat(const void *a, const void *b) {
+    float diff = *(const float *)a - *(const float *)b;
+    return (diff > 0) - (diff < 0);
+}
+
+static void usage(const char *name) {
+    printf("uso: %s [--runs N] [--tau S] [--tilt GRADOS] [--handled S] [--seed N]\n", name);
+}
+
+/*
+ * Una corrida: devuelve por result lo que paso hasta la primera muestra entregada
+ */
+static void runOnce(const scenario_t *scenario, float tau, float tilt, result_t *result) {
+    imu_warmup_t warmup;
+    imuWarmupInit(&warmup, SAMPLE_HZ, DMP_MAX_SAMPLES);
+    int16_t offsets[3] = {0};
+    float phase = rand_r(&seed) * 2.0f * (float)M_PI / RAND_MAX;
+
+    for (uint32_t n = 0; ; n++) {
+        float t = (float)n / SAMPLE_HZ;
+        bool moving = scenario->stillFromS < 0 || t < scenario->stillFromS;
+
+        float pitchTrue = tilt;
+        float rates[3] = {0};                           // grados/s en los ejes del sensor
+        if (moving) {
+            pitchTrue += 2.0f * sinf(2.0f * (float)M_PI * 0.7f * t + phase) + 0.8f * sinf(2.0f * (float)M_PI * 2.3f * t);
+            rates[0] = 6.0f * cosf(2.0f * (float)M_PI * 0.5f * t);
+            rates[1] = -2.0f * 2.0f * (float)M_PI * 0.7f * cosf(2.0f * (float)M_PI * 0.7f * t + phase);
+            rates[2] = 10.0f * sinf(2.0f * (float)M_PI * 0.3f * t + phase);
+        }
+        // El DMP arranca en cero y converge a la inclinacion (el movimiento lo sigue)
+        float pitch = pitchTrue - tilt * expf(-t / tau) + PITCH_NOISE_DEG * gaussian();
+
+        float gyroDps[3];
+        for (uint8_t i = 0; i < 3; i++) {
+            float bias = scenario->bias[i] + offsets[i] / MPU_GYRO_OFFSET_LSB_PER_DPS;
+            float raw = roundf((rates[i] + bias + GYRO_NOISE_DPS * gaussian()) * IMU_FUSION_DMP_GYRO_LSB_PER_DPS);
+            gyroDps[i] = raw / IMU_FUSION_DMP_GYRO_LSB_PER_DPS;
+        }
+
+        uint8_t state = imuWarmupUpdate(&warmup, pitch, gyroDps);
+        if (state == IMU_WARMUP_CORRECT) {
+            for (uint8_t i = 0; i < 3; i++) {
+                offsets[i] -= lroundf(warmup.gyroBias[i] * MPU_GYRO_OFFSET_LSB_PER_DPS);
+            }
+        }
+        if (warmup.state == IMU_WARMUP_RUNNING) {
+            continue;
+        }
+
+        result->settleS[result->runs++] = t;
+        if (warmup.corrections > result->correctionsMax) {
+            result->correctionsMax = warmup.corrections;
+        }
+        if (warmup.state == IMU_WARMUP_SETTLED) {
+            result->settled++;
+            if (moving) {
+                result->earlySettles++;
+            }
+            float pitchError = fabsf(warmup.pitchMean - tilt);
+            if (pitchError > result->pitchErrorMax) {
+                result->pitchErrorMax = pitchError;
+            }
+            for (uint8_t i = 0; i < 3; i++) {
+                float bias = fabsf(scenario->bias[i] + offsets[i] / MPU_GYRO_OFFSET_LSB_PER_DPS);
+                if (bias > result->biasMax) {
+                    result->biasMax = bias;
+                }
+            }
+        }
+        return;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t runs = DEFAULT_RUNS;
+    float tau = 0.8f;
+    float tilt = 3.0f;
+    float handled = 3.0f;
+
+    static const struct option options[] = {
+        {"runs",    required_argument, 0, 'r'},
+        {"tau",     required_argument, 0, 't'},
+        {"tilt",    required_argument, 0, 'i'},
+        {"handled", required_argument, 0, 'm'},
+        {"seed",    required_argument, 0, 's'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:t:i:m:s:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'r': runs = strtoul(optarg, NULL, 10); break;
+            case 't': tau = strtof(optarg, NULL); break;
+            case 'i': tilt = strtof(optarg, NULL); break;
+            case 'm': handled = strtof(optarg, NULL); break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!runs || runs > DEFAULT_RUNS * 50 || tau <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const scenario_t scenarios[] = {
+        {"nvs",        {0.03f, -0.05f, 0.02f}, 0,       true},
+        {"fabrica",    {2.1f, -1.4f, 0.7f},    0,       true},
+        {"en mano",    {0.03f, -0.05f, 0.02f}, handled, true},
+        {"movimiento", {0.03f, -0.05f, 0.02f}, -1,      false},
+    };
+
+    printf("DMP a %d Hz, ventanas de %d ms, inclinacion %.1f grados con tau %.2f s; antes: %d muestras fijas (%.1f s)\n\n",
+           SAMPLE_HZ, IMU_WARMUP_WINDOW_MS, tilt, tau, DMP_MAX_SAMPLES, (float)DMP_MAX_SAMPLES / SAMPLE_HZ);
+    printf("%-11s %8s %8s %8s %10s %11s %13s %12s\n", "escenario", "medio s", "p95 s", "max s", "asentadas",
+           "correccion", "err pitch", "sesgo dps");
+
+    int errors = 0;
+    static result_t result;
+    for (uint8_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        const scenario_t *scenario = &scenarios[s];
+        memset(&result, 0, sizeof(result));
+        for (uint32_t r = 0; r < runs; r++) {
+            runOnce(scenario, tau, tilt, &result);
+        }
+
+        double sum = 0;
+        for (uint32_t r = 0; r < result.runs; r++) {
+            sum += result.settleS[r];
+        }
+        qsort(result.settleS, result.runs, sizeof(float), compareFloat);
+        printf("%-11s %8.2f %8.2f %8.2f %6u/%-3u %11u %13.3f %12.3f\n", scenario->name, sum / result.runs,
+               result.settleS[(uint32_t)(0.95 * (result.runs - 1))], result.settleS[result.runs - 1], result.settled,
+               result.runs, result.correctionsMax, result.pitchErrorMax, result.biasMax);
+
+        if (scenario->mustSettle ? result.settled != result.runs : result.settled != 0) {
+            errors++;
+        }
+        if (result.earlySettles || result.pitchErrorMax > MAX_PITCH_ERROR_DEG || result.biasMax > IMU_WARMUP_GYRO_BIAS_MAX_DPS) {
+            errors++;
+        }
+    }
+    printf("\n%s\n", errors ? "ERROR: algun escenario no cumple" : "ok");
+    return errors ? 2 : 0;
+}